@@ -16,7 +16,6 @@
 #include <TH2.h>
 #include <TCanvas.h>
 #include <TGraphErrors.h>
-#include <TGProgressBar.h>
 #include <TPaveStats.h>
 #include <TPolyLine.h>
 #include <TSystem.h>
@@ -24,6 +23,11 @@
 #include "Math/MinimizerOptions.h"
 
 
+// Progress header
+#ifndef __PROGRESS_HH
+# include "Progress.hh"
+#endif
+
 // Settings header
 #ifndef __SETTINGS_HH
 # include "Settings.hh"
@@ -95,10 +99,10 @@ public:
 		cal = mycal;
 	}; ///< Assigns the calibration pointer in the ISSAutoCalibrator object
 
-	inline void AddProgressBar( std::shared_ptr<TGProgressBar> myprog ){
+	inline void AddProgress( std::shared_ptr<ISSProgress> myprog ){
 		prog = myprog;
 		_prog_ = true;
-	}; ///< Adds a progress bar to the GUI
+	}; ///< Adds the progress of a GUI job, which can also cancel it
 	
 	inline bool GetDebugStatus(){ return _debug_; } ///< Returns the debug status of the ISSAutoCalibrator
 	inline bool OnlyManualFitStatus(){ return _only_manual_fits_; } ///< Returns the manual fit status of the ISSAutoCalibrator
@@ -124,7 +128,7 @@ private:
 
 	// Progress bar
 	bool _prog_;							///< True if the GUI is being used
-	std::shared_ptr<TGProgressBar> prog;	///< A progress bar for this stage in the GUI
+	std::shared_ptr<ISSProgress> prog;	///< Progress of this stage, shown by the GUI
 	
 	// Autocal settings options
 	std::string autocal_settings_input_file;	///< The name of the autocal file used to control the fits
@@ -0,0 +1,138 @@
+#ifndef __BENCHMARK_HH
+#define __BENCHMARK_HH
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "TSystem.h"
+#include "TFile.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Calibration header
+#ifndef __CALIBRATION_HH
+# include "Calibration.hh"
+#endif
+
+// Reaction header
+#ifndef __REACTION_HH__
+# include "Reaction.hh"
+#endif
+
+// Converter header
+#ifndef _Converter_hh
+# include "Converter.hh"
+#endif
+
+// EventBuilder header
+#ifndef _EventBuilder_hh
+# include "EventBuilder.hh"
+#endif
+
+// Histogrammer header
+#ifndef __HISTOGRAMMER_hh
+# include "Histogrammer.hh"
+#endif
+
+// Scheduler header
+#ifndef __SCHEDULER_HH
+# include "Scheduler.hh"
+#endif
+
+// Generator header
+#ifndef __GENERATOR_HH
+# include "Generator.hh"
+#endif
+
+// Memory budget header
+#ifndef __MEMORYBUDGET_HH
+# include "MemoryBudget.hh"
+#endif
+
+/*! \brief Runs the whole sort on standard inputs to catch performance regressions
+*
+* Each input, either made by the ISSGenerator or a sample of real data, is
+* converted, built and histogrammed, recording the wall time, CPU time, peak
+* memory, bytes read and written and the number of hits or events per second
+* of each stage. To get the scaling curves, the same chain is run on several
+* copies of the input at the same time for each number of threads, and the
+* synthetic inputs can be made in several sizes.
+*
+* The results are saved in a text file, which can be used as the baseline of
+* a later run. Anything that has become slower or bigger than the baseline
+* by more than a threshold is reported as a regression.
+*
+*/
+class ISSBenchmark {
+
+public:
+
+	ISSBenchmark( ISSSettings *myset, std::string mycalfile, std::string myreactfile );///< Constructor
+	virtual ~ISSBenchmark(){};///< Destructor
+
+	void AddInput( std::string filename );///< Add a sample of real data
+	void AddSynthetic( unsigned long nblocks );///< Add a generated input with nblocks blocks
+	inline void SetThreads( std::vector<int> t ){ threads = t; };///< Numbers of chains to run at the same time
+	inline void SetRepeat( unsigned int n ){ repeat = n > 0 ? n : 1; };///< Runs of each test, keeping the fastest
+	inline void SetSeed( unsigned long long s ){ seed = s; };///< Seed for the generated inputs
+	inline void SetWorkDir( std::string dir ){ work_dir = dir; };///< Directory for the inputs and outputs
+
+	bool Run();///< Run every input with every number of threads
+	void Print();///< Table of the results and the scaling
+	bool Save( std::string filename );///< Write the results, to be used as a baseline later
+	int Compare( std::string filename, double threshold, double rss_threshold );///< Number of regressions compared to a baseline, -1 if it can't be read
+
+private:
+
+	/// Measurements of one stage, or of the whole chain
+	struct result_t {
+		std::string input;	///< name of the input
+		std::string stage;	///< convert, build, hist or total
+		int threads;		///< chains running at the same time
+		double wall;		///< wall time in s
+		double cpu;			///< CPU time in s
+		double rss;			///< peak resident memory in MB
+		double read;		///< MB read
+		double written;		///< MB written
+		double items;		///< hits or events processed
+	};
+
+	bool RunTest( std::string name, std::string filename, int nthreads );///< One input with one number of threads
+	bool RunChain( std::string filename, std::string prefix, std::vector<result_t> &res, bool reset_rss );///< Convert, build and histogram one copy
+	std::string MakeInput( unsigned long nblocks );///< Generate an input, or use the one made before
+
+	static double GetCPUTime();///< CPU time of this thread, or of the process if that's not known
+	static double GetFileSize( std::string filename );///< Size of a file in MB, zero if it doesn't exist
+	static std::string GetKey( const result_t &r );///< Input, stage and threads, for matching with the baseline
+
+	ISSSettings *set;			///< Settings of the sort
+	std::string name_cal_file;	///< Calibration file, a new calibration for each chain
+	std::string name_react_file;///< Reaction file, a new reaction for each chain
+
+	std::vector<std::pair<std::string,std::string>> inputs;	///< name and file of each input
+	std::vector<unsigned long> synthetic;	///< blocks in each generated input
+	std::vector<int> threads;				///< numbers of threads to run
+	unsigned int repeat;					///< runs of each test
+	unsigned long long seed;				///< seed of the generated inputs
+	std::string work_dir;					///< where the files go
+
+	std::vector<result_t> results;	///< everything that has been measured
+
+};
+
+#endif
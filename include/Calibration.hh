@@ -53,6 +53,20 @@ public:
 		return fInputFile;
 	}
 
+	/// Getter for the version of this calibration, counted by ISSCalibrationStore
+	inline unsigned int GetVersion(){ return fVersion; };
+
+	/// Setter for the version of this calibration
+	/// \param[in] v Version number, 0 if it doesn't come from an ISSCalibrationStore
+	inline void SetVersion( unsigned int v ){ fVersion = v; };
+
+	/// Getter for the state of the random number generator, used for checkpoints
+	inline UInt_t GetRandomSeed(){ return fRand->GetSeed(); };
+	
+	/// Setter for the state of the random number generator, used to resume from a checkpoint
+	/// \param[in] seed Value returned by GetRandomSeed() when the checkpoint was made
+	inline void SetRandomSeed( UInt_t seed ){ fRand->SetSeed( seed ); };
+
 	float AsicEnergy( unsigned int mod, unsigned int asic, unsigned int chan, unsigned short raw );
 	unsigned int AsicThreshold( unsigned int mod, unsigned int asic, unsigned int chan );
 	long AsicTime( unsigned int mod, unsigned int asic );
@@ -168,6 +182,7 @@ public:
 private:
 
 	std::string fInputFile;///< The location of the calibration input file
+	unsigned int fVersion;///< Version number of this calibration, 0 if it isn't from an ISSCalibrationStore
 	
 	ISSSettings *set;///< Pointer to the ISSSettings object
 	
@@ -0,0 +1,96 @@
+#ifndef __CALIBRATIONSTORE_HH
+#define __CALIBRATIONSTORE_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <climits>
+#include <algorithm>
+
+#include "TSystem.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Calibration header
+#ifndef __CALIBRATION_HH
+# include "Calibration.hh"
+#endif
+
+/*! \brief Versioned calibrations that can be swapped while the monitor is running
+*
+* Each time the calibration file is read, a new ISSCalibration is made and
+* published as the current snapshot, with the next version number. A snapshot
+* is never changed after it is published, so the threads that read it need no
+* locks: they call Acquire() at a block boundary and use what they get until
+* their next call. Reading and publishing a new file is done by another thread,
+* i.e. the one running the web server, so the sort never waits for it.
+*
+* Old snapshots are kept until every reader has moved past them (RCU style).
+* Each reader has a slot with the version it last acquired, and anything older
+* than all of the slots can no longer be in use and is deleted. A reader that
+* doesn't get a slot is given the snapshot that was current then, for good,
+* and that one is never deleted.
+*
+*/
+class ISSCalibrationStore {
+
+public:
+
+	ISSCalibrationStore( std::string filename, ISSSettings *myset );///< Constructor, reads the first snapshot
+	virtual ~ISSCalibrationStore(){};///< Destructor
+
+	// Writer side, called from one thread at a time
+	bool Reload();///< Read the file again and publish it
+	bool Load( std::string filename );///< Read a new file and publish it
+	bool CheckFile();///< Reload if the file has changed on disk, returns true if it did
+
+	// Reader side, lock free
+	int AddReader();///< Register a thread that uses the snapshots, -1 if there are too many and it must keep the pinned one
+	void RemoveReader( int reader );///< A reader that won't acquire any more snapshots
+
+	/// Latest snapshot, which the reader can use until it acquires again
+	/// \param[in] reader The slot returned by AddReader(), or -1 for the pinned snapshot
+	inline ISSCalibration* Acquire( int reader ){
+		if( reader < 0 || reader >= kMaxReaders ) return pinned;
+		ISSCalibration *snap = current.load( std::memory_order_seq_cst );
+		reader_version[reader].store( snap->GetVersion(), std::memory_order_seq_cst );
+		return snap;
+	};
+
+	inline unsigned int GetVersion(){ return current.load()->GetVersion(); };///< Version of the latest snapshot
+	inline std::string GetFile(){ return filename; };///< File of the latest snapshot
+
+private:
+
+	void Publish( std::unique_ptr<ISSCalibration> snap );///< Make a snapshot the current one and retire the old ones
+	void Retire();///< Delete the snapshots that no reader can still be using
+	void Stat( long long &size, long &mtime );///< Size and modification time of the file
+
+	static const int kMaxReaders = 16;							///< threads that can read the snapshots
+	static const unsigned int kNoReader = UINT_MAX;				///< version of a free slot
+
+	ISSSettings *set;											///< Settings, for the numbers of channels
+	std::string filename;										///< calibration file
+	long long file_size;										///< size of the file when it was last read
+	long file_mtime;											///< modification time of the file when it was last read
+	long long pending_size;										///< size of the file at the last check
+	long pending_mtime;											///< modification time of the file at the last check
+
+	std::atomic<ISSCalibration*> current;						///< latest snapshot
+	ISSCalibration *pinned;										///< snapshot of the readers without a slot, never retired
+	std::array<std::atomic<unsigned int>,kMaxReaders> reader_version;	///< version each reader last acquired
+	unsigned int next_version;									///< version of the next snapshot
+
+	std::mutex writer_mutex;									///< only one thread publishes at a time
+	std::vector<std::unique_ptr<ISSCalibration>> snapshots;		///< published and not yet retired
+
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef __CATALOG_HH
+#define __CATALOG_HH
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include "TSystem.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TKey.h"
+#include "TH1.h"
+
+// Data packets header
+#ifndef __DATAPACKETS_hh
+# include "DataPackets.hh"
+#endif
+
+/*! \brief Index of all the runs that have been sorted and what was made from them
+*
+* The catalog is a small text file kept next to the data, with a section for
+* each run file. It holds the size and number of blocks of the run, the time
+* span and number of hits in each part of the DAQ, and for each stage that
+* has been run, the output file, the digest of its manifest, how long it took
+* and the data rate. It lets you find runs without opening all of the ROOT
+* files, and lets the sort skip a stage without opening its output when the
+* output on disk is the same one that was recorded.
+*
+* The file is rewritten each time it changes, via a temporary file so that
+* it is never left half written. Tasks running in parallel share one catalog.
+* Other processes, i.e. a nearline sort and a batch sort of the same data,
+* can use the same file: it is read again under a lock file before it is
+* written, and only the values that this process has changed replace the
+* ones that are there.
+*
+*/
+class ISSCatalog {
+
+public:
+
+	ISSCatalog( std::string myfilename = "" ){ filename = myfilename; };///< Constructor
+	virtual ~ISSCatalog(){};///< Destructor
+
+	bool Load();///< Read the catalog file, returns false if there isn't one
+	bool Save();///< Write the catalog file
+
+	inline void SetFile( std::string myfilename ){ filename = myfilename; };///< Setter for the catalog file name
+	inline std::string GetFile(){ return filename; };///< Getter for the catalog file name
+
+	/// Store one value for a run
+	template<typename T> void Set( std::string run, std::string key, T value ){
+		std::stringstream ss;
+		ss << std::setprecision( std::numeric_limits<double>::max_digits10 ) << value;
+		std::lock_guard<std::mutex> lock( cat_mtx );
+		runs[run][key] = ss.str();
+		changed[run].insert( key );
+	};
+
+	/// Retrieve one value for a run, returns false if it isn't there
+	template<typename T> bool Get( std::string run, std::string key, T &value ){
+		std::lock_guard<std::mutex> lock( cat_mtx );
+		if( !runs.count( run ) || !runs[run].count( key ) ) return false;
+		std::stringstream ss( runs[run][key] );
+		ss >> value;
+		return !ss.fail();
+	};
+
+	/// Retrieve a text value for a run as it is, i.e. a file name with spaces
+	inline bool Get( std::string run, std::string key, std::string &value ){
+		std::lock_guard<std::mutex> lock( cat_mtx );
+		if( !runs.count( run ) || !runs[run].count( key ) ) return false;
+		value = runs[run][key];
+		return true;
+	};
+
+	std::vector<std::string> GetRuns();///< Names of all the run files in the catalog
+
+	void AddRawFile( std::string run, unsigned int block_size );///< Size, number of blocks and date of the run file
+	void AddConverted( std::string run, std::string filename );///< Time span and hits from a converted file
+	void AddStage( std::string run, std::string stage, std::string filename,
+				   std::string digest, double seconds );///< Output of a stage, its manifest digest and timing
+	bool UpToDate( std::string run, std::string stage, std::string filename,
+				   std::string digest );///< The recorded output of a stage is still there, unchanged, with the same digest
+
+	void Print();///< Table of the runs and the stages that have been done
+
+private:
+
+	bool GetFileInfo( std::string name, Long64_t &size, Long_t &mtime );///< Size and modification time of a file
+	bool Read( std::map<std::string,std::map<std::string,std::string>> &values );///< Parse the catalog file
+	void Unsaved( const std::map<std::string,std::set<std::string>> &keys );///< Keys that didn't make it to the file
+
+	std::string filename;		///< name of the catalog file
+	std::map<std::string,std::map<std::string,std::string>> runs;	///< values as text for each run, sorted by key
+	std::map<std::string,std::set<std::string>> changed;			///< keys of each run set since the last save
+	std::mutex cat_mtx;			///< protects the values when tasks run in parallel
+	std::mutex file_mtx;		///< only one task writes the file at a time
+
+};
+
+#endif
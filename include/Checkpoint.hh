@@ -0,0 +1,93 @@
+#ifndef __CHECKPOINT_HH
+#define __CHECKPOINT_HH
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+
+#include "TSystem.h"
+#include "TDirectory.h"
+#include "TKey.h"
+#include "TClass.h"
+#include "TH1.h"
+
+/*! \brief State of a long job so that it can be restarted
+*
+* The converter and event builder periodically flush their output trees and
+* histograms to disk and then save everything else they need to carry on,
+* i.e. the last block or entry processed, the decoder timestamps and the
+* counters, in a small text file next to the output. If the job is killed,
+* the next attempt reopens the output file and continues from there.
+*
+* The checkpoint file is written to a temporary file and then renamed, so
+* there is always a complete checkpoint on disk.
+*
+*/
+class ISSCheckpoint {
+
+public:
+
+	ISSCheckpoint( std::string myfilename = "" ){ filename = myfilename; };///< Constructor
+	virtual ~ISSCheckpoint(){};///< Destructor
+
+	bool Load();///< Read the checkpoint file, returns false if there isn't one
+	bool Save();///< Write the checkpoint file
+	void Remove();///< Delete the checkpoint file once the job is complete
+
+	inline void SetFile( std::string myfilename ){ filename = myfilename; };///< Setter for the checkpoint file name
+	inline std::string GetFile(){ return filename; };///< Getter for the checkpoint file name
+	inline void Clear(){ values.clear(); };///< Forget all values
+
+	/// Store a single value
+	template<typename T> void Set( std::string key, T value ){
+		std::stringstream ss;
+		ss << std::setprecision( std::numeric_limits<double>::max_digits10 ) << value;
+		values[key] = ss.str();
+	};
+
+	/// Store a list of values, i.e. one per module
+	template<typename T> void Set( std::string key, const std::vector<T> &value ){
+		std::stringstream ss;
+		ss << std::setprecision( std::numeric_limits<double>::max_digits10 );
+		for( unsigned int i = 0; i < value.size(); ++i )
+			ss << ( i ? " " : "" ) << value[i];
+		values[key] = ss.str();
+	};
+
+	/// Retrieve a single value, returns false if it isn't there
+	template<typename T> bool Get( std::string key, T &value ){
+		if( !values.count( key ) ) return false;
+		std::stringstream ss( values[key] );
+		ss >> value;
+		return !ss.fail();
+	};
+
+	/// Retrieve a list of values, which must have the same length as the vector
+	template<typename T> bool Get( std::string key, std::vector<T> &value ){
+		if( !values.count( key ) ) return false;
+		std::stringstream ss( values[key] );
+		for( unsigned int i = 0; i < value.size(); ++i ) {
+			T tmp;
+			ss >> tmp;
+			if( ss.fail() ) return false;
+			value[i] = tmp;
+		}
+		return true;
+	};
+
+	static void RestoreHists( TDirectory *dir );///< Add the histograms saved in a file to the new ones of the same name
+
+private:
+
+	std::string filename;						///< name of the checkpoint file
+	std::map<std::string,std::string> values;	///< saved values as text, sorted by key
+
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef __COMPRESSION_HH
+#define __COMPRESSION_HH
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <cstdio>
+#include <unistd.h>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TClass.h"
+#include "TBufferFile.h"
+#include "TSystem.h"
+#include "Compression.h"
+#include "RZip.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+/*! \brief Compression, basket size and cluster size of the output of one stage
+*
+* The settings file can give each stage (Convert, Build or Hist) its own
+* algorithm and level, i.e. LZ4 for the converter if it is the bottleneck, or
+* LZMA for the histograms that are kept for years.
+*
+* In "auto" mode the first few MB of the objects that are written are
+* serialised as ROOT would for a basket, then compressed and decompressed with
+* LZ4, ZSTD and ZLIB. Along with the speed of writing to the disk of the
+* output file, measured once, this gives the time that each would take per MB,
+* to compress it, write it, read it back in the next stage and decompress it.
+* The quickest one is used for the rest of the file. A fast disk then gets
+* LZ4, a slow one or a network file system gets ZSTD or ZLIB.
+*/
+class ISSCompression {
+
+public:
+
+	ISSCompression( ISSSettings *myset, std::string mystage );///< Constructor
+	virtual ~ISSCompression(){};///< Destructor
+
+	void Apply( TFile *f );///< Set the compression of a new output file
+	void Apply( TTree *t, double autoflush );///< Set the basket and cluster size of a new output tree, autoflush in bytes if not in the settings
+
+	inline bool IsSampling(){ return flag_sampling; };///< Still collecting data for the auto mode
+	template<typename T> inline void Sample( T *obj ){
+		Sample( obj, TClass::GetClass<T>() );
+	};///< Add an object that is written to the data for the auto mode
+	void Sample( void *obj, TClass *cl );///< Add an object that is written to the data for the auto mode
+
+	inline int GetBasketSize(){ return basket_size; };///< Basket size from the settings, 0 = default
+	std::string GetReport();///< What is used and, in auto mode, the speed of each algorithm
+
+private:
+
+	void Choose();///< Benchmark the algorithms on the sample and use the quickest
+	void Use( int settings );///< Set the compression of the file and trees
+	static int GetSettings( std::string alg, int level );///< ROOT compression settings, -1 for the default
+	static double GetDiskSpeed( std::string dir );///< Write speed of a directory in bytes/s
+
+	std::string stage;		///< stage name in the settings
+	std::string algorithm;	///< algorithm from the settings
+	int level;				///< level from the settings, 0 = the usual one
+	int basket_size;		///< basket size from the settings in bytes, 0 = default
+	double auto_flush;		///< cluster size from the settings in MB, 0 = from the caller
+
+	// Outputs
+	TFile *file;				///< file that is being written
+	std::vector<TTree*> trees;	///< trees in it
+
+	// Auto mode
+	bool flag_sampling;						///< collecting the sample
+	std::unique_ptr<TBufferFile> sample;	///< serialised objects
+	static const int kSampleBytes = 4 << 20;	///< size of the sample
+	std::stringstream report;				///< speed of each algorithm
+
+};
+
+#endif
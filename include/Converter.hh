@@ -10,6 +10,8 @@
 #include <string>
 #include <cstring>
 #include <memory>
+#include <functional>
+#include <numeric>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -17,10 +19,29 @@
 #include <TH1.h>
 #include <TH2.h>
 #include <TProfile.h>
-#include <TGProgressBar.h>
 #include <TSystem.h>
 
 
+// Memory usage header
+#ifndef __MEMORYUSAGE_HH
+# include "MemoryUsage.hh"
+#endif
+
+// Metrics header
+#ifndef __METRICS_HH
+# include "Metrics.hh"
+#endif
+
+// Timing header
+#ifndef __TIMING_HH
+# include "Timing.hh"
+#endif
+
+// Progress header
+#ifndef __PROGRESS_HH
+# include "Progress.hh"
+#endif
+
 // Settings header
 #ifndef __SETTINGS_HH
 # include "Settings.hh"
@@ -31,17 +52,44 @@
 # include "Calibration.hh"
 #endif
 
+// Calibration store header
+#ifndef __CALIBRATIONSTORE_HH
+# include "CalibrationStore.hh"
+#endif
+
 // Data packets header
 #ifndef __DATAPACKETS_hh
 # include "DataPackets.hh"
 #endif
 
+// Reorder buffer header
+#ifndef __REORDERBUFFER_HH
+# include "ReorderBuffer.hh"
+#endif
+
+// Memory budget header
+#ifndef __MEMORYBUDGET_HH
+# include "MemoryBudget.hh"
+#endif
+
+// Checkpoint header
+#ifndef __CHECKPOINT_HH
+# include "Checkpoint.hh"
+#endif
+
+// Compression header
+#ifndef __COMPRESSION_HH
+# include "Compression.hh"
+#endif
+
 class ISSConverter {
 
 public:
 	
 	ISSConverter( ISSSettings *myset );
-	virtual ~ISSConverter(){};
+	virtual ~ISSConverter(){
+		if( calstore ) calstore->RemoveReader( cal_reader );
+	};
 	
 
 	int ConvertFile( std::string input_file_name,
@@ -70,8 +118,14 @@ public:
 	void SetOutput( std::string output_file_name );
 	
 	inline void CloseOutput(){
-		std::cout << "\n Writing data and closing the file" << std::endl;
+		if( !flag_quiet )
+			std::cout << "\n Writing data and closing the file" << std::endl;
 		//output_tree->SetDirectory(0);
+		timing.Print( "ISSConverter" );
+		timing.Write( output_file );
+		AccountMemory();
+		memusage.ScanHists( output_file );
+		if( flag_print_memory ) memusage.Print( "ISSConverter" );
 		output_file->Write( 0, TObject::kWriteDelete );
 		output_file->Close();
 		//output_tree->ResetBranchAddresses();
@@ -82,13 +136,64 @@ public:
 	inline TTree* GetSortedTree(){ return sorted_tree; };
 
 	inline void AddCalibration( ISSCalibration *mycal ){ cal = mycal; };
+	
+	// Calibration that can be replaced while running, picked up at the next block
+	inline void AddCalibration( std::shared_ptr<ISSCalibrationStore> mystore ){
+		if( calstore ) calstore->RemoveReader( cal_reader );
+		calstore = mystore;
+		cal_reader = calstore->AddReader();
+		cal = calstore->Acquire( cal_reader );
+	};
 	inline void SourceOnly(){ flag_source = true; };
+	inline void SetQuiet( bool q = true ){ flag_quiet = q; };
+	inline bool BadHeader(){ return flag_bad_header; };
+	
+	// Pass each time-sorted hit on, i.e. to ISSEventBuilder::PushHit
+	inline void SetHitCallback( std::function<void(ISSDataPackets*)> func ){ hit_callback = func; };
+	inline void SetWriteSortedTree( bool w = true ){ flag_write_sorted = w; };
+	
+	// Checkpoints to restart a long conversion from where it stopped
+	inline void SetCheckpoint( std::string filename, int interval, std::string tag = "" ){
+		ckpt.SetFile( filename );
+		ckpt_interval = interval;
+		ckpt_tag = tag;
+	};
+	bool ResumeOutput( std::string output_file_name );
+	
+	// Decode some blocks before the start block to recover the timestamps,
+	// when a run is split into shards, but only keep from the start block
+	inline void SetWarmUp( unsigned long blocks ){ warmup_blocks = blocks; };
+	inline static unsigned int GetBlockSize(){ return DATA_BLOCK_SIZE; };
+	
+	// Profiles of time versus hit number, which the shards of a run record so
+	// they can be numbered from the start of the run when they are merged.
+	// Set it before MakeTree(), which makes the iss_counters tree
+	inline void SetRecordCounters( bool r = true ){ flag_record_counters = r; };
+	enum counter_t { kAsicHit, kAsicExt, kAsicPause, kAsicResume, kCaenHit, kCaenExt, kNumberOfCounters };
+	static std::string GetCounterName( counter_t c );
+	static bool MergeCounters( TFile *merged_file, std::vector<TFile*> &shard_files );
+	
+	// Memory for the tree buffers and the sort, zero for the defaults
+	inline void SetMemoryBudget( double bytes ){ membudget.SetBudget( bytes ); };
+	
+	// Time spent decoding and sorting, printed and stored in the output file
+	inline void SetTiming( bool t = true ){ timing.Enable( t ); };
+	
+	// Memory used by hits, traces, histograms and trees, printed at the end
+	inline void SetPrintMemory( bool p = true ){ flag_print_memory = p; };
 
-	inline void AddProgressBar( std::shared_ptr<TGProgressBar> myprog ){
+	inline void AddProgress( std::shared_ptr<ISSProgress> myprog ){
 		prog = myprog;
 		_prog_ = true;
 	};
 
+	// Counters of blocks and hits for the dashboards
+	void AddMetrics( std::shared_ptr<ISSMetrics> mymetrics );
+	void UpdateMetrics();
+
+	// The decoding steps are timed on their own by iss_microbench
+	friend class ISSMicroBenchmark;
+
 
 private:
 
@@ -145,6 +250,40 @@ private:
 	
 	// Flag for source run
 	bool flag_source;
+	
+	// Flag to suppress terminal output, i.e. when running in parallel
+	bool flag_quiet;
+	
+	// Flag set when a block doesn't start with a valid header
+	bool flag_bad_header;
+	
+	// Streaming of the sorted hits, instead of or as well as the sorted tree
+	std::function<void(ISSDataPackets*)> hit_callback;
+	bool flag_write_sorted;
+	
+	// Checkpoints
+	void WriteCheckpoint( std::string stage, unsigned long long next );
+	inline bool CheckpointDue(){
+		return ckpt_interval > 0 && time(0) - ckpt_time >= ckpt_interval;
+	};
+	ISSCheckpoint ckpt;
+	int ckpt_interval;					// seconds between checkpoints, 0 = never
+	time_t ckpt_time;					// time of the last checkpoint
+	std::string ckpt_tag;				// identifies the inputs, i.e. the manifest digest
+	bool flag_resume;					// carrying on from a checkpoint
+	std::string resume_stage;			// convert or sort
+	unsigned long long resume_next;		// next block or entry to process
+	ISSDataPackets *write_packet;		// branch address for the trees of a resumed file
+	
+	// Shards
+	unsigned long warmup_blocks;		// blocks decoded before the start block, but not kept
+	unsigned long warmup_end;			// first block that is kept, and counted in the metrics
+	
+	// Memory
+	ISSMemoryBudget membudget;			// sizes of the tree buffers and sort cache
+	
+	// Compression of the output file
+	std::unique_ptr<ISSCompression> compression;
 
 	// Logs
 	std::stringstream sslogs;
@@ -224,6 +363,14 @@ private:
 	TFile *output_file;
 	TTree *output_tree;
 	TTree *sorted_tree;
+	
+	// Times behind the profiles of hit number, only for a shard
+	bool flag_record_counters;
+	TTree *counter_tree;
+	unsigned char rec_counter;		// counter_t of the profile
+	unsigned short rec_module;		// module of the profile
+	ULong64_t rec_time;				// timestamp that was filled
+	void RecordCounter( counter_t c, unsigned int mod, TProfile *p, unsigned long ctr, unsigned long time );
 
 	// Counters
 	std::vector<unsigned long> ctr_asic_hit;		// hits on each ISS module
@@ -259,10 +406,29 @@ private:
 
 	// 	Calibrator
 	ISSCalibration *cal;
+	std::shared_ptr<ISSCalibrationStore> calstore;	// snapshots of the calibration, if it can change
+	int cal_reader;									// our slot in the calibration store
 
 	// Progress bar
 	bool _prog_;
-	std::shared_ptr<TGProgressBar> prog;
+	std::shared_ptr<ISSProgress> prog;
+	
+	// Counters of blocks and hits for the dashboards
+	bool _metrics_;
+	std::shared_ptr<ISSMetrics> metrics;
+	ISSMetrics::counter_t *met_blocks;
+	std::vector<ISSMetrics::counter_t*> met_asic_hits;
+	std::vector<ISSMetrics::counter_t*> met_caen_hits;
+	std::vector<unsigned long> met_asic_last;	// hits already counted
+	std::vector<unsigned long> met_caen_last;	// hits already counted
+	
+	// Timing of each part of the conversion
+	ISSTiming timing;
+	
+	// Memory used by each kind of object
+	ISSMemoryUsage memusage;
+	bool flag_print_memory;
+	void AccountMemory();
 
 
 };
@@ -163,6 +163,10 @@ public:
 	void SetData( std::shared_ptr<ISSCaenData> data );
 	void SetData( std::shared_ptr<ISSInfoData> data );
 
+	// Version of the calibration used for this hit, from ISSCalibrationStore
+	inline void SetCalibrationVersion( unsigned int v ){ cal_version = v; };
+	inline unsigned int GetCalibrationVersion(){ return cal_version; };
+
 	// These methods are not very safe for access
 	inline std::shared_ptr<ISSAsicData> GetAsicData() { return std::make_shared<ISSAsicData>( asic_packets.at(0) ); };
 	inline std::shared_ptr<ISSCaenData> GetCaenData() { return std::make_shared<ISSCaenData>( caen_packets.at(0) ); };
@@ -174,14 +178,31 @@ public:
 	UInt_t GetTimeLSB();
 
 	void ClearData();
+	
+	// Memory used by this hit, for ISSMemoryUsage
+	inline size_t GetMemory(){
+		return sizeof(*this) + asic_packets.capacity() * sizeof(ISSAsicData) +
+			caen_packets.capacity() * sizeof(ISSCaenData) +
+			info_packets.capacity() * sizeof(ISSInfoData);
+	};
+	inline size_t GetTraceMemory(){
+		size_t bytes = 0;
+		for( unsigned int i = 0; i < caen_packets.size(); ++i )
+			bytes += caen_packets[i].GetTraceLength() * sizeof(unsigned short);
+		return bytes;
+	};
+
+	// Adds the time offsets after sorting, without copying the hits
+	friend class ISSReorderBuffer;
 
 protected:
 	
 	std::vector<ISSAsicData> asic_packets;
 	std::vector<ISSCaenData> caen_packets;
 	std::vector<ISSInfoData> info_packets;
+	unsigned int cal_version = 0;	///< calibration version, kept when the data are cleared
 
-	ClassDef( ISSDataPackets, 1 )
+	ClassDef( ISSDataPackets, 2 )
 
 };
 
@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -17,10 +18,29 @@
 #include <TProfile.h>
 #include <TVector2.h>
 #include <TVector3.h>
-#include <TGProgressBar.h>
 #include <TSystem.h>
 
 
+// Memory usage header
+#ifndef __MEMORYUSAGE_HH
+# include "MemoryUsage.hh"
+#endif
+
+// Metrics header
+#ifndef __METRICS_HH
+# include "Metrics.hh"
+#endif
+
+// Timing header
+#ifndef __TIMING_HH
+# include "Timing.hh"
+#endif
+
+// Progress header
+#ifndef __PROGRESS_HH
+# include "Progress.hh"
+#endif
+
 // Settings header
 #ifndef __SETTINGS_HH
 # include "Settings.hh"
@@ -31,16 +51,36 @@
 # include "Calibration.hh"
 #endif
 
+// Calibration store header
+#ifndef __CALIBRATIONSTORE_HH
+# include "CalibrationStore.hh"
+#endif
+
 // Data packets header
 #ifndef __DATAPACKETS_hh
 # include "DataPackets.hh"
 #endif
 
+// Reorder buffer header
+#ifndef __REORDERBUFFER_HH
+# include "ReorderBuffer.hh"
+#endif
+
 // ISS Events tree
 #ifndef __ISSEVTS_HH
 # include "ISSEvts.hh"
 #endif
 
+// Event packer header
+#ifndef __EVENTPACKER_HH
+# include "EventPacker.hh"
+#endif
+
+// Event selector header
+#ifndef __EVENTSELECTOR_HH
+# include "EventSelector.hh"
+#endif
+
 // Reaction header
 #ifndef __REACTION_HH
 # include "Reaction.hh"
@@ -51,6 +91,21 @@
 # include "Histogrammer.hh"
 #endif
 
+// Memory budget header
+#ifndef __MEMORYBUDGET_HH
+# include "MemoryBudget.hh"
+#endif
+
+// Checkpoint header
+#ifndef __CHECKPOINT_HH
+# include "Checkpoint.hh"
+#endif
+
+// Compression header
+#ifndef __COMPRESSION_HH
+# include "Compression.hh"
+#endif
+
 /*!
 * \brief Builds physics events after all hits have been time sorted.
 *
@@ -69,11 +124,14 @@ class ISSEventBuilder {
 public:
 	
 	ISSEventBuilder( ISSSettings *myset ); ///< Constructor
-	virtual ~ISSEventBuilder(){}; /// Destructor (currently empty)
+	virtual ~ISSEventBuilder(){
+		if( calstore ) calstore->RemoveReader( cal_reader );
+	}; /// Destructor
 
 	void	SetInputFile( std::string input_file_name ); ///< Function to set the input file from which events are built
 	void	SetInputTree( TTree* user_tree ); ///< Grabs the input tree from the input file defined in ISSEventBuilder::SetInputFile
 	void	SetOutput( std::string output_file_name ); ///< Configures the output for the class
+	bool	ResumeOutput( std::string output_file_name ); ///< Reopens the output of a stopped job and restores the state from its checkpoint
 	void	StartFile();	///< Called for every file
 	void	Initialise();	///< Called for every event
 	void	MakeHists(); ///< Creates histograms for events that occur
@@ -84,10 +142,33 @@ public:
 	inline void AddCalibration( ISSCalibration *mycal ){
 		cal = mycal;
 		overwrite_cal = true;
+		reorder->SetCalibration( mycal );
+	};
+
+	/// Takes only the time offsets of a calibration, for when the energies
+	/// from the converter are kept
+	/// \param[in] mycal The calibration with the time offsets
+	inline void AddTimeOffsets( ISSCalibration *mycal ){
+		reorder->SetCalibration( mycal );
+	};
+
+	/// Takes only the time offsets from the latest snapshot of a calibration
+	/// store at the start of each call to ISSEventBuilder::BuildEvents, as the
+	/// converter has already done the energies with the same snapshot
+	/// \param[in] mycalstore The versioned calibrations of the monitor
+	inline void AddCalibration( std::shared_ptr<ISSCalibrationStore> mycalstore ){
+		if( calstore ) calstore->RemoveReader( cal_reader );
+		calstore = mycalstore;
+		cal_reader = calstore->AddReader();
 	};
 	
 	unsigned long	BuildEvents(); ///< The heart of this class
 
+	// Build events from hits pushed one at a time, rather than from a tree
+	void			StartStream(); ///< Get ready to receive hits with ISSEventBuilder::PushHit
+	void			PushHit( ISSDataPackets *hit ); ///< Adds the next time-sorted hit
+	unsigned long	FinishStream(); ///< Closes the last event and writes the output file
+
 	// Resolve multiplicities etc
 	void ArrayFinder(); ///< Processes all hits on the array that fall within the build window
 	void RecoilFinder(); ///< Processes all hits on the recoil detector that fall within the build window
@@ -101,27 +182,75 @@ public:
 	
 	inline void CloseOutput(){
 		output_tree->ResetBranchAddresses();
+		timing.Print( "ISSEventBuilder" );
+		timing.Write( output_file );
+		if( flag_print_memory ) memusage.Print( "ISSEventBuilder" );
 		output_file->Close();
-		input_tree->ResetBranchAddresses();
-		input_file->Close();
-		delete in_data;
+		if( input_tree ) input_tree->ResetBranchAddresses();
+		if( input_file ) input_file->Close();
+		delete read_data;
 		log_file.close(); //?? to close or not to close?
 	}; ///< Closes the output files from this class
 	void CleanHists(); ///< Deletes histograms from memory and clears vectors that store histograms
 
-	inline void AddProgressBar( std::shared_ptr<TGProgressBar> myprog ){
+	inline void AddProgress( std::shared_ptr<ISSProgress> myprog ){
 		prog = myprog;
 		_prog_ = true;
-	}; ///< Adds a progress bar to the GUI
-	///< \param[in] myprog pointer to the EventBuilder progress bar for the GUI
+	}; ///< Adds the progress of a GUI job, which can also cancel it
+	///< \param[in] myprog progress shared with the GUI timer that updates the EventBuilder progress bar
+	void AddMetrics( std::shared_ptr<ISSMetrics> mymetrics ); ///< Counts the hits and events for the dashboards
+
+	inline void SetQuiet( bool q = true ){ flag_quiet = q; }; ///< Suppresses terminal output, used when several builders run in parallel
+	inline void SetWriteTree( bool w = true ){ flag_write_tree = w; }; ///< Fill the output tree with the events, true by default
+	inline void SetEventCallback( std::function<void(ISSEvts*)> func ){
+		event_callback = func;
+	}; ///< Function called for every event that is built, i.e. ISSHistogrammer::PushEvent
+	inline void SetMemoryBudget( double bytes ){ membudget.SetBudget( bytes ); }; ///< Memory for the tree caches and buffers, zero for the defaults
+	inline void SetTiming( bool t = true ){ timing.Enable( t ); }; ///< Time each of the finders, printed and stored in the output file
+	inline void SetPrintMemory( bool p = true ){ flag_print_memory = p; }; ///< Print the memory used by hits, events, histograms and trees at the end
+	inline void SetCheckpoint( std::string filename, int interval, std::string tag = "" ){
+		ckpt.SetFile( filename );
+		ckpt_interval = interval;
+		ckpt_tag = tag;
+	}; ///< Save the state to a checkpoint file every interval seconds, tag identifies the inputs
+
+	friend class ISSMicroBenchmark; ///< Fills the event window directly to time the finders on their own
 
 
 private:
 	
+	// Steps of the event building, shared by BuildEvents and the stream
+	void ProcessHit(); ///< Adds the hit in in_data to the open event
+	void LookAhead(); ///< Checks if the next hit in in_data is outside the build window
+	void NextHits(); ///< Processes the hits that are ready to come out of the reorder buffer
+	void LastHit(); ///< Processes the hit that is being held and closes the last event
+	void CloseEvent(); ///< Runs the finders and fills the open event
+	void FinishEvents(); ///< Prints statistics and writes the output file
+	void MakeEventObjects(); ///< Creates the containers for the built events
+	
+	// Checkpoints
+	void WriteCheckpoint( unsigned long long next ); ///< Flushes the output and saves the state between two events
+	inline bool CheckpointDue(){
+		return ckpt_interval > 0 && time(0) - ckpt_time >= ckpt_interval;
+	}; ///< It's time for the next checkpoint
+	ISSCheckpoint ckpt; ///< Checkpoint file and the values saved in it
+	int ckpt_interval; ///< Seconds between checkpoints, 0 = never
+	time_t ckpt_time; ///< Time of the last checkpoint
+	std::string ckpt_tag; ///< Identifies the inputs, i.e. the manifest digest
+	bool flag_restart; ///< Carrying on from a checkpoint
+	unsigned long long restart_entry; ///< First entry to process after a restart
+	ISSEvts *restart_evts; ///< Branch address for the tree of a resumed file
+	ISSCompactEvts *restart_compact; ///< Branch address for the tree of a resumed file of compact events
+	
+	// Memory
+	ISSMemoryBudget membudget; ///< Sizes of the input cache and output buffers
+	double mem_full; ///< Size of the tree buffers before they are written or dropped
+
 	/// Input treze
 	TFile *input_file; ///< Pointer to the time-sorted input ROOT file
 	TTree *input_tree; ///< Pointer to the TTree in the input file
-	ISSDataPackets *in_data; ///< Pointer to the TBranch containing the data in the time-sorted input ROOT file
+	ISSDataPackets *read_data; ///< Pointer to the TBranch containing the data in the time-sorted input ROOT file
+	ISSDataPackets *in_data; ///< Hit that is being processed or looked at, from read_data or the reorder buffer
 	std::shared_ptr<ISSAsicData> asic_data; ///< Pointer to a given entry in the tree of some data from the ASICs
 	std::shared_ptr<ISSCaenData> caen_data; ///< Pointer to a given entry in the tree of some data from the CAEN
 	std::shared_ptr<ISSInfoData> info_data; ///< Pointer to a given entry in the tree of the "info" datatype
@@ -139,17 +268,45 @@ private:
 	TFile *output_file; ///< Pointer to the output ROOT file containing events
 	TTree *output_tree; ///< Pointer to the output ROOT tree containing events
 	std::unique_ptr<ISSEvts> write_evts; ///< Container for storing hits on all detectors in order to construct events
+	std::unique_ptr<ISSEventPacker> packer; ///< Packs the events before they are written, if CompactEvents is set in the settings
+	std::unique_ptr<ISSEventSelector> selector; ///< Chooses the events to write, if there are write conditions in the settings
+	std::unique_ptr<ISSCompression> compression; ///< Compression of the output file, from the settings
 	
 	// Do calibration
 	ISSCalibration *cal; ///< Pointer to an ISSCalibration object, used for accessing gain-matching parameters and thresholds
 	bool overwrite_cal; ///< Boolean determining whether an energy calibration should be used (true) or not (false). Set in the ISSEventBuilder::AddCalibration function
+	std::shared_ptr<ISSCalibrationStore> calstore; ///< Versioned calibrations for the time offsets in the monitor
+	int cal_reader; ///< Slot of this event builder in the calibration store
+
+	// Time offsets, added after sorting
+	std::unique_ptr<ISSReorderBuffer> reorder; ///< Adds the time offsets to the raw timestamps and puts the hits back in order
+	bool flag_raw_time; ///< The input hits have raw timestamps, without the time offsets
+	std::unique_ptr<ISSDataPackets> held_hit; ///< Hit from the reorder buffer, processed when the next one comes out
+	unsigned long long held_time; ///< Time of the held hit, with its offset
+	unsigned long long held_entry; ///< Entry of the held hit in the input tree, or the number of hits pushed before it
+	bool flag_restart_skip; ///< Drop the hits that were processed before the checkpoint
+	unsigned long long restart_time; ///< Time of the last hit processed before the checkpoint
+	unsigned long long restart_last; ///< Entry of the last hit processed before the checkpoint
 	
 	// Settings file
 	ISSSettings *set; ///< Pointer to the settings object. Assigned in constructor
 	
 	// Progress bar
-	bool _prog_; ///< Boolean determining if there is a progress bar (in the GUI)
-	std::shared_ptr<TGProgressBar> prog; ///< Progress bar for the GUI
+	bool _prog_; ///< Boolean determining if the progress is followed (in the GUI)
+	std::shared_ptr<ISSProgress> prog; ///< Progress and cancellation shared with the GUI
+	bool flag_quiet; ///< Boolean to suppress progress and statistics printed to the terminal
+	bool _metrics_; ///< Boolean determining if the hits and events are counted for the dashboards
+	std::shared_ptr<ISSMetrics> metrics; ///< Counters shared with the rest of the sort
+	ISSMetrics::counter_t *met_hits; ///< Hits read from the input tree
+	ISSMetrics::counter_t *met_events; ///< Events written or passed on
+	ISSTiming timing; ///< Time spent in each of the finders
+	ISSMemoryUsage memusage; ///< Memory used by each kind of object
+	bool flag_print_memory; ///< Print the memory usage when closing the output
+	void AccountMemory(); ///< Update the memory used by the hits, events and trees
+
+	// Streaming input and output
+	bool flag_write_tree; ///< Fill the output tree with the built events
+	std::function<void(ISSEvts*)> event_callback; ///< Called for every event that is built, if set
 
 	// Log file
 	std::ofstream log_file; ///< Log file for recording the results of the ISSEventBuilder
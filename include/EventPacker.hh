@@ -0,0 +1,92 @@
+#ifndef __EVENTPACKER_HH
+#define __EVENTPACKER_HH
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <climits>
+#include <cmath>
+
+#include "TTree.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// ISS Events tree
+#ifndef __ISSEVTS_HH
+# include "ISSEvts.hh"
+#endif
+
+/*! \brief Converts the built events to ISSCompactEvts and back
+*
+* Each energy is rounded to a number of steps, the step being set for each
+* type of detector in the settings file, and kept in 16 bits. The times of the
+* hits are differences to the earliest hit of the event, rounded to the time
+* step, in 32 bits. The timing signals and the time of the event itself are
+* kept as they are. With the default steps (1 keV, 10 keV for the recoils and
+* 1 ns) nothing is lost that the detectors can resolve, while each hit takes
+* about half of the bytes, and compresses better, as the high bytes of the
+* absolute timestamps and the noise in the low bits of the energies are gone.
+*
+* The error of every value that is packed is kept, so the size and precision
+* can be compared with ISSEventPacker::GetReport at the end of a file. Values
+* outside of the range (negative energies, energies above 65535 steps and
+* times more than 2^31 steps from the event) are clipped and counted.
+*/
+class ISSEventPacker {
+
+public:
+
+	ISSEventPacker( ISSSettings *myset );///< Constructor
+	virtual ~ISSEventPacker(){};///< Destructor
+
+	void Pack( ISSEvts *evts );///< Fill the compact event from a built event
+	void Unpack( ISSCompactEvts *in, ISSEvts *evts );///< Fill a built event from a compact event
+	inline ISSCompactEvts* GetCompactEvts(){ return compact.get(); };///< The compact event that is filled by ISSEventPacker::Pack
+
+	void ResetReport();///< Forget the errors and sizes, i.e. for a new file
+	std::string GetReport( TTree *t );///< Precision and size of everything packed, and of the tree
+
+private:
+
+	/// Precision of one type of value
+	struct error_t {
+		std::string name;		///< what it is, for printing
+		std::string unit;		///< unit of the step and errors
+		double step;			///< step of the values
+		unsigned long n;		///< values packed
+		unsigned long clipped;	///< values outside of the range
+		double sum2;			///< sum of the squared errors, not clipped
+		double max;				///< largest error, not clipped
+	};
+
+	/// Types of value
+	enum field_t { kArray, kRecoil, kElum, kZeroDegree, kGammaRay, kTime, kFields };
+
+	unsigned short PackEnergy( float e, field_t f );///< Energy in steps
+	int PackTime( unsigned long t, unsigned long ref );///< Time to the event in steps
+	static inline float UnpackEnergy( unsigned short e, float step ){
+		return e * step;
+	};///< Energy in keV
+	static inline unsigned long UnpackTime( int t, unsigned long ref, unsigned int step ){
+		if( t == INT_MIN ) return 0;
+		return ref + (long)t * step;
+	};///< Absolute time in ns
+
+	ISSSettings *set;						///< Settings, for the steps
+	std::unique_ptr<ISSCompactEvts> compact;	///< Event filled by ISSEventPacker::Pack
+
+	// Report
+	std::vector<error_t> errors;		///< precision of each type of value
+	unsigned long n_packed;				///< events packed
+	unsigned long long full_bytes;		///< bytes of the values of the built events
+	unsigned long long packed_bytes;	///< bytes of the values of the compact events
+
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef __EVENTSELECTOR_HH
+#define __EVENTSELECTOR_HH
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <regex>
+
+#include "TFormula.h"
+#include "TDirectory.h"
+#include "TH1.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// ISS Events tree
+#ifndef __ISSEVTS_HH
+# include "ISSEvts.hh"
+#endif
+
+/*! \brief Decides which of the built events are written, from the conditions in the settings file
+*
+* Each condition is an expression in the syntax of TFormula, i.e. C++, of the
+* multiplicities of the event (array, arrayp, recoil, mwpc, elum, zd, gamma),
+* the laser status (laser, 0 or 1) and the time of the event after the last
+* EBIS, T1 and SuperCycle pulses in ns (ebis, t1, sc). For example
+* "array && recoil" writes the array-recoil coincidences, "elum && ebis < 4e6"
+* the ELUM events within 4 ms of the EBIS pulse.
+*
+* A condition with a prescale of N only writes every Nth event that it
+* matches. An event is written if any condition writes it, so the prescaled
+* singles can be kept next to all of the coincidences. The events matched and
+* written by each condition are counted and stored in the output file.
+*/
+class ISSEventSelector {
+
+public:
+
+	ISSEventSelector( ISSSettings *myset );///< Constructor
+	virtual ~ISSEventSelector(){};///< Destructor
+
+	bool Select( ISSEvts *evts, unsigned long time );///< Should this event be written
+	inline unsigned int GetNumberOfConditions(){ return conds.size(); };///< Conditions that compiled
+
+	void GetCounters( std::vector<unsigned long long> &matched, std::vector<unsigned long long> &written ) const;///< Counts of each condition, for a checkpoint
+	void SetCounters( const std::vector<unsigned long long> &matched, const std::vector<unsigned long long> &written );///< Carry on counting from a checkpoint
+
+	std::string GetReport() const;///< Events matched and written by each condition
+	void Write( TDirectory *dir ) const;///< Store the counts as histograms
+
+private:
+
+	/// Things that the conditions can use
+	enum var_t { kArray, kArrayP, kRecoil, kMwpc, kElum, kZeroDegree, kGammaRay,
+		kLaser, kEBIS, kT1, kSC, kVariables };
+	static std::string GetName( var_t v );///< Name in the expressions
+
+	/// One condition
+	struct condition_t {
+		std::string expr;				///< expression as it was given
+		unsigned int prescale;			///< write one in this many
+		std::unique_ptr<TFormula> f;	///< compiled expression
+		std::vector<var_t> pars;		///< variable of each parameter of the formula
+		unsigned long long matched;		///< events that it matched
+		unsigned long long written;		///< events that it wrote
+	};
+
+	std::vector<condition_t> conds;		///< conditions that compiled
+	std::vector<double> vars;			///< values of the variables for this event
+	std::vector<double> pars;			///< parameters of one formula
+	unsigned long long n_events;		///< events looked at
+	unsigned long long n_written;		///< events written by any condition
+
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __FILEPREFETCHER_HH
+#define __FILEPREFETCHER_HH
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*! \brief Reads ahead the next files of a chain on a background thread
+*
+* A TChain only opens a file when it gets to its first entry, and opening it
+* means reading the header, the keys, the streamer info and the baskets of
+* the first cluster, one small read after another. On a busy RAID or network
+* disk each file boundary is then a stall of the whole loop.
+*
+* While one file is being processed, this reads the start of the next files
+* (the first clusters) and their end (where ROOT writes the keys, the
+* streamer info and the index of the baskets when the file is closed) into
+* the page cache. The reads are plain POSIX reads, so nothing of ROOT is used
+* from the second thread. The bytes read ahead are capped, split between the
+* files, so the data of the current file isn't pushed out of the cache.
+*/
+class ISSFilePrefetcher {
+
+public:
+
+	ISSFilePrefetcher( std::vector<std::string> myfiles, unsigned int mydepth, double mybytes );///< Constructor, starts the thread
+	virtual ~ISSFilePrefetcher();///< Destructor, stops the thread
+
+	void SetCurrent( unsigned int i );///< The chain has moved on to file i
+	std::string GetReport();///< How much was read ahead and whether it was in time
+
+private:
+
+	void Run();///< Loop of the background thread
+	bool Warm( unsigned int i );///< Read the start and end of file i, false if stopped
+
+	std::vector<std::string> files;	///< files of the chain, in order
+	unsigned int depth;				///< files to read ahead of the current one
+	double file_bytes;				///< bytes to read of each file
+
+	std::thread worker;				///< background thread
+	std::mutex mtx;					///< protects everything below
+	std::condition_variable cv;		///< wakes the thread when the chain moves on
+	bool stop;						///< thread should finish
+	unsigned int current;			///< file that the chain is reading
+	unsigned int next;				///< next file to be read ahead
+	std::vector<bool> warmed;		///< file has been read ahead
+
+	// Statistics
+	unsigned int n_warmed;			///< files read ahead
+	unsigned int n_ready;			///< files that were ready when the chain got to them
+	unsigned int n_switches;		///< file boundaries
+	double bytes_read;				///< bytes read ahead
+	double read_time;				///< seconds spent reading ahead
+
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef __GENERATOR_HH
+#define __GENERATOR_HH
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <random>
+
+#include "TSystem.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+/*! \brief Writes MIDAS files of made up data for testing the sort at scale
+*
+* The data is written in the same 64 kB blocks with 24-byte "EBYEDATA"
+* headers that the ISSConverter reads. There are array events with a p-side
+* and an n-side hit in the same row, recoil events with an energy loss and
+* a rest energy hit, uncorrelated ASIC singles, and the pulser, EBIS and T1
+* signals at a steady rate. The hits are encoded with the info words for the
+* timestamp bits as they change, so the timestamps roll over just as they do
+* in real data, starting from any time that is asked for.
+*
+* For testing the error handling, some hits can be written late (out of
+* order), some words can be corrupted and some block headers can be broken.
+* The same seed always gives the same file, on any machine, so the files can
+* be used as the input of benchmarks and regression tests.
+*
+*/
+class ISSGenerator {
+
+public:
+
+	ISSGenerator( ISSSettings *myset );///< Constructor
+	virtual ~ISSGenerator(){};///< Destructor
+
+	unsigned long Generate( std::string filename, unsigned long nblocks );///< Write nblocks blocks to a file and return the number of hits
+
+	inline void SetSeed( unsigned long long s ){ seed = s; };///< Seed of the random numbers
+	inline void SetStartTime( unsigned long long t ){ start_time = t; };///< Timestamp of the first hit in ns, to test the rollovers
+	inline void SetArrayRate( double r ){ array_rate = r; };///< Rate of p/n array events in Hz
+	inline void SetSinglesRate( double r ){ singles_rate = r; };///< Rate of uncorrelated ASIC hits in Hz
+	inline void SetRecoilRate( double r ){ recoil_rate = r; };///< Rate of dE/E recoil events in Hz
+	inline void SetTraceLength( unsigned int n ){ trace_length = 4 * ( ( n + 3 ) / 4 ); };///< Samples in the CAEN traces, zero for none
+	inline void SetPulserRate( double r ){ pulser_rate = r; };///< Rate of the pulser in Hz
+	inline void SetEBISRate( double r ){ ebis_rate = r; };///< Rate of the EBIS signal in Hz
+	inline void SetT1Period( double p ){ t1_period = p; };///< Time between proton pulses in s
+	inline void SetOutOfOrder( double f, double delay ){
+		ooo_fraction = f;
+		ooo_delay = delay;
+	};///< Fraction of hits that are written late, by up to delay ns
+	inline void SetCorruptWords( double f ){ corrupt_words = f; };///< Fraction of hits with a corrupted word
+	inline void SetCorruptBlocks( double f ){ corrupt_blocks = f; };///< Fraction of blocks with a broken header
+
+private:
+
+	/// Kinds of hit that are made
+	enum hit_type_t {
+		kAsic,		///< ASIC hit in the array
+		kCaen,		///< CAEN hit, i.e. recoil, pulser, EBIS or T1
+		kExtTrigger	///< ASIC external trigger info word from the pulser
+	};
+
+	/// One hit waiting to be written
+	struct hit_t {
+		hit_type_t type;			///< kind of hit
+		unsigned long long time;	///< timestamp in ns
+		unsigned long long emit;	///< time it is written, later than the timestamp if out of order
+		unsigned long long order;	///< order it was made in, for hits written at the same time
+		unsigned char mod;			///< module
+		unsigned char asic;			///< ASIC, for ASIC hits
+		unsigned char ch;			///< channel
+		unsigned int adc;			///< ADC value or Qlong
+		unsigned int qshort;		///< Qshort, for CAEN hits
+		unsigned int fine;			///< fine time or baseline, for CAEN hits
+		unsigned char corrupt;		///< how this hit is broken, if it is
+	};
+
+	/// Ways of breaking a hit
+	enum corrupt_t {
+		kGood,			///< not broken
+		kBadModule,		///< module number out of range
+		kBadType,		///< first word has no data type
+		kMissingWord,	///< CAEN hit without its Qshort, or an ASIC hit written twice
+		kNumberOfCorruptions
+	};
+
+	/// Earliest hit to be written first
+	struct later_t {
+		bool operator()( const hit_t &a, const hit_t &b ) const {
+			if( a.emit != b.emit ) return a.emit > b.emit;
+			return a.order > b.order;
+		};
+	};
+
+	/// Timestamp bits the converter knows about, so info words are only written when they change
+	struct sync_t {
+		long long hsb;		///< high bits of all timestamps
+		long long msb;		///< middle bits of the CAEN timestamps (also changed by external triggers)
+		long long msb_asic;	///< middle bits of the ASIC timestamps
+	};
+
+	// Random numbers, worked out from the raw generator so they are the same everywhere
+	double Uniform();///< Between 0 and 1
+	double Exponential( double rate );///< Time to the next hit in ns for a rate in Hz
+	double Gauss( double mean, double sigma );///< Normal distribution
+	unsigned int Integer( unsigned int n );///< Between 0 and n-1
+
+	// Making hits
+	void MakeArrayEvent( unsigned long long t );///< p-side and n-side hit in the same module and row
+	void MakeSingle( unsigned long long t );///< ASIC hit on its own
+	void MakeRecoilEvent( unsigned long long t );///< energy loss and rest energy in the same sector
+	void MakeCaenHit( unsigned long long t, unsigned char mod, unsigned char ch, unsigned int q );///< CAEN hit on one channel
+	void MakePulser( unsigned long long t );///< CAEN pulser and external triggers in each array module
+	void AddHit( hit_t &h );///< Queue a hit to be written, maybe late or corrupted
+
+	// Writing
+	unsigned int EncodeHit( const hit_t &h, sync_t &state, std::vector<ULong64_t> &words );///< Words for a hit, with the info words it needs first, returns the number of info words
+	void EncodeTrace( unsigned int amplitude, std::vector<ULong64_t> &words );///< Trace header and samples
+	static ULong64_t InfoWord( unsigned char mod, unsigned char code, unsigned int field, unsigned long long lsb );///< Info data word
+	bool WriteBlock( std::ofstream &output_file );///< Header, words and padding of the current block
+
+	ISSSettings *set;	///< Settings, for the number of modules and the special channels
+
+	// Parameters
+	unsigned long long seed;		///< seed of the random numbers
+	unsigned long long start_time;	///< timestamp of the first hit in ns
+	double array_rate;				///< p/n array events per second
+	double singles_rate;			///< uncorrelated ASIC hits per second
+	double recoil_rate;				///< dE/E recoil events per second
+	unsigned int trace_length;		///< samples in each CAEN trace
+	double pulser_rate;				///< pulser per second
+	double ebis_rate;				///< EBIS per second
+	double t1_period;				///< seconds between T1 signals
+	double ooo_fraction;			///< fraction of hits written late
+	double ooo_delay;				///< largest delay of a late hit in ns
+	double corrupt_words;			///< fraction of hits with a corrupted word
+	double corrupt_blocks;			///< fraction of blocks with a broken header
+
+	// State
+	std::mt19937_64 rng;			///< raw random numbers
+	std::priority_queue<hit_t,std::vector<hit_t>,later_t> pending;	///< hits waiting to be written
+	unsigned long long nmade;		///< hits made so far
+	std::vector<ULong64_t> block;	///< words of the block being filled
+	unsigned long nblock;			///< blocks written so far
+
+	// Counters for the summary
+	unsigned long ctr_asic;		///< ASIC hits written
+	unsigned long ctr_caen;		///< CAEN hits written
+	unsigned long ctr_info;		///< info words written
+	unsigned long ctr_late;		///< hits written out of order
+	unsigned long ctr_corrupt;	///< corrupted hits
+	unsigned long ctr_bad_blocks;	///< blocks with a broken header
+
+	// Same as the converter
+	static const int HEADER_SIZE = 24; // Size of header in bytes
+	static const int DATA_BLOCK_SIZE = 0x10000; // Block size for ISS/ASIC data = 64 kB
+	static const int MAIN_SIZE = DATA_BLOCK_SIZE - HEADER_SIZE;
+	static const int WORD_SIZE = MAIN_SIZE / sizeof(ULong64_t);
+
+};
+
+#endif
@@ -12,14 +12,34 @@
 #include <TTree.h>
 #include <TMath.h>
 #include <TChain.h>
+#include <TChainElement.h>
 #include <TProfile.h>
 #include <TH1.h>
 #include <TH2.h>
 #include <TCutG.h>
-#include <TGProgressBar.h>
 #include <TSystem.h>
 
 
+// Timing header
+#ifndef __TIMING_HH
+# include "Timing.hh"
+#endif
+
+// Memory usage header
+#ifndef __MEMORYUSAGE_HH
+# include "MemoryUsage.hh"
+#endif
+
+// Metrics header
+#ifndef __METRICS_HH
+# include "Metrics.hh"
+#endif
+
+// Progress header
+#ifndef __PROGRESS_HH
+# include "Progress.hh"
+#endif
+
 // Reaction header
 #ifndef __REACTION_HH
 # include "Reaction.hh"
@@ -30,11 +50,26 @@
 # include "ISSEvts.hh"
 #endif
 
+// Event packer header
+#ifndef __EVENTPACKER_HH
+# include "EventPacker.hh"
+#endif
+
 // Settings file
 #ifndef __SETTINGS_HH
 # include "Settings.hh"
 #endif
 
+// Compression header
+#ifndef __COMPRESSION_HH
+# include "Compression.hh"
+#endif
+
+// File prefetcher header
+#ifndef __FILEPREFETCHER_HH
+# include "FilePrefetcher.hh"
+#endif
+
 
 class ISSHistogrammer {
 	
@@ -46,6 +81,13 @@ public:
 	void MakeHists();
 	void ResetHists();
 	unsigned long FillHists();
+	void FillEvent();
+	
+	// Fill the histograms from events passed one by one, i.e. by the event builder
+	inline void PushEvent( ISSEvts *evts ){
+		read_evts = evts;
+		FillEvent();
+	};
 	
 	void SetInputFile( std::vector<std::string> input_file_names );
 	void SetInputFile( std::string input_file_name );
@@ -53,19 +95,31 @@ public:
 
 	inline void SetOutput( std::string output_file_name ){
 		output_file = new TFile( output_file_name.data(), "recreate" );
+		ISSCompression( set, "Hist" ).Apply( output_file ); // only histograms, so auto is the default
 		MakeHists();
 	};
 	inline void CloseOutput(){
+		timing.Print( "ISSHistogrammer" );
+		timing.Write( output_file );
+		if( flag_print_memory ) memusage.Print( "ISSHistogrammer" );
 		output_file->Close();
-		input_tree->ResetBranchAddresses();
+		if( input_tree ) input_tree->ResetBranchAddresses();
 	};
 
 	inline TFile* GetFile(){ return output_file; };
 	
-	inline void AddProgressBar( std::shared_ptr<TGProgressBar> myprog ){
+	inline void AddProgress( std::shared_ptr<ISSProgress> myprog ){
 		prog = myprog;
 		_prog_ = true;
 	};
+	inline void AddMetrics( std::shared_ptr<ISSMetrics> mymetrics ){
+		metrics = mymetrics;
+		_metrics_ = true;
+		met_events = metrics->AddCounter( "iss_histogrammed_events_total", "Events filled into the histograms" );
+	};
+	inline void SetQuiet( bool q = true ){ flag_quiet = q; };
+	inline void SetTiming( bool t = true ){ timing.Enable( t ); };
+	inline void SetPrintMemory( bool p = true ){ flag_print_memory = p; };
 	
 	// Recoil - array coincidence (numbers to go to reaction file?)
 	inline bool	PromptCoincidence( std::shared_ptr<ISSRecoilEvt> r, std::shared_ptr<ISSArrayEvt> a ){
@@ -173,6 +227,16 @@ private:
 	/// Input tree
 	TChain *input_tree;
 	ISSEvts *read_evts = 0;
+	void SetBranches();
+	
+	/// Reads the next files of the chain ahead
+	std::unique_ptr<ISSFilePrefetcher> prefetch;
+	void SetPrefetch();
+	
+	/// Compact events are unpacked into an event of our own
+	ISSCompactEvts *read_compact = 0;
+	std::unique_ptr<ISSEvts> unpacked_evts;
+	std::unique_ptr<ISSEventPacker> unpacker;
 	std::shared_ptr<ISSArrayEvt> array_evt;
 	std::shared_ptr<ISSArrayPEvt> arrayp_evt;
 	std::shared_ptr<ISSRecoilEvt> recoil_evt;
@@ -184,7 +248,22 @@ private:
 	
 	// Progress bar
 	bool _prog_;
-	std::shared_ptr<TGProgressBar> prog;
+	std::shared_ptr<ISSProgress> prog;
+	
+	// Events counted for the dashboards
+	bool _metrics_;
+	std::shared_ptr<ISSMetrics> metrics;
+	ISSMetrics::counter_t *met_events;
+	
+	// Flag to suppress terminal output, i.e. when running in parallel
+	bool flag_quiet;
+	
+	// Timing of the reaction and the histogram filling
+	ISSTiming timing;
+	
+	// Memory used by the events, histograms and input tree
+	ISSMemoryUsage memusage;
+	bool flag_print_memory;
 
 	// Counters
 	unsigned long n_entries;
@@ -346,6 +346,9 @@ private:
 class ISSEvts : public TObject {
 //class ISSEvts {
 
+	// Packs the events into ISSCompactEvts and back, without copying them
+	friend class ISSEventPacker;
+
 public:
 	
 	// setup functions
@@ -399,6 +402,17 @@ public:
 
 	void ClearEvt();
 	
+	// Memory used by this event, for ISSMemoryUsage
+	inline size_t GetMemory(){
+		return sizeof(*this) + array_event.capacity() * sizeof(ISSArrayEvt) +
+			arrayp_event.capacity() * sizeof(ISSArrayPEvt) +
+			recoil_event.capacity() * sizeof(ISSRecoilEvt) +
+			mwpc_event.capacity() * sizeof(ISSMwpcEvt) +
+			elum_event.capacity() * sizeof(ISSElumEvt) +
+			zd_event.capacity() * sizeof(ISSZeroDegreeEvt) +
+			gamma_event.capacity() * sizeof(ISSGammaRayEvt);
+	};
+	
 	// ISOLDE timestamping
 	inline void SetEBIS( unsigned long t ){ ebis = t; return; };
 	inline void SetT1( unsigned long t ){ t1 = t; return; };
@@ -431,5 +445,90 @@ private:
 	
 };
 
+/*! \brief Compact form of ISSEvts, written instead of it if CompactEvents is set
+*
+* The energies are quantised to a step for each type of detector and kept in
+* 16 bits, the IDs are in bytes and the times are differences to the time of
+* the event, in steps of TimeStep. The steps are in every event, so that files
+* with different precision can be read together, and cost nothing once they
+* are compressed. ISSEventPacker converts between this and ISSEvts.
+*/
+class ISSCompactEvts : public TObject {
+
+	friend class ISSEventPacker;
+
+public:
+	
+	// setup functions
+	ISSCompactEvts();
+	~ISSCompactEvts();
+	
+	void ClearEvt();
+	
+private:
+	
+	// Precision
+	float			array_step;		///< energy step of the array in keV
+	float			recoil_step;	///< energy step of the recoil detector
+	float			elum_step;		///< energy step of the ELUM detector
+	float			zd_step;		///< energy step of the ZeroDegree detector
+	float			gamma_step;		///< energy step of the gamma-ray detectors
+	unsigned int	time_step;		///< time step in ns
+
+	// Timestamping
+	unsigned long	time;		///< time of the event, the earliest hit in it
+	unsigned long	ebis;		///< absolute EBIS pulse time
+	unsigned long	t1;			///< absolute proton pulse time
+	unsigned long	sc;			///< absolute SuperCycle pulse time
+	bool			laser;		///< laser status, true = ON, false = OFF
+
+	// Array, the p-side only events after the p/n-side ones
+	unsigned short				n_array;	///< number of p/n-side events
+	std::vector<unsigned char>	array_mod;	///< module number
+	std::vector<unsigned char>	array_row;	///< row number of the silicon
+	std::vector<unsigned char>	array_pid;	///< p-side strip id
+	std::vector<unsigned char>	array_nid;	///< n-side strip id
+	std::vector<unsigned short>	array_pen;	///< p-side energy in steps
+	std::vector<unsigned short>	array_nen;	///< n-side energy in steps
+	std::vector<int>			array_ptd;	///< p-side time to the event
+	std::vector<int>			array_ntd;	///< n-side time to the event
+
+	// Recoils, with the layers of every recoil one after the other
+	std::vector<unsigned char>	recoil_sec;		///< sector
+	std::vector<unsigned char>	recoil_depth;	///< number of layers
+	std::vector<unsigned char>	recoil_id;		///< id of each layer
+	std::vector<unsigned short>	recoil_en;		///< energy of each layer in steps
+	std::vector<int>			recoil_detd;	///< dE time to the event
+	std::vector<int>			recoil_etd;		///< E time to the event
+
+	// MWPC
+	std::vector<int>			mwpc_tacdiff;	///< TAC difference
+	std::vector<unsigned char>	mwpc_axis;		///< axis ID
+	std::vector<int>			mwpc_td;		///< time to the event
+
+	// ELUM
+	std::vector<unsigned char>	elum_id;	///< ID
+	std::vector<unsigned char>	elum_sec;	///< sector
+	std::vector<unsigned short>	elum_en;	///< energy in steps
+	std::vector<int>			elum_td;	///< time to the event
+
+	// ZeroDegree, like the recoils
+	std::vector<unsigned char>	zd_sec;		///< sector
+	std::vector<unsigned char>	zd_depth;	///< number of layers
+	std::vector<unsigned char>	zd_id;		///< id of each layer
+	std::vector<unsigned short>	zd_en;		///< energy of each layer in steps
+	std::vector<int>			zd_detd;	///< dE time to the event
+	std::vector<int>			zd_etd;		///< E time to the event
+
+	// Gamma rays
+	std::vector<unsigned char>	gamma_id;	///< detector ID
+	std::vector<unsigned char>	gamma_type;	///< detector type
+	std::vector<unsigned short>	gamma_en;	///< energy in steps
+	std::vector<int>			gamma_td;	///< time to the event
+
+	ClassDef( ISSCompactEvts, 1 )
+	
+};
+
 #endif
 
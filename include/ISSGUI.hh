@@ -25,6 +25,8 @@
 #include <TString.h>
 #include <TObjString.h>
 #include <TG3DLine.h>
+#include <TTimer.h>
+#include <TROOT.h>
 #include <RQ_OBJECT.h>
 
 // My code include.
@@ -43,6 +45,8 @@
 #include <vector>
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <atomic>
 //#include <filesystem>
 
 
@@ -102,7 +106,18 @@ protected:
 	std::shared_ptr<TGHProgressBar>	prog_sort;
 	std::shared_ptr<TGHProgressBar>	prog_evnt;
 	std::shared_ptr<TGHProgressBar>	prog_hist;
-
+	
+	// Progress of each stage, updated by the worker and polled by the timer
+	std::shared_ptr<ISSProgress>	stat_conv;
+	std::shared_ptr<ISSProgress>	stat_sort;
+	std::shared_ptr<ISSProgress>	stat_evnt;
+	std::shared_ptr<ISSProgress>	stat_hist;
+	
+	// Background job
+	std::thread			worker;			// runs the analysis so the GUI stays responsive
+	std::atomic<bool>	flag_running;	// the worker hasn't finished yet
+	TTimer				*timer;			// updates the progress bars while the worker runs
+	std::string			name_hist_output;	// histogram file, read from the GUI before starting
 
 	// Labels
 	TGLabel				*lab_run_files;		// label for run file list
@@ -135,6 +150,7 @@ protected:
 	TGTextButton        *but_open;			// button to open configuration
 	TGTextButton        *but_save;			// button to save configuration
 	TGTextButton        *but_sort;			// button to do the sorting
+	TGTextButton        *but_cancel;		// button to cancel the sorting
 	TGTextButton        *but_set;			// button to open settings file
 	TGTextButton        *but_cal;			// button to open calibration file
 	TGTextButton        *but_rea;			// button to open reaction file
@@ -167,6 +183,8 @@ public:
 	void gui_build();
 	void gui_hist();
 	void gui_autocal();
+	void run_sort();		// all the steps, on the worker thread
+	void update_bar( std::shared_ptr<ISSProgress> stat, std::shared_ptr<TGHProgressBar> bar );
 
 	// Slots
 	TString		get_filename();
@@ -180,6 +198,9 @@ public:
 	void		on_sel_clicked();
 	void		on_add_clicked();
 	void		on_sort_clicked();
+	void		on_cancel_clicked();
+	void		on_timer();
+	void		on_close();
 
 	// Save setup
 	void SaveSetup( TString setupfile );
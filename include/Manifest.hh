@@ -0,0 +1,66 @@
+#ifndef __MANIFEST_HH
+#define __MANIFEST_HH
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "TSystem.h"
+#include "TFile.h"
+#include "TNamed.h"
+#include "TMD5.h"
+
+// Version of the code of each stage, from iss_version.hh made by the Makefile
+#ifndef ISS_CONVERT_VERSION
+# define ISS_CONVERT_VERSION "unknown"
+#endif
+#ifndef ISS_BUILD_VERSION
+# define ISS_BUILD_VERSION "unknown"
+#endif
+#ifndef ISS_HIST_VERSION
+# define ISS_HIST_VERSION "unknown"
+#endif
+
+/*! \brief Record of everything that went into making an output file
+*
+* Each stage of the sort stores a manifest in its output ROOT file, which
+* holds the hashes of the input data, the settings, calibration and reaction
+* files and the version of the code. Before running a stage again, the
+* manifest that it would write is compared to the one already in the file,
+* and the stage only needs to be repeated if something has changed.
+*
+*/
+class ISSManifest {
+
+public:
+
+	ISSManifest(){};///< Constructor
+	virtual ~ISSManifest(){};///< Destructor
+
+	void AddFile( std::string key, std::string filename );///< Add the MD5 hash of a text file, i.e. settings or calibration
+	void AddFile( std::string key, std::string filename, std::string part, bool with );///< Add the MD5 hash of the lines of a text file with or without part in them
+	void AddData( std::string key, std::string filename );///< Add a fingerprint of a large data file
+	void AddManifest( std::string key, const ISSManifest &other );///< Add the digest of a manifest from a previous stage
+	inline void AddValue( std::string key, std::string value ){
+		entries[key] = value;
+	};///< Add an option that changes the output
+
+	std::string GetText() const;///< All entries as "key = value" lines
+	std::string GetDigest() const;///< MD5 hash of all the entries
+
+	bool Write( std::string filename ) const;///< Store the manifest in an existing ROOT file
+	bool Read( std::string filename );///< Load the manifest from a ROOT file, false if there isn't one
+	std::vector<std::string> Compare( const ISSManifest &other ) const;///< Keys that are different in the two manifests
+	bool UpToDate( std::string filename ) const;///< The file exists and has the same manifest as this one
+
+private:
+
+	std::map<std::string,std::string> entries;	///< key and hash or value, sorted by key
+
+};
+
+#endif
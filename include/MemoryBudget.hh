@@ -0,0 +1,52 @@
+#ifndef __MEMORYBUDGET_HH
+#define __MEMORYBUDGET_HH
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+
+/*! \brief Memory allowed for one stage of the sort
+*
+* Each task in the scheduler reserves an estimate of the memory it needs.
+* When a total budget is given with -mem, the stage running the task is told
+* how much it has and sizes its tree caches, basket buffers and sort buffers
+* to fit, spilling to disk earlier when it is small. Without a budget, the
+* stages use the same sizes as always.
+*
+* The resident memory of the process is read from /proc on Linux, so the peak
+* of each task can be reported.
+*
+*/
+class ISSMemoryBudget {
+
+public:
+
+	ISSMemoryBudget( double mybytes = 0 ){ budget = mybytes; };///< Constructor
+	virtual ~ISSMemoryBudget(){};///< Destructor
+
+	inline void SetBudget( double mybytes ){ budget = mybytes; };///< Bytes for this stage, zero or less is no limit
+	inline double GetBudget() const { return budget; };///< Getter for the budget in bytes
+	inline bool IsLimited() const { return budget > 0; };///< A budget has been set
+
+	/// Size of one buffer: a fraction of the budget, but never more than
+	/// the default that is used without a budget and never less than min_bytes
+	inline double GetShare( double fraction, double default_bytes, double min_bytes = 1e6 ) const {
+		if( !IsLimited() ) return default_bytes;
+		return std::max( min_bytes, std::min( default_bytes, fraction * budget ) );
+	};
+
+	static double GetCurrentRSS();///< Resident memory of the process in bytes, 0 if not known
+	static double GetPeakRSS();///< Peak resident memory of the process in bytes, 0 if not known
+	static void ResetPeakRSS();///< Start measuring the peak again from now, if the kernel allows it
+
+private:
+
+	static double ReadStatus( std::string key );///< Value in bytes of a line of /proc/self/status
+
+	double budget;	///< bytes available to the stage, zero or less is no limit
+
+};
+
+#endif
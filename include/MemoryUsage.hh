@@ -0,0 +1,85 @@
+#ifndef __MEMORYUSAGE_HH
+#define __MEMORYUSAGE_HH
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "TDirectory.h"
+#include "TCollection.h"
+#include "TObjArray.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TBasket.h"
+#include "TH1.h"
+#include "TClass.h"
+#include "TProfile.h"
+#include "TArrayC.h"
+#include "TArrayS.h"
+#include "TArrayI.h"
+#include "TArrayF.h"
+#include "TArrayD.h"
+
+/*! \brief Memory used by each kind of object in a stage of the sort
+*
+* Each stage keeps a count of the memory used by the hits and events it is
+* holding, their traces, its histograms and the baskets and caches of its
+* trees. The counts are updated every so often, i.e. with the progress bar,
+* from the sizes of the objects themselves, so nothing has to be done on
+* every allocation. The current and peak values go into histograms in the
+* "memory" directory of the output file, where the monitor can see them as
+* they change, along with the memory taken by each family of histograms.
+*
+*/
+class ISSMemoryUsage {
+
+public:
+
+	/// Kinds of object that are counted
+	enum category_t {
+		kHits,		///< ISSDataPackets being held
+		kEvents,	///< ISSEvts being built or read
+		kTraces,	///< CAEN traces in the hits
+		kHists,		///< all histograms in the output file
+		kTrees,		///< baskets in memory and read caches of the trees
+		kNumberOfCategories
+	};
+
+	ISSMemoryUsage();///< Constructor
+	virtual ~ISSMemoryUsage(){};///< Destructor
+
+	void MakeHists( TDirectory *file );///< Histograms of the usage in the "memory" directory of the output file
+	void Set( category_t c, double bytes );///< Current usage of one category
+	inline double GetCurrent( category_t c ) const { return current[c]; };///< Current usage of one category in bytes
+	inline double GetPeak( category_t c ) const { return peak[c]; };///< Highest usage of one category in bytes
+
+	void ScanHists( TDirectory *dir );///< Add up all histograms in memory in a directory and those below it
+	void Print( std::string title ) const;///< Table of current and peak usage and the largest histogram families
+
+	static std::string GetName( category_t c );///< Name of a category for printing
+	static double HistBytes( TH1 *h );///< Estimated memory of one histogram, mostly its bins
+	static double TreeBytes( TTree *t );///< Baskets of a tree that are in memory, plus its read cache
+
+private:
+
+	void AddHists( TDirectory *dir, std::map<std::string,double> &sum );///< Add the histograms of one directory to each family
+	static double BranchBytes( TBranch *b );///< Baskets of a branch and its sub-branches that are in memory
+	static std::string GetFamily( std::string name );///< Histogram name without the numbers on the end
+
+	double current[kNumberOfCategories];	///< bytes in use now
+	double peak[kNumberOfCategories];		///< most bytes used so far
+	std::map<std::string,double> families;	///< bytes used by each family of histograms
+
+	TH1D *hcurrent;		///< current usage of each category in MB
+	TH1D *hpeak;		///< peak usage of each category in MB
+	TH1D *hfamilies;	///< largest families of histograms in MB
+
+	static const unsigned int nfamilies = 20;	///< number of families in the histogram
+
+};
+
+#endif
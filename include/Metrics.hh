@@ -0,0 +1,96 @@
+#ifndef __METRICS_HH
+#define __METRICS_HH
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#include "TSystem.h"
+
+// Memory budget header, for reading the memory of the process
+#ifndef __MEMORYBUDGET_HH
+# include "MemoryBudget.hh"
+#endif
+
+/*! \brief Numbers for the operations dashboards, i.e. blocks/s, hits/s and queue depths
+*
+* Counters (which only go up) and gauges (which can be set to anything) are
+* added once with a name, help text and labels, which returns a pointer to an
+* atomic value. The converter, event builder, histogrammer and scheduler then
+* update their values from whichever thread they are running on without
+* taking any locks. Rates are worked out from the counters by whatever reads
+* them, i.e. Prometheus.
+*
+* All the values are written in the Prometheus text format to a file every
+* few seconds. In monitor mode the file is also served by the THttpServer,
+* so it can be scraped directly.
+*
+*/
+class ISSMetrics {
+
+public:
+
+	typedef std::atomic<unsigned long long> counter_t;	///< Value of a counter
+	typedef std::atomic<double> gauge_t;				///< Value of a gauge
+
+	ISSMetrics( std::string myfilename = "" ){ filename = myfilename; running = false; };///< Constructor
+	virtual ~ISSMetrics(){ StopWriter(); };///< Destructor
+
+	counter_t* AddCounter( std::string name, std::string help, std::string labels = "" );///< Add a counter, or get the one with the same name and labels
+	gauge_t* AddGauge( std::string name, std::string help, std::string labels = "" );///< Add a gauge, or get the one with the same name and labels
+
+	/// Add to a counter, cheap enough for every block
+	inline static void Add( counter_t *c, unsigned long long n = 1 ){
+		if( c ) c->fetch_add( n, std::memory_order_relaxed );
+	};
+
+	/// Set a gauge
+	inline static void Set( gauge_t *g, double value ){
+		if( g ) g->store( value, std::memory_order_relaxed );
+	};
+
+	std::string GetText();///< All values in the Prometheus text format
+	bool Save();///< Write the values to the file
+
+	inline void SetFile( std::string myfilename ){ filename = myfilename; };///< Setter for the file name
+	inline std::string GetFile(){ return filename; };///< Getter for the file name
+
+	void StartWriter( double interval );///< Save the file every interval seconds on a separate thread
+	void StopWriter();///< Stop the thread and save the final values
+
+private:
+
+	/// One counter or gauge
+	struct metric_t {
+		std::string name;		///< name of the metric, the same for all labels
+		std::string help;		///< description for the HELP line
+		std::string type;		///< counter or gauge
+		std::string labels;		///< i.e. module="3",system="asic"
+		counter_t counter;		///< value if it is a counter
+		gauge_t gauge;			///< value if it is a gauge
+	};
+
+	metric_t* Find( std::string name, std::string type, std::string help, std::string labels );///< Existing metric or a new one
+
+	std::deque<metric_t> metrics;					///< all metrics, which never move once added
+	std::map<std::string,metric_t*> index;			///< metrics by name and labels
+	std::mutex add_mtx;								///< only for adding metrics and reading the list
+
+	std::string filename;		///< file to write, empty for none
+	std::thread writer;			///< thread that saves the file
+	bool running;				///< the writer thread should keep going
+	std::mutex writer_mtx;		///< protects running
+	std::condition_variable writer_cv;	///< wakes the writer to stop
+
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef __MICROBENCHMARK_HH
+#define __MICROBENCHMARK_HH
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+
+#include "TSystem.h"
+#include "TCutG.h"
+#include "TGraph.h"
+#include "TVector3.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Calibration header
+#ifndef __CALIBRATION_HH
+# include "Calibration.hh"
+#endif
+
+// Reaction header
+#ifndef __REACTION_HH__
+# include "Reaction.hh"
+#endif
+
+// Converter header
+#ifndef _Converter_hh
+# include "Converter.hh"
+#endif
+
+// EventBuilder header
+#ifndef _EventBuilder_hh
+# include "EventBuilder.hh"
+#endif
+
+// ISSEvts header
+#ifndef __ISSEVTS_HH__
+# include "ISSEvts.hh"
+#endif
+
+// Generator header
+#ifndef __GENERATOR_HH
+# include "Generator.hh"
+#endif
+
+/*! \brief Times the functions that the sort spends most of its time in
+*
+* Each kernel is called on its own, over and over, with inputs that are made
+* up from a seed, so no data files are needed and every run does the same
+* work. The MIDAS blocks come from the ISSGenerator and everything else is
+* drawn from the same random numbers, within the ranges of the settings.
+*
+* For every kernel, the time per call, the calls and MB per second and, on
+* Linux when the kernel lets us, the cycles, instructions, cache misses and
+* branch misses per call are measured. The decoding steps and the finders
+* work on private members, which are filled in directly, so for those the
+* time also includes putting the inputs in place.
+*
+*/
+class ISSMicroBenchmark {
+
+public:
+
+	ISSMicroBenchmark( ISSSettings *myset, std::string mycalfile, std::string myreactfile );///< Constructor
+	virtual ~ISSMicroBenchmark(){};///< Destructor
+
+	inline void SetSeed( unsigned long long s ){ seed = s; };///< Seed of the inputs
+	inline void SetMinTime( double t ){ min_time = t; };///< Seconds to run each kernel for
+	inline void SetFilter( std::string f ){ filter = f; };///< Only run kernels with this in their name
+
+	bool Run();///< Run every kernel
+	void Print();///< Table of the results
+	bool Save( std::string filename );///< Write the results as a text file
+
+private:
+
+	/// Hardware counters of one measurement
+	struct counters_t {
+		bool valid;					///< the counters could be read
+		double cycles;				///< CPU cycles
+		double instructions;		///< instructions retired
+		double cache_misses;		///< last level cache misses
+		double branch_misses;		///< mispredicted branches
+	};
+
+	/// Measurements of one kernel
+	struct result_t {
+		std::string name;			///< function that was timed
+		double calls;				///< number of calls
+		double ns;					///< time per call in ns
+		double bytes;				///< bytes of input per call
+		counters_t hw;				///< hardware counters per call
+	};
+
+	/// Calls a kernel n times and returns a value, so it can't be optimised away
+	typedef std::function<double(unsigned long)> kernel_t;
+
+	void Measure( std::string name, kernel_t kernel, double bytes = 0 );///< Time one kernel and store the result
+
+	// Groups of kernels with the same inputs
+	void RunConverter();///< GetWord, ProcessBlockData, ProcessASICData and ProcessCAENData
+	void RunCalibration();///< AsicEnergy, AsicWalk and CaenEnergy
+	void RunEventBuilder();///< ArrayFinder and RecoilFinder
+	void RunEvents();///< GetPhiXY and GetZ of array events
+	void RunReaction();///< MakeReaction, GetEnergyLoss and cut tests
+
+	// Hardware counters, only on Linux
+	bool OpenCounters();///< Set up the counters, false if they aren't available
+	void StartCounters();///< Zero and start the counters
+	counters_t StopCounters();///< Stop the counters and read them
+	void CloseCounters();///< Release the counters
+
+	// Random numbers, worked out from the raw generator so they are the same everywhere
+	inline double Uniform(){ return ( rng() >> 11 ) * ( 1.0 / 9007199254740992.0 ); };///< Between 0 and 1
+	inline unsigned int Integer( unsigned int n ){ return n ? rng() % n : 0; };///< Between 0 and n-1
+
+	ISSSettings *set;				///< Settings, for the numbers of modules and channels
+	std::string name_cal_file;		///< Calibration file
+	std::string name_react_file;	///< Reaction file
+	std::string work_dir;			///< Where the temporary files go
+
+	unsigned long long seed;		///< seed of the inputs
+	double min_time;				///< seconds to run each kernel for
+	std::string filter;				///< only run kernels with this in their name
+
+	std::mt19937_64 rng;			///< raw random numbers
+	std::vector<int> counter_fd;	///< file descriptors of the hardware counters, leader first
+	std::vector<result_t> results;	///< everything that has been measured
+
+};
+
+#endif
@@ -31,3 +31,7 @@ int StartMonitor(){
 	return 0;
 }
 
+int ReloadCal(){
+	reload_calibration();
+	return 0;
+}
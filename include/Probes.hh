@@ -0,0 +1,56 @@
+#ifndef __PROBES_HH
+#define __PROBES_HH
+
+/*! \file Probes.hh
+* \brief Static tracepoints at the stage and block boundaries
+*
+* Each ISS_PROBE is a USDT (SystemTap/DTrace) probe in the "iss" provider,
+* which is a single nop in the code until a tracer attaches to it, so they
+* cost nothing in a normal sort. With them, the latency of a running job can
+* be measured without restarting it, i.e.
+*
+*     bpftrace -e 'usdt:./bin/iss_sort:iss:block_end { @hits = hist(arg1 + arg2); }' -p PID
+*
+* They are only compiled in on Linux when <sys/sdt.h> is installed (i.e. the
+* systemtap-sdt-dev or systemtap-sdt-devel package), and can be left out with
+* -DISS_NO_PROBES. Otherwise they are empty.
+*
+* Probes and their arguments:
+* - block_start: block number
+* - block_end: block number, ASIC hits, CAEN hits
+* - sort_start: unsorted hits
+* - sort_index: hits in the time-ordered index, after it is built
+* - sort_progress: hits sorted so far, hits in the index
+* - sort_end: hits sorted
+* - event_open: timestamp of the first hit
+* - event_close: hits in the window, length of the window in ns, filled or not
+* - region_entry: ISSTiming region, i.e. 5 for ISSEventBuilder::ArrayFinder
+* - region_exit: ISSTiming region
+* - fill_batch: events histogrammed so far, events in the tree
+* - monitor_cycle_start: cycle number
+* - monitor_cycle_end: cycle number, events built
+*/
+
+#if defined(LINUX) && !defined(__CLING__) && !defined(ISS_NO_PROBES) && defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define ISS_PROBES_ENABLED
+# endif
+#endif
+
+#ifdef ISS_PROBES_ENABLED
+# define ISS_PROBE(name) STAP_PROBE(iss, name)
+# define ISS_PROBE1(name,a) STAP_PROBE1(iss, name, a)
+# define ISS_PROBE2(name,a,b) STAP_PROBE2(iss, name, a, b)
+# define ISS_PROBE3(name,a,b,c) STAP_PROBE3(iss, name, a, b, c)
+# define ISS_PROBE4(name,a,b,c,d) STAP_PROBE4(iss, name, a, b, c, d)
+#else
+// The arguments are never worked out, but still count as used
+# define ISS_PROBE(name) do {} while(0)
+# define ISS_PROBE1(name,a) do { (void)sizeof(a); } while(0)
+# define ISS_PROBE2(name,a,b) do { (void)sizeof(a); (void)sizeof(b); } while(0)
+# define ISS_PROBE3(name,a,b,c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while(0)
+# define ISS_PROBE4(name,a,b,c,d) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); (void)sizeof(d); } while(0)
+#endif
+
+#endif
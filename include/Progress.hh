@@ -0,0 +1,43 @@
+#ifndef __PROGRESS_HH
+#define __PROGRESS_HH
+
+#include <string>
+#include <atomic>
+#include <mutex>
+
+/*! \brief Progress of a job that runs in the background
+*
+* The converter, event builder, histogrammer and autocalibrator update the
+* position as they go and check whether the job has been cancelled, but they
+* never touch the GUI themselves. The GUI polls the position and label from a
+* timer on its own thread and updates the progress bars.
+*
+*/
+class ISSProgress {
+
+public:
+
+	ISSProgress();///< Constructor
+	virtual ~ISSProgress(){};///< Destructor
+
+	inline void SetPosition( float p ){ percent.store( p, std::memory_order_relaxed ); };///< Percent complete, called from the worker
+	inline float GetPosition(){ return percent.load( std::memory_order_relaxed ); };///< Percent complete, called from the GUI
+
+	void SetLabel( std::string mylabel );///< Text for the progress bar, can be a format with the percentage
+	bool GetLabel( std::string &mylabel );///< Copies the label, returns false if it hasn't changed since the last call
+
+	inline void Cancel(){ cancel.store( true ); };///< Ask the worker to stop
+	inline bool IsCancelled(){ return cancel.load( std::memory_order_relaxed ); };///< The worker should stop as soon as it can
+	void Reset();///< Ready for the next job
+
+private:
+
+	std::atomic<float> percent;		///< percentage complete
+	std::atomic<bool> cancel;		///< the job has been cancelled
+	std::mutex label_mutex;			///< protects the label
+	std::string label;				///< text shown on the progress bar
+	bool label_changed;				///< label is new since the GUI last read it
+
+};
+
+#endif
@@ -181,7 +181,7 @@ public:
 	
 	// This is the function called event-by-event
 	void	MakeReaction( TVector3 vec, double en );///< Called event-by-event for transfer reactions
-	void	SimulateReaction( TVector3 vec, double ex );///< Currently an empty function
+	float	SimulateReaction( TVector3 vec, double ex );///< Detected energy at a point on the array for a given excitation energy
 	float	SimulateDecay( TVector3 vec, double en );///< Called during the autocalibration process with alphas
 
 	// Getters
@@ -281,6 +281,8 @@ public:
 	// It's a source only measurement
 	inline void SourceOnly(){ flag_source = true; };///< Flags the measurement as source only
 
+	// The Monte Carlo copies the kinematics, geometry and stopping powers
+	friend class ISSSimulation;
 	
 private:
 
@@ -0,0 +1,110 @@
+#ifndef __REORDERBUFFER_HH
+#define __REORDERBUFFER_HH
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "TTree.h"
+#include "TNamed.h"
+#include "TList.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Calibration header
+#ifndef __CALIBRATION_HH
+# include "Calibration.hh"
+#endif
+
+// Data packets header
+#ifndef __DATAPACKETS_hh
+# include "DataPackets.hh"
+#endif
+
+/*! \brief Adds the time offsets to hits sorted by their raw timestamps
+*
+* The converter sorts the hits by the timestamps from the DAQ, without the
+* time offsets of the calibration, so that new offsets only need the events
+* to be built again. The offsets are added here, as the hits are read.
+*
+* Adding a different offset to each channel can move a hit past its
+* neighbours, but never by more than the span of the offsets, so the order is
+* fixed with a small heap rather than sorting again. After a hit with raw time
+* T, nothing later can be earlier than T plus the smallest offset, so every
+* hit up to then is final and can be popped. The heap only ever holds the hits
+* of one span, i.e. a few hundred for offsets of a few microseconds.
+*
+* Hits with the same time keep the order they were pushed in, and the popped
+* hits are recycled, so there are no allocations once it is running.
+*
+*/
+class ISSReorderBuffer {
+
+public:
+
+	ISSReorderBuffer( ISSSettings *myset );///< Constructor
+	virtual ~ISSReorderBuffer(){};///< Destructor
+
+	void SetCalibration( ISSCalibration *mycal );///< Take the time offsets from a calibration, nullptr for none
+	void Reset();///< Forget all of the hits, i.e. for a new file
+
+	void Push( ISSDataPackets *hit, unsigned long long entry );///< Add a copy of a hit in raw time order, with its offset
+	std::unique_ptr<ISSDataPackets> Pop( unsigned long long &time, unsigned long long &entry );///< Next hit that nothing can come before, nullptr if there isn't one yet
+	void Recycle( std::unique_ptr<ISSDataPackets> hit );///< Give a popped hit back to be reused
+	inline void Finish(){ flag_finish = true; };///< No more hits, so they can all be popped
+
+	void SetSkip( unsigned long long time, unsigned long long entry );///< Drop the hits up to this one, which were popped before a restart
+	unsigned long long GetOldestEntry( unsigned long long entry );///< First entry still in the buffer, or entry if there are none
+
+	inline long GetSpan(){ return max_offset - min_offset; };///< Largest distance a hit can move in ns
+	inline size_t GetSize(){ return heap.size(); };///< Hits in the buffer
+	inline size_t GetMaxSize(){ return max_size; };///< Most hits that were in the buffer at once
+
+	static void MarkRawTimes( TTree *t );///< Record that the timestamps of a sorted tree don't have the offsets
+	static bool HasRawTimes( TTree *t );///< The timestamps of a sorted tree don't have the offsets
+
+private:
+
+	/// Hit waiting in the heap
+	struct item_t {
+		long long time;						///< time with the offset in ns
+		unsigned long long entry;			///< order it was pushed in
+		std::unique_ptr<ISSDataPackets> hit;	///< copy of the hit
+	};
+
+	/// Earliest hit at the front of the heap
+	static inline bool Later( const item_t &a, const item_t &b ){
+		return a.time > b.time || ( a.time == b.time && a.entry > b.entry );
+	};
+
+	long GetOffset( ISSDataPackets *hit );///< Offset of the channel of a hit
+	static long long GetRawTime( ISSDataPackets *hit );///< Time of a hit, without copying it
+
+	ISSSettings *set;		///< Settings, for the numbers of channels and the CAEN timing signals
+
+	// Offsets of every channel
+	std::vector<std::vector<long>> asic_offset;	///< offset of each ASIC
+	std::vector<std::vector<long>> caen_offset;	///< offset of each CAEN channel
+	std::vector<std::vector<long>> info_offset;	///< offset of the CAEN timing signals, codes 20 to 24
+	long min_offset;		///< smallest offset, including zero for the ASIC info data
+	long max_offset;		///< largest offset, including zero for the ASIC info data
+
+	// Hits
+	std::vector<item_t> heap;								///< hits that could still be overtaken
+	std::vector<std::unique_ptr<ISSDataPackets>> spare;		///< popped hits for reuse
+	long long newest;			///< latest raw time pushed
+	bool flag_finish;			///< no more hits will be pushed
+	size_t max_size;			///< most hits in the heap
+
+	// Restarts
+	bool flag_skip;				///< drop the hits that were already popped
+	long long skip_time;		///< time of the last hit popped before the restart
+	unsigned long long skip_entry;	///< entry of the last hit popped before the restart
+
+};
+
+#endif
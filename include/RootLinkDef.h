@@ -15,6 +15,7 @@
 #pragma link C++ class ISSElumEvt+;
 #pragma link C++ class ISSZeroDegreeEvt+;
 #pragma link C++ class ISSGammaRayEvt+;
+#pragma link C++ class ISSCompactEvts+;
 #pragma link C++ class ISSDataPackets+;
 #pragma link C++ class ISSAsicData+;
 #pragma link C++ class ISSCaenData+;
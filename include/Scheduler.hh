@@ -0,0 +1,139 @@
+#ifndef __SCHEDULER_HH
+#define __SCHEDULER_HH
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <map>
+
+#include "TSystem.h"
+
+#include "MemoryBudget.hh"
+#include "Metrics.hh"
+
+/*! \brief A single task in the processing pipeline
+*
+* Each task is one stage (conversion, event building, histogramming, autocal)
+* for one run, or for all runs together. It holds the function to execute,
+* the tasks it depends on and the resources it needs while running.
+*
+*/
+struct ISSTask {
+
+	/// States of a task during the batch
+	enum state_t {
+		kWaiting,	///< not yet started
+		kRunning,	///< currently being processed
+		kDone,		///< finished successfully
+		kFailed,	///< failed after all retries
+		kSkipped	///< not run because a dependency failed
+	};
+
+	std::string name;					///< unique name of the task, i.e. "build run_1_events.root"
+	std::function<bool()> func;			///< work to do, returns true on success
+	std::vector<unsigned int> deps;		///< indices of the tasks that have to finish first
+	bool soft_deps;						///< run once dependencies have finished, even if some failed
+	float cpu;							///< number of cores kept busy by the task
+	double mem;							///< estimated peak memory use in bytes
+	float io;							///< fraction of the disk bandwidth used by the task
+	int priority;						///< higher priority tasks are started first when ready
+	state_t state;						///< current state of the task
+	unsigned int attempts;				///< number of times the task has been started
+	double wall_time;					///< time taken by the last attempt in seconds
+	double peak_rss;					///< peak resident memory of the process during the last attempt
+
+};
+
+/*! \brief Dependency-aware scheduler for the batch processing
+*
+* Runs a graph of ISSTask objects on a pool of threads. A task is started as
+* soon as all of its dependencies are complete and it fits in the remaining
+* CPU, memory and I/O resources, so that different stages of different runs
+* overlap. Failed tasks are retried, and tasks depending on a failed task are
+* skipped. Completed tasks are recorded in a journal file so that a batch that
+* was interrupted can be restarted from the last completed task.
+*
+*/
+class ISSScheduler {
+
+public:
+
+	ISSScheduler( unsigned int myncpu, double mymem = 0 );///< Constructor
+	virtual ~ISSScheduler(){};///< Destructor
+
+	unsigned int AddTask( std::string name, std::function<bool()> func,
+						  std::vector<unsigned int> deps = {},
+						  float cpu = 1, double mem = 0, float io = 0,
+						  int priority = 0, bool soft_deps = false );///< Add a task to the graph and return its index
+
+	bool Run();///< Execute all tasks, returns true if none of them failed
+	void PrintSummary();///< Print the state and timing of every task
+
+	inline void SetRetries( unsigned int n ){ retries = n; };///< Number of times a failed task is tried again
+	inline void SetIOCapacity( float io ){ max_io = io; };///< Disk bandwidth shared by the tasks, zero or less is no limit
+	inline void SetJournal( std::string filename ){ journal_name = filename; };///< File to record completed tasks for restarting a batch
+	void AddMetrics( std::shared_ptr<ISSMetrics> mymetrics );///< Publish the queue depths and task times for the dashboards
+
+	inline unsigned int GetNumberOfTasks(){ return tasks.size(); };///< Getter for the number of tasks
+	inline ISSTask::state_t GetState( unsigned int i ){
+		if( i < tasks.size() ) return tasks.at(i).state;
+		else return ISSTask::kSkipped;
+	};///< Getter for the state of a particular task
+
+
+private:
+
+	bool IsReady( unsigned int i );///< All dependencies are finished (or done for hard dependencies)
+	bool DependencyFailed( unsigned int i );///< A hard dependency failed or was skipped
+	bool DependenciesDone( unsigned int i );///< Every dependency finished successfully
+	bool FitsResources( unsigned int i );///< There are enough free resources to start the task
+	void Execute( unsigned int i );///< Run a task, called on the worker thread
+	void ReadJournal();///< Mark tasks completed in a previous batch as done
+	void WriteJournal( unsigned int i );///< Record a completed task
+	void UpdateMetrics( unsigned int nready );///< Set the gauges of running and queued tasks
+	static std::string GetStage( std::string name );///< First word of a task name, i.e. "build"
+
+	std::vector<ISSTask> tasks;	///< All tasks in the graph
+
+	// Resources
+	unsigned int ncpu;	///< Number of cores available to the tasks
+	double max_mem;		///< Memory budget in bytes, zero or less is no limit
+	float max_io;		///< Disk bandwidth, 1 = ten conversions at once, zero or less is no limit
+	float cpu_used;		///< Cores used by the running tasks
+	double mem_used;	///< Memory used by the running tasks
+	float io_used;		///< Disk bandwidth used by the running tasks
+	unsigned int nrunning;	///< Number of running tasks
+
+	// Retries and journal
+	unsigned int retries;		///< Number of retries for a failed task
+	std::string journal_name;	///< Journal file name, empty for no journal
+	std::ofstream journal_file;	///< Journal file opened during Run()
+
+	// Progress
+	unsigned int nfinished;	///< Number of tasks that have finished (done, failed or skipped)
+	unsigned int nreturned;	///< Number of task attempts that have returned
+
+	// Metrics
+	std::shared_ptr<ISSMetrics> metrics;	///< Counters and gauges shared with the rest of the sort, if any
+	ISSMetrics::gauge_t *met_running;		///< Tasks running now
+	ISSMetrics::gauge_t *met_ready;			///< Tasks ready but waiting for resources
+	ISSMetrics::gauge_t *met_waiting;		///< Tasks waiting for their dependencies or resources
+	ISSMetrics::gauge_t *met_finished;		///< Tasks done, failed or skipped
+
+	// Threading
+	std::mutex sched_mtx;				///< Protects the task states and resources
+	std::condition_variable sched_cv;	///< Wakes the dispatcher when a task finishes
+
+};
+
+#endif
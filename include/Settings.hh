@@ -4,6 +4,8 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <map>
 
 #include "TSystem.h"
 #include "TEnv.h"
@@ -97,6 +99,48 @@ public:
 	inline double GetZeroDegreeHitWindow(){ return zd_hit_window; }
 	inline double GetGammaRayHitWindow(){ return gamma_hit_window; }
 
+	// Compact events
+	inline bool GetCompactEvents(){ return flag_compact; };
+	inline double GetCompactArrayStep(){ return compact_array_step; };
+	inline double GetCompactRecoilStep(){ return compact_recoil_step; };
+	inline double GetCompactElumStep(){ return compact_elum_step; };
+	inline double GetCompactZeroDegreeStep(){ return compact_zd_step; };
+	inline double GetCompactGammaRayStep(){ return compact_gamma_step; };
+	inline unsigned int GetCompactTimeStep(){ return compact_time_step; };
+
+	// Compression of the output of each stage: Convert, Build or Hist
+	inline std::string GetCompression( std::string stage ){
+		if( compression.count( stage ) ) return compression[stage];
+		else return "default";
+	};
+	inline int GetCompressionLevel( std::string stage ){
+		if( compression_level.count( stage ) ) return compression_level[stage];
+		else return 0;
+	};
+	inline int GetBasketSize( std::string stage ){
+		if( basket_size.count( stage ) ) return basket_size[stage];
+		else return 0;
+	};
+	inline double GetAutoFlush( std::string stage ){
+		if( auto_flush.count( stage ) ) return auto_flush[stage];
+		else return 0;
+	};
+
+	// Reading ahead in chains of files
+	inline unsigned int GetPrefetchFiles(){ return prefetch_files; };
+	inline double GetPrefetchMemory(){ return prefetch_memory; };
+
+	// Write conditions
+	inline unsigned int GetNumberOfWriteConditions(){ return write_cond.size(); };
+	inline std::string GetWriteCondition( unsigned int i ){
+		if( i < write_cond.size() ) return write_cond[i];
+		else return "";
+	};
+	inline unsigned int GetWritePrescale( unsigned int i ){
+		if( i < write_prescale.size() ) return write_prescale[i];
+		else return 1;
+	};
+
 	
 	// Data settings
 	inline unsigned int GetBlockSize(){ return block_size; };
@@ -200,6 +244,29 @@ private:
 	double zd_hit_window;			///< Time window in ns for correlating ZeroDegree E-dE hits
 	double gamma_hit_window;		///< Time window in ns for correlating Gamma-Gamma hits (addback?)
 
+	// Compact events
+	bool flag_compact;				///< Write the events as ISSCompactEvts
+	double compact_array_step;		///< Energy step of the array in keV, with 16 bits
+	double compact_recoil_step;		///< Energy step of the recoil detector, with 16 bits
+	double compact_elum_step;		///< Energy step of the ELUM detector, with 16 bits
+	double compact_zd_step;			///< Energy step of the ZeroDegree detector, with 16 bits
+	double compact_gamma_step;		///< Energy step of the gamma-ray detectors, with 16 bits
+	unsigned int compact_time_step;	///< Time step in ns
+
+	// Compression, for each stage
+	std::map<std::string,std::string> compression;	///< Algorithm: default, none, zlib, lzma, lz4, zstd or auto
+	std::map<std::string,int> compression_level;	///< Level of the algorithm, 0 = the usual one for it
+	std::map<std::string,int> basket_size;			///< Basket size of the trees in bytes, 0 = default
+	std::map<std::string,double> auto_flush;		///< Cluster size of the trees in MB, 0 = from the memory budget
+
+	// Prefetch
+	unsigned int prefetch_files;	///< Files of a chain to read ahead, 0 = none
+	double prefetch_memory;			///< Most MB read ahead at once
+
+	// Write conditions
+	std::vector<std::string> write_cond;		///< Expressions that select the events to write, none = all of them
+	std::vector<unsigned int> write_prescale;	///< Write only one in this many of the events of each condition
+
 	
 	// Data format
 	unsigned int block_size;		///< not yet implemented, needs C++ style reading of data files
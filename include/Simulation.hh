@@ -0,0 +1,151 @@
+#ifndef __SIMULATION_HH
+#define __SIMULATION_HH
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#include "TFile.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "TGraph.h"
+#include "TMath.h"
+#include "TVector3.h"
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Reaction header
+#ifndef __REACTION_HH__
+# include "Reaction.hh"
+#endif
+
+/*! \brief Monte Carlo of the reaction in the array, for acceptances and response functions
+*
+* For each excitation energy of the recoil, reactions are made at a random
+* depth in the target, with the ejectile emitted isotropically in the centre
+* of mass. The ejectile loses energy on its way out of the target, then
+* follows its helix in the field until it crosses the hexagon of the array on
+* its way back towards the axis. If that is on the active part of a wafer, it
+* loses energy in the dead layer,
+* has the pulse height deficit applied and is counted as detected.
+*
+* The kinematics and geometry are the same as ISSReaction and ISSArrayEvt,
+* but everything is copied into lookup tables when the simulation is made, so
+* the threads never share any state. The events are made in chunks, and every
+* chunk has its own random number stream seeded from the seed, the level and
+* the chunk number, so the results don't depend on the number of threads.
+*
+* The output file has, for every level, the centre-of-mass angles of all
+* events and of the detected ones, the acceptance (the ratio of the two), the
+* response in energy vs. z and z vs. angle, and the kinematic line from
+* ISSReaction::SimulateReaction to overlay on the data.
+*
+*/
+class ISSSimulation {
+
+public:
+
+	ISSSimulation( ISSReaction *myreact, ISSSettings *myset );///< Constructor
+	virtual ~ISSSimulation(){};///< Destructor
+
+	inline void AddLevel( double ex ){ levels.push_back( ex ); };///< Excitation energy in keV to simulate
+	inline void SetEvents( unsigned long n ){ nevents = n; };///< Number of events for each level
+	inline void SetThreads( unsigned int n ){ nthreads = n > 0 ? n : 1; };///< Number of threads
+	inline void SetSeed( unsigned long long s ){ seed = s; };///< Seed of the random numbers
+	inline void SetResolution( double fwhm ){ sigma = fwhm / 2.35482; };///< Energy resolution of the array (FWHM) in keV
+
+	bool Run( std::string filename );///< Simulate every level and write the histograms to a file
+
+private:
+
+	/// Linear interpolation on a uniform grid, safe to use from any thread
+	struct table_t {
+		double xmin;				///< first point
+		double inv_step;			///< points per unit of x
+		std::vector<double> y;		///< values at the points
+		double Eval( double x ) const;///< Value at x, the end values outside of the range
+	};
+
+	/// Histograms of one level, one set for each thread
+	struct hists_t {
+		std::unique_ptr<TH1D> thetacm_gen;	///< centre-of-mass angle of every event
+		std::unique_ptr<TH1D> thetacm_det;	///< centre-of-mass angle of detected events
+		std::unique_ptr<TH2F> E_vs_z;		///< detected energy vs. z
+		std::unique_ptr<TH2F> z_vs_thetacm;	///< z vs. centre-of-mass angle of detected events
+		unsigned long ndet;					///< detected events
+	};
+
+	/// Random numbers of one chunk, from the raw generator so they are the same everywhere
+	struct stream_t {
+		std::mt19937_64 rng;			///< raw random numbers
+		inline double Uniform(){ return ( rng() >> 11 ) * ( 1.0 / 9007199254740992.0 ); };///< Between 0 and 1
+		inline double Gauss(){
+			double u1 = 1.0 - Uniform();
+			double u2 = Uniform();
+			return std::sqrt( -2.0 * std::log( u1 ) ) * std::cos( TMath::TwoPi() * u2 );
+		};///< Normal distribution, by Box-Muller
+	};
+
+	void MakeTable( table_t &t, TGraph *g, unsigned int n );///< Tabulate a TGraph over its range
+	double EnergyAfter( const table_t &t, double en, double dist ) const;///< Energy after a distance through a material
+	void MakeHists( hists_t &h, unsigned int level );///< Histograms of a level, not in any directory
+	void Generate( unsigned int level, unsigned long chunk, hists_t &h );///< Events of one chunk
+	bool Transport( double px, double py, double pz, double &z_hit, double &cos_inc );///< Follow the helix to the array
+
+	ISSReaction *react;		///< Reaction, for the kinematic lines
+	ISSSettings *set;		///< Settings
+
+	// Parameters of the simulation
+	std::vector<double> levels;		///< excitation energies in keV
+	unsigned long nevents;			///< events for each level
+	unsigned int nthreads;			///< threads to use
+	unsigned long long seed;		///< seed of the random numbers
+	double sigma;					///< energy resolution in keV
+
+	// Copy of the reaction
+	double m_beam;			///< beam mass in keV/c^2
+	double m_target;		///< target mass in keV/c^2
+	double m_ejectile;		///< ejectile mass in keV/c^2
+	double m_recoil;		///< recoil mass in its ground state in keV/c^2
+	double e_beam;			///< beam energy at the front of the target in keV
+	double e_beam_mid;		///< beam energy at the centre of the target in keV
+	double thickness;		///< target thickness in mg/cm^2
+	double deadlayer;		///< dead layer of the array in mm of Si
+	double qb;				///< charge times field of the ejectile in keV/c per mm
+	double turn;			///< 1 if phi gets smaller as the ejectile turns in the field, -1 if it gets bigger
+	double x_offset;		///< target offset from the array axis in mm
+	double y_offset;		///< target offset from the array axis in mm
+	double z0;				///< distance from the target to the array in mm
+	bool stopping;			///< energy losses are known
+	bool phd;				///< pulse height deficit is known
+
+	table_t dedx_beam;		///< stopping power of the beam in the target
+	table_t dedx_target;	///< stopping power of the ejectile in the target
+	table_t dedx_si;		///< stopping power of the ejectile in silicon
+	table_t phd_curve;		///< detected energy for the energy after the dead layer
+
+	// Binning of the output
+	double zmin;			///< lower edge of the z axis in mm
+	double zmax;			///< upper edge of the z axis in mm
+
+	// Array geometry, as in ISSArrayEvt
+	static constexpr double kApothem = 27.5;		///< distance from the axis to the silicon in mm
+	static constexpr double kActiveWidth = 11.0;	///< half width of the n-side strips on a face in mm
+	static constexpr double kWaferPitch = 125.5;	///< wafer length and the gap between wafers in mm
+	static constexpr double kEdge = 1.508;			///< wafer edge to the active region in mm
+	static constexpr double kActiveLength = 121.984;	///< length of the 128 p-side strips in mm
+	static const unsigned long kChunk = 65536;		///< events with the same random number stream
+
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef __TIMEALIGNER_HH
+#define __TIMEALIGNER_HH
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <complex>
+#include <cmath>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1.h"
+#include "TMath.h"
+
+// Progress header
+#ifndef __PROGRESS_HH
+# include "Progress.hh"
+#endif
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Calibration header
+#ifndef __CALIBRATION_HH
+# include "Calibration.hh"
+#endif
+
+// Data packets header
+#ifndef __DATAPACKETS_hh
+# include "DataPackets.hh"
+#endif
+
+// Reorder buffer header
+#ifndef __REORDERBUFFER_HH
+# include "ReorderBuffer.hh"
+#endif
+
+/*! \brief Finds the time offsets of every ASIC and CAEN channel against a reference
+*
+* In one pass over the time-sorted hits of the converted files, the time
+* difference between each hit and every reference hit within the window is
+* filled into a coarse histogram for its ASIC or CAEN channel. The reference
+* can be the CAEN pulser (the default), a CAEN channel, i.e. a recoil E
+* detector, or an ASIC of the array.
+*
+* The peak of each histogram is found by cross-correlating it with a Gaussian
+* of the expected time resolution, using an FFT. This is the matched filter for
+* a peak on the flat background of random coincidences, so it still finds small
+* peaks and doesn't need a fit. The position is interpolated between bins with a
+* parabola, then the offset of the channel is moved by that much and the spread
+* of the peak around it (after subtracting the background) is the residual.
+*
+* __Things to bear in mind__
+* - The offsets of the calibration given are added to the raw timestamps as
+*   the hits are read, so the new offsets are relative to that calibration.
+*   Build the events again with the new file (-e) to use them. Files converted
+*   before the raw timestamps were kept already have the offsets they were
+*   sorted with, and need to be converted again with the new file (-f).
+* - The offset of the reference itself isn't changed.
+* - Channels with too few counts in the peak keep their old offsets.
+*/
+class ISSTimeAligner {
+
+public:
+
+	ISSTimeAligner( ISSSettings *myset, ISSCalibration *mycal );///< Constructor
+	virtual ~ISSTimeAligner(){};///< Destructor
+
+	bool SetReference( std::string ref );///< "pulser", "caen_<mod>_<ch>" or "asic_<mod>_<asic>"
+	inline void SetWindow( double w ){ window = w; };///< Half width of the time differences in ns
+	inline void SetResolution( double r ){ resolution = r; };///< Expected width of the peaks (sigma) in ns
+	inline void SetMinimumCounts( double n ){ min_counts = n; };///< Fewest counts in a peak to move the offset
+
+	inline void AddProgress( std::shared_ptr<ISSProgress> myprog ){
+		prog = myprog;
+		_prog_ = true;
+	};///< Adds the progress of a GUI job, which can also cancel it
+
+	void MakeHists();///< Make the time-difference histograms, before any files are added
+	unsigned long AddFile( std::string input_file_name );///< Fill the histograms from the sorted tree of a converted file
+	void Align();///< Find the peaks and the new offsets
+	void SaveCalFile( std::string name_results_file );///< Write the calibration with the new offsets
+	void SaveHists( std::string name_output_file );///< Write the histograms and the summary
+
+private:
+
+	/// Hit in the window, waiting to be paired with later hits
+	struct hit_t {
+		long long time;		///< time in ns
+		int index;			///< histogram of the channel, -1 for the reference
+	};
+
+	/// Result of one channel
+	struct result_t {
+		bool aligned;		///< the peak was found and the offset moved
+		double shift;		///< position of the peak in ns
+		double counts;		///< counts in the peak above the background
+		double spread;		///< standard deviation of the peak in ns
+		long offset;		///< new offset in ns
+	};
+
+	unsigned long PairHit( ISSDataPackets *hit );///< Fill the time differences of a hit with the ones in the window
+	int GetIndex( ISSDataPackets *hit );///< Histogram of a hit, -1 for the reference, -2 if it isn't used
+	void FindPeak( TH1F *h, result_t &res );///< Cross-correlate with the resolution and measure the peak
+	static void FFT( std::vector<std::complex<double>> &x, bool inverse );///< In place radix-2 FFT
+
+	// Settings file
+	ISSSettings *set;			///< Pointer to the settings object
+
+	// Calibration
+	ISSCalibration *cal;		///< Calibration the files were sorted with, gets the new offsets
+
+	// Progress bar
+	bool _prog_;							///< True if the GUI is being used
+	std::shared_ptr<ISSProgress> prog;	///< Progress of this stage, shown by the GUI
+
+	// Reference
+	std::string ref_name;		///< name of the reference for printing
+	bool ref_pulser;			///< reference is the CAEN pulser info data
+	bool ref_caen;				///< reference is a CAEN channel, otherwise an ASIC
+	unsigned int ref_mod;		///< module of the reference
+	unsigned int ref_ch;		///< CAEN channel or ASIC of the reference
+
+	// Options
+	double window;				///< half width of the time differences in ns
+	double resolution;			///< sigma of the peaks in ns
+	double min_counts;			///< fewest counts in a peak to move the offset
+
+	// Histograms, ASICs first then the CAEN channels
+	std::vector<TH1F*> tdiff;		///< time difference to the reference for each channel
+	std::vector<result_t> results;	///< peak of each channel
+	unsigned int n_asic;			///< number of ASIC histograms
+	static const unsigned int kBins = 2048;	///< bins of each histogram, a power of 2 for the FFT
+
+	// Hits still in the window
+	std::deque<hit_t> recent;		///< hits in time order, newer than the window
+
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef __TIMING_HH
+#define __TIMING_HH
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include "TDirectory.h"
+#include "TH1.h"
+
+// Probes header
+#ifndef __PROBES_HH
+# include "Probes.hh"
+#endif
+
+// Read the time stamp counter of the CPU where we can, it's much
+// cheaper than asking the system for the time
+#if ( defined(__x86_64__) || defined(__i386__) ) && !defined(__CLING__)
+# include <x86intrin.h>
+# define ISS_TIMING_TSC
+#endif
+
+/*! \brief Time spent in each part of the sort
+*
+* Each stage (converter, event builder, histogrammer) has one of these and
+* adds the time taken by its main functions to a fixed list of regions,
+* using an ISSTimingScope at the start of each one. Every task works on its
+* own stage objects, so each thread has its own accumulators and nothing
+* needs to be locked. Some regions are inside others, i.e. MakeReaction is
+* part of FillArray, which is part of FillEvent, so they don't add up to
+* the total.
+*
+* It is switched off by default, when a scope costs a couple of branches.
+* When it is on, the CPU time stamp counter is read at the start and end of
+* each scope, and converted to seconds at the end of the run by comparing it to
+* the system clock over the same period.
+*
+* Every scope also has a region_entry and region_exit probe (see Probes.hh),
+* so the regions can be traced in a running job even with the timing off.
+*
+*/
+class ISSTiming {
+
+public:
+
+	/// Regions of the code that are timed
+	enum region_t {
+		kBlock,			///< ISSConverter::ProcessBlockData
+		kAsic,			///< ISSConverter::ProcessASICData
+		kCaen,			///< ISSConverter::ProcessCAENData
+		kInfo,			///< ISSConverter::ProcessInfoData
+		kSort,			///< ISSConverter::SortTree
+		kArrayFinder,	///< ISSEventBuilder::ArrayFinder
+		kRecoilFinder,	///< ISSEventBuilder::RecoilFinder
+		kMwpcFinder,	///< ISSEventBuilder::MwpcFinder
+		kElumFinder,	///< ISSEventBuilder::ElumFinder
+		kZeroDegreeFinder,	///< ISSEventBuilder::ZeroDegreeFinder
+		kGammaRayFinder,	///< ISSEventBuilder::GammaRayFinder
+		kFillEvent,		///< ISSHistogrammer::FillEvent
+		kReaction,		///< ISSReaction::MakeReaction, called from the histogrammer
+		kFillArray,		///< array histograms
+		kFillElum,		///< ELUM histograms
+		kFillRecoil,	///< recoil histograms
+		kNumberOfRegions
+	};
+
+	ISSTiming(){ enabled = false; Reset(); };///< Constructor
+	virtual ~ISSTiming(){};///< Destructor
+
+	inline void Enable( bool e = true ){ enabled = e; Reset(); };///< Switch the timing on and start again from zero
+	inline bool IsEnabled() const { return enabled; };///< Is the timing switched on?
+	void Reset();///< Zero all of the regions
+
+	/// Current value of the clock, in ticks
+	inline static unsigned long long Now(){
+#ifdef ISS_TIMING_TSC
+		return __rdtsc();
+#else
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	};
+
+	/// Add one call of a region that took a number of ticks
+	inline void Add( region_t r, unsigned long long ticks ){
+		ticks_sum[r] += ticks;
+		ncalls[r]++;
+	};
+
+	static std::string GetName( region_t r );///< Name of a region for printing
+	double GetSeconds( region_t r ) const;///< Total time spent in a region
+	inline unsigned long long GetCalls( region_t r ) const { return ncalls[r]; };///< Number of times a region was entered
+
+	void Print( std::string title ) const;///< Table of the regions that were used, most time first
+	void Write( TDirectory *dir ) const;///< Store the times and calls as histograms in a file
+
+private:
+
+	double GetTickRate() const;///< Ticks per second between the reset and now
+
+	bool enabled;	///< only time things if this is true
+
+	unsigned long long ticks_sum[kNumberOfRegions];	///< total ticks in each region
+	unsigned long long ncalls[kNumberOfRegions];		///< number of calls of each region
+
+	unsigned long long tick_start;	///< clock ticks at the reset
+	std::chrono::steady_clock::time_point time_start;	///< system time at the reset
+
+};
+
+/*! \brief Adds the time until it goes out of scope, or Stop() is called, to a region
+*/
+class ISSTimingScope {
+
+public:
+
+	/// Start timing a region, if the timing is switched on
+	inline ISSTimingScope( ISSTiming &mytiming, ISSTiming::region_t myregion ) :
+		timing( mytiming ), region( myregion ) {
+		ISS_PROBE1( region_entry, (int)region );
+		open = true;
+		running = timing.IsEnabled();
+		if( running ) start = ISSTiming::Now();
+	};
+
+	inline ~ISSTimingScope(){ Stop(); };///< Destructor, stops the timing
+
+	/// Stop before the end of the scope
+	inline void Stop(){
+		if( !open ) return;
+		open = false;
+		ISS_PROBE1( region_exit, (int)region );
+		if( !running ) return;
+		timing.Add( region, ISSTiming::Now() - start );
+		running = false;
+	};
+
+private:
+
+	ISSTiming &timing;				///< where the time is added
+	ISSTiming::region_t region;	///< which region it's added to
+	unsigned long long start;		///< clock ticks at the start
+	bool running;					///< timing has started and not yet stopped
+	bool open;						///< region has been entered and not yet left, for the probes
+
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef __WATCHER_HH
+#define __WATCHER_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <ctime>
+
+#include "TSystem.h"
+#include "TRegexp.h"
+#include "TString.h"
+
+#ifdef LINUX
+# include <sys/inotify.h>
+# include <poll.h>
+# include <unistd.h>
+#endif
+
+/*! \brief Watches a data directory for completed run files
+*
+* Used by the nearline mode of iss_sort. The directory is watched with inotify
+* on Linux, or scanned periodically elsewhere. A run file is considered to be
+* complete once it has not grown for a given number of seconds, or as soon as
+* a marker file with the same name plus ".closed" appears next to it.
+*
+*/
+class ISSWatcher {
+
+public:
+
+	ISSWatcher( std::string mydir, std::string mypattern = "*", int mysettle = 60 );///< Constructor
+	virtual ~ISSWatcher();///< Destructor
+
+	bool Open();///< Start watching the directory, returns false if it can't be read
+	void Close();///< Stop watching the directory
+	std::vector<std::string> Poll( int timeout_ms );///< Wait for changes and return the full path of newly completed run files
+
+	inline std::string GetDirectory(){ return dir; };///< Getter for the watched directory
+
+
+private:
+
+	bool IsRunFile( std::string name );///< Checks the name matches the pattern and isn't one of our outputs
+	void Scan();///< List the directory to find new or changed files
+	void Touch( std::string name );///< Mark a file as new or changed
+
+	/// Files that are still being written
+	struct candidate {
+		long long size;		///< last size seen in bytes
+		time_t last_change;	///< time the size last changed
+		bool closed;		///< a marker file says it is complete
+	};
+
+	std::string dir;		///< directory to watch
+	std::string pattern;	///< wildcard pattern for the run file names
+	int settle;				///< seconds without growth before a file is complete
+
+	std::map<std::string,candidate> candidates;	///< files not yet complete
+	std::set<std::string> completed;			///< files already reported as complete
+
+	int fd;		///< inotify file descriptor, -1 when not used
+	int wd;		///< inotify watch descriptor
+
+};
+
+#endif
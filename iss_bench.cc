@@ -0,0 +1,92 @@
+// ============================================================================================= //
+/*! \file iss_bench.cc
+* Runs the whole sort on generated inputs and samples of real data, with several numbers of
+* threads, to measure the speed, memory and I/O of each stage. The results can be saved and
+* used as the baseline of a later run, which then fails if anything has become slower.
+*/
+// ============================================================================================= //
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TROOT.h"
+
+#include "Settings.hh"
+#include "Benchmark.hh"
+#include "CommandLineInterface.hh"
+
+int main( int argc, char *argv[] ){
+
+	// Default options
+	std::vector<std::string> input_names;
+	std::vector<int> sizes;
+	std::vector<int> threads;
+	std::string name_set_file = "dummy";
+	std::string name_cal_file = "dummy";
+	std::string name_react_file = "dummy";
+	std::string work_dir = "iss_bench";
+	std::string output_name = "iss_bench.txt";
+	std::string baseline_name;
+	int repeat = 1;
+	long long seed = 1;
+	double threshold = 0.1;
+	double rss_threshold = 0.2;
+	bool help_flag = false;
+
+	// Command line interface
+	CommandLineInterface *interface = new CommandLineInterface();
+
+	interface->Add("-i", "Samples of real data to run (MIDAS files)", &input_names );
+	interface->Add("-sizes", "Sizes of the generated inputs in blocks (default 500)", &sizes );
+	interface->Add("-threads", "Numbers of threads to run (default 1)", &threads );
+	interface->Add("-repeat", "Runs of each test, keeping the fastest (default 1)", &repeat );
+	interface->Add("-seed", "Seed of the generated inputs (default 1)", &seed );
+	interface->Add("-dir", "Directory for the inputs and outputs (default iss_bench)", &work_dir );
+	interface->Add("-s", "Settings file", &name_set_file );
+	interface->Add("-c", "Calibration file", &name_cal_file );
+	interface->Add("-r", "Reaction file", &name_react_file );
+	interface->Add("-o", "File for the results (default iss_bench.txt)", &output_name );
+	interface->Add("-baseline", "Results of an earlier run to compare with", &baseline_name );
+	interface->Add("-threshold", "Fraction slower than the baseline that is a regression (default 0.1)", &threshold );
+	interface->Add("-rssthreshold", "Fraction more memory than the baseline that is a regression (default 0.2)", &rss_threshold );
+	interface->Add("-h", "Print this help", &help_flag );
+
+	interface->CheckFlags( argc, argv );
+	if( help_flag ) {
+
+		interface->CheckFlags( 1, argv );
+		return 0;
+
+	}
+
+	// Only generated data if nothing else is asked for
+	if( !sizes.size() && !input_names.size() ) sizes.push_back( 500 );
+	if( !threads.size() ) threads.push_back( 1 );
+
+	for( unsigned int i = 0; i < threads.size(); ++i )
+		if( threads[i] > 1 ) ROOT::EnableThreadSafety();
+
+	ISSSettings *myset = new ISSSettings( name_set_file );
+
+	ISSBenchmark bench( myset, name_cal_file, name_react_file );
+	bench.SetThreads( threads );
+	bench.SetRepeat( repeat > 0 ? repeat : 1 );
+	bench.SetSeed( seed );
+	bench.SetWorkDir( work_dir );
+	for( unsigned int i = 0; i < sizes.size(); ++i )
+		if( sizes[i] > 0 ) bench.AddSynthetic( sizes[i] );
+	for( unsigned int i = 0; i < input_names.size(); ++i )
+		bench.AddInput( input_names[i] );
+
+	bool success = bench.Run();
+	bench.Print();
+	if( output_name.size() ) bench.Save( output_name );
+	if( !success ) return 1;
+
+	// Any regression is a failure, so this can be used in a test script
+	if( baseline_name.size() && bench.Compare( baseline_name, threshold, rss_threshold ) != 0 )
+		return 1;
+
+	return 0;
+
+}
@@ -0,0 +1,86 @@
+// ============================================================================================= //
+/*! \file iss_gen.cc
+* Writes MIDAS files of made up data, with a controlled size, rate and mix of hits, for testing
+* the converter and event builder at scale without real runs. The same seed always gives the
+* same file, so the output can be used as the input of benchmarks and regression tests.
+*/
+// ============================================================================================= //
+#include <iostream>
+#include <string>
+
+#include "Settings.hh"
+#include "Generator.hh"
+#include "CommandLineInterface.hh"
+
+int main( int argc, char *argv[] ){
+
+	// Default options
+	std::string output_name = "iss_gen.dat";
+	std::string name_set_file = "dummy";
+	int nblocks = 1000;
+	long long seed = 1;
+	long long start_time = 0;
+	double array_rate = 2e4;
+	double singles_rate = 5e4;
+	double recoil_rate = 5e3;
+	int trace_length = 0;
+	double pulser_rate = 10;
+	double ebis_rate = 2.5;
+	double t1_period = 1.2;
+	double ooo_fraction = 0;
+	double ooo_delay = 1e4;
+	double corrupt_words = 0;
+	double corrupt_blocks = 0;
+	bool help_flag = false;
+
+	// Command line interface
+	CommandLineInterface *interface = new CommandLineInterface();
+
+	interface->Add("-o", "Output MIDAS file (default iss_gen.dat)", &output_name );
+	interface->Add("-s", "Settings file", &name_set_file );
+	interface->Add("-n", "Number of 64 kB blocks to write (default 1000)", &nblocks );
+	interface->Add("-seed", "Seed of the random numbers (default 1)", &seed );
+	interface->Add("-start", "Timestamp of the first hit in ns, i.e. just before a rollover (default 0)", &start_time );
+	interface->Add("-array", "Rate of p/n array events in Hz (default 2e4)", &array_rate );
+	interface->Add("-singles", "Rate of uncorrelated ASIC hits in Hz (default 5e4)", &singles_rate );
+	interface->Add("-recoil", "Rate of dE/E recoil events in Hz (default 5e3)", &recoil_rate );
+	interface->Add("-trace", "Number of samples in each CAEN trace (default 0)", &trace_length );
+	interface->Add("-pulser", "Rate of the pulser in Hz (default 10)", &pulser_rate );
+	interface->Add("-ebis", "Rate of the EBIS signal in Hz (default 2.5)", &ebis_rate );
+	interface->Add("-t1", "Time between proton pulses in s (default 1.2)", &t1_period );
+	interface->Add("-late", "Fraction of hits written out of order (default 0)", &ooo_fraction );
+	interface->Add("-latetime", "Largest delay of a hit written out of order in ns (default 1e4)", &ooo_delay );
+	interface->Add("-badwords", "Fraction of hits with a corrupted word (default 0)", &corrupt_words );
+	interface->Add("-badblocks", "Fraction of blocks with a broken header (default 0)", &corrupt_blocks );
+	interface->Add("-h", "Print this help", &help_flag );
+
+	interface->CheckFlags( argc, argv );
+	if( help_flag ) {
+
+		interface->CheckFlags( 1, argv );
+		return 0;
+
+	}
+
+	// The same settings as the sort, for the modules and special channels
+	ISSSettings *myset = new ISSSettings( name_set_file );
+
+	ISSGenerator gen( myset );
+	gen.SetSeed( seed );
+	gen.SetStartTime( start_time );
+	gen.SetArrayRate( array_rate );
+	gen.SetSinglesRate( singles_rate );
+	gen.SetRecoilRate( recoil_rate );
+	gen.SetTraceLength( trace_length > 0 ? trace_length : 0 );
+	gen.SetPulserRate( pulser_rate );
+	gen.SetEBISRate( ebis_rate );
+	gen.SetT1Period( t1_period );
+	gen.SetOutOfOrder( ooo_fraction, ooo_delay );
+	gen.SetCorruptWords( corrupt_words );
+	gen.SetCorruptBlocks( corrupt_blocks );
+
+	if( !gen.Generate( output_name, nblocks > 0 ? nblocks : 0 ) ) return 1;
+
+	return 0;
+
+}
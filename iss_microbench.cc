@@ -0,0 +1,66 @@
+// ============================================================================================= //
+/*! \file iss_microbench.cc
+* Times the functions that the sort spends most of its time in, one at a time, on inputs that
+* are made up from a seed, so it runs anywhere without data. Each one gets the time per call,
+* the throughput and, where the kernel allows it, the hardware counters per call.
+*/
+// ============================================================================================= //
+#include <iostream>
+#include <string>
+
+#include "Settings.hh"
+#include "MicroBenchmark.hh"
+#include "CommandLineInterface.hh"
+
+int main( int argc, char *argv[] ){
+
+	// Default options
+	std::string name_set_file = "dummy";
+	std::string name_cal_file = "dummy";
+	std::string name_react_file = "dummy";
+	std::string output_name;
+	std::string filter;
+	long long seed = 1;
+	double min_time = 0.2;
+	bool help_flag = false;
+
+	// Command line interface
+	CommandLineInterface *interface = new CommandLineInterface();
+
+	interface->Add("-s", "Settings file", &name_set_file );
+	interface->Add("-c", "Calibration file", &name_cal_file );
+	interface->Add("-r", "Reaction file", &name_react_file );
+	interface->Add("-k", "Only run the kernels with this in their name, i.e. ISSConverter", &filter );
+	interface->Add("-time", "Seconds to run each kernel for (default 0.2)", &min_time );
+	interface->Add("-seed", "Seed of the inputs (default 1)", &seed );
+	interface->Add("-o", "File for the results", &output_name );
+	interface->Add("-h", "Print this help", &help_flag );
+
+	interface->CheckFlags( argc, argv );
+	if( help_flag ) {
+
+		interface->CheckFlags( 1, argv );
+		return 0;
+
+	}
+
+	ISSSettings *myset = new ISSSettings( name_set_file );
+
+	ISSMicroBenchmark bench( myset, name_cal_file, name_react_file );
+	bench.SetSeed( seed );
+	bench.SetMinTime( min_time > 0 ? min_time : 0.2 );
+	bench.SetFilter( filter );
+
+	if( !bench.Run() ) {
+
+		std::cerr << "No kernels were run" << std::endl;
+		return 1;
+
+	}
+
+	bench.Print();
+	if( output_name.size() && !bench.Save( output_name ) ) return 1;
+
+	return 0;
+
+}
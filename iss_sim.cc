@@ -0,0 +1,84 @@
+// ============================================================================================= //
+/*! \file iss_sim.cc
+* Monte Carlo of the reaction file in the array, giving the acceptance in centre-of-mass angle
+* and the response in energy vs. z for each excitation energy, with the kinematic lines to
+* compare with the data. Events are shared out over all of the cores and the same seed always
+* gives the same histograms, however many threads are used.
+*/
+// ============================================================================================= //
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "TROOT.h"
+
+#include "Settings.hh"
+#include "Reaction.hh"
+#include "Simulation.hh"
+#include "CommandLineInterface.hh"
+
+int main( int argc, char *argv[] ){
+
+	// Default options
+	std::string output_name = "iss_sim.root";
+	std::string name_set_file = "dummy";
+	std::string name_react_file = "dummy";
+	std::vector<double> levels;
+	long long nevents = 1000000;
+	int nthreads = std::thread::hardware_concurrency();
+	long long seed = 1;
+	double fwhm = 0;
+	bool help_flag = false;
+
+	// Command line interface
+	CommandLineInterface *interface = new CommandLineInterface();
+
+	interface->Add("-o", "Output ROOT file (default iss_sim.root)", &output_name );
+	interface->Add("-s", "Settings file", &name_set_file );
+	interface->Add("-r", "Reaction file", &name_react_file );
+	interface->Add("-ex", "Excitation energies of the recoil in keV (default 0)", &levels );
+	interface->Add("-n", "Number of events for each excitation energy (default 1000000)", &nevents );
+	interface->Add("-threads", "Number of threads (default all cores)", &nthreads );
+	interface->Add("-seed", "Seed of the random numbers (default 1)", &seed );
+	interface->Add("-fwhm", "Energy resolution of the array (FWHM) in keV (default 0)", &fwhm );
+	interface->Add("-h", "Print this help", &help_flag );
+
+	interface->CheckFlags( argc, argv );
+	if( help_flag ) {
+
+		interface->CheckFlags( 1, argv );
+		return 0;
+
+	}
+
+	if( name_react_file == "dummy" ) {
+
+		std::cout << "A reaction file is needed for the simulation, use -r" << std::endl;
+		return 1;
+
+	}
+
+	if( levels.size() == 0 ) levels.push_back( 0.0 );
+	if( nthreads < 1 ) nthreads = 1;
+
+	// The threads only fill their own histograms, which aren't in a directory
+	if( nthreads > 1 ) ROOT::EnableThreadSafety();
+
+	// The same settings and reaction as the sort
+	ISSSettings *myset = new ISSSettings( name_set_file );
+	ISSReaction *myreact = new ISSReaction( name_react_file, myset, false );
+
+	ISSSimulation sim( myreact, myset );
+	for( unsigned int i = 0; i < levels.size(); ++i )
+		sim.AddLevel( levels[i] );
+	sim.SetEvents( nevents > 0 ? nevents : 0 );
+	sim.SetThreads( nthreads );
+	sim.SetSeed( seed );
+	sim.SetResolution( fwhm > 0 ? fwhm : 0 );
+
+	if( !sim.Run( output_name ) ) return 1;
+
+	return 0;
+
+}
@@ -14,13 +14,21 @@
 // My code include.
 #include "Settings.hh"
 #include "Calibration.hh"
+#include "CalibrationStore.hh"
 #include "Converter.hh"
 #include "EventBuilder.hh"
 #include "Reaction.hh"
 #include "Histogrammer.hh"
 #include "AutoCalibrator.hh"
+#include "TimeAligner.hh"
 #include "ISSGUI.hh"
 #include "DataSpy.hh"
+#include "Scheduler.hh"
+#include "Watcher.hh"
+#include "Manifest.hh"
+#include "Catalog.hh"
+#include "Metrics.hh"
+#include "Probes.hh"
 
 #include "iss_sort.hh"
 
@@ -33,11 +41,17 @@ std::string name_react_file;
 std::string name_autocal_file;
 std::vector<std::string> input_names;
 
+// Time alignment of the channels
+std::string time_ref = "pulser";	// CAEN pulser, caen_<mod>_<ch> or asic_<mod>_<asic>
+float time_window = 1e4;		// half width of the time differences in ns
+float time_res = 50;			// expected width of the peaks in ns
+
 // a flag at the input to force or not the conversion
 bool flag_convert = false;
 bool flag_events = false;
 bool flag_source = false;
 bool flag_autocal = false;
+bool flag_timealign = false;
 
 // select what steps of the analysis to be forced
 std::vector<bool> force_convert;
@@ -64,10 +78,50 @@ ISSSettings *myset;
 // Calibration file
 ISSCalibration *mycal;
 bool overwrite_cal = false;
+std::shared_ptr<ISSCalibrationStore> calstore;	// versions of the calibration for the monitor
 
 // Reaction file
 ISSReaction *myreact;
 
+// Parallel processing of files
+int nworkers = 1;		// number of tasks run at the same time
+float mem_budget = 0;	// memory budget in GB shared by the tasks, 0 = no limit
+int nretry = 1;			// number of times a failed task is tried again
+float io_capacity = 1;	// disk bandwidth, 1 = ten conversions at once, 0 = no limit
+
+// Nearline mode, watching the data directory
+std::string watch_dir;				// directory to watch for new run files
+std::string watch_pattern = "*";	// wildcard pattern for run file names
+int settle_time = 60;				// seconds without growth before a run file is complete
+std::vector<std::string> nearline_hist_files;	// histogram files of every run seen, for the merged file
+
+// Fused mode, passing hits and events between the stages in memory
+bool flag_fused = false;		// convert, build and histogram each run in one pass
+bool flag_keep_sort = false;	// still write the time-sorted tree in fused mode
+bool flag_keep_events = false;	// still write the event tree in fused mode
+
+// Checkpoints, so long conversions and builds can carry on after a crash
+int checkpoint_time = 600;		// seconds between checkpoints, 0 = never
+
+// Shards, splitting large runs into block ranges that are converted in parallel
+int nshards = 1;				// maximum number of shards per run, 1 = no splitting
+int shard_overlap = 20;			// blocks decoded before each shard to recover the timestamps
+const unsigned long shard_min_blocks = 1000;	// smallest shard, ~65 MB
+
+// Catalog of the runs, their statistics and the outputs of each stage
+std::string name_catalog_file;	// default is iss_catalog.txt in the data directory
+bool flag_list = false;			// print the catalog and stop
+ISSCatalog *catalog = nullptr;
+
+// Timing of each part of each stage
+bool flag_timing = false;		// print the timing and store it in the output files
+bool flag_memory = false;		// print the memory used by each kind of object
+
+// Metrics of the throughput, rates and queues for the dashboards
+std::string name_metrics_file;	// default is iss_metrics/metrics.txt in monitor mode
+int metrics_time = 10;			// seconds between writing the metrics in batch mode
+std::shared_ptr<ISSMetrics> metrics;
+
 // Struct for passing to the thread
 typedef struct thptr {
 	
@@ -106,6 +160,10 @@ void start_monitor(){
 	bRunMon = kTRUE;
 }
 
+void reload_calibration(){
+	if( calstore ) calstore->Reload();
+}
+
 // Function to call the monitoring loop
 void* monitor_run( void* ptr ){
 	
@@ -141,15 +199,33 @@ void* monitor_run( void* ptr ){
 	int start_block = 0;
 	int nblocks = 0;
 	unsigned long nbuild = 0;
+	unsigned long ncycle = 0;
 
 	// Converter setup
 	if( !flag_spy ) curFileMon = input_names.at(0); // maybe change in GUI later?
 	if( flag_source ) conv_mon->SourceOnly();
-	conv_mon->AddCalibration( calfiles->mycal );
+	conv_mon->AddCalibration( calstore );
+	eb_mon->AddCalibration( calstore );
 	conv_mon->SetOutput( "monitor_singles.root" );
 	conv_mon->MakeTree();
 	conv_mon->MakeHists();
 	
+	// Counters for the dashboards, scraped from the web server
+	ISSMetrics::counter_t *met_dropped = nullptr;
+	ISSMetrics::gauge_t *met_cycle = nullptr;
+	ISSMetrics::gauge_t *met_calver = nullptr;
+	if( metrics ) {
+		
+		conv_mon->AddMetrics( metrics );
+		eb_mon->AddMetrics( metrics );
+		hist_mon->AddMetrics( metrics );
+		met_dropped = metrics->AddCounter( "iss_spy_blocks_dropped_total", "DataSpy blocks that were missed or not read" );
+		met_cycle = metrics->AddGauge( "iss_monitor_cycle_seconds", "Time taken by the last monitor cycle, without the wait" );
+		met_calver = metrics->AddGauge( "iss_calibration_version", "Latest version of the calibration, incremented each time it is reloaded" );
+		
+	}
+	int spy_seq = 0, spy_last_seq = -1;
+	
 	// Update server settings
 	// title of web page
 	std::string toptitle;
@@ -167,6 +243,8 @@ void* monitor_run( void* ptr ){
 			
 			// Lock the main thread
 			//TThread::Lock();
+			auto t_cycle = std::chrono::steady_clock::now();
+			ISS_PROBE1( monitor_cycle_start, ncycle );
 			
 			// Convert - from file
 			if( !flag_spy ) {
@@ -181,7 +259,7 @@ void* monitor_run( void* ptr ){
 				
 				// First check if we have data
 				std::cout << "Looking for data from DataSpy" << std::endl;
-				spy_length = myspy.Read( file_id, (char*)buffer, calfiles->myset->GetBlockSize() );
+				spy_length = myspy.ReadWithSeq( file_id, (char*)buffer, calfiles->myset->GetBlockSize(), &spy_seq );
 				if( spy_length == 0 && bFirstRun ) {
 					std::cout << "No data yet on first pass" << std::endl;
 					gSystem->Sleep( 2e3 );
@@ -190,7 +268,12 @@ void* monitor_run( void* ptr ){
 				
 				// Keep reading until we have all the data
 				int block_ctr = 0;
-				while( spy_length ){
+				while( spy_length > 0 ){
+					
+					// Gaps in the sequence are blocks that were overwritten before we got to them
+					if( spy_last_seq >= 0 && spy_seq > spy_last_seq + 1 )
+						ISSMetrics::Add( met_dropped, spy_seq - spy_last_seq - 1 );
+					spy_last_seq = spy_seq;
 					
 					std::cout << "Got some data from DataSpy, block " << block_ctr << std::endl;
 					nblocks = conv_mon->ConvertBlock( (char*)buffer, 0 );
@@ -201,9 +284,10 @@ void* monitor_run( void* ptr ){
 					
 					// Read a new block
 					//gSystem->Sleep( 10 ); // wait 10 ms
-					spy_length = myspy.Read( file_id, (char*)buffer, calfiles->myset->GetBlockSize() );
+					spy_length = myspy.ReadWithSeq( file_id, (char*)buffer, calfiles->myset->GetBlockSize(), &spy_seq );
 					
 				}
+				conv_mon->UpdateMetrics();
 				
 				// Sort the packets we just got, then do the rest of the analysis
 				conv_mon->SortTree();
@@ -245,6 +329,18 @@ void* monitor_run( void* ptr ){
 				
 			}
 			
+			// Publish the metrics for this cycle
+			if( metrics ) {
+				
+				ISSMetrics::Set( met_cycle, std::chrono::duration<double>( std::chrono::steady_clock::now() - t_cycle ).count() );
+				ISSMetrics::Set( met_calver, calstore->GetVersion() );
+				metrics->Save();
+				
+			}
+			
+			ISS_PROBE2( monitor_cycle_end, ncycle, nbuild );
+			ncycle++;
+			
 			// This makes things unresponsive!
 			// Unless we are threading?
 			gSystem->Sleep( mon_time * 1e3 );
@@ -289,6 +385,7 @@ void start_http(){
 	serv->RegisterCommand("/ResetSingles", "ResetConv()");
 	serv->RegisterCommand("/ResetEvents", "ResetEvnt()");
 	serv->RegisterCommand("/ResetHists", "ResetHist()");
+	serv->RegisterCommand("/ReloadCal", "ReloadCal()");
 
 	// hide commands so the only show as buttons
 	//serv->Hide("/Start");
@@ -298,171 +395,615 @@ void start_http(){
 	// Add data directory
 	if( datadir_name.size() > 0 ) serv->AddLocation( "data/", datadir_name.data() );
 	
+	// Metrics for Prometheus, i.e. http://localhost:8030/metrics/metrics.txt
+	if( metrics ) {
+		
+		std::string metrics_dir = gSystem->GetDirName( metrics->GetFile().data() ).Data();
+		gSystem->mkdir( metrics_dir.data(), true );
+		serv->AddLocation( "metrics/", metrics_dir.data() );
+		
+	}
+	
 	return;
 	
 }
 
-void do_convert(){
+// Get the size of a file on disk in bytes, zero if it can't be opened
+double get_file_size( std::string name ){
 	
-	//------------------------//
-	// Run conversion to ROOT //
-	//------------------------//
-	ISSConverter conv( myset );
-	conv.AddCalibration( mycal );
-	if( flag_source ) conv.SourceOnly();
-	std::cout << "\n +++ ISS Analysis:: processing Converter +++" << std::endl;
+	std::ifstream ftest( name.data(), std::ios::in|std::ios::binary|std::ios::ate );
+	if( !ftest.is_open() ) return 0;
+	
+	double size = ftest.tellg();
+	ftest.close();
+	
+	return size;
+	
+}
 
-	TFile *rtest;
-	std::ifstream ftest;
-	std::string name_input_file;
-	std::string name_output_file;
+// What goes into converting a run, compared to the manifest in the output file
+ISSManifest convert_manifest( std::string name_input_file ){
 	
-	// Check each file
-	for( unsigned int i = 0; i < input_names.size(); i++ ){
-			
-		name_input_file = input_names.at(i);
-		if( flag_source ) name_output_file = input_names.at(i) + "_source.root";
-		else name_output_file = input_names.at(i) + ".root";
+	ISSManifest manifest;
+	manifest.AddValue( "stage", flag_source ? "convert source" : "convert" );
+	manifest.AddValue( "version", ISS_CONVERT_VERSION );
+	manifest.AddData( "input", name_input_file );
+	manifest.AddFile( "settings", name_set_file );
+	
+	// Time offsets are added by the event builder, so they don't need a new conversion
+	manifest.AddFile( "calibration", name_cal_file, ".Time:", false );
+	
+	return manifest;
+	
+}
 
-		force_convert.push_back( false );
+// Event building depends on the converted file, through its manifest
+ISSManifest build_manifest( std::string name_input_file ){
+	
+	ISSManifest manifest;
+	manifest.AddValue( "stage", "build" );
+	manifest.AddValue( "version", ISS_BUILD_VERSION );
+	
+	// The catalog has the digest if the converted file hasn't changed since,
+	// otherwise it has to be read from the file itself
+	std::string name_conv_file = name_input_file + ".root";
+	std::string digest;
+	if( catalog && catalog->Get( name_input_file, "convert.digest", digest ) &&
+	    catalog->UpToDate( name_input_file, "convert", name_conv_file, digest ) )
+		manifest.AddValue( "convert", digest );
+	
+	else {
+		
+		ISSManifest convert;
+		convert.Read( name_conv_file );
+		manifest.AddManifest( "convert", convert );
+		
+	}
+	
+	manifest.AddFile( "settings", name_set_file );
+	if( overwrite_cal ) manifest.AddFile( "calibration", name_cal_file );
+	else manifest.AddFile( "calibration", name_cal_file, ".Time:", true );
+	
+	return manifest;
+	
+}
 
-		// If input doesn't exist, skip it
-		ftest.open( name_input_file.data() );
-		if( !ftest.is_open() ) {
+// Histograms depend on the event files from every run and the reaction
+ISSManifest hist_manifest( std::vector<std::string> name_input_files ){
+	
+	ISSManifest manifest;
+	manifest.AddValue( "stage", "hist" );
+	manifest.AddValue( "version", ISS_HIST_VERSION );
+	manifest.AddFile( "settings", name_set_file );
+	manifest.AddFile( "reaction", name_react_file );
+	
+	for( unsigned int i = 0; i < name_input_files.size(); i++ ){
+		
+		// From the catalog if we can, see build_manifest()
+		std::string name_evts_file = name_input_files.at(i) + "_events.root";
+		std::string digest;
+		if( catalog && catalog->Get( name_input_files.at(i), "build.digest", digest ) &&
+		    catalog->UpToDate( name_input_files.at(i), "build", name_evts_file, digest ) ) {
 			
-			std::cerr << name_input_file << " does not exist" << std::endl;
+			manifest.AddValue( "build " + name_input_files.at(i), digest );
 			continue;
 			
 		}
-		else ftest.close();
 		
-		// If output doesn't exist, we have to convert it anyway
-		// The convert flag will force it to be converted
-		ftest.open( name_output_file.data() );
-		if( !ftest.is_open() ) force_convert.at(i) = true;
-		else {
+		ISSManifest build;
+		build.Read( name_evts_file );
+		manifest.AddManifest( "build " + name_input_files.at(i), build );
+		
+	}
+	
+	return manifest;
+	
+}
+
+// The fused mode does everything from the run file in one go
+ISSManifest fused_manifest( std::string name_input_file ){
+	
+	ISSManifest manifest;
+	manifest.AddValue( "stage", "fused" );
+	manifest.AddValue( "build version", ISS_BUILD_VERSION );
+	manifest.AddValue( "hist version", ISS_HIST_VERSION );
+	manifest.AddManifest( "convert", convert_manifest( name_input_file ) );
+	manifest.AddFile( "settings", name_set_file );
+	if( overwrite_cal ) manifest.AddFile( "calibration", name_cal_file );
+	else manifest.AddFile( "calibration", name_cal_file, ".Time:", true );
+	manifest.AddFile( "reaction", name_react_file );
+	
+	return manifest;
+	
+}
+
+// Is the output of a stage already made with the same inputs?
+// The catalog is checked first, so that the file only has to be opened
+// if it has changed since it was recorded or isn't in the catalog
+bool stage_done( std::string name_run, std::string stage,
+				 std::string name_output_file, const ISSManifest &manifest ){
+	
+	if( catalog && catalog->UpToDate( name_run, stage, name_output_file, manifest.GetDigest() ) )
+		return true;
+	
+	return manifest.UpToDate( name_output_file );
+	
+}
+
+// Record a stage that has finished in the catalog, once its manifest is written
+void catalog_stage( std::string name_run, std::string stage, std::string name_output_file,
+					const ISSManifest &manifest, std::chrono::steady_clock::time_point t_start ){
+	
+	if( !catalog ) return;
+	
+	double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - t_start ).count();
+	catalog->AddRawFile( name_run, ISSConverter::GetBlockSize() );
+	if( stage == "convert" ) catalog->AddConverted( name_run, name_output_file );
+	catalog->AddStage( name_run, stage, name_output_file, manifest.GetDigest(), seconds );
+	catalog->Save();
+	
+	return;
+	
+}
+
+// Memory a task may use for its trees and buffers, from what the scheduler
+// has set aside for it, or zero to use the usual sizes when there's no budget
+double task_memory( double estimate ){
+	
+	if( mem_budget <= 0 ) return 0;
+	return std::min( estimate, mem_budget * 1e9 );
+	
+}
+
+bool convert_file( std::string name_input_file, std::string name_output_file,
+				   std::string tag = "", double mem = 0 ){
+	
+	// Each task has its own calibration, so that the random numbers
+	// don't depend on how the files are shared between workers
+	ISSCalibration jobcal( name_cal_file, myset );
+	
+	ISSConverter conv( myset );
+	conv.AddCalibration( &jobcal );
+	conv.SetMemoryBudget( mem );
+	conv.SetTiming( flag_timing );
+	conv.SetPrintMemory( flag_memory );
+	if( metrics ) conv.AddMetrics( metrics );
+	if( flag_source ) conv.SourceOnly();
+	if( nworkers > 1 ) conv.SetQuiet();
+	
+	// Carry on from the checkpoint of a previous attempt if there is one
+	std::string name_ckpt_file = name_output_file + ".ckpt";
+	conv.SetCheckpoint( name_ckpt_file, checkpoint_time, tag );
+	if( !conv.ResumeOutput( name_output_file ) ) {
+		
+		conv.SetOutput( name_output_file );
+		conv.MakeTree();
+		conv.MakeHists();
+		
+	}
+	bool success = conv.ConvertFile( name_input_file ) >= 0;
+	if( conv.BadHeader() ) success = false;
+	
+	// Sort the tree before writing and closing
+	if( success && !flag_source ) conv.SortTree();
+	conv.CloseOutput();
+	
+	// Finished, one way or the other, so the checkpoint isn't needed
+	ISSCheckpoint( name_ckpt_file ).Remove();
+	
+	// Don't leave a broken file behind that looks converted
+	if( !success ) gSystem->Unlink( name_output_file.data() );
+	
+	return success;
+	
+}
+
+// Convert and time sort one shard of a run, blocks start_block to end_block
+bool convert_shard( std::string name_input_file, std::string name_output_file,
+				    unsigned long start_block, long end_block, double mem = 0 ){
+	
+	// Each task has its own calibration, see convert_file()
+	ISSCalibration jobcal( name_cal_file, myset );
+	
+	ISSConverter conv( myset );
+	conv.AddCalibration( &jobcal );
+	conv.SetQuiet();
+	conv.SetWarmUp( shard_overlap );
+	conv.SetRecordCounters();
+	conv.SetMemoryBudget( mem );
+	conv.SetTiming( flag_timing );
+	conv.SetPrintMemory( flag_memory );
+	if( metrics ) conv.AddMetrics( metrics );
+	
+	conv.SetOutput( name_output_file );
+	conv.MakeTree();
+	conv.MakeHists();
+	bool success = conv.ConvertFile( name_input_file, start_block, end_block ) >= 0;
+	if( conv.BadHeader() ) success = false;
+	if( success ) conv.SortTree();
+	conv.CloseOutput();
+	
+	if( !success ) gSystem->Unlink( name_output_file.data() );
+	
+	return success;
+	
+}
+
+// Put the shards of a run back together as if it was converted in one go.
+// Histograms are added with hadd, then the profiles of time versus hit number
+// are numbered from the start of the run, see ISSConverter::MergeCounters().
+// The time-sorted trees are merged in time order. Equal times are taken from
+// the earlier shard first, which keeps the order of the run file.
+bool merge_shards( std::vector<std::string> name_shard_files, std::string name_output_file ){
+	
+	std::string cmd = "hadd -k -T -v 0 -f " + name_output_file;
+	for( unsigned int i = 0; i < name_shard_files.size(); i++ )
+		cmd += " " + name_shard_files.at(i);
+	if( gSystem->Exec( cmd.data() ) != 0 ) return false;
+	
+	// Open all of the shards
+	std::vector<TFile*> shard_files;
+	std::vector<TTree*> shard_trees;
+	std::vector<ISSDataPackets*> shard_data( name_shard_files.size(), nullptr );
+	std::vector<unsigned long long> shard_entry( name_shard_files.size(), 0 );
+	unsigned long long n_total = 0;
+	bool success = true;
+	
+	for( unsigned int i = 0; i < name_shard_files.size(); i++ ){
+		
+		shard_files.push_back( new TFile( name_shard_files.at(i).data(), "read" ) );
+		shard_trees.push_back( (TTree*)shard_files.back()->Get( "iss_sort" ) );
+		if( shard_files.back()->IsZombie() || !shard_trees.back() ) {
 			
-			ftest.close();
-			rtest = new TFile( name_output_file.data() );
-			if( rtest->IsZombie() ) force_convert.at(i) = true;
-			if( !flag_convert && !force_convert.at(i) )
-				std::cout << name_output_file << " already converted" << std::endl;
-			rtest->Close();
+			std::cerr << "Cannot read " << name_shard_files.at(i) << std::endl;
+			success = false;
+			break;
 			
 		}
-
-		if( flag_convert || force_convert.at(i) ) {
+		
+		shard_trees.back()->SetBranchAddress( "data", &shard_data.at(i) );
+		n_total += shard_trees.back()->GetEntries();
+		
+	}
+	
+	// Same trees as the converter makes, copied from the first shard
+	TFile *output_file = nullptr;
+	TTree *raw_tree = nullptr, *sorted_tree = nullptr;
+	auto write_data = std::make_unique<ISSDataPackets>();
+	ISSDataPackets *write_ptr = write_data.get();
+	if( success ) {
+		
+		output_file = new TFile( name_output_file.data(), "update" );
+		raw_tree = (TTree*)shard_files.at(0)->Get( "iss" );
+		if( raw_tree ) {
+			raw_tree = raw_tree->CloneTree(0);
+			raw_tree->SetDirectory( output_file );
+		}
+		sorted_tree = shard_trees.at(0)->CloneTree(0);
+		sorted_tree->SetDirectory( output_file );
+		ISSReorderBuffer::MarkRawTimes( sorted_tree );
+		sorted_tree->SetBranchAddress( "data", &write_ptr );
+		
+		if( !ISSConverter::MergeCounters( output_file, shard_files ) ) {
 			
-			std::cout << name_input_file << " --> ";
-			std::cout << name_output_file << std::endl;
+			std::cerr << "Merging the hit profiles of " << name_output_file << " failed" << std::endl;
+			success = false;
 			
-			conv.SetOutput( name_output_file );
-			conv.MakeTree();
-			conv.MakeHists();
-			conv.ConvertFile( name_input_file );
+		}
+		
+	}
+	
+	// Take the earliest hit of all the shards each time
+	typedef std::pair<unsigned long,unsigned int> shard_hit;
+	std::priority_queue<shard_hit,std::vector<shard_hit>,std::greater<shard_hit>> next_hits;
+	for( unsigned int i = 0; success && i < shard_trees.size(); i++ ){
+		
+		if( !shard_trees.at(i)->GetEntries() ) continue;
+		shard_trees.at(i)->GetEntry(0);
+		next_hits.push( shard_hit( shard_data.at(i)->GetTime(), i ) );
+		
+	}
+	
+	unsigned long long n_merged = 0;
+	unsigned long time_prev = 0;
+	bool ordered = true;
+	while( success && !next_hits.empty() ) {
+		
+		shard_hit hit = next_hits.top();
+		next_hits.pop();
+		unsigned int j = hit.second;
+		
+		*write_data = *shard_data.at(j);
+		sorted_tree->Fill();
+		if( sorted_tree->MemoryFull(30e6) )
+			sorted_tree->FlushBaskets();
+		
+		if( hit.first < time_prev ) ordered = false;
+		time_prev = hit.first;
+		n_merged++;
+		
+		// Replace it with the next one from the same shard
+		if( (long long)++shard_entry.at(j) < shard_trees.at(j)->GetEntries() ) {
+			
+			shard_trees.at(j)->GetEntry( shard_entry.at(j) );
+			next_hits.push( shard_hit( shard_data.at(j)->GetTime(), j ) );
+			
+		}
+		
+	}
+	
+	// All of the shard hits were written and in time order. This can't see hits that
+	// are lost or doubled at the shard boundaries, make shardtest checks for those
+	if( success && ( n_merged != n_total || !ordered ) ) {
+		
+		std::cerr << "Merging shards of " << name_output_file << " failed: ";
+		std::cerr << n_merged << " of " << n_total << " hits";
+		if( !ordered ) std::cerr << ", not in time order";
+		std::cerr << std::endl;
+		success = false;
+		
+	}
+	
+	if( output_file ) {
+		
+		if( success ) {
+			sorted_tree->FlushBaskets();
+			output_file->Write( 0, TObject::kWriteDelete );
+		}
+		output_file->Close();
+		delete output_file;
+		
+	}
+	
+	for( unsigned int i = 0; i < shard_files.size(); i++ ){
+		
+		shard_files.at(i)->Close();
+		delete shard_files.at(i);
+		
+	}
+	
+	// Shards are only needed until they're merged, but keep them for a retry
+	if( !success ) {
+		
+		gSystem->Unlink( name_output_file.data() );
+		return false;
+		
+	}
+	
+	for( unsigned int i = 0; i < name_shard_files.size(); i++ )
+		gSystem->Unlink( name_shard_files.at(i).data() );
+	
+	std::cout << " Merged " << name_shard_files.size() << " shards into " << name_output_file << std::endl;
+	
+	return success;
+	
+}
+
+int plan_convert( ISSScheduler &sched, unsigned int i, int priority = 0 ){
+	
+	//------------------------//
+	// Run conversion to ROOT //
+	//------------------------//
+	std::ifstream ftest;
+	std::string name_input_file;
+	std::string name_output_file;
+	
+	name_input_file = input_names.at(i);
+	if( flag_source ) name_output_file = input_names.at(i) + "_source.root";
+	else name_output_file = input_names.at(i) + ".root";
+
+	force_convert.push_back( false );
 
-			// Sort the tree before writing and closing
-			if( !flag_source ) conv.SortTree();
-			conv.CloseOutput();
+	// Same file given twice, only convert it once
+	for( unsigned int j = 0; j < i; j++ )
+		if( input_names.at(j) == input_names.at(i) ) return -1;
 
+	// If input doesn't exist, skip it
+	ftest.open( name_input_file.data() );
+	if( !ftest.is_open() ) {
+		
+		std::cerr << name_input_file << " does not exist" << std::endl;
+		return -1;
+		
+	}
+	else ftest.close();
+	
+	// Convert it again if the input, settings or calibration have changed
+	// since the output was made, or if it doesn't exist yet
+	// The convert flag will force it to be converted
+	ISSManifest manifest = convert_manifest( name_input_file );
+	if( !flag_convert && stage_done( name_input_file, "convert", name_output_file, manifest ) ) {
+		
+		std::cout << name_output_file << " already converted" << std::endl;
+		return -1;
+		
+	}
+	force_convert.at(i) = true;
+
+	// The time sorting is done in the same task, on the open trees,
+	// holding up to ~1 GB of baskets for each tree
+	double size = get_file_size( name_input_file );
+	double mem = 5e8 + std::min( size, 2.5e9 );
+	
+	// Large runs are split into shards that are converted on separate
+	// cores and then merged back into one time-sorted file
+	unsigned long nblocks = (unsigned long)( size / ISSConverter::GetBlockSize() );
+	unsigned long nsplit = std::min( (unsigned long)std::max( nshards, 1 ), nblocks / shard_min_blocks );
+	if( nsplit > 1 && !flag_source ) {
+		
+		std::vector<unsigned int> shard_tasks;
+		std::vector<std::string> name_shard_files;
+		for( unsigned long j = 0; j < nsplit; j++ ) {
+			
+			unsigned long start_block = j * nblocks / nsplit;
+			long end_block = ( j + 1 ) * nblocks / nsplit - 1;
+			if( j + 1 == nsplit ) end_block = -1; // to the end, even a partial block
+			
+			std::string name_shard_file = input_names.at(i) + "_shard" + std::to_string(j) + ".root";
+			name_shard_files.push_back( name_shard_file );
+			double mem_shard = 5e8 + std::min( size / nsplit, 2.5e9 );
+			shard_tasks.push_back( sched.AddTask( "convert " + name_shard_file,
+												  [=](){
+													  return convert_shard( name_input_file, name_shard_file,
+																			start_block, end_block,
+																			task_memory( mem_shard ) );
+												  },
+												  {}, 1, mem_shard, 0.1 / nsplit, priority + 1 ) );
+			
 		}
 		
+		// The manifest is only added once the shards are merged, and the
+		// time in the catalog is only for the merge, the shards are separate
+		return sched.AddTask( "merge " + name_output_file,
+							  [=](){
+								  auto t_start = std::chrono::steady_clock::now();
+								  if( !merge_shards( name_shard_files, name_output_file ) ) return false;
+								  if( !manifest.Write( name_output_file ) ) return false;
+								  catalog_stage( name_input_file, "convert", name_output_file, manifest, t_start );
+								  return true;
+							  },
+							  shard_tasks, 1, 5e8, 0.02, priority + 1 );
+		
 	}
 	
-	return;
+	// The manifest is only added once the output is complete
+	return sched.AddTask( "convert " + name_input_file,
+						  [=](){
+							  auto t_start = std::chrono::steady_clock::now();
+							  if( !convert_file( name_input_file, name_output_file,
+												 manifest.GetDigest(), task_memory( mem ) ) ) return false;
+							  if( !manifest.Write( name_output_file ) ) return false;
+							  catalog_stage( name_input_file, "convert", name_output_file, manifest, t_start );
+							  return true;
+						  },
+						  {}, 1, mem, 0.1, priority + 1 );
 	
 }
 
+bool build_file( std::string name_input_file, std::string name_output_file,
+				 std::string tag = "", double mem = 0 ){
+	
+	// Make sure we can read the input before building
+	std::string name_ckpt_file = name_output_file + ".ckpt";
+	TFile *rtest = new TFile( name_input_file.data() );
+	bool zombie = rtest->IsZombie();
+	rtest->Close();
+	delete rtest;
+	if( zombie ) {
+		
+		ISSCheckpoint( name_ckpt_file ).Remove();
+		return false;
+		
+	}
+	
+	// Each task has its own calibration, see convert_file()
+	ISSCalibration jobcal( name_cal_file, myset );
+
+	ISSEventBuilder eb( myset );
+	eb.SetMemoryBudget( mem );
+	eb.SetTiming( flag_timing );
+	eb.SetPrintMemory( flag_memory );
+	if( metrics ) eb.AddMetrics( metrics );
+	if( nworkers > 1 ) eb.SetQuiet();
+
+	// Update calibration file if given
+	if( overwrite_cal ) eb.AddCalibration( &jobcal );
+	else eb.AddTimeOffsets( &jobcal );
+
+	// Carry on from the checkpoint of a previous attempt if there is one
+	eb.SetInputFile( name_input_file );
+	eb.SetCheckpoint( name_ckpt_file, checkpoint_time, tag );
+	if( !eb.ResumeOutput( name_output_file ) )
+		eb.SetOutput( name_output_file );
+	eb.BuildEvents();
+	eb.CloseOutput();
+	
+	ISSCheckpoint( name_ckpt_file ).Remove();
+	
+	return true;
+	
+}
 
-bool do_build(){
+int plan_build( ISSScheduler &sched, unsigned int i, int conv_task, int priority = 0 ){
 	
 	//-----------------------//
 	// Physics event builder //
 	//-----------------------//
-	ISSEventBuilder eb( myset );
-	std::cout << "\n +++ ISS Analysis:: processing EventBuilder +++" << std::endl;
-	
-	TFile *rtest;
 	std::ifstream ftest;
 	std::string name_input_file;
 	std::string name_output_file;
-	bool return_flag = false;
 	
-	// Update calibration file if given
-	if( overwrite_cal ) eb.AddCalibration( mycal );
-
-	// Do event builder for each file individually
-	for( unsigned int i = 0; i < input_names.size(); i++ ){
-			
-		name_input_file = input_names.at(i) + ".root";
-		//name_input_file = input_names.at(i) + "_sort.root";
-		name_output_file = input_names.at(i) + "_events.root";
+	name_input_file = input_names.at(i) + ".root";
+	//name_input_file = input_names.at(i) + "_sort.root";
+	name_output_file = input_names.at(i) + "_events.root";
+	
+	// Same file given twice, only build it once
+	for( unsigned int j = 0; j < i; j++ )
+		if( input_names.at(j) == input_names.at(i) ) return -1;
+
+	// We need to do event builder if we are converting it
+	// specific request to do new event build with -e
+	// this is useful if you need to add a new calibration
+	if( conv_task >= 0 ) force_events = true;
+	
+	// Otherwise check if the input file exists
+	else {
 		
-		// Check if the input file exists
 		ftest.open( name_input_file.data() );
 		if( !ftest.is_open() ) {
 			
 			std::cerr << name_input_file << " does not exist" << std::endl;
-			continue;
-			
-		}
-		else {
-			
-			return_flag = true;
-			ftest.close();
-
-		}
-
-		// We need to do event builder if we just converted it
-		// specific request to do new event build with -e
-		// this is useful if you need to add a new calibration
-		if( flag_convert || force_convert.at(i) || flag_events )
-			force_events = true;
-
-		// If it doesn't exist, we have to sort it anyway
-		else {
-			
-			ftest.open( name_output_file.data() );
-			if( !ftest.is_open() ) force_events = true;
-			else {
-				
-				ftest.close();
-				rtest = new TFile( name_output_file.data() );
-				if( rtest->IsZombie() ) force_events = true;
-				if( !force_events )
-					std::cout << name_output_file << " already built" << std::endl;
-				rtest->Close();
-				
-			}
+			return -1;
 			
 		}
+		else ftest.close();
 		
-		if( force_events ) {
-
-			std::cout << name_input_file << " --> ";
-			std::cout << name_output_file << std::endl;
-
-			eb.SetInputFile( name_input_file );
-			eb.SetOutput( name_output_file );
-			eb.BuildEvents();
-			eb.CloseOutput();
+		if( flag_events ) force_events = true;
 		
-			force_events = false;
-			
-		}
+		// If it doesn't exist or it's out of date, we have to build it anyway
+		else if( !stage_done( input_names.at(i), "build", name_output_file,
+							  build_manifest( input_names.at(i) ) ) )
+			force_events = true;
+		
+		else std::cout << name_output_file << " already built" << std::endl;
 		
 	}
 	
-	return return_flag;
+	if( !force_events ) return -1;
+	force_events = false;
+
+	// Builder loads 500 MB of input baskets plus the output buffers
+	double mem = 5e8 + std::min( get_file_size( name_input_file ), 1e9 );
+	std::vector<unsigned int> deps;
+	if( conv_task >= 0 ) deps.push_back( conv_task );
+	std::string name_run = input_names.at(i);
+
+	// Failed builds shouldn't be left to be histogrammed
+	// and the manifest is made after the conversion is finished
+	return sched.AddTask( "build " + name_output_file,
+						  [=](){
+							  auto t_start = std::chrono::steady_clock::now();
+							  ISSManifest manifest = build_manifest( name_run );
+							  bool success = build_file( name_input_file, name_output_file,
+														 manifest.GetDigest(), task_memory( mem ) );
+							  if( success ) success = manifest.Write( name_output_file );
+							  if( success ) catalog_stage( name_run, "build", name_output_file, manifest, t_start );
+							  if( !success ) gSystem->Unlink( name_output_file.data() );
+							  return success;
+						  },
+						  deps, 1, mem, 0.05, priority + 2 );
 	
 }
 
-void do_hist(){
+bool do_hist(){
 	
 	//------------------------------//
 	// Finally make some histograms //
 	//------------------------------//
 	ISSHistogrammer hist( myreact, myset );
+	hist.SetTiming( flag_timing );
+	hist.SetPrintMemory( flag_memory );
+	if( metrics ) hist.AddMetrics( metrics );
 	std::cout << "\n +++ ISS Analysis:: processing Histogrammer +++" << std::endl;
 
 	std::ifstream ftest;
@@ -489,20 +1030,24 @@ void do_hist(){
 	}
 
 	// Only do something if there are valid files
-	if( name_hist_files.size() ) {
-		
-		hist.SetOutput( output_name );
-		hist.SetInputFile( name_hist_files );
-		hist.FillHists();
-		hist.CloseOutput();
-
-	}
+	if( !name_hist_files.size() ) return false;
 	
-	return;
+	hist.SetOutput( output_name );
+	if( hist.GetFile()->IsZombie() ) return false;
+	hist.SetInputFile( name_hist_files );
+	hist.FillHists();
+	hist.CloseOutput();
+	
+	// Runs are missing, i.e. a build failed, so it isn't up to date with all of them.
+	// The scheduler doesn't journal it either, so it's done again next time.
+	if( name_hist_files.size() != input_names.size() ) return true;
+	
+	// Record which events went into the histograms
+	return hist_manifest( input_names ).Write( output_name );
 	
 }
 
-void do_autocal(){
+bool do_autocal(){
 
 	//-----------------------------------//
 	// Run automatic calibration routine //
@@ -563,10 +1108,464 @@ void do_autocal(){
 	gSystem->Exec( cmd.data() );
 	
 	// Give this file to the autocalibrator
-	if( autocal.SetOutputFile( name_output_file ) ) return;
+	if( autocal.SetOutputFile( name_output_file ) ) return false;
 	autocal.DoFits();
 	autocal.SaveCalFile( name_results_file );
 	
+	return true;
+	
+}
+
+bool do_timealign(){
+
+	//-------------------------------------//
+	// Align the time offsets of channels  //
+	//-------------------------------------//
+	ISSTimeAligner aligner( myset, mycal );
+	if( !aligner.SetReference( time_ref ) ) return false;
+	aligner.SetWindow( time_window );
+	aligner.SetResolution( time_res );
+	aligner.MakeHists();
+
+	std::string name_output_file = "timealign.root";
+	std::string name_results_file = "timealign_results.cal";
+
+	// One pass over each converted file
+	unsigned long n_pairs = 0;
+	for( unsigned int i = 0; i < input_names.size(); i++ )
+		n_pairs += aligner.AddFile( input_names.at(i) + ".root" );
+
+	if( !n_pairs ) {
+
+		std::cout << "No time differences to " << time_ref << " found" << std::endl;
+		return false;
+
+	}
+
+	aligner.Align();
+	aligner.SaveHists( name_output_file );
+	aligner.SaveCalFile( name_results_file );
+
+	std::cout << "New time offsets written to " << name_results_file << std::endl;
+
+	return true;
+
+}
+
+bool hist_file( std::string name_input_file, std::string name_output_file ){
+	
+	// Each task has its own reaction, because MakeReaction isn't thread safe
+	ISSReaction jobreact( name_react_file, myset, flag_source );
+	
+	ISSHistogrammer hist( &jobreact, myset );
+	hist.SetTiming( flag_timing );
+	hist.SetPrintMemory( flag_memory );
+	if( metrics ) hist.AddMetrics( metrics );
+	if( nworkers > 1 ) hist.SetQuiet();
+	
+	hist.SetOutput( name_output_file );
+	hist.SetInputFile( name_input_file );
+	hist.FillHists();
+	hist.CloseOutput();
+	
+	return true;
+	
+}
+
+bool merge_hists( std::vector<std::string> name_hist_files ){
+	
+	// Always start again from the runs, so a run that was histogrammed again
+	// replaces its old histograms instead of being added a second time.
+	// Merge to a temporary file so the merged file is always complete for anyone reading it
+	std::string name_tmp_file = output_name + ".tmp.root";
+	std::string cmd = "hadd -k -T -v 0 -f " + name_tmp_file;
+	
+	// hadd only keeps the first manifest, so make a new one for the merged file
+	ISSManifest manifest;
+	manifest.AddValue( "stage", "merge" );
+	manifest.AddValue( "version", ISS_HIST_VERSION );
+	
+	std::ifstream ftest;
+	unsigned int nfiles = 0;
+	for( unsigned int i = 0; i < name_hist_files.size(); i++ ){
+		
+		ftest.open( name_hist_files.at(i).data() );
+		if( !ftest.is_open() ) continue;
+		ftest.close();
+		cmd += " " + name_hist_files.at(i);
+		nfiles++;
+		
+		ISSManifest run;
+		run.Read( name_hist_files.at(i) );
+		manifest.AddManifest( "hist " + name_hist_files.at(i), run );
+		
+	}
+	
+	if( !nfiles ) return true;
+	if( gSystem->Exec( cmd.data() ) != 0 ) return false;
+	if( !manifest.Write( name_tmp_file ) ) return false;
+	if( gSystem->Rename( name_tmp_file.data(), output_name.data() ) != 0 ) return false;
+
+	std::cout << " Merged " << nfiles << " runs into " << output_name << std::endl;
+	
+	return true;
+	
+}
+
+bool fused_file( std::string name_input_file, std::string name_output_file, double mem = 0 ){
+	
+	// Output files of the intermediate stages
+	std::string name_conv_file = name_input_file + ".root";
+	std::string name_evts_file = name_input_file + "_events.root";
+	
+	// Each task has its own calibration and reaction, see convert_file() and hist_file()
+	ISSCalibration jobcal( name_cal_file, myset );
+	ISSReaction jobreact( name_react_file, myset, flag_source );
+
+	ISSConverter conv( myset );
+	ISSEventBuilder eb( myset );
+	ISSHistogrammer hist( &jobreact, myset );
+	if( nworkers > 1 ) {
+		conv.SetQuiet();
+		eb.SetQuiet();
+		hist.SetQuiet();
+	}
+	
+	conv.SetTiming( flag_timing );
+	conv.SetPrintMemory( flag_memory );
+	if( metrics ) conv.AddMetrics( metrics );
+	eb.SetTiming( flag_timing );
+	eb.SetPrintMemory( flag_memory );
+	if( metrics ) eb.AddMetrics( metrics );
+	hist.SetTiming( flag_timing );
+	hist.SetPrintMemory( flag_memory );
+	if( metrics ) hist.AddMetrics( metrics );
+	
+	// Most of the memory goes to the converter's time sort
+	conv.SetMemoryBudget( 0.7 * mem );
+	eb.SetMemoryBudget( 0.3 * mem );
+	
+	// Converter
+	conv.AddCalibration( &jobcal );
+	conv.SetOutput( name_conv_file );
+	conv.MakeTree();
+	conv.MakeHists();
+	conv.SetWriteSortedTree( flag_keep_sort );
+
+	// Event builder
+	if( overwrite_cal ) eb.AddCalibration( &jobcal );
+	else eb.AddTimeOffsets( &jobcal );
+	eb.SetOutput( name_evts_file );
+	eb.SetWriteTree( flag_keep_events );
+	
+	// Histogrammer
+	hist.SetOutput( name_output_file );
+	
+	// Each time-sorted hit goes to the event builder, and each event to the histograms
+	conv.SetHitCallback( [&]( ISSDataPackets *hit ){ eb.PushHit( hit ); } );
+	eb.SetEventCallback( [&]( ISSEvts *evts ){ hist.PushEvent( evts ); } );
+	
+	eb.StartStream();
+	bool success = conv.ConvertFile( name_input_file ) >= 0;
+	if( conv.BadHeader() ) success = false;
+	if( success ) conv.SortTree();
+	eb.FinishStream();
+	hist.GetFile()->Write();
+	
+	conv.CloseOutput();
+	eb.CloseOutput();
+	hist.CloseOutput();
+	
+	// Kept files get the same manifests as in a normal sort
+	if( success && flag_keep_sort )
+		success = convert_manifest( name_input_file ).Write( name_conv_file );
+	if( success && flag_keep_events )
+		success = build_manifest( name_input_file ).Write( name_evts_file );
+	if( success )
+		success = fused_manifest( name_input_file ).Write( name_output_file );
+	
+	// Intermediate files that weren't kept would look complete to a normal sort
+	if( !success || !flag_keep_sort ) gSystem->Unlink( name_conv_file.data() );
+	if( !success || !flag_keep_events ) gSystem->Unlink( name_evts_file.data() );
+	if( !success ) gSystem->Unlink( name_output_file.data() );
+	
+	return success;
+	
+}
+
+int plan_fused( ISSScheduler &sched, unsigned int i, int priority = 0 ){
+	
+	//----------------------------------------//
+	// Convert, build and histogram in memory //
+	//----------------------------------------//
+	std::ifstream ftest;
+	std::string name_input_file;
+	std::string name_output_file;
+	
+	name_input_file = input_names.at(i);
+	name_output_file = input_names.at(i) + "_fused_hists.root";
+
+	// Same file given twice, only sort it once
+	for( unsigned int j = 0; j < i; j++ )
+		if( input_names.at(j) == input_names.at(i) ) return -1;
+
+	// If input doesn't exist, skip it
+	ftest.open( name_input_file.data() );
+	if( !ftest.is_open() ) {
+		
+		std::cerr << name_input_file << " does not exist" << std::endl;
+		return -1;
+		
+	}
+	else ftest.close();
+	
+	// Nothing to do if this run was already sorted with the same inputs, unless forced
+	if( !flag_convert && !flag_events &&
+	    stage_done( name_input_file, "fused", name_output_file, fused_manifest( name_input_file ) ) ) {
+		
+		std::cout << name_output_file << " already sorted" << std::endl;
+		return -1;
+		
+	}
+	
+	// Converter baskets plus the builder and histograms, all in the one task
+	double mem = 1e9 + std::min( get_file_size( name_input_file ), 2.5e9 );
+
+	return sched.AddTask( "fused " + name_input_file,
+						  [=](){
+							  auto t_start = std::chrono::steady_clock::now();
+							  if( !fused_file( name_input_file, name_output_file, task_memory( mem ) ) ) return false;
+							  catalog_stage( name_input_file, "fused", name_output_file,
+											 fused_manifest( name_input_file ), t_start );
+							  return true;
+						  },
+						  {}, 1, mem, 0.1, priority + 1 );
+	
+}
+
+bool do_pipeline(){
+	
+	//--------------------------------//
+	// Plan and run all of the stages //
+	//--------------------------------//
+	ISSScheduler sched( nworkers, mem_budget * 1e9 );
+	sched.SetRetries( nretry );
+	sched.SetIOCapacity( io_capacity );
+	sched.SetJournal( output_name + ".tasks" );
+	if( metrics ) sched.AddMetrics( metrics );
+
+	std::cout << "\n +++ ISS Analysis:: planning tasks +++" << std::endl;
+
+	std::vector<unsigned int> conv_tasks;
+	std::vector<unsigned int> build_tasks;
+	
+	// Everything for each run in one task, then merge the histograms
+	if( flag_fused && !flag_source && !flag_autocal && !flag_timealign ) {
+		
+		std::vector<unsigned int> fused_tasks;
+		std::vector<std::string> name_hist_files;
+		
+		for( unsigned int i = 0; i < input_names.size(); i++ ){
+			
+			int fused_task = plan_fused( sched, i );
+			if( fused_task >= 0 ) fused_tasks.push_back( fused_task );
+			
+			// Only count each run once
+			std::string name_hist_file = input_names.at(i) + "_fused_hists.root";
+			if( std::find( name_hist_files.begin(), name_hist_files.end(), name_hist_file )
+			   == name_hist_files.end() ) name_hist_files.push_back( name_hist_file );
+			
+		}
+		
+		// Runs sorted before are included, but not the old merged file
+		sched.AddTask( "merge " + output_name,
+					   [=](){ return merge_hists( name_hist_files ); },
+					   fused_tasks, 1, 5e8, 0.2, 3, true );
+		
+	}
+	
+	else {
+		
+		for( unsigned int i = 0; i < input_names.size(); i++ ){
+			
+			int conv_task = plan_convert( sched, i );
+			if( conv_task >= 0 ) conv_tasks.push_back( conv_task );
+			
+			// Source runs don't need building
+			if( flag_source || flag_autocal || flag_timealign ) continue;
+			
+			int build_task = plan_build( sched, i, conv_task );
+			if( build_task >= 0 ) build_tasks.push_back( build_task );
+			
+		}
+		
+	}
+	
+	// The histograms need all the builds to be finished, but not necessarily successful
+	// Nothing to do if no events have changed since the last time
+	if( !flag_fused && !flag_source && !flag_autocal && !flag_timealign ) {
+		
+		if( !build_tasks.size() && !flag_convert && !flag_events &&
+		    hist_manifest( input_names ).UpToDate( output_name ) )
+			std::cout << output_name << " already histogrammed" << std::endl;
+		
+		else sched.AddTask( "hist " + output_name,
+							[](){ return do_hist(); },
+							build_tasks, 1, 1e9, 0.1, 3, true );
+		
+	}
+	
+	// Same for the automatic calibration with the converted files
+	else if( flag_autocal ) {
+		
+		sched.AddTask( "autocal", [](){ return do_autocal(); },
+					   conv_tasks, 1, 1e9, 0.2, 3, true );
+		
+	}
+	
+	// Or the time alignment, which only needs the time-sorted hits
+	else if( flag_timealign ) {
+		
+		sched.AddTask( "timealign", [](){ return do_timealign(); },
+					   conv_tasks, 1, 5e8, 0.2, 3, true );
+		
+	}
+	
+	std::cout << " " << sched.GetNumberOfTasks() << " tasks for ";
+	std::cout << input_names.size() << " files on " << nworkers << " workers";
+	if( mem_budget > 0 ) std::cout << " with a memory budget of " << mem_budget << " GB";
+	std::cout << std::endl << std::endl;
+
+	bool success = sched.Run();
+	if( !success ) sched.PrintSummary();
+	
+	return success;
+	
+}
+
+bool do_nearline( std::vector<std::string> runs ){
+	
+	//-----------------------------------------//
+	// Process a batch of newly completed runs //
+	//-----------------------------------------//
+	ISSScheduler sched( nworkers, mem_budget * 1e9 );
+	sched.SetRetries( nretry );
+	sched.SetIOCapacity( io_capacity );
+	if( metrics ) sched.AddMetrics( metrics );
+
+	// The planning functions work on the list of input files
+	input_names = runs;
+	force_convert.clear();
+
+	std::vector<unsigned int> hist_tasks;
+	
+	for( unsigned int i = 0; i < input_names.size(); i++ ){
+		
+		// The newest runs have the highest priority
+		int priority = 10 * ( i + 1 );
+		
+		// Every run seen so far goes into the merged file, even if nothing changed for it
+		std::string name_run_hists = input_names.at(i);
+		name_run_hists += flag_fused ? "_fused_hists.root" : "_hists.root";
+		if( !flag_source && std::find( nearline_hist_files.begin(), nearline_hist_files.end(),
+									   name_run_hists ) == nearline_hist_files.end() )
+			nearline_hist_files.push_back( name_run_hists );
+
+		// All stages in one task
+		if( flag_fused && !flag_source ) {
+			
+			int fused_task = plan_fused( sched, i, priority );
+			if( fused_task < 0 ) continue;
+			hist_tasks.push_back( fused_task );
+			continue;
+			
+		}
+
+		int conv_task = plan_convert( sched, i, priority );
+		
+		// Source runs don't need building
+		if( flag_source ) continue;
+		
+		int build_task = plan_build( sched, i, conv_task, priority );
+
+		// Each run gets its own histogram file, which is then added to the merged file
+		std::string name_run = input_names.at(i);
+		std::string name_input_file = input_names.at(i) + "_events.root";
+		std::string name_output_file = input_names.at(i) + "_hists.root";
+		
+		std::vector<unsigned int> deps;
+		if( build_task >= 0 ) deps.push_back( build_task );
+		else {
+			
+			// Nothing new to build, check there's anything to histogram
+			std::ifstream ftest( name_input_file.data() );
+			if( !ftest.is_open() ) continue;
+			ftest.close();
+			
+			// And that we didn't do the histograms already with the same events
+			if( stage_done( name_run, "hist", name_output_file, hist_manifest( { name_run } ) ) ) continue;
+			
+		}
+		
+		hist_tasks.push_back( sched.AddTask( "hist " + name_output_file,
+			[=](){
+				auto t_start = std::chrono::steady_clock::now();
+				ISSManifest manifest = hist_manifest( { name_run } );
+				bool success = hist_file( name_input_file, name_output_file );
+				if( success ) success = manifest.Write( name_output_file );
+				if( success ) catalog_stage( name_run, "hist", name_output_file, manifest, t_start );
+				if( !success ) gSystem->Unlink( name_output_file.data() );
+				return success;
+			},
+			deps, 1, 1e9, 0.1, priority + 3 ) );
+		
+	}
+	
+	// Merging happens once everything else is finished, with all of the runs
+	if( hist_tasks.size() ) {
+		
+		std::vector<std::string> name_merge_files = nearline_hist_files;
+		sched.AddTask( "merge " + output_name,
+					   [=](){ return merge_hists( name_merge_files ); },
+					   hist_tasks, 1, 5e8, 0.2, 0, true );
+		
+	}
+	
+	return sched.Run();
+	
+}
+
+void do_watch(){
+	
+	//------------------------------------//
+	// Nearline sorting of the data files //
+	//------------------------------------//
+	ISSWatcher watcher( watch_dir, watch_pattern, settle_time );
+	if( !watcher.Open() ) return;
+	
+	std::cout << "\n +++ ISS Analysis:: watching " << watcher.GetDirectory() << " +++" << std::endl;
+	std::cout << " Runs are complete after " << settle_time << " s without growing";
+	std::cout << " or when a .closed marker file appears" << std::endl;
+	std::cout << " Merged histograms in " << output_name << std::endl;
+
+	// Keep going until killed
+	while( true ) {
+		
+		std::vector<std::string> runs = watcher.Poll( 5000 );
+		if( !runs.size() ) continue;
+		
+		std::cout << "\n " << runs.size() << " new run(s) ready:" << std::endl;
+		for( unsigned int i = 0; i < runs.size(); i++ )
+			std::cout << "  " << runs.at(i) << std::endl;
+		
+		// Anything that turns up while this is running is queued for the next batch
+		if( !do_nearline( runs ) )
+			std::cerr << " Some tasks failed, see above" << std::endl;
+		
+	}
+	
+	return;
+	
 }
 
 int main( int argc, char *argv[] ){
@@ -584,10 +1583,33 @@ int main( int argc, char *argv[] ){
 	interface->Add("-e", "Flag to force new event builder (new calibration)", &flag_events );
 	interface->Add("-source", "Flag to define an source only run", &flag_source );
 	interface->Add("-autocal", "Flag to perform automatic calibration of alpha source data", &flag_autocal );
+	interface->Add("-timealign", "Flag to align the time offsets of all channels to a reference", &flag_timealign );
+	interface->Add("-timeref", "Reference for -timealign: pulser, caen_<mod>_<ch> or asic_<mod>_<asic> (default pulser)", &time_ref );
+	interface->Add("-timewindow", "Half width of the time differences for -timealign in ns (default 1e4)", &time_window );
+	interface->Add("-timeres", "Expected time resolution (sigma) for -timealign in ns (default 50)", &time_res );
 	interface->Add("-spy", "Flag to run the DataSpy", &flag_spy );
 	interface->Add("-m", "Monitor input file every X seconds", &mon_time );
 	interface->Add("-p", "Port number for web server (default 8030)", &port_num );
 	interface->Add("-d", "Data directory to add to the monitor", &datadir_name );
+	interface->Add("-j", "Number of tasks to run in parallel (default 1), also limited by -io", &nworkers );
+	interface->Add("-io", "Disk bandwidth for the tasks, 1 allows ten conversions at once, 0 for no limit (default 1)", &io_capacity );
+	interface->Add("-mem", "Memory budget in GB shared by the tasks and their buffers (default no limit)", &mem_budget );
+	interface->Add("-retry", "Number of times to retry a failed task (default 1)", &nretry );
+	interface->Add("-watch", "Data directory to watch for new runs to sort nearline", &watch_dir );
+	interface->Add("-watchfiles", "Wildcard pattern for run files when watching (default *)", &watch_pattern );
+	interface->Add("-settle", "Seconds without growth before a watched run is complete (default 60)", &settle_time );
+	interface->Add("-fused", "Flag to convert, build and histogram each run in memory in one pass", &flag_fused );
+	interface->Add("-keepsort", "Flag to keep the time-sorted tree in fused mode", &flag_keep_sort );
+	interface->Add("-keepevents", "Flag to keep the event tree in fused mode", &flag_keep_events );
+	interface->Add("-shards", "Split large runs into up to N shards that are converted in parallel (default 1)", &nshards );
+	interface->Add("-shardoverlap", "Blocks decoded before each shard to recover the timestamps (default 20)", &shard_overlap );
+	interface->Add("-checkpoint", "Seconds between checkpoints of long jobs, 0 to disable (default 600)", &checkpoint_time );
+	interface->Add("-catalog", "Catalog of runs (default iss_catalog.txt in the data directory)", &name_catalog_file );
+	interface->Add("-list", "Flag to print the catalog of runs and stop", &flag_list );
+	interface->Add("-timing", "Flag to time each part of the sort and print it at the end of each file", &flag_timing );
+	interface->Add("-memreport", "Flag to print the memory used by hits, events, traces, histograms and trees", &flag_memory );
+	interface->Add("-metrics", "File to write throughput and queue metrics to for Prometheus (default iss_metrics/metrics.txt when monitoring)", &name_metrics_file );
+	interface->Add("-metricstime", "Seconds between writing the metrics file (default 10)", &metrics_time );
 	interface->Add("-g", "Launch the GUI", &gui_flag );
 	interface->Add("-h", "Print this help", &help_flag );
 
@@ -610,10 +1632,34 @@ int main( int argc, char *argv[] ){
 
 	}
 
+	// The catalog lives with the data, unless we're told otherwise
+	if( !name_catalog_file.size() ) {
+		
+		if( watch_dir.size() )
+			name_catalog_file = watch_dir + "/iss_catalog.txt";
+		
+		else if( input_names.size() )
+			name_catalog_file = std::string( gSystem->GetDirName( input_names.at(0).data() ).Data() ) + "/iss_catalog.txt";
+		
+		else name_catalog_file = "iss_catalog.txt";
+		
+	}
+	catalog = new ISSCatalog( name_catalog_file );
+	catalog->Load();
+	
+	// Just show what's in the catalog
+	if( flag_list ) {
+		
+		std::cout << "Catalog: " << name_catalog_file << std::endl;
+		catalog->Print();
+		return 0;
+		
+	}
+
 	// Check we have data files
-	if( !input_names.size() && !flag_spy ) {
+	if( !input_names.size() && !flag_spy && !watch_dir.size() ) {
 			
-			std::cout << "You have to provide at least one input file unless you are in DataSpy mode!" << std::endl;
+			std::cout << "You have to provide at least one input file unless you are in DataSpy or watch mode!" << std::endl;
 			return 1;
 			
 	}
@@ -661,7 +1707,10 @@ int main( int argc, char *argv[] ){
 	// Check the ouput file name
 	if( output_name.length() == 0 ) {
 	
-		if( bool( input_names.size() ) )
+		if( watch_dir.size() )
+			output_name = "nearline_hists.root";
+		
+		else if( bool( input_names.size() ) )
 			output_name = input_names.at(0) + "_hists.root";
 		
 		else output_name = "spy_hists.root";
@@ -761,11 +1810,21 @@ int main( int argc, char *argv[] ){
 	myreact = new ISSReaction( name_react_file, myset, flag_source );
 
 	
+	// Metrics go to a file, which is also served by the monitor
+	if( ( flag_monitor || flag_spy ) && !name_metrics_file.size() )
+		name_metrics_file = "iss_metrics/metrics.txt";
+	if( name_metrics_file.size() )
+		metrics = std::make_shared<ISSMetrics>( name_metrics_file );
+
 	//-------------------//
 	// Online monitoring //
 	//-------------------//
 	if( flag_monitor || flag_spy ) {
 		
+		// The calibration can be changed while monitoring, by editing
+		// the file or with the ReloadCal button, without a restart
+		calstore = std::make_shared<ISSCalibrationStore>( name_cal_file, myset );
+		
 		// Make some data for the thread
 		thread_data data;
 		data.mycal = mycal;
@@ -780,11 +1839,13 @@ int main( int argc, char *argv[] ){
 		TThread *th = new TThread( "monitor", monitor_run, (void*) &data );
 		th->Run();
 		
-		// wait until we finish
+		// wait until we finish, checking the calibration file every second
+		unsigned int nwait = 0;
 		while( true ){
 			
 			gSystem->Sleep(10);
 			gSystem->ProcessEvents();
+			if( ++nwait % 100 == 0 ) calstore->CheckFile();
 			
 		}
 		std::cout << "Finished" << std::endl;
@@ -797,16 +1858,25 @@ int main( int argc, char *argv[] ){
 	//------------------//
 	// Run the analysis //
 	//------------------//
-	do_convert();
-	if( !flag_source && !flag_autocal ) {
-		if( do_build() )
-			do_hist();
-	}
-	else if( flag_autocal ) {
-		do_autocal();
+	if( nworkers < 1 ) nworkers = 1;
+	if( nworkers > 1 ) ROOT::EnableThreadSafety();
+	if( nretry < 0 ) nretry = 0;
+	
+	// Write the metrics every so often while the tasks run
+	if( metrics ) metrics->StartWriter( metrics_time );
+	
+	// Nearline mode never returns
+	if( watch_dir.size() ) {
+		
+		do_watch();
+		return 1;
+		
 	}
+	
+	bool success = do_pipeline();
+	if( metrics ) metrics->StopWriter();
 	std::cout << "\n\nFinished!\n";
 
-	return 0;
+	return success ? 0 : 1;
 
 }
@@ -13,6 +13,19 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <queue>
+
+// Version of the code, made by the Makefile
+#include "iss_version.hh"
 
 // Command line interface
 #ifndef __COMMAND_LINE_INTERFACE
@@ -41,3 +54,4 @@ void reset_evnt_hists();
 void reset_phys_hists();
 void stop_monitor();
 void start_monitor();
+void reload_calibration();
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Converts the same generated run in one go and in shards, and checks that
+# the time-sorted trees have exactly the same hits, i.e. that nothing is lost
+# or doubled at the boundaries between the shards, and that every histogram
+# in the converted files is the same.
+#
+# Run from the top directory after make, or with make shardtest:
+#   scripts/shardtest.sh [directory] [blocks] [shards]
+# Each shard is at least 1000 blocks, so blocks has to be at least 1000 x shards.
+
+DIR=${1:-shardtest}
+BLOCKS=${2:-4000}
+SHARDS=${3:-4}
+
+mkdir -p $DIR || exit 1
+
+# Some hits out of order, so the shards have to be sorted properly
+./bin/iss_gen -o $DIR/whole.dat -n $BLOCKS -seed 7 -late 0.01 || exit 1
+cp $DIR/whole.dat $DIR/shards.dat || exit 1
+
+./bin/iss_sort -i $DIR/whole.dat -o $DIR/whole_hists.root -f || exit 1
+./bin/iss_sort -i $DIR/shards.dat -o $DIR/shards_hists.root -f -j $SHARDS -shards $SHARDS || exit 1
+
+root -l -b -q -e 'gSystem->Load("lib/libiss_sort.so")' \
+	-e ".x scripts/CompareSorted.C(\"$DIR/whole.dat.root\",\"$DIR/shards.dat.root\")"
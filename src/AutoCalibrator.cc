@@ -33,6 +33,9 @@ ISSAutoCalibrator::ISSAutoCalibrator( ISSSettings *myset, ISSReaction *myreact,
 	my_max_amp = 0;
 	my_threshold = 0;
 	
+	// No GUI progress unless it's added
+	_prog_ = false;
+	
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1233,6 +1236,9 @@ void ISSAutoCalibrator::DoFits(){
 
 		// Loop over ASICs in the module
 		for( unsigned int asic = 0; asic < set->GetNumberOfArrayASICs(); asic++ ){
+			
+			// Stop if the job was cancelled from the GUI
+			if( _prog_ && prog->IsCancelled() ) return;
 
 			// Get the histogram
 			std::string hname = "asic_";
@@ -1320,13 +1326,12 @@ void ISSAutoCalibrator::DoFits(){
 					if( (int)chanNo % (nchans/100) == 0 || chanNo+1 == nchans ) {
 					
 						// Progress bar in GUI
-						//if( _prog_ ) prog->SetPosition( percent );
+						if( _prog_ ) prog->SetPosition( percent );
 
 						// Progress bar in terminal
 						std::cout << " " << std::setw(6) << std::setprecision(4);
 						std::cout << percent << "%    \r";
 						std::cout.flush();
-						gSystem->ProcessEvents();
 						
 					}
 
@@ -0,0 +1,443 @@
+#include "Benchmark.hh"
+
+ISSBenchmark::ISSBenchmark( ISSSettings *myset, std::string mycalfile, std::string myreactfile ){
+
+	set = myset;
+	name_cal_file = mycalfile;
+	name_react_file = myreactfile;
+
+	threads = { 1 };
+	repeat = 1;
+	seed = 1;
+	work_dir = "iss_bench";
+
+}
+
+void ISSBenchmark::AddInput( std::string filename ){
+
+	// Named after the file, without the directory
+	std::string name = filename.substr( filename.find_last_of( '/' ) + 1 );
+	inputs.push_back( std::make_pair( name, filename ) );
+
+	return;
+
+}
+
+void ISSBenchmark::AddSynthetic( unsigned long nblocks ){
+
+	if( nblocks > 0 ) synthetic.push_back( nblocks );
+
+	return;
+
+}
+
+double ISSBenchmark::GetCPUTime(){
+
+	// Each chain runs in its own thread, so the time of this
+	// thread only if the kernel can tell us, otherwise the process
+	struct rusage usage;
+#ifdef RUSAGE_THREAD
+	if( getrusage( RUSAGE_THREAD, &usage ) != 0 )
+#endif
+	if( getrusage( RUSAGE_SELF, &usage ) != 0 )
+		return (double)std::clock() / CLOCKS_PER_SEC;
+
+	return usage.ru_utime.tv_sec + 1e-6 * usage.ru_utime.tv_usec +
+		usage.ru_stime.tv_sec + 1e-6 * usage.ru_stime.tv_usec;
+
+}
+
+double ISSBenchmark::GetFileSize( std::string filename ){
+
+	FileStat_t fs;
+	if( gSystem->GetPathInfo( filename.data(), fs ) != 0 ) return 0;
+
+	return fs.fSize / 1e6;
+
+}
+
+std::string ISSBenchmark::GetKey( const result_t &r ){
+
+	return r.input + " " + r.stage + " " + std::to_string( r.threads );
+
+}
+
+std::string ISSBenchmark::MakeInput( unsigned long nblocks ){
+
+	// The same seed always gives the same file, so one from
+	// an earlier run can be used again if it's complete
+	std::string filename = work_dir + "/iss_bench_" + std::to_string( seed );
+	filename += "_" + std::to_string( nblocks ) + ".dat";
+
+	FileStat_t fs;
+	if( gSystem->GetPathInfo( filename.data(), fs ) == 0 &&
+	    fs.fSize == (Long64_t)nblocks * 0x10000 ) return filename;
+
+	std::cout << "Generating " << nblocks << " blocks in " << filename << std::endl;
+
+	ISSGenerator gen( set );
+	gen.SetSeed( seed );
+	if( !gen.Generate( filename, nblocks ) ) return "";
+
+	return filename;
+
+}
+
+bool ISSBenchmark::RunChain( std::string filename, std::string prefix,
+							std::vector<result_t> &res, bool reset_rss ){
+
+	std::string name_conv_file = prefix + ".root";
+	std::string name_evt_file = prefix + "_events.root";
+	std::string name_hist_file = prefix + "_hists.root";
+
+	// Each chain has its own calibration and reaction, as in the sort
+	ISSCalibration cal( name_cal_file, set );
+	ISSReaction react( name_react_file, set, false );
+
+	std::chrono::steady_clock::time_point t0;
+	double cpu0 = 0;
+	result_t r;
+
+	auto start = [&]( std::string stage ){
+		r = result_t();
+		r.stage = stage;
+		if( reset_rss ) ISSMemoryBudget::ResetPeakRSS();
+		cpu0 = GetCPUTime();
+		t0 = std::chrono::steady_clock::now();
+	};
+
+	auto stop = [&]( std::string name_in, std::string name_out, double items ){
+		r.wall = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+		r.cpu = GetCPUTime() - cpu0;
+		r.rss = ISSMemoryBudget::GetPeakRSS() / 1e6;
+		r.read = GetFileSize( name_in );
+		r.written = GetFileSize( name_out );
+		r.items = items;
+		res.push_back( r );
+	};
+
+	bool success = true;
+
+	// Convert
+	start( "convert" );
+	{
+		ISSConverter conv( set );
+		conv.AddCalibration( &cal );
+		conv.SetQuiet();
+		conv.SetOutput( name_conv_file );
+		conv.MakeTree();
+		conv.MakeHists();
+		if( conv.ConvertFile( filename ) < 0 || conv.BadHeader() ) success = false;
+		unsigned long long nhits = conv.SortTree();
+		conv.CloseOutput();
+		stop( filename, name_conv_file, nhits );
+	}
+
+	// Build
+	if( success ) {
+
+		start( "build" );
+		ISSEventBuilder eb( set );
+		eb.SetQuiet();
+		eb.AddTimeOffsets( &cal );
+		eb.SetInputFile( name_conv_file );
+		eb.SetOutput( name_evt_file );
+		eb.BuildEvents();
+		double nevents = eb.GetTree()->GetEntries();
+		eb.CloseOutput();
+		stop( name_conv_file, name_evt_file, nevents );
+
+	}
+
+	// Histogram
+	if( success ) {
+
+		start( "hist" );
+		ISSHistogrammer hist( &react, set );
+		hist.SetQuiet();
+		hist.SetOutput( name_hist_file );
+		hist.SetInputFile( name_evt_file );
+		unsigned long nevents = hist.FillHists();
+		hist.CloseOutput();
+		stop( name_evt_file, name_hist_file, nevents );
+
+	}
+
+	// Only the measurements are kept
+	gSystem->Unlink( name_conv_file.data() );
+	gSystem->Unlink( name_evt_file.data() );
+	gSystem->Unlink( name_hist_file.data() );
+
+	return success;
+
+}
+
+bool ISSBenchmark::RunTest( std::string name, std::string filename, int nthreads ){
+
+	std::cout << "Running " << name << " with " << nthreads;
+	std::cout << ( nthreads == 1 ? " thread" : " threads" ) << std::endl;
+
+	std::vector<result_t> best;
+	double best_wall = -1;
+
+	for( unsigned int i = 0; i < repeat; ++i ) {
+
+		// One copy of the chain per thread, each with its own outputs
+		std::vector<std::vector<result_t>> chain_res( nthreads );
+		ISSScheduler sched( nthreads );
+		sched.SetRetries( 0 );
+		for( int j = 0; j < nthreads; ++j ) {
+
+			std::string prefix = work_dir + "/" + name + "_" + std::to_string( nthreads );
+			prefix += "_" + std::to_string( j );
+			std::vector<result_t> *mine = &chain_res[j];
+			bool reset_rss = nthreads == 1;
+			sched.AddTask( "bench " + prefix, [this,filename,prefix,mine,reset_rss](){
+				return RunChain( filename, prefix, *mine, reset_rss );
+			} );
+
+		}
+
+		ISSMemoryBudget::ResetPeakRSS();
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		bool success = sched.Run();
+		double wall = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+		if( !success ) {
+
+			std::cerr << "Benchmark of " << name << " failed" << std::endl;
+			return false;
+
+		}
+
+		// Each stage is the mean over the chains, so the rate is per chain,
+		// while the total is everything done by all chains in the wall time
+		std::vector<result_t> res;
+		result_t total = result_t();
+		total.input = name;
+		total.stage = "total";
+		total.threads = nthreads;
+		total.wall = wall;
+		total.rss = ISSMemoryBudget::GetPeakRSS() / 1e6;
+
+		for( unsigned int k = 0; k < chain_res[0].size(); ++k ) {
+
+			result_t r = result_t();
+			r.input = name;
+			r.stage = chain_res[0][k].stage;
+			r.threads = nthreads;
+			for( int j = 0; j < nthreads; ++j ) {
+
+				const result_t &c = chain_res[j][k];
+				r.wall += c.wall / nthreads;
+				r.cpu += c.cpu / nthreads;
+				r.rss = std::max( r.rss, c.rss );
+				r.read += c.read / nthreads;
+				r.written += c.written / nthreads;
+				r.items += c.items / nthreads;
+
+				total.cpu += c.cpu;
+				if( k == 0 ) total.read += c.read;
+				if( k + 1 == chain_res[0].size() ) total.written += c.written;
+				if( k == 0 ) total.items += c.items;
+
+			}
+
+			res.push_back( r );
+
+		}
+
+		res.push_back( total );
+
+		// Keep the fastest run, the others are just noise on top
+		if( best_wall < 0 || wall < best_wall ) {
+
+			best_wall = wall;
+			best = res;
+
+		}
+
+	}
+
+	results.insert( results.end(), best.begin(), best.end() );
+
+	return true;
+
+}
+
+bool ISSBenchmark::Run(){
+
+	gSystem->mkdir( work_dir.data(), true );
+
+	for( unsigned int i = 0; i < synthetic.size(); ++i ) {
+
+		std::string filename = MakeInput( synthetic[i] );
+		if( !filename.size() ) {
+
+			std::cerr << "Cannot make the input with " << synthetic[i] << " blocks" << std::endl;
+			return false;
+
+		}
+
+		inputs.push_back( std::make_pair( "synthetic_" + std::to_string( synthetic[i] ), filename ) );
+
+	}
+	synthetic.clear();
+
+	bool success = true;
+	for( unsigned int i = 0; i < inputs.size(); ++i )
+		for( unsigned int j = 0; j < threads.size(); ++j )
+			if( threads[j] > 0 && !RunTest( inputs[i].first, inputs[i].second, threads[j] ) )
+				success = false;
+
+	return success;
+
+}
+
+void ISSBenchmark::Print(){
+
+	std::cout << std::endl << std::left;
+	std::cout << std::setw(24) << "input" << std::setw(10) << "stage";
+	std::cout << std::right << std::setw(8) << "threads";
+	std::cout << std::setw(10) << "wall/s" << std::setw(10) << "cpu/s";
+	std::cout << std::setw(10) << "rss/MB" << std::setw(10) << "read/MB";
+	std::cout << std::setw(12) << "written/MB" << std::setw(12) << "items";
+	std::cout << std::setw(12) << "items/s" << std::endl;
+
+	std::cout << std::fixed << std::setprecision(2);
+	for( unsigned int i = 0; i < results.size(); ++i ) {
+
+		const result_t &r = results[i];
+		std::cout << std::left << std::setw(24) << r.input << std::setw(10) << r.stage;
+		std::cout << std::right << std::setw(8) << r.threads;
+		std::cout << std::setw(10) << r.wall << std::setw(10) << r.cpu;
+		std::cout << std::setw(10) << r.rss << std::setw(10) << r.read;
+		std::cout << std::setw(12) << r.written;
+		std::cout << std::setw(12) << std::setprecision(0) << r.items;
+		std::cout << std::setw(12) << ( r.wall > 0 ? r.items / r.wall : 0 );
+		std::cout << std::setprecision(2) << std::endl;
+
+	}
+
+	// Scaling of the whole chain, compared to the fewest threads of each input
+	std::cout << std::endl << "Scaling:" << std::endl;
+	std::cout << std::left << std::setw(24) << "input" << std::right << std::setw(8) << "threads";
+	std::cout << std::setw(12) << "items/s" << std::setw(10) << "speedup";
+	std::cout << std::setw(12) << "efficiency" << std::endl;
+
+	std::map<std::string,const result_t*> first;
+	for( unsigned int i = 0; i < results.size(); ++i ) {
+
+		const result_t &r = results[i];
+		if( r.stage != "total" || r.wall <= 0 ) continue;
+		if( first.find( r.input ) == first.end() ) first[r.input] = &r;
+
+		const result_t *f = first[r.input];
+		double speedup = ( r.items / r.wall ) / ( f->items / f->wall );
+		std::cout << std::left << std::setw(24) << r.input << std::right << std::setw(8) << r.threads;
+		std::cout << std::setw(12) << std::setprecision(0) << r.items / r.wall;
+		std::cout << std::setw(10) << std::setprecision(2) << speedup;
+		std::cout << std::setw(12) << speedup * f->threads / r.threads << std::endl;
+
+	}
+
+	std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+
+	return;
+
+}
+
+bool ISSBenchmark::Save( std::string filename ){
+
+	std::ofstream output_file( filename.data() );
+	if( !output_file.is_open() ) {
+
+		std::cerr << "Cannot write benchmark results to " << filename << std::endl;
+		return false;
+
+	}
+
+	output_file << "# input stage threads wall_s cpu_s peak_rss_MB read_MB written_MB items rate_per_s" << std::endl;
+	output_file << std::setprecision(10);
+	for( unsigned int i = 0; i < results.size(); ++i ) {
+
+		const result_t &r = results[i];
+		output_file << r.input << " " << r.stage << " " << r.threads << " ";
+		output_file << r.wall << " " << r.cpu << " " << r.rss << " ";
+		output_file << r.read << " " << r.written << " " << r.items << " ";
+		output_file << ( r.wall > 0 ? r.items / r.wall : 0 ) << std::endl;
+
+	}
+
+	output_file.close();
+
+	return true;
+
+}
+
+int ISSBenchmark::Compare( std::string filename, double threshold, double rss_threshold ){
+
+	std::ifstream input_file( filename.data() );
+	if( !input_file.is_open() ) {
+
+		std::cerr << "Cannot read benchmark baseline " << filename << std::endl;
+		return -1;
+
+	}
+
+	std::map<std::string,result_t> baseline;
+	std::string line;
+	while( std::getline( input_file, line ) ) {
+
+		if( !line.size() || line[0] == '#' ) continue;
+
+		std::stringstream ss( line );
+		result_t r;
+		if( !( ss >> r.input >> r.stage >> r.threads >> r.wall >> r.cpu
+			   >> r.rss >> r.read >> r.written >> r.items ) ) continue;
+		baseline[GetKey(r)] = r;
+
+	}
+
+	input_file.close();
+
+	std::cout << std::endl << "Compared to " << filename << ":" << std::endl;
+	std::cout << std::left << std::setw(44) << "test" << std::right;
+	std::cout << std::setw(12) << "time" << std::setw(12) << "rss" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+
+	int nregress = 0;
+	for( unsigned int i = 0; i < results.size(); ++i ) {
+
+		const result_t &r = results[i];
+		auto it = baseline.find( GetKey(r) );
+		if( it == baseline.end() ) continue;
+		const result_t &b = it->second;
+
+		// Time per item, in case the input has changed a bit, but
+		// tiny times are just noise and not counted as a regression
+		double time_change = 0;
+		if( r.items > 0 && b.items > 0 && b.wall > 0 )
+			time_change = ( r.wall / r.items ) / ( b.wall / b.items ) - 1;
+		else if( b.wall > 0 ) time_change = r.wall / b.wall - 1;
+		double rss_change = b.rss > 0 ? r.rss / b.rss - 1 : 0;
+
+		bool slower = time_change > threshold && r.wall - b.wall > 0.05;
+		bool bigger = rss_change > rss_threshold;
+
+		std::cout << std::left << std::setw(44) << GetKey(r) << std::right;
+		std::cout << std::setw(11) << std::showpos << 100 * time_change << "%";
+		std::cout << std::setw(11) << 100 * rss_change << "%" << std::noshowpos;
+		if( slower ) std::cout << "  SLOWER";
+		if( bigger ) std::cout << "  BIGGER";
+		std::cout << std::endl;
+
+		if( slower || bigger ) nregress++;
+
+	}
+
+	std::cout << std::defaultfloat << std::setprecision(6);
+	std::cout << nregress << " regressions" << std::endl;
+
+	return nregress;
+
+}
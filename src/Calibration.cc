@@ -61,6 +61,7 @@ ISSCalibration::ISSCalibration( std::string filename, ISSSettings *myset ) {
 
 	SetFile( filename );
 	set = myset;
+	fVersion = 0;
 	ReadCalibration();
 	fRand = new TRandom();
 	
@@ -0,0 +1,172 @@
+#include "CalibrationStore.hh"
+
+ISSCalibrationStore::ISSCalibrationStore( std::string myfile, ISSSettings *myset ){
+
+	set = myset;
+	filename = myfile;
+	next_version = 1;
+
+	// No readers yet
+	for( unsigned int i = 0; i < reader_version.size(); ++i )
+		reader_version[i].store( kNoReader );
+
+	// The first snapshot, so there is always one to acquire
+	current.store( nullptr );
+	pinned = nullptr;
+	Stat( file_size, file_mtime );
+	pending_size = file_size;
+	pending_mtime = file_mtime;
+	Publish( std::make_unique<ISSCalibration>( filename, set ) );
+
+}
+
+int ISSCalibrationStore::AddReader(){
+
+	std::lock_guard<std::mutex> lock( writer_mutex );
+
+	for( int i = 0; i < kMaxReaders; ++i ) {
+
+		if( reader_version[i].load() != kNoReader ) continue;
+		reader_version[i].store( current.load()->GetVersion() );
+		return i;
+
+	}
+
+	// Set before AddReader returns, so the reader sees it in Acquire
+	if( !pinned ) pinned = current.load();
+	std::cerr << "Too many readers of the calibration, it won't be updated";
+	std::cerr << " from version " << pinned->GetVersion() << std::endl;
+	return -1;
+
+}
+
+void ISSCalibrationStore::RemoveReader( int reader ){
+
+	if( reader < 0 || reader >= kMaxReaders ) return;
+
+	std::lock_guard<std::mutex> lock( writer_mutex );
+	reader_version[reader].store( kNoReader );
+	Retire();
+
+	return;
+
+}
+
+void ISSCalibrationStore::Publish( std::unique_ptr<ISSCalibration> snap ){
+
+	// Called with the writer lock held, or from the constructor
+	snap->SetVersion( next_version++ );
+	current.store( snap.get(), std::memory_order_seq_cst );
+	snapshots.push_back( std::move( snap ) );
+	Retire();
+
+	return;
+
+}
+
+void ISSCalibrationStore::Retire(){
+
+	// Oldest version that a reader could still be using. A reader may be
+	// between loading the current snapshot and updating its slot, but then
+	// its slot is still at or below the version it loaded, so that's kept
+	unsigned int oldest = current.load( std::memory_order_seq_cst )->GetVersion();
+	for( unsigned int i = 0; i < reader_version.size(); ++i )
+		oldest = std::min( oldest, reader_version[i].load( std::memory_order_seq_cst ) );
+
+	// The current snapshot is the newest, so is never deleted,
+	// and the pinned one is used by the readers without a slot
+	unsigned int j = 0;
+	for( unsigned int i = 0; i < snapshots.size(); ++i ) {
+
+		if( snapshots[i]->GetVersion() >= oldest || snapshots[i].get() == pinned )
+			snapshots[j++] = std::move( snapshots[i] );
+
+	}
+	snapshots.resize( j );
+
+	return;
+
+}
+
+void ISSCalibrationStore::Stat( long long &size, long &mtime ){
+
+	FileStat_t fs;
+	if( gSystem->GetPathInfo( filename.data(), fs ) ) {
+
+		size = -1;
+		mtime = 0;
+
+	}
+
+	else {
+
+		size = fs.fSize;
+		mtime = fs.fMtime;
+
+	}
+
+	return;
+
+}
+
+bool ISSCalibrationStore::Load( std::string myfile ){
+
+	// Don't replace a good calibration with the defaults
+	if( gSystem->AccessPathName( myfile.data() ) ) {
+
+		std::cerr << "Cannot read calibration file " << myfile;
+		std::cerr << ", keeping version " << GetVersion() << std::endl;
+		return false;
+
+	}
+
+	// Reading the file is the slow part and the readers carry on meanwhile
+	auto snap = std::make_unique<ISSCalibration>( myfile, set );
+
+	std::lock_guard<std::mutex> lock( writer_mutex );
+	filename = myfile;
+	Stat( file_size, file_mtime );
+	pending_size = file_size;
+	pending_mtime = file_mtime;
+	Publish( std::move( snap ) );
+
+	std::cout << "Calibration version " << GetVersion() << " from " << filename << std::endl;
+
+	return true;
+
+}
+
+bool ISSCalibrationStore::Reload(){
+
+	return Load( filename );
+
+}
+
+bool ISSCalibrationStore::CheckFile(){
+
+	long long size;
+	long mtime;
+	Stat( size, mtime );
+
+	// Free old snapshots even if nothing has changed
+	if( size == file_size && mtime == file_mtime ) {
+
+		std::lock_guard<std::mutex> lock( writer_mutex );
+		Retire();
+		return false;
+
+	}
+
+	// Wait for one more check without changes, so a file that is still
+	// being written isn't read half way through
+	if( size != pending_size || mtime != pending_mtime ) {
+
+		pending_size = size;
+		pending_mtime = mtime;
+		return false;
+
+	}
+
+	return Reload();
+
+}
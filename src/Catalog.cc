@@ -0,0 +1,316 @@
+#include "Catalog.hh"
+
+bool ISSCatalog::Load(){
+
+	std::lock_guard<std::mutex> lock( cat_mtx );
+	runs.clear();
+	changed.clear();
+
+	return Read( runs );
+
+}
+
+bool ISSCatalog::Read( std::map<std::string,std::map<std::string,std::string>> &values ){
+
+	std::ifstream input_file( filename.data() );
+	if( !input_file.is_open() ) return false;
+
+	// A "[run]" line starts a new run, then one "key = value" per line
+	std::string line, run;
+	while( std::getline( input_file, line ) ) {
+
+		if( line.size() > 2 && line.front() == '[' && line.back() == ']' ) {
+
+			run = line.substr( 1, line.size() - 2 );
+			continue;
+
+		}
+
+		size_t pos = line.find( " = " );
+		if( pos == std::string::npos || !run.size() ) continue;
+		values[run][ line.substr( 0, pos ) ] = line.substr( pos + 3 );
+
+	}
+
+	input_file.close();
+
+	return true;
+
+}
+
+bool ISSCatalog::Save(){
+
+	std::lock_guard<std::mutex> file_lock( file_mtx );
+
+	// Other processes may be writing the same catalog, so hold the lock file
+	// from reading what they have written until ours is in place
+	std::string name_lock_file = filename + ".lock";
+	int lock_fd = open( name_lock_file.data(), O_RDWR | O_CREAT, 0666 );
+	if( lock_fd < 0 || flock( lock_fd, LOCK_EX ) != 0 ) {
+
+		std::cerr << "Cannot lock catalog " << filename << std::endl;
+		if( lock_fd >= 0 ) close( lock_fd );
+		return false;
+
+	}
+
+	// What is in the file now, with our changes on top of it
+	std::map<std::string,std::map<std::string,std::string>> copy;
+	std::map<std::string,std::set<std::string>> saved;
+	Read( copy );
+	{
+		std::lock_guard<std::mutex> lock( cat_mtx );
+		for( auto it = changed.begin(); it != changed.end(); ++it )
+			for( auto jt = it->second.begin(); jt != it->second.end(); ++jt )
+				copy[it->first][*jt] = runs[it->first][*jt];
+		runs = copy;
+		saved.swap( changed );
+	}
+
+	std::string name_tmp_file = filename + ".tmp";
+	std::ofstream output_file( name_tmp_file.data() );
+	if( !output_file.is_open() ) {
+
+		std::cerr << "Cannot write catalog " << filename << std::endl;
+		Unsaved( saved );
+		close( lock_fd );
+		return false;
+
+	}
+
+	for( auto it = copy.begin(); it != copy.end(); ++it ) {
+
+		output_file << "[" << it->first << "]" << std::endl;
+		for( auto jt = it->second.begin(); jt != it->second.end(); ++jt )
+			output_file << jt->first << " = " << jt->second << std::endl;
+		output_file << std::endl;
+
+	}
+
+	output_file.close();
+
+	// Swap the new one in, so we never have half a catalog
+	bool success = gSystem->Rename( name_tmp_file.data(), filename.data() ) == 0;
+	if( !success ) {
+
+		std::cerr << "Cannot write catalog " << filename << std::endl;
+		Unsaved( saved );
+
+	}
+
+	// Closing the lock file releases the lock
+	close( lock_fd );
+
+	return success;
+
+}
+
+void ISSCatalog::Unsaved( const std::map<std::string,std::set<std::string>> &keys ){
+
+	// Try again with the next save
+	std::lock_guard<std::mutex> lock( cat_mtx );
+	for( auto it = keys.begin(); it != keys.end(); ++it )
+		changed[it->first].insert( it->second.begin(), it->second.end() );
+
+	return;
+
+}
+
+std::vector<std::string> ISSCatalog::GetRuns(){
+
+	std::lock_guard<std::mutex> lock( cat_mtx );
+
+	std::vector<std::string> names;
+	for( auto it = runs.begin(); it != runs.end(); ++it )
+		names.push_back( it->first );
+
+	return names;
+
+}
+
+bool ISSCatalog::GetFileInfo( std::string name, Long64_t &size, Long_t &mtime ){
+
+	FileStat_t fstat;
+	if( gSystem->GetPathInfo( name.data(), fstat ) != 0 ) return false;
+
+	size = fstat.fSize;
+	mtime = fstat.fMtime;
+
+	return true;
+
+}
+
+void ISSCatalog::AddRawFile( std::string run, unsigned int block_size ){
+
+	Long64_t size;
+	Long_t mtime;
+	if( !GetFileInfo( run, size, mtime ) ) return;
+
+	Set( run, "size", size );
+	Set( run, "blocks", ( size + block_size - 1 ) / block_size );
+	Set( run, "mtime", mtime );
+
+	return;
+
+}
+
+void ISSCatalog::AddConverted( std::string run, std::string name_conv_file ){
+
+	// Doesn't exist, so don't let ROOT complain about it
+	if( gSystem->AccessPathName( name_conv_file.data() ) ) return;
+
+	TFile *input_file = new TFile( name_conv_file.data(), "read" );
+	if( input_file->IsZombie() ) {
+
+		delete input_file;
+		return;
+
+	}
+
+	// The first and last hits of the time-sorted tree give the span of the run
+	TTree *sorted_tree = (TTree*)input_file->Get( "iss_sort" );
+	if( sorted_tree && sorted_tree->GetEntries() ) {
+
+		ISSDataPackets *data = nullptr;
+		sorted_tree->SetBranchAddress( "data", &data );
+
+		Long64_t nhits = sorted_tree->GetEntries();
+		sorted_tree->GetEntry( 0 );
+		unsigned long time_first = data->GetTime();
+		sorted_tree->GetEntry( nhits - 1 );
+		unsigned long time_last = data->GetTime();
+
+		double span = ( time_last - time_first ) * 1e-9;
+		Set( run, "hits", nhits );
+		Set( run, "time_first", time_first );
+		Set( run, "time_last", time_last );
+		Set( run, "time_span", span );
+		if( span > 0 ) Set( run, "hit_rate", nhits / span );
+
+		sorted_tree->ResetBranchAddresses();
+		delete data;
+
+	}
+
+	// Each hit is counted in the profiles of the converter, per module
+	TDirectory *dir = input_file->GetDirectory( "timing_hists" );
+	if( dir ) {
+
+		double nasic = 0, ncaen = 0;
+		TIter next( dir->GetListOfKeys() );
+		while( TKey *key = (TKey*)next() ) {
+
+			std::string name = key->GetName();
+			bool is_asic = name.find( "hasic_hit" ) == 0;
+			bool is_caen = name.find( "hcaen_hit" ) == 0;
+			if( !is_asic && !is_caen ) continue;
+
+			TH1 *h = (TH1*)key->ReadObj();
+			if( !h ) continue;
+			if( is_asic ) nasic += h->GetEntries();
+			else ncaen += h->GetEntries();
+			delete h;
+
+		}
+
+		Set( run, "hits_asic", (Long64_t)nasic );
+		Set( run, "hits_caen", (Long64_t)ncaen );
+
+	}
+
+	input_file->Close();
+	delete input_file;
+
+	return;
+
+}
+
+void ISSCatalog::AddStage( std::string run, std::string stage, std::string name_output_file,
+						   std::string digest, double seconds ){
+
+	Set( run, stage + ".file", name_output_file );
+	Set( run, stage + ".digest", digest );
+	Set( run, stage + ".time", seconds );
+	Set( run, stage + ".date", (long)std::time(nullptr) );
+
+	// The output is identified by its size and date, so it can be
+	// recognised again later without opening it
+	Long64_t size;
+	Long_t mtime;
+	if( GetFileInfo( name_output_file, size, mtime ) ) {
+
+		Set( run, stage + ".size", size );
+		Set( run, stage + ".mtime", mtime );
+
+	}
+
+	// Data rate through the stage from the size of the run file
+	double raw_size = 0;
+	if( seconds > 0 && Get( run, "size", raw_size ) )
+		Set( run, stage + ".rate", raw_size / seconds / 1e6 );
+
+	return;
+
+}
+
+bool ISSCatalog::UpToDate( std::string run, std::string stage, std::string name_output_file,
+						   std::string digest ){
+
+	std::string cat_file, cat_digest;
+	Long64_t cat_size, size;
+	Long_t cat_mtime, mtime;
+	if( !Get( run, stage + ".file", cat_file ) || cat_file != name_output_file ) return false;
+	if( !Get( run, stage + ".digest", cat_digest ) || cat_digest != digest ) return false;
+	if( !Get( run, stage + ".size", cat_size ) || !Get( run, stage + ".mtime", cat_mtime ) ) return false;
+
+	// Any change to the file since it was recorded and we can't trust it
+	if( !GetFileInfo( name_output_file, size, mtime ) ) return false;
+
+	return size == cat_size && mtime == cat_mtime;
+
+}
+
+void ISSCatalog::Print(){
+
+	std::vector<std::string> names = GetRuns();
+	std::string stages[4] = { "convert", "build", "hist", "fused" };
+
+	std::cout << std::left << std::setw(40) << "run";
+	std::cout << std::right << std::setw(10) << "size/MB";
+	std::cout << std::setw(10) << "span/s";
+	std::cout << std::setw(12) << "hits";
+	std::cout << std::setw(12) << "rate/Hz";
+	std::cout << "  stages (time/s)" << std::endl;
+
+	for( unsigned int i = 0; i < names.size(); ++i ) {
+
+		double size = 0, span = 0, rate = 0;
+		Long64_t hits = 0;
+		Get( names.at(i), "size", size );
+		Get( names.at(i), "time_span", span );
+		Get( names.at(i), "hits", hits );
+		Get( names.at(i), "hit_rate", rate );
+
+		std::cout << std::left << std::setw(40) << names.at(i);
+		std::cout << std::right << std::fixed << std::setprecision(1);
+		std::cout << std::setw(10) << size / 1e6;
+		std::cout << std::setw(10) << span;
+		std::cout << std::setw(12) << hits;
+		std::cout << std::setw(12) << rate;
+		std::cout << " ";
+
+		for( unsigned int j = 0; j < 4; ++j ) {
+
+			double seconds;
+			if( Get( names.at(i), stages[j] + ".time", seconds ) )
+				std::cout << " " << stages[j] << "(" << seconds << ")";
+
+		}
+
+		std::cout << std::defaultfloat << std::endl;
+
+	}
+
+	return;
+
+}
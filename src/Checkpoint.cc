@@ -0,0 +1,116 @@
+#include "Checkpoint.hh"
+
+bool ISSCheckpoint::Load(){
+
+	values.clear();
+
+	std::ifstream input_file( filename.data() );
+	if( !input_file.is_open() ) return false;
+
+	// One "key = value" per line
+	std::string line;
+	while( std::getline( input_file, line ) ) {
+
+		size_t pos = line.find( " = " );
+		if( pos == std::string::npos ) continue;
+		values[ line.substr( 0, pos ) ] = line.substr( pos + 3 );
+
+	}
+
+	input_file.close();
+
+	// It's only complete if we got to the end marker
+	if( !values.count( "complete" ) ) {
+
+		values.clear();
+		return false;
+
+	}
+
+	return true;
+
+}
+
+bool ISSCheckpoint::Save(){
+
+	std::string name_tmp_file = filename + ".tmp";
+	std::ofstream output_file( name_tmp_file.data() );
+	if( !output_file.is_open() ) {
+
+		std::cerr << "Cannot write checkpoint " << filename << std::endl;
+		return false;
+
+	}
+
+	for( auto it = values.begin(); it != values.end(); ++it )
+		if( it->first != "complete" )
+			output_file << it->first << " = " << it->second << std::endl;
+	output_file << "complete = 1" << std::endl;
+	output_file.close();
+
+	// Swap the new one in, so we never have half a checkpoint
+	if( gSystem->Rename( name_tmp_file.data(), filename.data() ) != 0 ) {
+
+		std::cerr << "Cannot write checkpoint " << filename << std::endl;
+		return false;
+
+	}
+
+	return true;
+
+}
+
+void ISSCheckpoint::Remove(){
+
+	if( !gSystem->AccessPathName( filename.data() ) )
+		gSystem->Unlink( filename.data() );
+
+	return;
+
+}
+
+void ISSCheckpoint::RestoreHists( TDirectory *dir ){
+
+	if( !dir ) return;
+
+	// Copy the list first, reading objects can add to it
+	std::vector<TKey*> keys;
+	TIter next( dir->GetListOfKeys() );
+	while( TKey *key = (TKey*)next() ) keys.push_back( key );
+
+	for( unsigned int i = 0; i < keys.size(); ++i ) {
+
+		TKey *key = keys.at(i);
+		TClass *cl = TClass::GetClass( key->GetClassName() );
+		if( !cl ) continue;
+
+		// Only the latest cycle
+		if( dir->GetKey( key->GetName() ) != key ) continue;
+
+		// Go through the subdirectories too
+		if( cl->InheritsFrom( TDirectory::Class() ) ) {
+
+			RestoreHists( dir->GetDirectory( key->GetName() ) );
+			continue;
+
+		}
+
+		if( !cl->InheritsFrom( TH1::Class() ) ) continue;
+
+		// New, empty histogram with the same name
+		TH1 *hnew = (TH1*)dir->GetList()->FindObject( key->GetName() );
+		if( !hnew || hnew->GetEntries() > 0 ) continue;
+
+		// Add what was saved and throw away the copy
+		TH1 *hold = (TH1*)key->ReadObj();
+		if( !hold ) continue;
+		if( hold != hnew ) {
+			hnew->Add( hold );
+			delete hold;
+		}
+
+	}
+
+	return;
+
+}
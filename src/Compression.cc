@@ -0,0 +1,264 @@
+#include "Compression.hh"
+
+ISSCompression::ISSCompression( ISSSettings *myset, std::string mystage ){
+
+	stage = mystage;
+	algorithm = myset->GetCompression( stage );
+	std::transform( algorithm.begin(), algorithm.end(), algorithm.begin(), ::tolower );
+	level = myset->GetCompressionLevel( stage );
+	basket_size = myset->GetBasketSize( stage );
+	auto_flush = myset->GetAutoFlush( stage );
+
+	file = nullptr;
+	flag_sampling = false;
+
+}
+
+int ISSCompression::GetSettings( std::string alg, int lvl ){
+
+	// The usual levels, i.e. ROOT's own choices for analysis and general purpose
+	if( alg == "none" ) return 0;
+	else if( alg == "zlib" )
+		return ROOT::CompressionSettings( ROOT::RCompressionSetting::EAlgorithm::kZLIB, lvl ? lvl : 1 );
+	else if( alg == "lzma" )
+		return ROOT::CompressionSettings( ROOT::RCompressionSetting::EAlgorithm::kLZMA, lvl ? lvl : 5 );
+	else if( alg == "lz4" )
+		return ROOT::CompressionSettings( ROOT::RCompressionSetting::EAlgorithm::kLZ4, lvl ? lvl : 4 );
+	else if( alg == "zstd" )
+		return ROOT::CompressionSettings( ROOT::RCompressionSetting::EAlgorithm::kZSTD, lvl ? lvl : 5 );
+
+	return -1;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// In auto mode this starts collecting the sample, and the file keeps its
+/// default until the choice is made
+/// \param[in] f The output file, just opened
+void ISSCompression::Apply( TFile *f ){
+
+	file = f;
+	trees.clear();
+	report.str( std::string() );
+
+	if( algorithm == "auto" ) {
+
+		sample.reset();
+		flag_sampling = true;
+
+	}
+
+	else {
+
+		flag_sampling = false;
+		int settings = GetSettings( algorithm, level );
+		if( settings >= 0 ) Use( settings );
+		else if( algorithm != "default" )
+			std::cerr << stage << "Compression: " << algorithm << " is unknown, using the default" << std::endl;
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] t The output tree, with its branches made
+/// \param[in] autoflush Cluster size in bytes, unless there is one in the settings
+void ISSCompression::Apply( TTree *t, double autoflush ){
+
+	if( basket_size > 0 ) t->SetBasketSize( "*", basket_size );
+	if( auto_flush > 0 ) t->SetAutoFlush( -auto_flush * 1e6 );
+	else t->SetAutoFlush( -autoflush );
+
+	// The file's compression is only for new branches
+	if( file && algorithm != "auto" ) {
+
+		int settings = GetSettings( algorithm, level );
+		if( settings >= 0 ) {
+
+			TIter next( t->GetListOfBranches() );
+			while( TBranch *b = (TBranch*)next() )
+				b->SetCompressionSettings( settings );
+
+		}
+
+	}
+
+	trees.push_back( t );
+
+	return;
+
+}
+
+void ISSCompression::Sample( void *obj, TClass *cl ){
+
+	if( !flag_sampling ) return;
+	if( !sample )
+		sample = std::make_unique<TBufferFile>( TBuffer::kWrite, kSampleBytes + ( 1 << 20 ) );
+
+	sample->WriteObjectAny( obj, cl );
+	if( sample->Length() >= kSampleBytes ) Choose();
+
+	return;
+
+}
+
+void ISSCompression::Use( int settings ){
+
+	if( file ) file->SetCompressionSettings( settings );
+
+	for( unsigned int i = 0; i < trees.size(); ++i ) {
+
+		TIter next( trees[i]->GetListOfBranches() );
+		while( TBranch *b = (TBranch*)next() )
+			b->SetCompressionSettings( settings );
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The sample is compressed in pieces of the basket size, like ROOT does, and
+/// the time per byte of each algorithm is the time to compress and decompress
+/// it plus the time to write and read the compressed data at the disk speed
+void ISSCompression::Choose(){
+
+	flag_sampling = false;
+
+	char *src = sample->Buffer();
+	int length = sample->Length();
+	int chunk = basket_size > 0 ? basket_size : 32000;
+	std::vector<char> zipped( chunk + 1024 ), unzipped( chunk );
+
+	std::string dir = file ? gSystem->GetDirName( file->GetName() ).Data() : ".";
+	double disk = GetDiskSpeed( dir );
+
+	std::vector<std::string> algs = { "lz4", "zstd", "zlib" };
+	std::string best;
+	double best_time = -1;
+	report << "  " << stage << " compression auto, disk = " << disk / 1e6 << " MB/s" << std::endl;
+
+	for( unsigned int i = 0; i < algs.size(); ++i ) {
+
+		int settings = GetSettings( algs[i], level );
+		auto alg = (ROOT::RCompressionSetting::EAlgorithm::EValues)( settings / 100 );
+		double zip_time = 0, unzip_time = 0, zip_bytes = 0;
+
+		for( int pos = 0; pos < length; pos += chunk ) {
+
+			int srcsize = std::min( chunk, length - pos );
+			int tgtsize = zipped.size();
+			int irep = 0;
+
+			auto t0 = std::chrono::steady_clock::now();
+			R__zipMultipleAlgorithm( settings % 100, &srcsize, src + pos, &tgtsize, zipped.data(), &irep, alg );
+			auto t1 = std::chrono::steady_clock::now();
+			zip_time += std::chrono::duration<double>( t1 - t0 ).count();
+
+			// Incompressible pieces are written as they are
+			if( irep <= 0 || irep >= srcsize ) {
+
+				zip_bytes += srcsize;
+				continue;
+
+			}
+			zip_bytes += irep;
+
+			int zipsize = irep, outsize = srcsize, nout = 0;
+			t0 = std::chrono::steady_clock::now();
+			R__unzip( &zipsize, (unsigned char*)zipped.data(), &outsize, (unsigned char*)unzipped.data(), &nout );
+			t1 = std::chrono::steady_clock::now();
+			unzip_time += std::chrono::duration<double>( t1 - t0 ).count();
+
+		}
+
+		// Time for all of the sample, from being filled to being read again
+		double total = zip_time + unzip_time + 2.0 * zip_bytes / disk;
+		report << "   " << std::setw(4) << algs[i] << ": ratio = " << std::setprecision(3);
+		report << length / zip_bytes << ", compress = " << length / zip_time / 1e6;
+		report << " MB/s, decompress = " << length / unzip_time / 1e6 << " MB/s, overall = ";
+		report << length / total / 1e6 << " MB/s" << std::setprecision(6) << std::endl;
+
+		if( best_time < 0 || total < best_time ) {
+
+			best_time = total;
+			best = algs[i];
+
+		}
+
+	}
+
+	report << "   Using " << best << std::endl;
+	Use( GetSettings( best, level ) );
+	sample.reset();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Writes 32 MB of random data to a temporary file and waits for it to reach
+/// the disk. This is only done once, for the first directory that is asked for.
+/// \param[in] dir The directory of the output files
+/// \return The speed in bytes/s
+double ISSCompression::GetDiskSpeed( std::string dir ){
+
+	static std::mutex disk_mutex;
+	static double disk_speed = 0;
+
+	std::lock_guard<std::mutex> lock( disk_mutex );
+	if( disk_speed > 0 ) return disk_speed;
+
+	const int kBlock = 1 << 20;
+	const int kBlocks = 32;
+	std::vector<unsigned int> block( kBlock / sizeof(unsigned int) );
+	std::mt19937 rng( 12345 );
+	for( unsigned int i = 0; i < block.size(); ++i ) block[i] = rng();
+
+	std::string name = dir + "/.iss_disk_speed_" + std::to_string( gSystem->GetPid() );
+	FILE *fp = fopen( name.data(), "wb" );
+	if( !fp ) {
+
+		// Something reasonable for a local disk
+		disk_speed = 200e6;
+		return disk_speed;
+
+	}
+
+	auto t0 = std::chrono::steady_clock::now();
+	for( int i = 0; i < kBlocks; ++i ) {
+
+		// Different data each time, so it can't be deduplicated
+		block[0] = i;
+		fwrite( block.data(), 1, kBlock, fp );
+
+	}
+	fflush( fp );
+	fsync( fileno( fp ) );
+	auto t1 = std::chrono::steady_clock::now();
+	fclose( fp );
+	gSystem->Unlink( name.data() );
+
+	double seconds = std::chrono::duration<double>( t1 - t0 ).count();
+	disk_speed = seconds > 0 ? (double)kBlock * kBlocks / seconds : 200e6;
+
+	return disk_speed;
+
+}
+
+std::string ISSCompression::GetReport(){
+
+	// Not enough data for auto mode to decide
+	if( flag_sampling && sample && sample->Length() ) Choose();
+
+	std::stringstream ss;
+	ss << report.str();
+	if( algorithm != "auto" && algorithm != "default" )
+		ss << "  " << stage << " compression = " << algorithm << std::endl;
+
+	return ss.str();
+
+}
@@ -6,6 +6,7 @@ ISSConverter::ISSConverter( ISSSettings *myset ) {
 	set = myset;
 
 	my_tm_stp_msb = 0;
+	my_tm_stp_msb_asic = 0;
 	my_tm_stp_hsb = 0;
 	
 	// Resize counters
@@ -19,16 +20,50 @@ ISSConverter::ISSConverter( ISSSettings *myset ) {
 	// Start counters at zero
 	StartFile();
 	
+	// Compression of the output, from the settings
+	compression = std::make_unique<ISSCompression>( set, "Convert" );
+	
 	// Default that we do not have a source only run
 	flag_source = false;
 	
+	// Print progress to the terminal by default
+	flag_quiet = false;
+	flag_print_memory = false;
+	
+	// Write the sorted tree by default
+	flag_write_sorted = true;
+	
+	// No calibration until one is added
+	cal = nullptr;
+	cal_reader = -1;
+	
+	// No checkpoints unless asked for
+	ckpt_interval = 0;
+	ckpt_time = 0;
+	flag_resume = false;
+	resume_next = 0;
+	write_packet = nullptr;
+	
+	// Start from the first block asked for
+	warmup_blocks = 0;
+	warmup_end = 0;
+	flag_record_counters = false;
+	counter_tree = nullptr;
+	
 	// No progress bar by default
 	_prog_ = false;
 	
+	// No metrics by default
+	_metrics_ = false;
+	met_blocks = nullptr;
+	
 }
 
 void ISSConverter::StartFile(){
 	
+	// No bad blocks yet
+	flag_bad_header = false;
+	
 	// Start counters at zero
 	for( unsigned int i = 0; i < set->GetNumberOfArrayModules(); ++i ) {
 				
@@ -46,6 +81,10 @@ void ISSConverter::StartFile(){
 
 	}
 	
+	// Hits counted for the metrics start again too
+	met_asic_last.assign( set->GetNumberOfArrayModules(), 0 );
+	met_caen_last.assign( set->GetNumberOfCAENModules(), 0 );
+	
 	return;
 	
 }
@@ -54,7 +93,7 @@ void ISSConverter::SetOutput( std::string output_file_name ){
 
 	// Open output file
 	output_file = new TFile( output_file_name.data(), "recreate" );
-	//if( !flag_source ) output_file->SetCompressionLevel(0);
+	compression->Apply( output_file );
 
 	return;
 
@@ -73,11 +112,87 @@ void ISSConverter::MakeTree() {
 	sorted_tree = (TTree*)output_tree->CloneTree(0);
 	sorted_tree->SetName("iss_sort");
 	sorted_tree->SetTitle( "Time sorted, calibrated ISS data" );
+	ISSReorderBuffer::MarkRawTimes( sorted_tree );
 	sorted_tree->SetDirectory( output_file->GetDirectory("/") );
 	output_tree->SetDirectory( output_file->GetDirectory("/") );
 	
-	output_tree->SetAutoFlush(-10e6);
-	sorted_tree->SetAutoFlush(-10e6);
+	// A shard keeps the times behind its profiles of hit number, see MergeCounters()
+	if( flag_record_counters ) {
+		
+		counter_tree = new TTree( "iss_counters", "Times filled in the profiles of hit number" );
+		counter_tree->Branch( "counter", &rec_counter, "counter/b" );
+		counter_tree->Branch( "module", &rec_module, "module/s" );
+		counter_tree->Branch( "time", &rec_time, "time/l" );
+		counter_tree->SetDirectory( output_file->GetDirectory("/") );
+		
+	}
+	
+	// Cluster size, smaller if we are short of memory
+	double autoflush = membudget.GetShare( 0.01, 10e6 );
+	compression->Apply( output_tree, autoflush );
+	compression->Apply( sorted_tree, autoflush );
+
+	asic_data = std::make_shared<ISSAsicData>();
+	caen_data = std::make_shared<ISSCaenData>();
+	info_data = std::make_shared<ISSInfoData>();
+
+	asic_data->ClearData();
+	caen_data->ClearData();
+	info_data->ClearData();
+	
+	return;
+	
+}
+
+// Reopen the output of a job that was stopped and restore the state from the checkpoint
+bool ISSConverter::ResumeOutput( std::string output_file_name ){
+	
+	flag_resume = false;
+	if( !ckpt.GetFile().size() || !ckpt.Load() ) return false;
+	
+	// Has to be for the same input, settings and calibration
+	std::string tag;
+	ckpt.Get( "tag", tag );
+	if( ckpt_tag.size() && tag != ckpt_tag ) {
+		
+		std::cout << " Checkpoint " << ckpt.GetFile() << " is for different inputs, starting again" << std::endl;
+		ckpt.Remove();
+		return false;
+		
+	}
+	
+	if( gSystem->AccessPathName( output_file_name.data() ) ) return false;
+	output_file = new TFile( output_file_name.data(), "update" );
+	if( output_file->IsZombie() ) {
+		
+		delete output_file;
+		return false;
+		
+	}
+	
+	// The trees must be as they were when the checkpoint was made
+	unsigned long long raw_entries = 0, sorted_entries = 0;
+	ckpt.Get( "raw_entries", raw_entries );
+	ckpt.Get( "sorted_entries", sorted_entries );
+	output_tree = (TTree*)output_file->Get( "iss" );
+	sorted_tree = (TTree*)output_file->Get( "iss_sort" );
+	if( !output_tree || !sorted_tree ||
+	    (unsigned long long)output_tree->GetEntries() != raw_entries ||
+	    (unsigned long long)sorted_tree->GetEntries() != sorted_entries ) {
+		
+		std::cout << " Checkpoint " << ckpt.GetFile() << " doesn't match ";
+		std::cout << output_file_name << ", starting again" << std::endl;
+		output_file->Close();
+		delete output_file;
+		return false;
+		
+	}
+	
+	// Same data objects as in MakeTree()
+	data_packet = std::make_unique<ISSDataPackets>();
+	write_packet = data_packet.get();
+	output_tree->SetBranchAddress( "data", &write_packet );
+	sorted_tree->SetBranchAddress( "data", &write_packet );
 
 	asic_data = std::make_shared<ISSAsicData>();
 	caen_data = std::make_shared<ISSCaenData>();
@@ -87,6 +202,64 @@ void ISSConverter::MakeTree() {
 	caen_data->ClearData();
 	info_data->ClearData();
 	
+	// Decoder state
+	ckpt.Get( "stage", resume_stage );
+	ckpt.Get( "next", resume_next );
+	ckpt.Get( "tm_stp", my_tm_stp );
+	ckpt.Get( "tm_stp_msb", my_tm_stp_msb );
+	ckpt.Get( "tm_stp_msb_asic", my_tm_stp_msb_asic );
+	ckpt.Get( "tm_stp_hsb", my_tm_stp_hsb );
+	ckpt.Get( "ctr_asic_hit", ctr_asic_hit );
+	ckpt.Get( "ctr_asic_ext", ctr_asic_ext );
+	ckpt.Get( "ctr_asic_pause", ctr_asic_pause );
+	ckpt.Get( "ctr_asic_resume", ctr_asic_resume );
+	ckpt.Get( "ctr_caen_hit", ctr_caen_hit );
+	ckpt.Get( "ctr_caen_ext", ctr_caen_ext );
+	
+	// Same random numbers for the calibration as we would have had
+	UInt_t seed;
+	if( cal && ckpt.Get( "seed", seed ) ) cal->SetRandomSeed( seed );
+
+	// Histograms carry on from what was saved
+	MakeHists();
+	ISSCheckpoint::RestoreHists( output_file );
+	
+	std::cout << " Resuming " << output_file_name << " from checkpoint, ";
+	std::cout << resume_stage << " at " << resume_next << std::endl;
+	flag_resume = true;
+	
+	return true;
+	
+}
+
+// Flush everything to disk and record where we are
+void ISSConverter::WriteCheckpoint( std::string stage, unsigned long long next ){
+	
+	output_tree->FlushBaskets();
+	sorted_tree->FlushBaskets();
+	output_file->Write( 0, TObject::kWriteDelete );
+	
+	ckpt.Clear();
+	ckpt.Set( "tag", ckpt_tag );
+	ckpt.Set( "stage", stage );
+	ckpt.Set( "next", next );
+	ckpt.Set( "raw_entries", output_tree->GetEntries() );
+	ckpt.Set( "sorted_entries", sorted_tree->GetEntries() );
+	ckpt.Set( "tm_stp", my_tm_stp );
+	ckpt.Set( "tm_stp_msb", my_tm_stp_msb );
+	ckpt.Set( "tm_stp_msb_asic", my_tm_stp_msb_asic );
+	ckpt.Set( "tm_stp_hsb", my_tm_stp_hsb );
+	ckpt.Set( "ctr_asic_hit", ctr_asic_hit );
+	ckpt.Set( "ctr_asic_ext", ctr_asic_ext );
+	ckpt.Set( "ctr_asic_pause", ctr_asic_pause );
+	ckpt.Set( "ctr_asic_resume", ctr_asic_resume );
+	ckpt.Set( "ctr_caen_hit", ctr_caen_hit );
+	ckpt.Set( "ctr_caen_ext", ctr_caen_ext );
+	if( cal ) ckpt.Set( "seed", cal->GetRandomSeed() );
+	ckpt.Save();
+	
+	ckpt_time = time(0);
+	
 	return;
 	
 }
@@ -455,13 +628,17 @@ void ISSConverter::MakeHists() {
 
 	}
 	
+	// Memory taken by the histograms, and where to keep track of it
+	memusage.MakeHists( output_file );
+	memusage.ScanHists( output_file );
+	
 	return;
 	
 }
 
 void ISSConverter::ResetHists() {
 	
-	std::cout << "in ISSConverter::ResetHist()" << std::endl;
+	if( !flag_quiet ) std::cout << "in ISSConverter::ResetHist()" << std::endl;
 	
 	for( unsigned int i = 0; i < hasic_hit.size(); ++i )
 		hasic_hit[i]->Reset("ICESM");
@@ -517,6 +694,137 @@ void ISSConverter::ResetHists() {
 	
 }
 
+std::string ISSConverter::GetCounterName( counter_t c ){
+	
+	switch( c ) {
+		case kAsicHit:		return "hasic_hit";
+		case kAsicExt:		return "hasic_ext";
+		case kAsicPause:	return "hasic_pause";
+		case kAsicResume:	return "hasic_resume";
+		case kCaenHit:		return "hcaen_hit";
+		case kCaenExt:		return "hcaen_ext";
+		default:			return "";
+	}
+	
+}
+
+void ISSConverter::RecordCounter( counter_t c, unsigned int mod, TProfile *p,
+								  unsigned long ctr, unsigned long time ){
+	
+	// Only a shard records, and only what is inside the axis,
+	// the hits after that are all in the overflow bin
+	if( !counter_tree || ctr >= p->GetXaxis()->GetXmax() ) return;
+	
+	rec_counter = c;
+	rec_module = mod;
+	rec_time = time;
+	counter_tree->Fill();
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The profiles of time versus hit number use the count of hits so far as x,
+/// which starts again from zero in each shard, so adding them with hadd puts
+/// the Nth hit of every shard in the same bin. Instead, they are emptied and
+/// filled again from the times each shard recorded, with its hits numbered on
+/// from the hits of the shards before it. Hits past the end of the axis in a
+/// shard are only in its overflow bin, which is added as it is.
+/// \param[in] merged_file The output of hadd, opened for update
+/// \param[in] shard_files The shards, in the order of the run file
+/// \return false if a shard has no record of its profiles
+bool ISSConverter::MergeCounters( TFile *merged_file, std::vector<TFile*> &shard_files ){
+	
+	// The profiles that hadd made, emptied
+	std::vector<std::vector<TProfile*>> hmerged( kNumberOfCounters );
+	for( unsigned int c = 0; c < kNumberOfCounters; ++c ) {
+		
+		for( unsigned int m = 0; ; ++m ) {
+			
+			std::string hname = "timing_hists/" + GetCounterName( (counter_t)c ) + std::to_string(m);
+			TProfile *p = (TProfile*)merged_file->Get( hname.data() );
+			if( !p ) break;
+			p->Reset("ICESM");
+			hmerged[c].push_back( p );
+			
+		}
+		
+	}
+	
+	// Hits in the shards so far, and recorded in this one
+	std::vector<std::vector<unsigned long>> offset( kNumberOfCounters );
+	std::vector<std::vector<unsigned long>> nrec( kNumberOfCounters );
+	for( unsigned int c = 0; c < kNumberOfCounters; ++c )
+		offset[c].resize( hmerged[c].size(), 0 );
+	
+	for( unsigned int s = 0; s < shard_files.size(); ++s ) {
+		
+		TTree *t = (TTree*)shard_files[s]->Get( "iss_counters" );
+		if( !t ) {
+			
+			std::cerr << shard_files[s]->GetName() << " has no iss_counters tree" << std::endl;
+			return false;
+			
+		}
+		
+		unsigned char counter;
+		unsigned short module;
+		ULong64_t time;
+		t->SetBranchAddress( "counter", &counter );
+		t->SetBranchAddress( "module", &module );
+		t->SetBranchAddress( "time", &time );
+		
+		for( unsigned int c = 0; c < kNumberOfCounters; ++c )
+			nrec[c].assign( hmerged[c].size(), 0 );
+		
+		// Same order as the hits were in the run file
+		for( long long i = 0; i < t->GetEntries(); ++i ) {
+			
+			t->GetEntry(i);
+			if( counter >= kNumberOfCounters || module >= hmerged[counter].size() ) continue;
+			hmerged[counter][module]->Fill( offset[counter][module] + nrec[counter][module], time, 1 );
+			nrec[counter][module]++;
+			
+		}
+		t->ResetBranchAddresses();
+		
+		// Add the overflow of the shard, and move on by all of its hits
+		for( unsigned int c = 0; c < kNumberOfCounters; ++c ) {
+			
+			for( unsigned int m = 0; m < hmerged[c].size(); ++m ) {
+				
+				std::string hname = "timing_hists/" + GetCounterName( (counter_t)c ) + std::to_string(m);
+				TProfile *q = (TProfile*)shard_files[s]->Get( hname.data() );
+				if( !q ) {
+					
+					std::cerr << shard_files[s]->GetName() << " has no " << hname << std::endl;
+					return false;
+					
+				}
+				
+				TProfile *p = hmerged[c][m];
+				int ovf = p->GetNbinsX() + 1;
+				p->GetArray()[ovf] += q->GetArray()[ovf];
+				p->SetBinEntries( ovf, p->GetBinEntries( ovf ) + q->GetBinEntries( ovf ) );
+				if( p->GetSumw2N() && q->GetSumw2N() )
+					p->GetSumw2()->AddAt( p->GetSumw2()->At( ovf ) + q->GetSumw2()->At( ovf ), ovf );
+				if( p->GetBinSumw2()->GetSize() && q->GetBinSumw2()->GetSize() )
+					p->GetBinSumw2()->AddAt( p->GetBinSumw2()->At( ovf ) + q->GetBinSumw2()->At( ovf ), ovf );
+				p->SetEntries( p->GetEntries() + q->GetEntries() - nrec[c][m] );
+				
+				offset[c][m] += (unsigned long)q->GetEntries();
+				
+			}
+			
+		}
+		
+	}
+	
+	return true;
+	
+}
+
 // Function to copy the header from a DataSpy, for example
 void ISSConverter::SetBlockHeader( char *input_header ){
 	
@@ -570,7 +878,7 @@ void ISSConverter::ProcessBlockHeader( unsigned long nblock ){
 	if( std::string(header_id).substr(0,8) != "EBYEDATA" ) {
 	
 		std::cerr << "Bad header in block " << nblock << std::endl;
-		exit(0);
+		flag_bad_header = true;
 	
 	}
 	
@@ -595,6 +903,8 @@ void ISSConverter::SetBlockData( char *input_data ){
 
 // Function to process data words
 void ISSConverter::ProcessBlockData( unsigned long nblock ){
+
+	ISSTimingScope scope( timing, ISSTiming::kBlock );
 	
 	// Get the data in 64-bit words and check endieness and swap if needed
 	// Data format here: http://npg.dl.ac.uk/documents/edoc504/edoc504.html
@@ -692,8 +1002,8 @@ void ISSConverter::ProcessBlockData( unsigned long nblock ){
 			// Get the samples from the trace
 			for( UInt_t j = 0; j < nsamples; j++ ){
 				
-				// get next word
-				ULong64_t sample_packet = GetWord(i++);
+				// get next word, after the trace header
+				ULong64_t sample_packet = GetWord(++i);
 
 				UInt_t block_test = ( sample_packet >> 32 ) & 0x00000000FFFFFFFF;
 				unsigned char trace_test = ( sample_packet >> 62 ) & 0x0000000000000003;
@@ -741,6 +1051,8 @@ void ISSConverter::ProcessBlockData( unsigned long nblock ){
 
 void ISSConverter::ProcessASICData(){
 
+	ISSTimingScope scope( timing, ISSTiming::kAsic );
+
 	// ISS/R3B ASIC data format
 	my_hit = ( word_0 >> 29 ) & 0x1;
 	my_adc_data = word_0 & 0xFFF; // 12 bits from 0
@@ -804,6 +1116,7 @@ void ISSConverter::ProcessASICData(){
 		hasic[my_mod_id][my_asic_id]->Fill( my_ch_id, my_adc_data );
 		hasic_cal[my_mod_id][my_asic_id]->Fill( my_ch_id, my_energy );
 		hasic_hit[my_mod_id]->Fill( ctr_asic_hit[my_mod_id], my_tm_stp, 1 );
+		RecordCounter( kAsicHit, my_mod_id, hasic_hit[my_mod_id], ctr_asic_hit[my_mod_id], my_tm_stp );
 
 		if( my_asic_id == 0 || my_asic_id == 2 || my_asic_id == 3 || my_asic_id == 5 )
 			hpside[my_mod_id]->Fill( my_energy );
@@ -811,8 +1124,8 @@ void ISSConverter::ProcessASICData(){
 			hnside[my_mod_id]->Fill( my_energy );
 
 
-		// Make an AsicData item
-		asic_data->SetTime( my_tm_stp + cal->AsicTime( my_mod_id, my_asic_id ) );
+		// Make an AsicData item, the time offset is added by the event builder
+		asic_data->SetTime( my_tm_stp );
 		asic_data->SetWalk( (int)cal->AsicWalk( my_mod_id, my_asic_id, my_energy ) );
 		asic_data->SetAdcValue( my_adc_data );
 		asic_data->SetHitBit( my_hit );
@@ -843,6 +1156,8 @@ void ISSConverter::ProcessASICData(){
 
 void ISSConverter::ProcessCAENData(){
 
+	ISSTimingScope scope( timing, ISSTiming::kCaen );
+
 	// CAEN data format
 	my_adc_data = word_0 & 0xFFFF; // 16 bits from 0
 	
@@ -964,6 +1279,8 @@ void ISSConverter::FinishCAENData(){
 
 		// Fill histograms
 		hcaen_hit[caen_data->GetModule()]->Fill( ctr_caen_hit[caen_data->GetModule()], caen_data->GetTime(), 1 );
+		RecordCounter( kCaenHit, caen_data->GetModule(), hcaen_hit[caen_data->GetModule()],
+					   ctr_caen_hit[caen_data->GetModule()], caen_data->GetTime() );
 
 		// Check if this is actually just a timestamp
 		flag_caen_info = false;
@@ -1013,8 +1330,8 @@ void ISSConverter::FinishCAENData(){
 		// If this is a timestamp, fill an info event
 		if( flag_caen_info ) {
 				
-			// Add the time offset to this channel
-			info_data->SetTime( caen_data->GetTime() + cal->CaenTime( caen_data->GetModule(), caen_data->GetChannel() ) );
+			// The time offset of this channel is added by the event builder
+			info_data->SetTime( caen_data->GetTime() );
 			info_data->SetModule( caen_data->GetModule() + set->GetNumberOfArrayModules() );
 			info_data->SetCode( my_info_code );
 			data_packet->SetData( info_data );
@@ -1025,6 +1342,8 @@ void ISSConverter::FinishCAENData(){
 			if( my_info_code == 20 ) {
 				
 				hcaen_ext[caen_data->GetModule()]->Fill( ctr_caen_ext[caen_data->GetModule()], caen_data->GetTime(), 1 );
+				RecordCounter( kCaenExt, caen_data->GetModule(), hcaen_ext[caen_data->GetModule()],
+							   ctr_caen_ext[caen_data->GetModule()], caen_data->GetTime() );
 
 				// Count external trigger event
 				ctr_caen_ext[caen_data->GetModule()]++;
@@ -1061,8 +1380,7 @@ void ISSConverter::FinishCAENData(){
 
 
 			// Set this data and fill event to tree
-			// Also add the time offset when we do this
-			caen_data->SetTime( caen_data->GetTime() + cal->CaenTime( caen_data->GetModule(), caen_data->GetChannel() ) );
+			// The time offset is added by the event builder, after sorting
 			data_packet->SetData( caen_data );
 			if( !flag_source ) output_tree->Fill();
 			data_packet->ClearData();
@@ -1105,6 +1423,8 @@ void ISSConverter::FinishCAENData(){
 
 void ISSConverter::ProcessInfoData(){
 
+	ISSTimingScope scope( timing, ISSTiming::kInfo );
+
 	// MIDAS info data format
 	my_mod_id = (word_0 >> 24) & 0x003F; // bits 24:29
 
@@ -1145,6 +1465,7 @@ void ISSConverter::ProcessInfoData(){
 		my_tm_stp_msb = my_info_field & 0x000FFFFF;
 		my_tm_stp = ( my_tm_stp_hsb << 48 ) | ( my_tm_stp_msb << 28 ) | ( my_tm_stp_lsb & 0x0FFFFFFF );
 		hasic_ext[my_mod_id]->Fill( ctr_asic_ext[my_mod_id], my_tm_stp, 1 );
+		RecordCounter( kAsicExt, my_mod_id, hasic_ext[my_mod_id], ctr_asic_ext[my_mod_id], my_tm_stp );
 		ctr_asic_ext[my_mod_id]++;
 
 	}
@@ -1163,6 +1484,7 @@ void ISSConverter::ProcessInfoData(){
 		my_tm_stp_msb = my_info_field & 0x000FFFFF;
 		my_tm_stp = ( my_tm_stp_hsb << 48 ) | ( my_tm_stp_msb << 28 ) | ( my_tm_stp_lsb & 0x0FFFFFFF );
 		hasic_pause[my_mod_id]->Fill( ctr_asic_pause[my_mod_id], my_tm_stp, 1 );
+		RecordCounter( kAsicPause, my_mod_id, hasic_pause[my_mod_id], ctr_asic_pause[my_mod_id], my_tm_stp );
 		ctr_asic_pause[my_mod_id]++;
 
     }
@@ -1173,6 +1495,7 @@ void ISSConverter::ProcessInfoData(){
 		my_tm_stp_msb = my_info_field & 0x000FFFFF;
 		my_tm_stp = ( my_tm_stp_hsb << 48 ) | ( my_tm_stp_msb << 28 ) | ( my_tm_stp_lsb & 0x0FFFFFFF );
 		hasic_resume[my_mod_id]->Fill( ctr_asic_resume[my_mod_id], my_tm_stp, 1 );
+		RecordCounter( kAsicResume, my_mod_id, hasic_resume[my_mod_id], ctr_asic_resume[my_mod_id], my_tm_stp );
 		ctr_asic_resume[my_mod_id]++;
 
     }
@@ -1200,12 +1523,32 @@ void ISSConverter::ProcessInfoData(){
 // Common function called to process data in a block from file or DataSpy
 bool ISSConverter::ProcessCurrentBlock( int nblock ) {
 	
+	ISS_PROBE1( block_start, nblock );
+
+	// A new calibration is only picked up between blocks
+	if( calstore ) cal = calstore->Acquire( cal_reader );
+	if( cal ) data_packet->SetCalibrationVersion( cal->GetVersion() );
+
 	// Process header.
 	ProcessBlockHeader( nblock );
+	if( flag_bad_header ) return false;
+	if( _metrics_ && (unsigned long)nblock >= warmup_end ) ISSMetrics::Add( met_blocks );
+
+#ifdef ISS_PROBES_ENABLED
+	// Hits so far, so the probe can give the hits in this block
+	unsigned long nasic = std::accumulate( ctr_asic_hit.begin(), ctr_asic_hit.end(), 0ul );
+	unsigned long ncaen = std::accumulate( ctr_caen_hit.begin(), ctr_caen_hit.end(), 0ul );
+#endif
 
 	// Process the main block data until terminator found
 	data = (ULong64_t *)(block_data);
 	ProcessBlockData( nblock );
+	
+#ifdef ISS_PROBES_ENABLED
+	ISS_PROBE3( block_end, nblock,
+			   std::accumulate( ctr_asic_hit.begin(), ctr_asic_hit.end(), 0ul ) - nasic,
+			   std::accumulate( ctr_caen_hit.begin(), ctr_caen_hit.end(), 0ul ) - ncaen );
+#endif
 			
 	// Check once more after going over left overs....
 	if( !flag_terminator && flag_asic_data ){
@@ -1253,12 +1596,20 @@ int ISSConverter::ConvertFile( std::string input_file_name,
 		
 	}
 	
-	// Reset counters
-	StartFile();
+	// Reset counters, unless they came from a checkpoint
+	if( !flag_resume ) StartFile();
+	else flag_bad_header = false;
+	ckpt_time = time(0);
+	
+	// Carry on from the block after the checkpoint
+	if( flag_resume && resume_stage == "convert" )
+		start_block = resume_next;
 
 	// Conversion starting
-	std::cout << "Converting file: " << input_file_name;
-	std::cout << " from block " << start_block << std::endl;
+	if( !flag_quiet ) {
+		std::cout << "Converting file: " << input_file_name;
+		std::cout << " from block " << start_block << std::endl;
+	}
 	
 	
 	// Calculate the size of the file.
@@ -1284,7 +1635,7 @@ int ISSConverter::ConvertFile( std::string input_file_name,
 	sslogs << "\tBlock size = " << DATA_BLOCK_SIZE << std::endl;
 	sslogs << "\t  N blocks = " << BLOCKS_NUM << std::endl;
 
-	std::cout << sslogs.str() << std::endl;
+	if( !flag_quiet ) std::cout << sslogs.str() << std::endl;
 	sslogs.str( std::string() ); // clean up
 	
 	// Data format: http://npg.dl.ac.uk/documents/edoc504/edoc504.html
@@ -1292,8 +1643,27 @@ int ISSConverter::ConvertFile( std::string input_file_name,
 	// We will collect the data in 64 bit words and split later
 	
 	
+	// The conversion was already finished before the job stopped
+	if( flag_resume && resume_stage == "sort" )
+		start_block = BLOCKS_NUM;
+	
+	// A shard of a run starts with a few blocks from the one before,
+	// so that the timestamp bits from the info data are known
+	unsigned long first_block = start_block;
+	if( !flag_resume && warmup_blocks > 0 && start_block < BLOCKS_NUM )
+		first_block = start_block > warmup_blocks ? start_block - warmup_blocks : 0;
+	
+	// The warm up blocks are not counted in the metrics, the previous shard has them
+	warmup_end = first_block < start_block ? start_block : 0;
+	
+	// Go straight to the first block rather than reading everything before it
+	input_file.seekg( (unsigned long long)first_block * DATA_BLOCK_SIZE, input_file.beg );
+	
 	// Loop over all the blocks.
-	for( unsigned long nblock = 0; nblock < BLOCKS_NUM ; nblock++ ){
+	for( unsigned long nblock = first_block; nblock < BLOCKS_NUM ; nblock++ ){
+		
+		// Stop if the job was cancelled from the GUI
+		if( _prog_ && prog->IsCancelled() ) break;
 		
 		// Take one block each time and analyze it.
 		if( nblock % 200 == 0 || nblock+1 == BLOCKS_NUM ) {
@@ -1302,17 +1672,18 @@ int ISSConverter::ConvertFile( std::string input_file_name,
 			float percent = (float)(nblock+1)*100.0/(float)BLOCKS_NUM;
 			
 			// Progress bar in GUI
-			if( _prog_ ) {
-				
-				prog->SetPosition( percent );
-				gSystem->ProcessEvents();
-				
-			}
+			if( _prog_ ) prog->SetPosition( percent );
+			
+			// Keep track of the memory as we go
+			AccountMemory();
+			UpdateMetrics();
 
 			// Progress bar in terminal
-			std::cout << " " << std::setw(8) << std::setprecision(4);
-			std::cout << percent << "%\r";
-			std::cout.flush();
+			if( !flag_quiet ) {
+				std::cout << " " << std::setw(8) << std::setprecision(4);
+				std::cout << percent << "%\r";
+				std::cout.flush();
+			}
 
 		}
 
@@ -1323,24 +1694,47 @@ int ISSConverter::ConvertFile( std::string input_file_name,
 		input_file.read( (char*)&block_data, MAIN_SIZE );
 
 
-		// Check if we are before the start block or after the end block
-		if( nblock < start_block || ( (long)nblock > end_block && end_block > 0 ) )
-			continue;
+		// Check if we are after the end block
+		if( (long)nblock > end_block && end_block > 0 )
+			break;
+		
+		// Throw away everything from the warm up, the previous shard has it
+		if( nblock == start_block && first_block < start_block ) {
+			
+			output_tree->Reset();
+			if( counter_tree ) counter_tree->Reset();
+			ResetHists();
+			StartFile();
+			
+			if( !my_tm_stp_msb && !my_tm_stp_msb_asic ) {
+				std::cout << " *WARNING* no timestamp found in the " << warmup_blocks;
+				std::cout << " blocks before block " << start_block << std::endl;
+			}
+			
+		}
 		
 		
 		// Each time we have completed a block, optimise filling
 		if( nblock == start_block + 1 )
-			output_tree->OptimizeBaskets(30e6);	 // output tree basket size max 30 MB
+			output_tree->OptimizeBaskets( membudget.GetShare( 0.02, 30e6 ) ); // output tree basket size max 30 MB
 
 
 		// Process current block. If it's the end, stop.
 		if( !ProcessCurrentBlock( nblock ) ) break;
 		
+		// Save our progress every so often
+		if( CheckpointDue() ) WriteCheckpoint( "convert", nblock+1 );
 		
 	} // loop - nblock < BLOCKS_NUM
 	
 	// Close input
 	input_file.close();
+	UpdateMetrics();
+	
+	// The sort can be restarted without converting again
+	if( ckpt_interval > 0 && !flag_source && !flag_bad_header &&
+	    !( flag_resume && resume_stage == "sort" ) )
+		WriteCheckpoint( "sort", 0 );
 	
 	// Print time
 	//std::cout << "Last time stamp in file = " << my_tm_stp << std::endl;
@@ -1349,20 +1743,90 @@ int ISSConverter::ConvertFile( std::string input_file_name,
 	
 }
 
+void ISSConverter::AddMetrics( std::shared_ptr<ISSMetrics> mymetrics ){
+	
+	metrics = mymetrics;
+	_metrics_ = true;
+	
+	met_blocks = metrics->AddCounter( "iss_blocks_total", "Data blocks converted" );
+	
+	met_asic_hits.clear();
+	for( unsigned int i = 0; i < set->GetNumberOfArrayModules(); ++i )
+		met_asic_hits.push_back( metrics->AddCounter( "iss_hits_total", "Hits converted on each module",
+			"system=\"asic\",module=\"" + std::to_string(i) + "\"" ) );
+	
+	met_caen_hits.clear();
+	for( unsigned int i = 0; i < set->GetNumberOfCAENModules(); ++i )
+		met_caen_hits.push_back( metrics->AddCounter( "iss_hits_total", "Hits converted on each module",
+			"system=\"caen\",module=\"" + std::to_string(i) + "\"" ) );
+	
+	return;
+	
+}
+
+void ISSConverter::UpdateMetrics(){
+	
+	if( !_metrics_ ) return;
+	
+	// Hits are counted per module already, so only the new ones are added,
+	// rather than touching the metrics for every hit
+	for( unsigned int i = 0; i < met_asic_hits.size(); ++i ) {
+		
+		if( ctr_asic_hit[i] < met_asic_last[i] ) met_asic_last[i] = 0;
+		ISSMetrics::Add( met_asic_hits[i], ctr_asic_hit[i] - met_asic_last[i] );
+		met_asic_last[i] = ctr_asic_hit[i];
+		
+	}
+	
+	for( unsigned int i = 0; i < met_caen_hits.size(); ++i ) {
+		
+		if( ctr_caen_hit[i] < met_caen_last[i] ) met_caen_last[i] = 0;
+		ISSMetrics::Add( met_caen_hits[i], ctr_caen_hit[i] - met_caen_last[i] );
+		met_caen_last[i] = ctr_caen_hit[i];
+		
+	}
+	
+	return;
+	
+}
+
+void ISSConverter::AccountMemory(){
+	
+	// The hit being decoded, and the trees that all the others are in
+	memusage.Set( ISSMemoryUsage::kHits, data_packet ? data_packet->GetMemory() : 0 );
+	memusage.Set( ISSMemoryUsage::kTraces, data_packet ? data_packet->GetTraceMemory() : 0 );
+	memusage.Set( ISSMemoryUsage::kTrees, ISSMemoryUsage::TreeBytes( output_tree ) +
+				 ISSMemoryUsage::TreeBytes( sorted_tree ) );
+	
+	return;
+	
+}
+
 unsigned long long ISSConverter::SortTree(){
+
+	ISSTimingScope scope( timing, ISSTiming::kSort );
 	
-	// Reset the sorted tree so it's empty before we start
-	sorted_tree->Reset();
+	// Reset the sorted tree so it's empty before we start,
+	// unless we are carrying on from a checkpoint
+	unsigned long start_entry = 0;
+	if( flag_resume && resume_stage == "sort" ) start_entry = resume_next;
+	else sorted_tree->Reset();
+	flag_resume = false;
+	ISS_PROBE1( sort_start, output_tree->GetEntries() );
 	
-	// Load the full tree if possible
-	output_tree->SetMaxVirtualSize(2e9); // 2GB
-	sorted_tree->SetMaxVirtualSize(2e9); // 2GB
-	output_tree->LoadBaskets(1e9); 		 // Load 1 GB of data to memory
+	// Load the full tree if possible, within the memory budget
+	output_tree->SetMaxVirtualSize( membudget.GetShare( 0.35, 2e9 ) ); // 2GB
+	sorted_tree->SetMaxVirtualSize( membudget.GetShare( 0.35, 2e9 ) ); // 2GB
+	output_tree->LoadBaskets( membudget.GetShare( 0.25, 1e9 ) );		// Load 1 GB of data to memory
+	
+	// Spill to disk sooner when there's less memory
+	double mem_full = membudget.GetShare( 0.02, 30e6 );
 	
 	// Check we have entries and build time-ordered index
 	if( output_tree->GetEntries() ){
 
-		std::cout << "\n Building time-ordered index of events..." << std::endl;
+		if( !flag_quiet )
+			std::cout << "\n Building time-ordered index of events..." << std::endl;
 		output_tree->BuildIndex( "data.GetTime()" );
 
 	}
@@ -1371,10 +1835,15 @@ unsigned long long ISSConverter::SortTree(){
 	// Get index and prepare for sorting
 	TTreeIndex *att_index = (TTreeIndex*)output_tree->GetTreeIndex();
 	unsigned long long nb_idx = att_index->GetN();
-	std::cout << " Sorting: size of the sorted index = " << nb_idx << std::endl;
+	ISS_PROBE1( sort_index, nb_idx );
+	if( !flag_quiet )
+		std::cout << " Sorting: size of the sorted index = " << nb_idx << std::endl;
 
 	// Loop on t_raw entries and fill t
-	for( unsigned long i = 0; i < nb_idx; ++i ) {
+	for( unsigned long i = start_entry; i < nb_idx; ++i ) {
+		
+		// Stop if the job was cancelled from the GUI
+		if( _prog_ && prog->IsCancelled() ) break;
 		
 		// Clean up old data
 		data_packet->ClearData();
@@ -1383,17 +1852,27 @@ unsigned long long ISSConverter::SortTree(){
 		unsigned long long idx = att_index->GetIndex()[i];
 		
 		// Check if the input or output trees are filling
-		if( output_tree->MemoryFull(30e6) )
+		if( output_tree->MemoryFull( mem_full ) )
 			output_tree->DropBaskets();
-		if( sorted_tree->MemoryFull(30e6) )
+		if( flag_write_sorted && sorted_tree->MemoryFull( mem_full ) )
 			sorted_tree->FlushBaskets();
 		
 		// Get entry from unsorted tree and fill to sorted tree
 		output_tree->GetEntry( idx );
-		sorted_tree->Fill();
+		if( flag_write_sorted ) sorted_tree->Fill();
+		if( flag_write_sorted && compression->IsSampling() )
+			compression->Sample( data_packet.get() );
+		
+		// Hand the hit straight on to the next stage
+		if( hit_callback ) hit_callback( data_packet.get() );
 
-		// Optimise filling tree
-		if( i == 100 ) sorted_tree->OptimizeBaskets(30e6);	 // sorted tree basket size max 30 MB
+		// Optimise filling tree, unless the basket size is in the settings
+		if( flag_write_sorted && i == 100 && !compression->GetBasketSize() )
+			sorted_tree->OptimizeBaskets( mem_full );	 // sorted tree basket size max 30 MB
+		
+		// Save our progress every so often
+		if( flag_write_sorted && i+1 < nb_idx && CheckpointDue() )
+			WriteCheckpoint( "sort", i+1 );
 
 		// Progress bar
 		bool update_progress = false;
@@ -1407,19 +1886,20 @@ unsigned long long ISSConverter::SortTree(){
 			
 			// Percent complete
 			float percent = (float)(i+1)*100.0/(float)nb_idx;
+			ISS_PROBE2( sort_progress, i+1, nb_idx );
 			
 			// Progress bar in GUI
-			if( _prog_ ) {
-				
-				prog->SetPosition( percent );
-				gSystem->ProcessEvents();
-				
-			}
+			if( _prog_ ) prog->SetPosition( percent );
+			
+			// Keep track of the memory as we go
+			AccountMemory();
 			
 			// Progress bar in terminal
-			std::cout << " " << std::setw(6) << std::setprecision(4);
-			std::cout << percent << "%    \r";
-			std::cout.flush();
+			if( !flag_quiet ) {
+				std::cout << " " << std::setw(6) << std::setprecision(4);
+				std::cout << percent << "%    \r";
+				std::cout.flush();
+			}
 
 		}
 
@@ -1428,6 +1908,10 @@ unsigned long long ISSConverter::SortTree(){
 	// Reset the output tree so it's empty after we've finished
 	output_tree->FlushBaskets();
 	output_tree->Reset();
+	ISS_PROBE1( sort_end, nb_idx );
+	
+	// What the compression is, and why
+	if( !flag_quiet ) std::cout << compression->GetReport();
 
 	return nb_idx;
 	
@@ -15,6 +15,42 @@ ISSEventBuilder::ISSEventBuilder( ISSSettings *myset ){
 	
 	// No progress bar by default
 	_prog_ = false;
+	
+	// No metrics by default
+	_metrics_ = false;
+	met_hits = nullptr;
+	met_events = nullptr;
+	
+	// Print to the terminal by default
+	flag_quiet = false;
+	flag_print_memory = false;
+
+	// Write the events to the tree, no stream or callback by default
+	flag_write_tree = true;
+	mem_full = 30e6;
+	input_file = nullptr;
+	input_tree = nullptr;
+	read_data = nullptr;
+	in_data = nullptr;
+	
+	// Time offsets from the calibration, if there is one, added after sorting
+	calstore = nullptr;
+	cal_reader = -1;
+	reorder = std::make_unique<ISSReorderBuffer>( set );
+	flag_raw_time = true;
+	held_time = 0;
+	held_entry = 0;
+	flag_restart_skip = false;
+	restart_time = 0;
+	restart_last = 0;
+	
+	// No checkpoints unless asked for
+	ckpt_interval = 0;
+	ckpt_time = 0;
+	flag_restart = false;
+	restart_entry = 0;
+	restart_evts = nullptr;
+	restart_compact = nullptr;
 
 	// ------------------------------------------------------------------------ //
 	// Initialise variables and flags
@@ -234,8 +270,14 @@ void ISSEventBuilder::SetInputTree( TTree *user_tree ){
 	
 	// Find the tree and set branch addresses
 	input_tree = user_tree;
+	read_data = nullptr;
 	in_data = nullptr;
-	input_tree->SetBranchAddress( "data", &in_data );
+	input_tree->SetBranchAddress( "data", &read_data );
+	
+	// Files converted before the offsets were added here already have them
+	flag_raw_time = ISSReorderBuffer::HasRawTimes( input_tree );
+	if( !flag_raw_time && !flag_quiet )
+		std::cout << " Time offsets are already in " << input_tree->GetName() << ", convert again to change them" << std::endl;
 
 	return;
 	
@@ -247,6 +289,32 @@ void ISSEventBuilder::SetInputTree( TTree *user_tree ){
 void ISSEventBuilder::SetOutput( std::string output_file_name ) {
 
 	// These are the branches we need
+	MakeEventObjects();
+
+	// ------------------------------------------------------------------------ //
+	// Create output file and create events tree
+	// ------------------------------------------------------------------------ //
+	output_file = new TFile( output_file_name.data(), "recreate" );
+	compression->Apply( output_file );
+	output_tree = new TTree( "evt_tree", "evt_tree" );
+	if( packer ) output_tree->Branch( "ISSCompactEvts", "ISSCompactEvts", packer->GetCompactEvts() );
+	else output_tree->Branch( "ISSEvts", "ISSEvts", write_evts.get() );
+	compression->Apply( output_tree, membudget.GetShare( 0.03, 30e6 ) );
+
+	// Create log file.
+	std::string log_file_name = output_file_name.substr( 0, output_file_name.find_last_of(".") );
+	log_file_name += ".log";
+	log_file.open( log_file_name.data(), std::ios::app );
+	
+	// Hisograms in separate function
+	MakeHists();
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Creates the event containers that are filled by the finders and written to the output tree
+void ISSEventBuilder::MakeEventObjects() {
+
 	write_evts	= std::make_unique<ISSEvts>();
 	array_evt	= std::make_shared<ISSArrayEvt>();
 	arrayp_evt	= std::make_shared<ISSArrayPEvt>();
@@ -256,21 +324,229 @@ void ISSEventBuilder::SetOutput( std::string output_file_name ) {
 	zd_evt		= std::make_shared<ISSZeroDegreeEvt>();
 	gamma_evt	= std::make_shared<ISSGammaRayEvt>();
 
-	// ------------------------------------------------------------------------ //
-	// Create output file and create events tree
-	// ------------------------------------------------------------------------ //
-	output_file = new TFile( output_file_name.data(), "recreate" );
-	output_tree = new TTree( "evt_tree", "evt_tree" );
-	output_tree->Branch( "ISSEvts", "ISSEvts", write_evts.get() );
-	output_tree->SetAutoFlush();
+	// Quantised events for the tree
+	if( set->GetCompactEvents() ) packer = std::make_unique<ISSEventPacker>( set );
+	else packer.reset();
 
-	// Create log file.
+	// Conditions for writing the events
+	if( set->GetNumberOfWriteConditions() ) selector = std::make_unique<ISSEventSelector>( set );
+	else selector.reset();
+
+	// Compression of the output file
+	compression = std::make_unique<ISSCompression>( set, "Build" );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Reopens the output file of a job that was stopped part way through, after ISSEventBuilder::SetInputFile, and restores the counters, the timing signals and the random numbers of the calibration from the checkpoint, so the job carries on exactly where it was at the time of the checkpoint.
+/// \param [in] output_file_name The ROOT file of the events from the previous attempt
+/// \return false if there is no usable checkpoint, then ISSEventBuilder::SetOutput should be used instead
+bool ISSEventBuilder::ResumeOutput( std::string output_file_name ) {
+	
+	flag_restart = false;
+	if( !ckpt.GetFile().size() || !ckpt.Load() ) return false;
+	
+	// Has to be for the same input, settings and calibration
+	std::string tag;
+	ckpt.Get( "tag", tag );
+	if( ckpt_tag.size() && tag != ckpt_tag ) {
+		
+		std::cout << " Checkpoint " << ckpt.GetFile() << " is for different inputs, starting again" << std::endl;
+		ckpt.Remove();
+		return false;
+		
+	}
+	
+	if( gSystem->AccessPathName( output_file_name.data() ) ) return false;
+	output_file = new TFile( output_file_name.data(), "update" );
+	if( output_file->IsZombie() ) {
+		
+		delete output_file;
+		return false;
+		
+	}
+	
+	// The tree must be as it was when the checkpoint was made
+	unsigned long long events = 0;
+	ckpt.Get( "events", events );
+	output_tree = (TTree*)output_file->Get( "evt_tree" );
+	if( !output_tree || (unsigned long long)output_tree->GetEntries() != events ) {
+		
+		std::cout << " Checkpoint " << ckpt.GetFile() << " doesn't match ";
+		std::cout << output_file_name << ", starting again" << std::endl;
+		output_file->Close();
+		delete output_file;
+		return false;
+		
+	}
+	
+	MakeEventObjects();
+	if( packer ) {
+		restart_compact = packer->GetCompactEvts();
+		output_tree->SetBranchAddress( "ISSCompactEvts", &restart_compact );
+	}
+	else {
+		restart_evts = write_evts.get();
+		output_tree->SetBranchAddress( "ISSEvts", &restart_evts );
+	}
+
+	// Same log file as SetOutput
 	std::string log_file_name = output_file_name.substr( 0, output_file_name.find_last_of(".") );
 	log_file_name += ".log";
 	log_file.open( log_file_name.data(), std::ios::app );
 	
-	// Hisograms in separate function
+	// Timing signals
+	ckpt.Get( "next", restart_entry );
+	flag_restart_skip = ckpt.Get( "last_time", restart_time ) && ckpt.Get( "last_entry", restart_last );
+	ckpt.Get( "time_prev", time_prev );
+	ckpt.Get( "time_min", time_min );
+	ckpt.Get( "time_max", time_max );
+	ckpt.Get( "time_first", time_first );
+	ckpt.Get( "caen_time", caen_time );
+	ckpt.Get( "caen_prev", caen_prev );
+	ckpt.Get( "ebis_prev", ebis_prev );
+	ckpt.Get( "t1_prev", t1_prev );
+	ckpt.Get( "sc_prev", sc_prev );
+	ckpt.Get( "laser_prev", laser_prev );
+	ckpt.Get( "flag_caen_pulser", flag_caen_pulser );
+	ckpt.Get( "flag_pause", flag_pause );
+	ckpt.Get( "flag_resume", flag_resume );
+	ckpt.Get( "pause_time", pause_time );
+	ckpt.Get( "resume_time", resume_time );
+	ckpt.Get( "asic_dead_time", asic_dead_time );
+	ckpt.Get( "asic_time_start", asic_time_start );
+	ckpt.Get( "asic_time_stop", asic_time_stop );
+	ckpt.Get( "asic_time", asic_time );
+	ckpt.Get( "asic_prev", asic_prev );
+	ckpt.Get( "fpga_time", fpga_time );
+	ckpt.Get( "fpga_prev", fpga_prev );
+	ckpt.Get( "caen_time_start", caen_time_start );
+	ckpt.Get( "caen_time_stop", caen_time_stop );
+	
+	// Counters
+	ckpt.Get( "n_asic_data", n_asic_data );
+	ckpt.Get( "n_caen_data", n_caen_data );
+	ckpt.Get( "n_info_data", n_info_data );
+	ckpt.Get( "n_caen_pulser", n_caen_pulser );
+	ckpt.Get( "n_ebis", n_ebis );
+	ckpt.Get( "n_t1", n_t1 );
+	ckpt.Get( "n_sc", n_sc );
+	ckpt.Get( "n_laser", n_laser );
+	ckpt.Get( "n_fpga_pulser", n_fpga_pulser );
+	ckpt.Get( "n_asic_pulser", n_asic_pulser );
+	ckpt.Get( "n_asic_pause", n_asic_pause );
+	ckpt.Get( "n_asic_resume", n_asic_resume );
+	ckpt.Get( "array_ctr", array_ctr );
+	ckpt.Get( "arrayp_ctr", arrayp_ctr );
+	ckpt.Get( "recoil_ctr", recoil_ctr );
+	ckpt.Get( "mwpc_ctr", mwpc_ctr );
+	ckpt.Get( "elum_ctr", elum_ctr );
+	ckpt.Get( "zd_ctr", zd_ctr );
+	ckpt.Get( "gamma_ctr", gamma_ctr );
+	if( selector ) {
+		std::vector<unsigned long long> matched( selector->GetNumberOfConditions() + 1 );
+		std::vector<unsigned long long> written( selector->GetNumberOfConditions() + 1 );
+		if( ckpt.Get( "selection_matched", matched ) && ckpt.Get( "selection_written", written ) )
+			selector->SetCounters( matched, written );
+	}
+	
+	// Same random numbers for the calibration as we would have had
+	UInt_t seed;
+	if( overwrite_cal && ckpt.Get( "seed", seed ) ) cal->SetRandomSeed( seed );
+
+	// Histograms carry on from what was saved
 	MakeHists();
+	ISSCheckpoint::RestoreHists( output_file );
+	
+	std::cout << " Resuming " << output_file_name << " from checkpoint at entry ";
+	std::cout << restart_entry << std::endl;
+	flag_restart = true;
+
+	return true;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Writes the events and histograms so far to disk and then saves everything needed to carry on from the next entry. Only called between events, so there is never a partly built event to save.
+/// \param [in] next The first entry of the next event
+void ISSEventBuilder::WriteCheckpoint( unsigned long long next ) {
+	
+	output_tree->FlushBaskets();
+	if( selector ) selector->Write( output_file );
+	output_file->Write( 0, TObject::kWriteDelete );
+	
+	ckpt.Clear();
+	ckpt.Set( "tag", ckpt_tag );
+	ckpt.Set( "next", next );
+	ckpt.Set( "events", output_tree->GetEntries() );
+	
+	// Last hit out of the reorder buffer, the ones before it are dropped after a restart
+	if( flag_raw_time ) {
+		ckpt.Set( "last_time", held_time );
+		ckpt.Set( "last_entry", held_entry );
+	}
+	
+	// Timing signals
+	ckpt.Set( "time_prev", time_prev );
+	ckpt.Set( "time_min", time_min );
+	ckpt.Set( "time_max", time_max );
+	ckpt.Set( "time_first", time_first );
+	ckpt.Set( "caen_time", caen_time );
+	ckpt.Set( "caen_prev", caen_prev );
+	ckpt.Set( "ebis_prev", ebis_prev );
+	ckpt.Set( "t1_prev", t1_prev );
+	ckpt.Set( "sc_prev", sc_prev );
+	ckpt.Set( "laser_prev", laser_prev );
+	ckpt.Set( "flag_caen_pulser", flag_caen_pulser );
+	ckpt.Set( "flag_pause", flag_pause );
+	ckpt.Set( "flag_resume", flag_resume );
+	ckpt.Set( "pause_time", pause_time );
+	ckpt.Set( "resume_time", resume_time );
+	ckpt.Set( "asic_dead_time", asic_dead_time );
+	ckpt.Set( "asic_time_start", asic_time_start );
+	ckpt.Set( "asic_time_stop", asic_time_stop );
+	ckpt.Set( "asic_time", asic_time );
+	ckpt.Set( "asic_prev", asic_prev );
+	ckpt.Set( "fpga_time", fpga_time );
+	ckpt.Set( "fpga_prev", fpga_prev );
+	ckpt.Set( "caen_time_start", caen_time_start );
+	ckpt.Set( "caen_time_stop", caen_time_stop );
+	
+	// Counters
+	ckpt.Set( "n_asic_data", n_asic_data );
+	ckpt.Set( "n_caen_data", n_caen_data );
+	ckpt.Set( "n_info_data", n_info_data );
+	ckpt.Set( "n_caen_pulser", n_caen_pulser );
+	ckpt.Set( "n_ebis", n_ebis );
+	ckpt.Set( "n_t1", n_t1 );
+	ckpt.Set( "n_sc", n_sc );
+	ckpt.Set( "n_laser", n_laser );
+	ckpt.Set( "n_fpga_pulser", n_fpga_pulser );
+	ckpt.Set( "n_asic_pulser", n_asic_pulser );
+	ckpt.Set( "n_asic_pause", n_asic_pause );
+	ckpt.Set( "n_asic_resume", n_asic_resume );
+	ckpt.Set( "array_ctr", array_ctr );
+	ckpt.Set( "arrayp_ctr", arrayp_ctr );
+	ckpt.Set( "recoil_ctr", recoil_ctr );
+	ckpt.Set( "mwpc_ctr", mwpc_ctr );
+	ckpt.Set( "elum_ctr", elum_ctr );
+	ckpt.Set( "zd_ctr", zd_ctr );
+	ckpt.Set( "gamma_ctr", gamma_ctr );
+	if( selector ) {
+		std::vector<unsigned long long> matched, written;
+		selector->GetCounters( matched, written );
+		ckpt.Set( "selection_matched", matched );
+		ckpt.Set( "selection_written", written );
+	}
+	
+	if( overwrite_cal ) ckpt.Set( "seed", cal->GetRandomSeed() );
+	ckpt.Save();
+	
+	ckpt_time = time(0);
+	
+	return;
 	
 }
 
@@ -367,9 +643,10 @@ unsigned long ISSEventBuilder::BuildEvents() {
 	/// Function to loop over the sort tree and build array and recoil events
 
 	// Load the full tree if possible
-	output_tree->SetMaxVirtualSize(5e8); // 500 MB
-	input_tree->SetMaxVirtualSize(5e8); // 500 MB
-	input_tree->LoadBaskets(5e8); // Load 500 MB of data to memory
+	output_tree->SetMaxVirtualSize( membudget.GetShare( 0.25, 5e8 ) ); // 500 MB
+	input_tree->SetMaxVirtualSize( membudget.GetShare( 0.25, 5e8 ) ); // 500 MB
+	input_tree->LoadBaskets( membudget.GetShare( 0.25, 5e8 ) ); // Load 500 MB of data to memory
+	mem_full = membudget.GetShare( 0.03, 30e6 );
 
 	if( input_tree->LoadTree(0) < 0 ){
 		
@@ -381,618 +658,860 @@ unsigned long ISSEventBuilder::BuildEvents() {
 	// Get ready and go
 	Initialise();
 	n_entries = input_tree->GetEntries();
+	ckpt_time = time(0);
+	
+	// Offsets of the latest calibration in the monitor
+	if( calstore ) reorder->SetCalibration( calstore->Acquire( cal_reader ) );
+	reorder->Reset();
+	reorder->Recycle( std::move( held_hit ) );
+	
+	// Carry on from the event after the checkpoint
+	unsigned long start_entry = 0;
+	if( flag_restart && restart_entry < n_entries ) {
+		start_entry = restart_entry;
+		if( flag_raw_time && flag_restart_skip )
+			reorder->SetSkip( restart_time, restart_last );
+	}
+	flag_restart = false;
 
-	std::cout << " Event Building: number of entries in input tree = ";
-	std::cout << n_entries << std::endl;
+	if( !flag_quiet ) {
+		std::cout << " Event Building: number of entries in input tree = ";
+		std::cout << n_entries << std::endl;
+	}
 
 	
+	// Hits already counted for the metrics
+	unsigned long met_hits_last = start_entry;
+	
 	// ------------------------------------------------------------------------ //
 	// Main loop over TTree to find events
 	// ------------------------------------------------------------------------ //
-	for( unsigned long i = 0; i < n_entries; ++i ) {
+	for( unsigned long i = start_entry; i < n_entries; ++i ) {
+		
+		// Stop if the job was cancelled from the GUI
+		if( _prog_ && prog->IsCancelled() ) break;
 		
 		// Current event data
-		if( input_tree->MemoryFull(30e6) )
+		if( input_tree->MemoryFull( mem_full ) )
 			input_tree->DropBaskets();
-		if( i == 0 ) input_tree->GetEntry(i);
-		
-		// Get the time of the event
-		mytime = in_data->GetTime();
 		
-		//std::cout << i << "\t" << mytime << std::endl;
-				
-		// check time stamp monotonically increases!
-		if( time_prev > mytime ) {
+		// Raw timestamps get their offsets in the reorder buffer, and
+		// the hits that come out of it are built into events
+		if( flag_raw_time ) {
 			
-			std::cout << "Out of order event in file ";
-			std::cout << input_tree->GetName() << std::endl;
+			input_tree->GetEntry(i);
+			reorder->Push( read_data, i );
+			NextHits();
 			
 		}
 		
-		// record time of this event
-		time_prev = mytime;
-		
-		// assume this is above threshold initially
-		mythres = true;
-		
-		
-		// ------------------------------------------ //
-		// Find particles on the array
-		// ------------------------------------------ //
-		if( in_data->IsAsic() ) {
+		else {
 			
-			// Increment event counter
-			n_asic_data++;
+			if( i == start_entry ) input_tree->GetEntry(i);
+			in_data = read_data;
 			
-			asic_data = in_data->GetAsicData();
-			mymod = asic_data->GetModule();
-			mych = asic_data->GetChannel();
-			myasic = asic_data->GetAsic();
-			myside = asic_side.at( myasic );
-			myrow = array_row.at( myasic ).at( mych );
-			if( overwrite_cal ) {
+			// Process this hit, it's already in memory
+			ProcessHit();
 			
-				myenergy = cal->AsicEnergy( mymod, myasic,
-									 mych, asic_data->GetAdcValue() );
-				mywalk = cal->AsicWalk( mymod, myasic, myenergy );
+			//------------------------------
+			//  check if last datum from this event and do some cleanup
+			//------------------------------
+			if( input_tree->GetEntry(i+1) ) LookAhead();
 			
-				/*if( asic_data->GetAdcValue() > cal->AsicThreshold( mymod, myasic, mych ) )
-					mythres = true;
-				else mythres = false;*/
-				if( asic_data->GetAdcValue() < cal->AsicThreshold( mymod, myasic, mych ) )
-					mythres = false;
+			//----------------------------
+			// if close this event or last entry
+			//----------------------------
+			if( flag_close_event || (i+1) == n_entries ) {
+				
+				CloseEvent();
+				
+				// Save our progress every so often, between events
+				if( (i+1) < n_entries && flag_write_tree && CheckpointDue() )
+					WriteCheckpoint( i+1 );
 				
 			}
 			
-			else {
+		}
 				
-				myenergy = asic_data->GetEnergy();
-				mywalk = asic_data->GetWalk();
-				mythres = asic_data->IsOverThreshold();
+		// Progress bar
+		bool update_progress = false;
+		if( n_entries < 200 )
+			update_progress = true;
+		else if( i % (n_entries/100) == 0 || i+1 == n_entries )
+			update_progress = true;
+		
+		if( update_progress ) {
+
+			// Percent complete
+			float percent = (float)(i+1)*100.0/(float)n_entries;
+
+			// Progress bar in GUI
+			if( _prog_ ) prog->SetPosition( percent );
+
+			// Keep track of the memory as we go
+			AccountMemory();
 			
+			// Hits since the last update
+			if( _metrics_ ) ISSMetrics::Add( met_hits, i + 1 - met_hits_last );
+			met_hits_last = i + 1;
+
+			// Progress bar in terminal
+			if( !flag_quiet ) {
+				std::cout << " " << std::setw(6) << std::setprecision(4);
+				std::cout << percent << "%    \r";
+				std::cout.flush();
 			}
 
-			// If it's below zero in energy, consider it below threshold
-			if( myenergy < 0 ) mythres = false;
+		}
+		
+		
+	} // End of main loop over TTree to process raw MIDAS data entries (for n_entries)
+	
+	// Everything left in the reorder buffer
+	if( flag_raw_time ) {
+		
+		reorder->Finish();
+		NextHits();
+		LastHit();
+		
+	}
+	in_data = nullptr;
+	
+	// Statistics and writing the output
+	FinishEvents();
+	
+	return n_entries;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Processes the hit currently held in in_data, adding it to the open event or opening a new one. Timing signals from the info data are used to update the EBIS, T1, SuperCycle and pulser times.
+void ISSEventBuilder::ProcessHit(){
+	
+	// Get the time of the event
+	mytime = in_data->GetTime();
+	
+	//std::cout << i << "\t" << mytime << std::endl;
 			
-			// If it's below threshold do not use as window opener
-			if ( mythres ) event_open = true;
+	// check time stamp monotonically increases!
+	if( time_prev > mytime ) {
+		
+		std::cout << "Out of order event";
+		if( input_tree ) std::cout << " in file " << input_tree->GetName();
+		std::cout << std::endl;
+		
+	}
+	
+	// record time of this event
+	time_prev = mytime;
+	
+	// assume this is above threshold initially
+	mythres = true;
+	
+	
+	// ------------------------------------------ //
+	// Find particles on the array
+	// ------------------------------------------ //
+	if( in_data->IsAsic() ) {
+		
+		// Increment event counter
+		n_asic_data++;
+		
+		asic_data = in_data->GetAsicData();
+		mymod = asic_data->GetModule();
+		mych = asic_data->GetChannel();
+		myasic = asic_data->GetAsic();
+		myside = asic_side.at( myasic );
+		myrow = array_row.at( myasic ).at( mych );
+		if( overwrite_cal ) {
+		
+			myenergy = cal->AsicEnergy( mymod, myasic,
+								 mych, asic_data->GetAdcValue() );
+			mywalk = cal->AsicWalk( mymod, myasic, myenergy );
+		
+			/*if( asic_data->GetAdcValue() > cal->AsicThreshold( mymod, myasic, mych ) )
+				mythres = true;
+			else mythres = false;*/
+			if( asic_data->GetAdcValue() < cal->AsicThreshold( mymod, myasic, mych ) )
+				mythres = false;
 			
-			// p-side event
-			if( myside == 0 && mythres ) {
+		}
+		
+		else {
 			
-			// test here about hit bit value
-			//if( myside == 0 && !asic_data->GetHitBit() ) {
+			myenergy = asic_data->GetEnergy();
+			mywalk = asic_data->GetWalk();
+			mythres = asic_data->IsOverThreshold();
+		
+		}
 
-				mystrip = array_pid.at( myasic ).at( mych );
-				
-				// Only use if it is an event from a detector
-				if( mystrip >= 0 ) {
-							
-					pen_list.push_back( myenergy );
-					ptd_list.push_back( mytime + mywalk );
-					pmod_list.push_back( mymod );
-					pid_list.push_back( mystrip );
-					prow_list.push_back( myrow );
+		// If it's below zero in energy, consider it below threshold
+		if( myenergy < 0 ) mythres = false;
+		
+		// If it's below threshold do not use as window opener
+		if ( mythres ) event_open = true;
+		
+		// p-side event
+		if( myside == 0 && mythres ) {
+		
+		// test here about hit bit value
+		//if( myside == 0 && !asic_data->GetHitBit() ) {
 
-					hit_ctr++; // increase counter for bits of data included in this event
+			mystrip = array_pid.at( myasic ).at( mych );
+			
+			// Only use if it is an event from a detector
+			if( mystrip >= 0 ) {
+						
+				pen_list.push_back( myenergy );
+				ptd_list.push_back( mytime + mywalk );
+				pmod_list.push_back( mymod );
+				pid_list.push_back( mystrip );
+				prow_list.push_back( myrow );
+
+				hit_ctr++; // increase counter for bits of data included in this event
 
-				}
-				
 			}
+			
+		}
 
-			// n-side event
-			else if( myside == 1 && mythres ) {
+		// n-side event
+		else if( myside == 1 && mythres ) {
 
-			// test here about hit bit value
-			//else if( myside == 1 && asic_data->GetHitBit() ) {
+		// test here about hit bit value
+		//else if( myside == 1 && asic_data->GetHitBit() ) {
 
-				mystrip = array_nid.at( asic_data->GetAsic() ).at( asic_data->GetChannel() );
+			mystrip = array_nid.at( asic_data->GetAsic() ).at( asic_data->GetChannel() );
 
-				// Only use if it is an event from a detector
-				if( mystrip >= 0 ) {
-							
-					nen_list.push_back( myenergy );
-					ntd_list.push_back( mytime + mywalk );
-					nmod_list.push_back( mymod );
-					nid_list.push_back( mystrip );
-					nrow_list.push_back( myrow );
+			// Only use if it is an event from a detector
+			if( mystrip >= 0 ) {
+						
+				nen_list.push_back( myenergy );
+				ntd_list.push_back( mytime + mywalk );
+				nmod_list.push_back( mymod );
+				nid_list.push_back( mystrip );
+				nrow_list.push_back( myrow );
 
-					hit_ctr++; // increase counter for bits of data included in this event
+				hit_ctr++; // increase counter for bits of data included in this event
 
-				}
-				
 			}
-
-			// Is it the start event?
-			if( asic_time_start.at( mymod ) == 0 )
-				asic_time_start.at( mymod ) = mytime;
-			
-			// or is it the end event (we don't know so keep updating)
-			asic_time_stop.at( mymod ) = mytime;
 			
 		}
 
-		// ------------------------------------------ //
-		// Find recoils and other things
-		// ------------------------------------------ //
-		else if( in_data->IsCaen() ) {
-			
-			// Increment event counter
-			n_caen_data++;
-			
-			caen_data = in_data->GetCaenData();
-			mymod = caen_data->GetModule();
-			mych = caen_data->GetChannel();
+		// Is it the start event?
+		if( asic_time_start.at( mymod ) == 0 )
+			asic_time_start.at( mymod ) = mytime;
+		
+		// or is it the end event (we don't know so keep updating)
+		asic_time_stop.at( mymod ) = mytime;
+		
+	}
 
-			if( overwrite_cal ) {
-				
-				std::string entype = cal->CaenType( mymod, mych );
-				unsigned short adc_value = 0;
-				if( entype == "Qlong" ) adc_value = caen_data->GetQlong();
-				else if( entype == "Qshort" ) adc_value = caen_data->GetQshort();
-				else if( entype == "Qdiff" ) adc_value = caen_data->GetQdiff();
-				else {
-					std::cerr << "Incorrect CAEN energy type must be Qlong, Qshort or Qdiff" << std::endl;
-					adc_value = caen_data->GetQlong();
-				}
-				myenergy = cal->CaenEnergy( mymod, mych, adc_value );
-				
-				if( adc_value < cal->CaenThreshold( mymod, mych ) )
-					mythres = false;
+	// ------------------------------------------ //
+	// Find recoils and other things
+	// ------------------------------------------ //
+	else if( in_data->IsCaen() ) {
+		
+		// Increment event counter
+		n_caen_data++;
+		
+		caen_data = in_data->GetCaenData();
+		mymod = caen_data->GetModule();
+		mych = caen_data->GetChannel();
 
-			}
+		if( overwrite_cal ) {
 			
+			std::string entype = cal->CaenType( mymod, mych );
+			unsigned short adc_value = 0;
+			if( entype == "Qlong" ) adc_value = caen_data->GetQlong();
+			else if( entype == "Qshort" ) adc_value = caen_data->GetQshort();
+			else if( entype == "Qdiff" ) adc_value = caen_data->GetQdiff();
 			else {
-				
-				myenergy = caen_data->GetEnergy();
-				mythres = caen_data->IsOverThreshold();
-
+				std::cerr << "Incorrect CAEN energy type must be Qlong, Qshort or Qdiff" << std::endl;
+				adc_value = caen_data->GetQlong();
 			}
+			myenergy = cal->CaenEnergy( mymod, mych, adc_value );
 			
-			// If it's below threshold do not use as window opener
-			if( mythres ) event_open = true;
-
-			// DETERMINE WHICH TYPE OF CAEN EVENT THIS IS
-			// Is it a recoil?
-			if( set->IsRecoil( mymod, mych ) && mythres ) {
-				
-				mysector = set->GetRecoilSector( mymod, mych );
-				mylayer = set->GetRecoilLayer( mymod, mych );
-				
-				ren_list.push_back( myenergy );
-				rtd_list.push_back( mytime );
-				rid_list.push_back( mylayer );
-				rsec_list.push_back( mysector );
-
-				hit_ctr++; // increase counter for bits of data included in this event
+			if( adc_value < cal->CaenThreshold( mymod, mych ) )
+				mythres = false;
 
-			}
+		}
+		
+		else {
 			
-			// Is it an MWPC?
-			else if( set->IsMWPC( mymod, mych ) && mythres ) {
-				
-				mwpctac_list.push_back( myenergy );
-				mwpctd_list.push_back( mytime );
-				mwpcaxis_list.push_back( set->GetMWPCAxis( mymod, mych ) );
-				mwpcid_list.push_back( set->GetMWPCID( mymod, mych ) );
+			myenergy = caen_data->GetEnergy();
+			mythres = caen_data->IsOverThreshold();
 
-				hit_ctr++; // increase counter for bits of data included in this event
+		}
+		
+		// If it's below threshold do not use as window opener
+		if( mythres ) event_open = true;
 
-			}
+		// DETERMINE WHICH TYPE OF CAEN EVENT THIS IS
+		// Is it a recoil?
+		if( set->IsRecoil( mymod, mych ) && mythres ) {
 			
-			// Is it an ELUM?
-			else if( set->IsELUM( mymod, mych ) && mythres ) {
-				
-				mysector = set->GetELUMSector( mymod, mych );
-				
-				een_list.push_back( myenergy );
-				etd_list.push_back( mytime );
-				esec_list.push_back( mysector );
+			mysector = set->GetRecoilSector( mymod, mych );
+			mylayer = set->GetRecoilLayer( mymod, mych );
+			
+			ren_list.push_back( myenergy );
+			rtd_list.push_back( mytime );
+			rid_list.push_back( mylayer );
+			rsec_list.push_back( mysector );
 
-				hit_ctr++; // increase counter for bits of data included in this event
+			hit_ctr++; // increase counter for bits of data included in this event
 
-			}
+		}
+		
+		// Is it an MWPC?
+		else if( set->IsMWPC( mymod, mych ) && mythres ) {
+			
+			mwpctac_list.push_back( myenergy );
+			mwpctd_list.push_back( mytime );
+			mwpcaxis_list.push_back( set->GetMWPCAxis( mymod, mych ) );
+			mwpcid_list.push_back( set->GetMWPCID( mymod, mych ) );
 
-			// Is it a ZeroDegree?
-			else if( set->IsZD( mymod, mych ) && mythres ) {
-				
-				mylayer = set->GetZDLayer( mymod, mych );
-				
-				zen_list.push_back( myenergy );
-				ztd_list.push_back( mytime );
-				zid_list.push_back( mylayer );
-				
-				hit_ctr++; // increase counter for bits of data included in this event
+			hit_ctr++; // increase counter for bits of data included in this event
 
-			}
+		}
+		
+		// Is it an ELUM?
+		else if( set->IsELUM( mymod, mych ) && mythres ) {
 			
-			// Is it a ScintArray?
-			else if( set->IsScintArray( mymod, mych ) && mythres ) {
+			mysector = set->GetELUMSector( mymod, mych );
 			
-				myid = set->GetScintArrayDetector( mymod, mych );
-				
-				saen_list.push_back( myenergy );
-				satd_list.push_back( mytime );
-				said_list.push_back( myid );
-				
-				hit_ctr++; // increase counter for bits of data included in this event
+			een_list.push_back( myenergy );
+			etd_list.push_back( mytime );
+			esec_list.push_back( mysector );
 
-			}
-			
+			hit_ctr++; // increase counter for bits of data included in this event
+
+		}
 
-			// Is it the start event?
-			if( caen_time_start.at( mymod ) == 0 )
-				caen_time_start.at( mymod ) = mytime;
+		// Is it a ZeroDegree?
+		else if( set->IsZD( mymod, mych ) && mythres ) {
 			
-			// or is it the end event (we don't know so keep updating)
-			caen_time_stop.at( mymod ) = mytime;
+			mylayer = set->GetZDLayer( mymod, mych );
+			
+			zen_list.push_back( myenergy );
+			ztd_list.push_back( mytime );
+			zid_list.push_back( mylayer );
+			
+			hit_ctr++; // increase counter for bits of data included in this event
 
 		}
 		
+		// Is it a ScintArray?
+		else if( set->IsScintArray( mymod, mych ) && mythres ) {
 		
-		// ------------------------------------------ //
-		// Find info events, like timestamps etc
-		// ------------------------------------------ //
-		else if( in_data->IsInfo() ) {
-			
-			// Increment event counter
-			n_info_data++;
-			info_data = in_data->GetInfoData();
+			myid = set->GetScintArrayDetector( mymod, mych );
 			
-			// if there are no data so far, set this as time_first - multiple info events will just update this so won't be a problem
-			if( hit_ctr == 0 )
-				time_first = mytime;
+			saen_list.push_back( myenergy );
+			satd_list.push_back( mytime );
+			said_list.push_back( myid );
 			
-			
-			// CHECK ALL OF THE INFO DATA CODE VALUES
-			// Update EBIS time
-			// N.B. if you are exceeding the limits of long long, then your DAQ has been running too long
-			long long info_tdiff;
-			if( info_data->GetCode() == set->GetEBISCode() ){
-			
-				// Each ASIC module sends ebis_time signal, so make sure difference between last ebis pulse and now is longer than the time it takes for them all to enter the DAQ
-				info_tdiff = (long long)info_data->GetTime() - (long long)ebis_prev;
-				if( TMath::Abs( info_tdiff ) > 1e3 ){
-					
-					ebis_prev = info_data->GetTime();
-					if( ebis_prev != 0 ) ebis_period->Fill( info_tdiff );
-					n_ebis++;
-					
-				}
-				
-			}
+			hit_ctr++; // increase counter for bits of data included in this event
+
+		}
 		
-			// Update T1 time
-			else if( info_data->GetCode() == set->GetT1Code() ){
-				
-				info_tdiff = (long long)info_data->GetTime() - (long long)t1_prev;
-				if( TMath::Abs( info_tdiff ) > 1e3 ){
-				
-					t1_prev = info_data->GetTime();
-					if( t1_prev != 0 ){
-						t1_period->Fill( info_tdiff );
-						supercycle->Fill( t1_prev - sc_prev );
-					}
-					n_t1++;
 
-				}
+		// Is it the start event?
+		if( caen_time_start.at( mymod ) == 0 )
+			caen_time_start.at( mymod ) = mytime;
+		
+		// or is it the end event (we don't know so keep updating)
+		caen_time_stop.at( mymod ) = mytime;
 
-			}
-			
-			// Update SuperCycle time
-			else if( info_data->GetCode() == set->GetSCCode() ){
+	}
+	
+	
+	// ------------------------------------------ //
+	// Find info events, like timestamps etc
+	// ------------------------------------------ //
+	else if( in_data->IsInfo() ) {
+		
+		// Increment event counter
+		n_info_data++;
+		info_data = in_data->GetInfoData();
+		
+		// if there are no data so far, set this as time_first - multiple info events will just update this so won't be a problem
+		if( hit_ctr == 0 )
+			time_first = mytime;
+		
+		
+		// CHECK ALL OF THE INFO DATA CODE VALUES
+		// Update EBIS time
+		// N.B. if you are exceeding the limits of long long, then your DAQ has been running too long
+		long long info_tdiff;
+		if( info_data->GetCode() == set->GetEBISCode() ){
+		
+			// Each ASIC module sends ebis_time signal, so make sure difference between last ebis pulse and now is longer than the time it takes for them all to enter the DAQ
+			info_tdiff = (long long)info_data->GetTime() - (long long)ebis_prev;
+			if( TMath::Abs( info_tdiff ) > 1e3 ){
 				
-				info_tdiff = (long long)info_data->GetTime() - (long long)sc_prev;
-				if( TMath::Abs( info_tdiff ) > 1e3 ){
+				ebis_prev = info_data->GetTime();
+				if( ebis_prev != 0 ) ebis_period->Fill( info_tdiff );
+				n_ebis++;
 				
-					sc_prev = info_data->GetTime();
-					if( sc_prev != 0 ) sc_period->Fill( info_tdiff );
-					n_sc++;
-
+			}
+			
+		}
+	
+		// Update T1 time
+		else if( info_data->GetCode() == set->GetT1Code() ){
+			
+			info_tdiff = (long long)info_data->GetTime() - (long long)t1_prev;
+			if( TMath::Abs( info_tdiff ) > 1e3 ){
+			
+				t1_prev = info_data->GetTime();
+				if( t1_prev != 0 ){
+					t1_period->Fill( info_tdiff );
+					supercycle->Fill( t1_prev - sc_prev );
 				}
+				n_t1++;
 
 			}
-			
-			// Update Laser status time
-			else if( info_data->GetCode() == set->GetLaserCode() ){
-				
-				info_tdiff = (long long)info_data->GetTime() - (long long)laser_prev;
-				if( TMath::Abs( info_tdiff ) > 1e3 ){
-				
-					laser_prev = info_data->GetTime();
-					if( laser_prev != 0 ) laser_period->Fill( info_tdiff );
-					n_laser++;
 
-				}
+		}
+		
+		// Update SuperCycle time
+		else if( info_data->GetCode() == set->GetSCCode() ){
+			
+			info_tdiff = (long long)info_data->GetTime() - (long long)sc_prev;
+			if( TMath::Abs( info_tdiff ) > 1e3 ){
+			
+				sc_prev = info_data->GetTime();
+				if( sc_prev != 0 ) sc_period->Fill( info_tdiff );
+				n_sc++;
 
 			}
+
+		}
+		
+		// Update Laser status time
+		else if( info_data->GetCode() == set->GetLaserCode() ){
 			
-			// Update CAEN pulser time
-			else if( info_data->GetCode() == set->GetCAENPulserCode() ) {
-				
-				caen_time = info_data->GetTime();
-				if( caen_prev != 0 ) caen_period->Fill( caen_time - caen_prev );
-				flag_caen_pulser = true;
-				n_caen_pulser++;
-				
+			info_tdiff = (long long)info_data->GetTime() - (long long)laser_prev;
+			if( TMath::Abs( info_tdiff ) > 1e3 ){
+			
+				laser_prev = info_data->GetTime();
+				if( laser_prev != 0 ) laser_period->Fill( info_tdiff );
+				n_laser++;
 
 			}
 
-			// Update ISS pulser time in FPGA
-			else if( info_data->GetCode() == set->GetExternalTriggerCode() ) {
-			   
-				fpga_time[info_data->GetModule()] = info_data->GetTime();
-				info_tdiff = (long long)fpga_time[info_data->GetModule()] - (long long)fpga_prev[info_data->GetModule()];
+		}
+		
+		// Update CAEN pulser time
+		else if( info_data->GetCode() == set->GetCAENPulserCode() ) {
+			
+			caen_time = info_data->GetTime();
+			if( caen_prev != 0 ) caen_period->Fill( caen_time - caen_prev );
+			flag_caen_pulser = true;
+			n_caen_pulser++;
+			
 
-				if( fpga_prev[info_data->GetModule()] != 0 )
-					fpga_period[info_data->GetModule()]->Fill( info_tdiff );
+		}
 
-				n_fpga_pulser[info_data->GetModule()]++;
+		// Update ISS pulser time in FPGA
+		else if( info_data->GetCode() == set->GetExternalTriggerCode() ) {
+		   
+			fpga_time[info_data->GetModule()] = info_data->GetTime();
+			info_tdiff = (long long)fpga_time[info_data->GetModule()] - (long long)fpga_prev[info_data->GetModule()];
 
-			}
-			
-			// Update ISS pulser time in ASICs
-			else if( info_data->GetCode() == set->GetArrayPulserCode() ) {
-			   
-				asic_time[info_data->GetModule()] = info_data->GetTime();
-				info_tdiff = (long long)asic_time[info_data->GetModule()] - (long long)asic_prev[info_data->GetModule()];
+			if( fpga_prev[info_data->GetModule()] != 0 )
+				fpga_period[info_data->GetModule()]->Fill( info_tdiff );
 
-				if( asic_prev[info_data->GetModule()] != 0 )
-					asic_period[info_data->GetModule()]->Fill( info_tdiff );
+			n_fpga_pulser[info_data->GetModule()]++;
 
-				n_asic_pulser[info_data->GetModule()]++;
+		}
+		
+		// Update ISS pulser time in ASICs
+		else if( info_data->GetCode() == set->GetArrayPulserCode() ) {
+		   
+			asic_time[info_data->GetModule()] = info_data->GetTime();
+			info_tdiff = (long long)asic_time[info_data->GetModule()] - (long long)asic_prev[info_data->GetModule()];
 
+			if( asic_prev[info_data->GetModule()] != 0 )
+				asic_period[info_data->GetModule()]->Fill( info_tdiff );
+
+			n_asic_pulser[info_data->GetModule()]++;
+
+		}
+		
+		// Check the pause events for each module
+		else if( info_data->GetCode() == set->GetPauseCode() ) {
+			
+			if( info_data->GetModule() < set->GetNumberOfArrayModules() ) {
+			
+				n_asic_pause[info_data->GetModule()]++;
+				flag_pause[info_data->GetModule()] = true;
+				pause_time[info_data->GetModule()] = info_data->GetTime();
+			
 			}
 			
-			// Check the pause events for each module
-			else if( info_data->GetCode() == set->GetPauseCode() ) {
-				
-				if( info_data->GetModule() < set->GetNumberOfArrayModules() ) {
-				
-					n_asic_pause[info_data->GetModule()]++;
-					flag_pause[info_data->GetModule()] = true;
-					pause_time[info_data->GetModule()] = info_data->GetTime();
-				
-				}
-				
-				else{
-				
-					std::cerr << "Bad pause event in module " << (int)info_data->GetModule() << std::endl;
-					
-				}
+			else{
+			
+				std::cerr << "Bad pause event in module " << (int)info_data->GetModule() << std::endl;
 				
 			}
 			
-			// Check the resume events for each module
-			else if( info_data->GetCode() == set->GetResumeCode() ) {
-				
-				if( info_data->GetModule() < set->GetNumberOfArrayModules() ) {
-				
-					n_asic_resume[info_data->GetModule()]++;
-					flag_resume[info_data->GetModule()] = true;
-					resume_time[info_data->GetModule()] = info_data->GetTime();
+		}
+		
+		// Check the resume events for each module
+		else if( info_data->GetCode() == set->GetResumeCode() ) {
+			
+			if( info_data->GetModule() < set->GetNumberOfArrayModules() ) {
+			
+				n_asic_resume[info_data->GetModule()]++;
+				flag_resume[info_data->GetModule()] = true;
+				resume_time[info_data->GetModule()] = info_data->GetTime();
 
-					// If we didn't get the pause, module was stuck at start of run
-					if( !flag_pause[info_data->GetModule()] ) {
+				// If we didn't get the pause, module was stuck at start of run
+				if( !flag_pause[info_data->GetModule()] ) {
 
-						std::cout << "Module " << info_data->GetModule();
-						std::cout << " was blocked at start of run for ";
-						std::cout << (double)resume_time[info_data->GetModule()]/1e9;
-						std::cout << " seconds" << std::endl;
+					std::cout << "Module " << info_data->GetModule();
+					std::cout << " was blocked at start of run for ";
+					std::cout << (double)resume_time[info_data->GetModule()]/1e9;
+					std::cout << " seconds" << std::endl;
 
-					}
-					else{
-					
-						// Do have pause and resume -> work out the dead time
-						asic_dead_time[info_data->GetModule()] += resume_time[info_data->GetModule()];
-						asic_dead_time[info_data->GetModule()] -= pause_time[info_data->GetModule()];
-						
-						// Reset flags
-						flag_pause[info_data->GetModule()] = false;
-						flag_resume[info_data->GetModule()] = false;
-					
-					}
-				
 				}
+				else{
 				
-				else
-					std::cerr << "Bad resume event in module " << (int)info_data->GetModule() << std::endl;
+					// Do have pause and resume -> work out the dead time
+					asic_dead_time[info_data->GetModule()] += resume_time[info_data->GetModule()];
+					asic_dead_time[info_data->GetModule()] -= pause_time[info_data->GetModule()];
+					
+					// Reset flags
+					flag_pause[info_data->GetModule()] = false;
+					flag_resume[info_data->GetModule()] = false;
 				
+				}
+			
 			}
-
-			// If we have a pulser event from the CAEN DAQs, fill time difference
-			if( flag_caen_pulser ) {
 			
-				for( unsigned int j = 0; j < set->GetNumberOfArrayModules(); ++j ) {
-				
-					double fpga_tdiff = (double)caen_time - (double)fpga_time[j];
-					double asic_tdiff = (double)caen_time - (double)asic_time[j];
-
-					// If diff is greater than 5 ms, we have the wrong pair
-					if( fpga_tdiff > 5e6 ) fpga_tdiff = (double)caen_prev - (double)fpga_time[j];
-					else if( fpga_tdiff < -5e6 ) fpga_tdiff = (double)caen_time - (double)fpga_prev[j];
-					if( asic_tdiff > 5e6 ) asic_tdiff = (double)caen_prev - (double)asic_time[j];
-					else if( asic_tdiff < -5e6 ) asic_tdiff = (double)caen_time - (double)asic_prev[j];
-					
-					// ??? Could be the case that |fpga_tdiff| > 5e6 after these conditional statements...change to while loop? Or have an extra condition?
+			else
+				std::cerr << "Bad resume event in module " << (int)info_data->GetModule() << std::endl;
+			
+		}
 
-					fpga_td[j]->Fill( fpga_tdiff );
-					fpga_sync[j]->Fill( fpga_time[j], fpga_tdiff );
-					fpga_pulser_loss[j]->Fill( fpga_time[j], (int)n_fpga_pulser[j] - (int)n_caen_pulser );
-					
-					asic_td[j]->Fill( asic_tdiff );
-					asic_sync[j]->Fill( asic_time[j], asic_tdiff );
-					asic_pulser_loss[j]->Fill( asic_time[j], (int)n_asic_pulser[j] - (int)n_caen_pulser );
+		// If we have a pulser event from the CAEN DAQs, fill time difference
+		if( flag_caen_pulser ) {
+		
+			for( unsigned int j = 0; j < set->GetNumberOfArrayModules(); ++j ) {
+			
+				double fpga_tdiff = (double)caen_time - (double)fpga_time[j];
+				double asic_tdiff = (double)caen_time - (double)asic_time[j];
 
-				}
+				// If diff is greater than 5 ms, we have the wrong pair
+				if( fpga_tdiff > 5e6 ) fpga_tdiff = (double)caen_prev - (double)fpga_time[j];
+				else if( fpga_tdiff < -5e6 ) fpga_tdiff = (double)caen_time - (double)fpga_prev[j];
+				if( asic_tdiff > 5e6 ) asic_tdiff = (double)caen_prev - (double)asic_time[j];
+				else if( asic_tdiff < -5e6 ) asic_tdiff = (double)caen_time - (double)asic_prev[j];
+				
+				// ??? Could be the case that |fpga_tdiff| > 5e6 after these conditional statements...change to while loop? Or have an extra condition?
 
-				flag_caen_pulser = false;
+				fpga_td[j]->Fill( fpga_tdiff );
+				fpga_sync[j]->Fill( fpga_time[j], fpga_tdiff );
+				fpga_pulser_loss[j]->Fill( fpga_time[j], (int)n_fpga_pulser[j] - (int)n_caen_pulser );
+				
+				asic_td[j]->Fill( asic_tdiff );
+				asic_sync[j]->Fill( asic_time[j], asic_tdiff );
+				asic_pulser_loss[j]->Fill( asic_time[j], (int)n_asic_pulser[j] - (int)n_caen_pulser );
 
 			}
-			
-			// Now reset previous timestamps
-			if( info_data->GetCode() == set->GetCAENPulserCode() )
-				caen_prev = caen_time;
-			if( info_data->GetCode() == set->GetExternalTriggerCode() )
-				fpga_prev[info_data->GetModule()] = fpga_time[info_data->GetModule()];
-			if( info_data->GetCode() == set->GetArrayPulserCode() )
-				asic_prev[info_data->GetModule()] = asic_time[info_data->GetModule()];
 
-						
+			flag_caen_pulser = false;
+
 		}
 		
-		// Sort out the timing for the event window
-		// but only if it isn't an info event, i.e only for real data
-		if ( !in_data->IsInfo() ){
-			
-			// if this is first datum included in Event
-			if( hit_ctr == 1 && mythres ) {
-				
-				time_min	= mytime;
-				time_max	= mytime;
-				time_first	= mytime;
-				
-			}
-			
-			// Update max time
-			if( mytime > time_max ) time_max = mytime;
-			else if( mytime < time_min ) time_min = mytime;
-			
-		} // not info data
+		// Now reset previous timestamps
+		if( info_data->GetCode() == set->GetCAENPulserCode() )
+			caen_prev = caen_time;
+		if( info_data->GetCode() == set->GetExternalTriggerCode() )
+			fpga_prev[info_data->GetModule()] = fpga_time[info_data->GetModule()];
+		if( info_data->GetCode() == set->GetArrayPulserCode() )
+			asic_prev[info_data->GetModule()] = asic_time[info_data->GetModule()];
 
+					
+	}
+	
+	// Sort out the timing for the event window
+	// but only if it isn't an info event, i.e only for real data
+	if ( !in_data->IsInfo() ){
 		
-		// Debug
-		//if( mytime-ebis_time > 40e6 ) {
-		//	std::cout << "Entry #" << i << ": time = " << mytime << std::endl;
-		//	if( in_data->IsInfo() ) std::cout << "\tInfo code = " << (int)info_data->GetCode() << std::endl;
-		//	else if( in_data->IsAsic() ) {
-		//		std::cout << "\tAsic = " << (int)asic_data->GetAsic() << std::endl;
-		//		std::cout << "\tMod  = " << (int)asic_data->GetModule() << std::endl;
-		//		std::cout << "\tCh   = " << (int)asic_data->GetChannel() << std::endl;
-		//	}
-		//	else if( in_data->IsCaen() ) std::cout << "\tCAEN = " << (int)caen_data->GetModule() << std::endl;
-		//	else std::cout << "\tUnknown event type" << std::endl;
-		//}
+		// if this is first datum included in Event
+		if( hit_ctr == 1 && mythres ) {
+			
+			time_min	= mytime;
+			time_max	= mytime;
+			time_first	= mytime;
+			ISS_PROBE1( event_open, time_first );
+			
+		}
 		
-		//------------------------------
-		//  check if last datum from this event and do some cleanup
-		//------------------------------
+		// Update max time
+		if( mytime > time_max ) time_max = mytime;
+		else if( mytime < time_min ) time_min = mytime;
 		
-		if( input_tree->GetEntry(i+1) ) {
-					
-			time_diff = in_data->GetTime() - time_first;
+	} // not info data
+
+	
+	// Debug
+	//if( mytime-ebis_time > 40e6 ) {
+	//	std::cout << "Entry #" << i << ": time = " << mytime << std::endl;
+	//	if( in_data->IsInfo() ) std::cout << "\tInfo code = " << (int)info_data->GetCode() << std::endl;
+	//	else if( in_data->IsAsic() ) {
+	//		std::cout << "\tAsic = " << (int)asic_data->GetAsic() << std::endl;
+	//		std::cout << "\tMod  = " << (int)asic_data->GetModule() << std::endl;
+	//		std::cout << "\tCh   = " << (int)asic_data->GetChannel() << std::endl;
+	//	}
+	//	else if( in_data->IsCaen() ) std::cout << "\tCAEN = " << (int)caen_data->GetModule() << std::endl;
+	//	else std::cout << "\tUnknown event type" << std::endl;
+	//}
 
-			// window = time_stamp_first + time_window
-			if( time_diff > build_window )
-				flag_close_event = true; // set flag to close this event
+	return;
+	
+}
 
-			// we've gone on to the next file in the chain
-			else if( time_diff < 0 )
-				flag_close_event = true; // set flag to close this event
-				
-			// Fill tdiff hist only for real data
-			if( !in_data->IsInfo() ) {
-				
-				tdiff->Fill( time_diff );
-				if( mythres )
-					tdiff_clean->Fill( time_diff );
-			
-			}
+////////////////////////////////////////////////////////////////////////////////
+/// Compares the time of the next hit, now held in in_data, to the first hit of the open event. If it is outside of the build window, the event is flagged to be closed.
+void ISSEventBuilder::LookAhead(){
+	
+	time_diff = in_data->GetTime() - time_first;
 
-		}
+	// window = time_stamp_first + time_window
+	if( time_diff > build_window )
+		flag_close_event = true; // set flag to close this event
+
+	// we've gone on to the next file in the chain
+	else if( time_diff < 0 )
+		flag_close_event = true; // set flag to close this event
 		
-		// Debug
-		//if( mytime-ebis_time > 40e6 ) {
-		//	std::cout << "\tNext time = " << in_data->GetTime() << std::endl;
-		//	std::cout << "\ttime_diff = " << time_diff << std::endl;
-		//	std::cout << "\ttime-EBIS = " << mytime-ebis_time << std::endl;
-		//	std::cout << "\thit_ctr = " << hit_ctr << std::endl;
-		//	std::cout << "\tEvent open? " << event_open << std::endl;
-		//	std::cout << "\tClose event? " << flag_close_event << std::endl;
-		//}
-		
-		//----------------------------
-		// if close this event or last entry
-		//----------------------------
-		if( flag_close_event || (i+1) == n_entries ) {
-			
-			// If we opened the event, then sort it out
-			if( event_open ) {
-			
-				//----------------------------------
-				// Build array events, recoils, etc
-				//----------------------------------
-				ArrayFinder();		// add an ArrayEvt for each n/p pair
-				RecoilFinder();		// add a RecoilEvt for each dE-E
-				MwpcFinder();		// add an MwpcEvt for pair of TAC events
-				ElumFinder();		// add an ElumEvt for each S1 event
-				ZeroDegreeFinder();	// add a ZeroDegreeEvt for each dE-E
-				GammaRayFinder();	// add a GammaRay event for ScintArray/HPGe events
-
-				// ------------------------------------
-				// Add timing and fill the ISSEvts tree
-				// ------------------------------------
-				write_evts->SetEBIS( ebis_prev );
-				write_evts->SetT1( t1_prev );
-				write_evts->SetSC( sc_prev );
-				if( TMath::Abs( (double)ebis_prev - (double)laser_prev ) < 1e3
-					&& laser_prev > 0 ) write_evts->SetLaserStatus( true );
-				else
-					write_evts->SetLaserStatus( false );
-				
-				// Fill only if we have some physics events
-				if( write_evts->GetArrayMultiplicity() ||
-					write_evts->GetArrayPMultiplicity() ||
-					write_evts->GetRecoilMultiplicity() ||
-					write_evts->GetMwpcMultiplicity() ||
-					write_evts->GetElumMultiplicity() ||
-					write_evts->GetZeroDegreeMultiplicity() ||
-					write_evts->GetGammaRayMultiplicity() )
-					output_tree->Fill();
-
-				// Clean up if the next event is going to make the tree full
-				if( output_tree->MemoryFull(30e6) )
-					output_tree->DropBaskets();
+	// Fill tdiff hist only for real data
+	if( !in_data->IsInfo() ) {
+		
+		tdiff->Fill( time_diff );
+		if( mythres )
+			tdiff_clean->Fill( time_diff );
+	
+	}
+
+	return;
+	
+}
 
+////////////////////////////////////////////////////////////////////////////////
+/// The counters are added to the shared metrics once, and then updated without locking as the events are built
+/// \param[in] mymetrics metrics shared with the rest of the sort
+void ISSEventBuilder::AddMetrics( std::shared_ptr<ISSMetrics> mymetrics ){
+	
+	metrics = mymetrics;
+	_metrics_ = true;
+	
+	met_hits = metrics->AddCounter( "iss_eventbuilder_hits_total", "Hits read by the event builder" );
+	met_events = metrics->AddCounter( "iss_events_total", "Events built with at least one physics event" );
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The hit and event being worked on, and the baskets of the input and output trees
+void ISSEventBuilder::AccountMemory(){
+	
+	memusage.Set( ISSMemoryUsage::kHits, in_data ? in_data->GetMemory() : 0 );
+	memusage.Set( ISSMemoryUsage::kTraces, in_data ? in_data->GetTraceMemory() : 0 );
+	memusage.Set( ISSMemoryUsage::kEvents, write_evts ? write_evts->GetMemory() : 0 );
+	memusage.Set( ISSMemoryUsage::kTrees, ISSMemoryUsage::TreeBytes( input_tree ) +
+				 ISSMemoryUsage::TreeBytes( output_tree ) );
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Runs all of the finders on the hits in the open event, then fills the event to the output tree and passes it to the event callback, if there is one. Finally the lists are cleared ready for the next event.
+void ISSEventBuilder::CloseEvent(){
+	
+	// If we opened the event, then sort it out
+	if( event_open ) {
+	
+		//----------------------------------
+		// Build array events, recoils, etc
+		//----------------------------------
+		ArrayFinder();		// add an ArrayEvt for each n/p pair
+		RecoilFinder();		// add a RecoilEvt for each dE-E
+		MwpcFinder();		// add an MwpcEvt for pair of TAC events
+		ElumFinder();		// add an ElumEvt for each S1 event
+		ZeroDegreeFinder();	// add a ZeroDegreeEvt for each dE-E
+		GammaRayFinder();	// add a GammaRay event for ScintArray/HPGe events
+
+		// ------------------------------------
+		// Add timing and fill the ISSEvts tree
+		// ------------------------------------
+		write_evts->SetEBIS( ebis_prev );
+		write_evts->SetT1( t1_prev );
+		write_evts->SetSC( sc_prev );
+		if( TMath::Abs( (double)ebis_prev - (double)laser_prev ) < 1e3
+			&& laser_prev > 0 ) write_evts->SetLaserStatus( true );
+		else
+			write_evts->SetLaserStatus( false );
+		
+		// Fill only if we have some physics events
+		bool filled = write_evts->GetArrayMultiplicity() ||
+			write_evts->GetArrayPMultiplicity() ||
+			write_evts->GetRecoilMultiplicity() ||
+			write_evts->GetMwpcMultiplicity() ||
+			write_evts->GetElumMultiplicity() ||
+			write_evts->GetZeroDegreeMultiplicity() ||
+			write_evts->GetGammaRayMultiplicity();
+		
+		// And only the ones that pass a write condition, if there are any
+		bool selected = filled &&
+			( !selector || selector->Select( write_evts.get(), time_min ) );
+		if( selected ) {
+			
+			if( flag_write_tree ) {
+				if( packer ) packer->Pack( write_evts.get() );
+				output_tree->Fill();
+				if( compression->IsSampling() ) {
+					if( packer ) compression->Sample( packer->GetCompactEvts() );
+					else compression->Sample( write_evts.get() );
+				}
 			}
+			if( event_callback ) event_callback( write_evts.get() );
+			if( _metrics_ ) ISSMetrics::Add( met_events );
 			
-			//--------------------------------------------------
-			// clear values of arrays to store intermediate info
-			//--------------------------------------------------
-			Initialise();
-			
-		} // if close event
-				
-		// Progress bar
-		bool update_progress = false;
-		if( n_entries < 200 )
-			update_progress = true;
-		else if( i % (n_entries/100) == 0 || i+1 == n_entries )
-			update_progress = true;
-		
-		if( update_progress ) {
+		}
+		ISS_PROBE3( event_close, hit_ctr, time_max - time_min, filled );
 
-			// Percent complete
-			float percent = (float)(i+1)*100.0/(float)n_entries;
+		// Clean up if the next event is going to make the tree full
+		if( flag_write_tree && output_tree->MemoryFull( mem_full ) )
+			output_tree->DropBaskets();
 
-			// Progress bar in GUI
-			if( _prog_ ) {
+	}
+	
+	//--------------------------------------------------
+	// clear values of arrays to store intermediate info
+	//--------------------------------------------------
+	Initialise();
+
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Prepares the event builder to receive hits one by one with ISSEventBuilder::PushHit, instead of reading them from an input tree. ISSEventBuilder::SetOutput must have been called first.
+void ISSEventBuilder::StartStream(){
+	
+	StartFile();
+	Initialise();
+	n_entries = 0;
+	
+	// The converter always gives raw timestamps
+	flag_raw_time = true;
+	if( calstore ) reorder->SetCalibration( calstore->Acquire( cal_reader ) );
+	
+	// We don't have any hits waiting yet
+	reorder->Reset();
+	reorder->Recycle( std::move( held_hit ) );
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The hit goes into the reorder buffer to get its time offset, and is built into an event once no later hit can come before it. Hits must be pushed in the order of their raw timestamps, as they come out of ISSConverter::SortTree.
+/// \param [in] hit The next time-sorted hit, which is copied so the caller can reuse it
+void ISSEventBuilder::PushHit( ISSDataPackets *hit ){
+	
+	reorder->Push( hit, n_entries );
+	NextHits();
+	n_entries++;
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Each hit is held until the next one comes out of the reorder buffer, so that the build window can be checked in the same way as when reading the offsets from the tree
+void ISSEventBuilder::NextHits(){
+	
+	unsigned long long next_time, next_entry;
+	std::unique_ptr<ISSDataPackets> hit;
+	while( ( hit = reorder->Pop( next_time, next_entry ) ) ) {
+		
+		// Process the hit we were holding, now we know what comes after it
+		if( held_hit ) {
+			
+			in_data = held_hit.get();
+			ProcessHit();
+			
+			in_data = hit.get();
+			LookAhead();
+			if( flag_close_event ) {
+				
+				CloseEvent();
 				
-				prog->SetPosition( percent );
-				gSystem->ProcessEvents();
+				// Save our progress every so often, between events, starting again
+				// from the earliest hit that hasn't been processed yet
+				if( input_tree && flag_write_tree && CheckpointDue() )
+					WriteCheckpoint( reorder->GetOldestEntry( next_entry ) );
 				
 			}
-
-			// Progress bar in terminal
-			std::cout << " " << std::setw(6) << std::setprecision(4);
-			std::cout << percent << "%    \r";
-			std::cout.flush();
-
+			
+			reorder->Recycle( std::move( held_hit ) );
+			
 		}
 		
+		// Keep this one until the next hit comes out
+		held_hit = std::move( hit );
+		held_time = next_time;
+		held_entry = next_entry;
 		
-	} // End of main loop over TTree to process raw MIDAS data entries (for n_entries)
+	}
+	in_data = nullptr;
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Processes the hit that is being held, after the reorder buffer has been emptied, and closes the last event
+void ISSEventBuilder::LastHit(){
+	
+	if( held_hit ) {
+		
+		in_data = held_hit.get();
+		ProcessHit();
+		CloseEvent();
+		reorder->Recycle( std::move( held_hit ) );
+		
+	}
+	in_data = nullptr;
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Processes the last hit that is being held and closes the final event, then writes the statistics and the output file in the same way as ISSEventBuilder::BuildEvents.
+/// \return The number of hits that were pushed
+unsigned long ISSEventBuilder::FinishStream(){
+	
+	reorder->Finish();
+	NextHits();
+	LastHit();
+	
+	FinishEvents();
+	
+	return n_entries;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Prints the statistics of the event building to the terminal and the log file, then writes the output file
+void ISSEventBuilder::FinishEvents(){
 	
 	// TODO -> if we end on a pause with no resume, add any remaining time to the dead time
 	
@@ -1015,6 +1534,10 @@ unsigned long ISSEventBuilder::BuildEvents() {
 		ss_log << " s" << std::endl;
 	}
 	ss_log << "  Info data packets = " << n_info_data << std::endl;
+	if( flag_raw_time ) {
+		ss_log << "  Time offsets span " << reorder->GetSpan() << " ns, reordered with up to ";
+		ss_log << reorder->GetMaxSize() << " hits in the buffer" << std::endl;
+	}
 	ss_log << "   Array p/n-side correlated events = " << array_ctr << std::endl;
 	ss_log << "   Array p-side only events = " << arrayp_ctr << std::endl;
 	ss_log << "   Recoil events = " << recoil_ctr << std::endl;
@@ -1034,12 +1557,23 @@ unsigned long ISSEventBuilder::BuildEvents() {
 	ss_log << "   SC events = " << n_sc << std::endl;
 	ss_log << "   Laser events = " << n_laser << std::endl;
 	ss_log << "  Tree entries = " << output_tree->GetEntries() << std::endl;
+	if( selector ) {
+		ss_log << selector->GetReport();
+		selector->Write( output_file );
+	}
+	if( packer ) {
+		output_tree->FlushBaskets();
+		ss_log << packer->GetReport( output_tree );
+	}
+	ss_log << compression->GetReport();
 
-	std::cout << ss_log.str();
+	if( !flag_quiet ) std::cout << ss_log.str();
 	if( log_file.is_open() && flag_input_file ) log_file << ss_log.str();
 	
-	std::cout << " Writing output file...\r";
-	std::cout.flush();
+	if( !flag_quiet ) {
+		std::cout << " Writing output file...\r";
+		std::cout.flush();
+	}
 	
 	// Force the rest of the events in the buffer to disk
 	output_tree->FlushBaskets();
@@ -1048,17 +1582,21 @@ unsigned long ISSEventBuilder::BuildEvents() {
 	//output_file->Close();
 	
 	// Dump the input buffers
-	input_tree->DropBaskets();
+	if( input_tree ) input_tree->DropBaskets();
 
-	std::cout << " Writing output file... Done!" << std::endl << std::endl;
-
-	return n_entries;
+	if( !flag_quiet )
+		std::cout << " Writing output file... Done!" << std::endl << std::endl;
+	
+	return;
 	
 }
 
+
 ////////////////////////////////////////////////////////////////////////////////
 /// This function processes a series of vectors that are populated in a given build window, and deals with the signals accordingly. This is currently done on a case-by-case basis i.e. each different number of p-side and n-side hits is dealt with in it's own section. Charge addback is implemented for neighbouring strips that fall within a prompt coincidence window defined by the user in the ISSSettings file.
 void ISSEventBuilder::ArrayFinder() {
+
+	ISSTimingScope scope( timing, ISSTiming::kArrayFinder );
 	
 	//std::cout << __PRETTY_FUNCTION__ << std::endl;
 	
@@ -1932,6 +2470,8 @@ void ISSEventBuilder::ArrayFinder() {
 /// This function takes a series of E and dE signals on the silicon recoil detector and determines what hits to keep from these using sensible conditions including a prompt coincidence window. Signals are triggered by the dE detector, but if a corresponding E signal is not found, then a hit at E = 0 is still recorded.
 void ISSEventBuilder::RecoilFinder() {
 
+	ISSTimingScope scope( timing, ISSTiming::kRecoilFinder );
+
 	//std::cout << __PRETTY_FUNCTION__ << std::endl;
 	
 	// Checks to prevent re-using events
@@ -2018,6 +2558,8 @@ void ISSEventBuilder::RecoilFinder() {
 /// Assesses the validity of hits in the MWPC detector
 void ISSEventBuilder::MwpcFinder() {
 
+	ISSTimingScope scope( timing, ISSTiming::kMwpcFinder );
+
 	//std::cout << __PRETTY_FUNCTION__ << std::endl;
 	
 	// Checks to prevent re-using events
@@ -2086,6 +2628,8 @@ void ISSEventBuilder::MwpcFinder() {
 ////////////////////////////////////////////////////////////////////////////////
 /// Assesses the validity of events in the ELUM detector
 void ISSEventBuilder::ElumFinder() {
+
+	ISSTimingScope scope( timing, ISSTiming::kElumFinder );
 	
 	//std::cout << __PRETTY_FUNCTION__ << std::endl;
 	
@@ -2119,6 +2663,8 @@ void ISSEventBuilder::ElumFinder() {
 /// prompt coincidence on these hits, which can be altered in the ISSSettings file
 void ISSEventBuilder::ZeroDegreeFinder() {
 
+	ISSTimingScope scope( timing, ISSTiming::kZeroDegreeFinder );
+
 	//std::cout << __PRETTY_FUNCTION__ << std::endl;
 	
 	// Checks to prevent re-using events
@@ -2178,6 +2724,8 @@ void ISSEventBuilder::ZeroDegreeFinder() {
 ////////////////////////////////////////////////////////////////////////////////
 /// Builds gamma-ray events from the ScintArray and maybe also HPGe detectors in the future
 void ISSEventBuilder::GammaRayFinder() {
+
+	ISSTimingScope scope( timing, ISSTiming::kGammaRayFinder );
 	
 	//std::cout << __PRETTY_FUNCTION__ << std::endl;
 	
@@ -2603,6 +3151,10 @@ void ISSEventBuilder::MakeHists(){
 	gamma_gamma_td = new TH1F( hname.data(), htitle.data(), 600, -1.0*set->GetEventWindow()-20, set->GetEventWindow()+20 );
 
 	
+	// Memory taken by the histograms, and where to keep track of it
+	memusage.MakeHists( output_file );
+	memusage.ScanHists( output_file );
+	
 	return;
 	
 }
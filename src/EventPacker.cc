@@ -0,0 +1,380 @@
+#include "EventPacker.hh"
+
+ISSEventPacker::ISSEventPacker( ISSSettings *myset ){
+
+	set = myset;
+	compact = std::make_unique<ISSCompactEvts>();
+
+	// The steps go into every event, so the files can be read without the settings
+	compact->array_step = set->GetCompactArrayStep();
+	compact->recoil_step = set->GetCompactRecoilStep();
+	compact->elum_step = set->GetCompactElumStep();
+	compact->zd_step = set->GetCompactZeroDegreeStep();
+	compact->gamma_step = set->GetCompactGammaRayStep();
+	compact->time_step = set->GetCompactTimeStep();
+	if( compact->time_step == 0 ) compact->time_step = 1;
+
+	errors.resize( kFields );
+	errors[kArray] = { "Array energy", "keV", compact->array_step, 0, 0, 0, 0 };
+	errors[kRecoil] = { "Recoil energy", "keV", compact->recoil_step, 0, 0, 0, 0 };
+	errors[kElum] = { "ELUM energy", "keV", compact->elum_step, 0, 0, 0, 0 };
+	errors[kZeroDegree] = { "ZeroDegree energy", "keV", compact->zd_step, 0, 0, 0, 0 };
+	errors[kGammaRay] = { "Gamma-ray energy", "keV", compact->gamma_step, 0, 0, 0, 0 };
+	errors[kTime] = { "Time", "ns", (double)compact->time_step, 0, 0, 0, 0 };
+
+	ResetReport();
+
+}
+
+void ISSEventPacker::ResetReport(){
+
+	for( unsigned int i = 0; i < errors.size(); ++i ) {
+
+		errors[i].n = 0;
+		errors[i].clipped = 0;
+		errors[i].sum2 = 0;
+		errors[i].max = 0;
+
+	}
+
+	n_packed = 0;
+	full_bytes = 0;
+	packed_bytes = 0;
+
+	return;
+
+}
+
+unsigned short ISSEventPacker::PackEnergy( float e, field_t f ){
+
+	error_t &err = errors[f];
+	double q = std::round( e / err.step );
+	err.n++;
+
+	// Out of range
+	if( q < 0 || q > USHRT_MAX ) {
+
+		err.clipped++;
+		return q < 0 ? 0 : USHRT_MAX;
+
+	}
+
+	double diff = std::abs( e - q * err.step );
+	err.sum2 += diff * diff;
+	if( diff > err.max ) err.max = diff;
+
+	return (unsigned short)q;
+
+}
+
+int ISSEventPacker::PackTime( unsigned long t, unsigned long ref ){
+
+	// Timestamps that were never set
+	if( t == 0 ) return INT_MIN;
+
+	error_t &err = errors[kTime];
+	double q = std::round( ( (double)t - (double)ref ) / err.step );
+	err.n++;
+
+	if( q <= INT_MIN || q > INT_MAX ) {
+
+		err.clipped++;
+		return q < 0 ? INT_MIN + 1 : INT_MAX;
+
+	}
+
+	double diff = std::abs( (double)t - (double)ref - q * err.step );
+	err.sum2 += diff * diff;
+	if( diff > err.max ) err.max = diff;
+
+	return (int)q;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Fills the event given by ISSEventPacker::GetCompactEvts, which is the one
+/// that should be given to the output tree
+/// \param[in] evts The built event
+void ISSEventPacker::Pack( ISSEvts *evts ){
+
+	ISSCompactEvts *c = compact.get();
+	c->ClearEvt();
+
+	// The event starts with its earliest hit
+	unsigned long ref = 0;
+	auto earliest = [&ref]( unsigned long t ){
+		if( t > 0 && ( ref == 0 || t < ref ) ) ref = t;
+	};
+	for( auto &a : evts->array_event ) { earliest( a.GetPTime() ); earliest( a.GetNTime() ); }
+	for( auto &a : evts->arrayp_event ) { earliest( a.GetPTime() ); earliest( a.GetNTime() ); }
+	for( auto &r : evts->recoil_event ) { earliest( r.GetdETime() ); earliest( r.GetETime() ); }
+	for( auto &m : evts->mwpc_event ) earliest( m.GetTime() );
+	for( auto &e : evts->elum_event ) earliest( e.GetTime() );
+	for( auto &z : evts->zd_event ) { earliest( z.GetdETime() ); earliest( z.GetETime() ); }
+	for( auto &g : evts->gamma_event ) earliest( g.GetTime() );
+
+	c->time = ref;
+	c->ebis = evts->ebis;
+	c->t1 = evts->t1;
+	c->sc = evts->sc;
+	c->laser = evts->laser;
+	full_bytes += 3 * sizeof(unsigned long) + sizeof(bool);
+	packed_bytes += 4 * sizeof(unsigned long) + sizeof(bool);
+
+	// Array, p-side only events after the others
+	c->n_array = evts->array_event.size();
+	for( unsigned int i = 0; i < evts->array_event.size() + evts->arrayp_event.size(); ++i ) {
+
+		ISSArrayEvt &a = i < evts->array_event.size() ? evts->array_event[i] :
+			evts->arrayp_event[i-evts->array_event.size()];
+		c->array_mod.push_back( a.GetModule() );
+		c->array_row.push_back( a.GetRow() );
+		c->array_pid.push_back( a.GetPID() );
+		c->array_nid.push_back( a.GetNID() );
+		c->array_pen.push_back( PackEnergy( a.GetPEnergy(), kArray ) );
+		c->array_nen.push_back( PackEnergy( a.GetNEnergy(), kArray ) );
+		c->array_ptd.push_back( PackTime( a.GetPTime(), ref ) );
+		c->array_ntd.push_back( PackTime( a.GetNTime(), ref ) );
+		full_bytes += 2 * sizeof(float) + 4 + 2 * sizeof(unsigned long);
+		packed_bytes += 2 * sizeof(unsigned short) + 4 + 2 * sizeof(int);
+
+	}
+
+	// Recoils
+	for( auto &r : evts->recoil_event ) {
+
+		c->recoil_sec.push_back( r.GetSector() );
+		c->recoil_depth.push_back( r.GetDepth() );
+		for( unsigned int j = 0; j < r.GetDepth(); ++j ) {
+
+			c->recoil_id.push_back( r.GetID(j) );
+			c->recoil_en.push_back( PackEnergy( r.GetEnergy(j), kRecoil ) );
+
+		}
+		c->recoil_detd.push_back( PackTime( r.GetdETime(), ref ) );
+		c->recoil_etd.push_back( PackTime( r.GetETime(), ref ) );
+		full_bytes += r.GetDepth() * ( sizeof(float) + 1 ) + 1 + 2 * sizeof(unsigned long);
+		packed_bytes += r.GetDepth() * ( sizeof(unsigned short) + 1 ) + 2 + 2 * sizeof(int);
+
+	}
+
+	// MWPC
+	for( auto &m : evts->mwpc_event ) {
+
+		c->mwpc_tacdiff.push_back( m.GetTacDiff() );
+		c->mwpc_axis.push_back( m.GetAxis() );
+		c->mwpc_td.push_back( PackTime( m.GetTime(), ref ) );
+		full_bytes += sizeof(int) + 1 + sizeof(unsigned long);
+		packed_bytes += sizeof(int) + 1 + sizeof(int);
+
+	}
+
+	// ELUM
+	for( auto &e : evts->elum_event ) {
+
+		c->elum_id.push_back( e.GetID() );
+		c->elum_sec.push_back( e.GetSector() );
+		c->elum_en.push_back( PackEnergy( e.GetEnergy(), kElum ) );
+		c->elum_td.push_back( PackTime( e.GetTime(), ref ) );
+		full_bytes += sizeof(float) + 2 + sizeof(unsigned long);
+		packed_bytes += sizeof(unsigned short) + 2 + sizeof(int);
+
+	}
+
+	// ZeroDegree
+	for( auto &z : evts->zd_event ) {
+
+		c->zd_sec.push_back( z.GetSector() );
+		c->zd_depth.push_back( z.GetDepth() );
+		for( unsigned int j = 0; j < z.GetDepth(); ++j ) {
+
+			c->zd_id.push_back( z.GetID(j) );
+			c->zd_en.push_back( PackEnergy( z.GetEnergy(j), kZeroDegree ) );
+
+		}
+		c->zd_detd.push_back( PackTime( z.GetdETime(), ref ) );
+		c->zd_etd.push_back( PackTime( z.GetETime(), ref ) );
+		full_bytes += z.GetDepth() * ( sizeof(float) + 1 ) + 1 + 2 * sizeof(unsigned long);
+		packed_bytes += z.GetDepth() * ( sizeof(unsigned short) + 1 ) + 2 + 2 * sizeof(int);
+
+	}
+
+	// Gamma rays
+	for( auto &g : evts->gamma_event ) {
+
+		c->gamma_id.push_back( g.GetID() );
+		c->gamma_type.push_back( g.GetType() );
+		c->gamma_en.push_back( PackEnergy( g.GetEnergy(), kGammaRay ) );
+		c->gamma_td.push_back( PackTime( g.GetTime(), ref ) );
+		full_bytes += sizeof(float) + 2 + sizeof(unsigned long);
+		packed_bytes += sizeof(unsigned short) + 2 + sizeof(int);
+
+	}
+
+	n_packed++;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Uses the steps stored in the compact event, not the ones of the settings
+/// \param[in] in The compact event, i.e. read from a tree
+/// \param[out] evts The event to fill, which is cleared first
+void ISSEventPacker::Unpack( ISSCompactEvts *in, ISSEvts *evts ){
+
+	// Keep the memory of the vectors for the next event
+	evts->array_event.clear();
+	evts->arrayp_event.clear();
+	evts->recoil_event.clear();
+	evts->mwpc_event.clear();
+	evts->elum_event.clear();
+	evts->zd_event.clear();
+	evts->gamma_event.clear();
+
+	unsigned long ref = in->time;
+	unsigned int ts = in->time_step;
+	evts->ebis = in->ebis;
+	evts->t1 = in->t1;
+	evts->sc = in->sc;
+	evts->laser = in->laser;
+
+	// Array
+	for( unsigned int i = 0; i < in->array_mod.size(); ++i ) {
+
+		ISSArrayEvt *a;
+		if( i < in->n_array ) {
+
+			evts->array_event.emplace_back();
+			a = &evts->array_event.back();
+
+		}
+
+		else {
+
+			evts->arrayp_event.emplace_back();
+			a = &evts->arrayp_event.back();
+
+		}
+
+		a->SetEvent( UnpackEnergy( in->array_pen[i], in->array_step ),
+					 UnpackEnergy( in->array_nen[i], in->array_step ),
+					 in->array_pid[i], in->array_nid[i],
+					 UnpackTime( in->array_ptd[i], ref, ts ),
+					 UnpackTime( in->array_ntd[i], ref, ts ),
+					 in->array_mod[i], in->array_row[i] );
+
+	}
+
+	// Recoils
+	std::vector<float> en;
+	std::vector<unsigned char> id;
+	for( unsigned int i = 0, k = 0; i < in->recoil_sec.size(); ++i ) {
+
+		en.clear();
+		id.clear();
+		for( unsigned int j = 0; j < in->recoil_depth[i]; ++j, ++k ) {
+
+			en.push_back( UnpackEnergy( in->recoil_en[k], in->recoil_step ) );
+			id.push_back( in->recoil_id[k] );
+
+		}
+
+		evts->recoil_event.emplace_back();
+		evts->recoil_event.back().SetEvent( en, id, in->recoil_sec[i],
+										   UnpackTime( in->recoil_detd[i], ref, ts ),
+										   UnpackTime( in->recoil_etd[i], ref, ts ) );
+
+	}
+
+	// MWPC
+	for( unsigned int i = 0; i < in->mwpc_axis.size(); ++i ) {
+
+		evts->mwpc_event.emplace_back();
+		evts->mwpc_event.back().SetEvent( in->mwpc_tacdiff[i], in->mwpc_axis[i],
+										 UnpackTime( in->mwpc_td[i], ref, ts ) );
+
+	}
+
+	// ELUM
+	for( unsigned int i = 0; i < in->elum_id.size(); ++i ) {
+
+		evts->elum_event.emplace_back();
+		evts->elum_event.back().SetEvent( UnpackEnergy( in->elum_en[i], in->elum_step ),
+										 in->elum_id[i], in->elum_sec[i],
+										 UnpackTime( in->elum_td[i], ref, ts ) );
+
+	}
+
+	// ZeroDegree
+	for( unsigned int i = 0, k = 0; i < in->zd_sec.size(); ++i ) {
+
+		en.clear();
+		id.clear();
+		for( unsigned int j = 0; j < in->zd_depth[i]; ++j, ++k ) {
+
+			en.push_back( UnpackEnergy( in->zd_en[k], in->zd_step ) );
+			id.push_back( in->zd_id[k] );
+
+		}
+
+		evts->zd_event.emplace_back();
+		evts->zd_event.back().SetEvent( en, id, in->zd_sec[i],
+									   UnpackTime( in->zd_detd[i], ref, ts ),
+									   UnpackTime( in->zd_etd[i], ref, ts ) );
+
+	}
+
+	// Gamma rays
+	for( unsigned int i = 0; i < in->gamma_id.size(); ++i ) {
+
+		evts->gamma_event.emplace_back();
+		evts->gamma_event.back().SetEvent( UnpackEnergy( in->gamma_en[i], in->gamma_step ),
+										  in->gamma_id[i], in->gamma_type[i],
+										  UnpackTime( in->gamma_td[i], ref, ts ) );
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] t The output tree, for its size on disk, or nullptr
+/// \return Lines to print, with the error of each type of value and the bytes per event
+std::string ISSEventPacker::GetReport( TTree *t ){
+
+	std::stringstream ss;
+	ss << "  Compact events, " << n_packed << " packed" << std::endl;
+
+	for( unsigned int i = 0; i < errors.size(); ++i ) {
+
+		if( !errors[i].n ) continue;
+
+		// Only the values that weren't clipped have an error
+		unsigned long n = errors[i].n - errors[i].clipped;
+		double rms = n ? std::sqrt( errors[i].sum2 / n ) : 0;
+
+		ss << "   " << errors[i].name << ": step = " << errors[i].step << " " << errors[i].unit;
+		ss << ", rms error = " << rms << " " << errors[i].unit;
+		ss << ", max error = " << errors[i].max << " " << errors[i].unit;
+		ss << ", clipped = " << errors[i].clipped << "/" << errors[i].n << std::endl;
+
+	}
+
+	if( n_packed ) {
+
+		ss << "   Bytes per event = " << std::setprecision(3);
+		ss << (double)packed_bytes / n_packed << " packed, ";
+		ss << (double)full_bytes / n_packed << " in full";
+		if( t && t->GetEntries() ) {
+			ss << ", " << (double)t->GetZipBytes() / t->GetEntries() << " in the tree";
+			ss << " (" << (double)t->GetTotBytes() / t->GetEntries() << " before compression)";
+		}
+		ss << std::setprecision(6) << std::endl;
+
+	}
+
+	return ss.str();
+
+}
@@ -0,0 +1,214 @@
+#include "EventSelector.hh"
+
+ISSEventSelector::ISSEventSelector( ISSSettings *myset ){
+
+	vars.resize( kVariables, 0 );
+	n_events = 0;
+	n_written = 0;
+
+	// Names of the variables, as parameters of TFormula
+	std::string names;
+	for( unsigned int v = 0; v < kVariables; ++v )
+		names += ( v ? "|" : "" ) + GetName( (var_t)v );
+	std::regex words( "\\b(" + names + ")\\b" );
+
+	for( unsigned int i = 0; i < myset->GetNumberOfWriteConditions(); ++i ) {
+
+		condition_t c;
+		c.expr = myset->GetWriteCondition(i);
+		c.prescale = myset->GetWritePrescale(i);
+		c.matched = 0;
+		c.written = 0;
+
+		// Variables become the named parameters [array], [recoil] etc.
+		std::string formula = std::regex_replace( c.expr, words, "[$1]" );
+		c.f = std::make_unique<TFormula>( Form( "write_condition_%d", i ), formula.data(), false );
+		if( !c.expr.size() || !c.f->IsValid() ) {
+
+			std::cerr << "Write condition " << i << " \"" << c.expr;
+			std::cerr << "\" is not a valid expression, ignoring it" << std::endl;
+			continue;
+
+		}
+
+		// Match the parameters to the variables
+		bool known = true;
+		for( int j = 0; j < c.f->GetNpar(); ++j ) {
+
+			unsigned int v = 0;
+			while( v < kVariables && GetName( (var_t)v ) != c.f->GetParName(j) ) v++;
+			c.pars.push_back( (var_t)v );
+			if( v == kVariables ) known = false;
+
+		}
+
+		if( !known ) {
+
+			std::cerr << "Write condition " << i << " \"" << c.expr;
+			std::cerr << "\" has an unknown variable, ignoring it" << std::endl;
+			continue;
+
+		}
+
+		if( c.pars.size() > pars.size() ) pars.resize( c.pars.size() );
+		conds.push_back( std::move( c ) );
+
+	}
+
+}
+
+std::string ISSEventSelector::GetName( var_t v ){
+
+	switch( v ) {
+		case kArray:		return "array";
+		case kArrayP:		return "arrayp";
+		case kRecoil:		return "recoil";
+		case kMwpc:			return "mwpc";
+		case kElum:			return "elum";
+		case kZeroDegree:	return "zd";
+		case kGammaRay:		return "gamma";
+		case kLaser:		return "laser";
+		case kEBIS:			return "ebis";
+		case kT1:			return "t1";
+		case kSC:			return "sc";
+		default:			return "unknown";
+	}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Every condition is tested, so they are all counted, even if an earlier one
+/// has already decided to write the event
+/// \param[in] evts The built event, with the timing signals set
+/// \param[in] time Time of the event, for the time since the pulses
+/// \return true if any condition writes the event
+bool ISSEventSelector::Select( ISSEvts *evts, unsigned long time ){
+
+	vars[kArray] = evts->GetArrayMultiplicity();
+	vars[kArrayP] = evts->GetArrayPMultiplicity();
+	vars[kRecoil] = evts->GetRecoilMultiplicity();
+	vars[kMwpc] = evts->GetMwpcMultiplicity();
+	vars[kElum] = evts->GetElumMultiplicity();
+	vars[kZeroDegree] = evts->GetZeroDegreeMultiplicity();
+	vars[kGammaRay] = evts->GetGammaRayMultiplicity();
+	vars[kLaser] = evts->GetLaserStatus();
+	vars[kEBIS] = (double)time - (double)evts->GetEBIS();
+	vars[kT1] = (double)time - (double)evts->GetT1();
+	vars[kSC] = (double)time - (double)evts->GetSC();
+
+	bool write = false;
+	double x = 0;
+	for( unsigned int i = 0; i < conds.size(); ++i ) {
+
+		condition_t &c = conds[i];
+		for( unsigned int j = 0; j < c.pars.size(); ++j )
+			pars[j] = vars[c.pars[j]];
+
+		if( c.f->EvalPar( &x, pars.data() ) == 0 ) continue;
+
+		// Prescale, starting with the first event
+		if( c.matched++ % c.prescale ) continue;
+
+		c.written++;
+		write = true;
+
+	}
+
+	n_events++;
+	if( write ) n_written++;
+
+	return write;
+
+}
+
+void ISSEventSelector::GetCounters( std::vector<unsigned long long> &matched, std::vector<unsigned long long> &written ) const {
+
+	matched.clear();
+	written.clear();
+	for( unsigned int i = 0; i < conds.size(); ++i ) {
+
+		matched.push_back( conds[i].matched );
+		written.push_back( conds[i].written );
+
+	}
+
+	// Totals at the end
+	matched.push_back( n_events );
+	written.push_back( n_written );
+
+	return;
+
+}
+
+void ISSEventSelector::SetCounters( const std::vector<unsigned long long> &matched, const std::vector<unsigned long long> &written ){
+
+	if( matched.size() != conds.size() + 1 || written.size() != conds.size() + 1 )
+		return;
+
+	for( unsigned int i = 0; i < conds.size(); ++i ) {
+
+		conds[i].matched = matched[i];
+		conds[i].written = written[i];
+
+	}
+
+	n_events = matched.back();
+	n_written = written.back();
+
+	return;
+
+}
+
+std::string ISSEventSelector::GetReport() const {
+
+	std::stringstream ss;
+	ss << "  Write conditions, " << n_written << " of " << n_events << " events written" << std::endl;
+	for( unsigned int i = 0; i < conds.size(); ++i ) {
+
+		ss << "   " << conds[i].expr;
+		if( conds[i].prescale > 1 ) ss << " (prescale " << conds[i].prescale << ")";
+		ss << ": matched = " << conds[i].matched;
+		ss << ", written = " << conds[i].written << std::endl;
+
+	}
+
+	return ss.str();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The histograms selection_matched and selection_written have a bin for each
+/// condition, labelled with its expression, then one for all the events
+/// \param[in] dir The output file
+void ISSEventSelector::Write( TDirectory *dir ) const {
+
+	if( !dir ) return;
+
+	TDirectory *saved = gDirectory;
+	dir->cd();
+
+	unsigned int nbins = conds.size() + 1;
+	TH1D hmatched( "selection_matched", "Events matched by each write condition;;events",
+				  nbins, -0.5, nbins - 0.5 );
+	TH1D hwritten( "selection_written", "Events written by each write condition;;events",
+				  nbins, -0.5, nbins - 0.5 );
+	for( unsigned int i = 0; i < nbins; ++i ) {
+
+		std::string label = i < conds.size() ? conds[i].expr : "all";
+		if( i < conds.size() && conds[i].prescale > 1 )
+			label += " /" + std::to_string( conds[i].prescale );
+		hmatched.GetXaxis()->SetBinLabel( i + 1, label.data() );
+		hwritten.GetXaxis()->SetBinLabel( i + 1, label.data() );
+		hmatched.SetBinContent( i + 1, i < conds.size() ? conds[i].matched : n_events );
+		hwritten.SetBinContent( i + 1, i < conds.size() ? conds[i].written : n_written );
+
+	}
+
+	hmatched.Write( "selection_matched", TObject::kOverwrite );
+	hwritten.Write( "selection_written", TObject::kOverwrite );
+
+	if( saved ) saved->cd();
+
+	return;
+
+}
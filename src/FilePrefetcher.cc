@@ -0,0 +1,171 @@
+#include "FilePrefetcher.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] myfiles The files of the chain, in the order they are read
+/// \param[in] mydepth How many files to read ahead of the current one
+/// \param[in] mybytes Most bytes to read ahead at once, shared by the files
+ISSFilePrefetcher::ISSFilePrefetcher( std::vector<std::string> myfiles, unsigned int mydepth, double mybytes ){
+
+	files = myfiles;
+	depth = mydepth;
+	file_bytes = depth ? mybytes / depth : 0;
+
+	stop = false;
+	current = 0;
+	next = 1;
+	warmed.assign( files.size(), false );
+	if( warmed.size() ) warmed[0] = true; // the chain opens it straight away
+
+	n_warmed = 0;
+	n_ready = 0;
+	n_switches = 0;
+	bytes_read = 0;
+	read_time = 0;
+
+	if( depth && file_bytes > 0 && files.size() > 1 )
+		worker = std::thread( &ISSFilePrefetcher::Run, this );
+
+}
+
+ISSFilePrefetcher::~ISSFilePrefetcher(){
+
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		stop = true;
+	}
+	cv.notify_all();
+	if( worker.joinable() ) worker.join();
+
+}
+
+void ISSFilePrefetcher::SetCurrent( unsigned int i ){
+
+	std::lock_guard<std::mutex> lock( mtx );
+	if( i == current || i >= files.size() ) return;
+
+	n_switches++;
+	if( warmed[i] ) n_ready++;
+
+	// Don't bother with files that the chain has already passed
+	current = i;
+	if( next <= current ) next = current + 1;
+	cv.notify_all();
+
+	return;
+
+}
+
+void ISSFilePrefetcher::Run(){
+
+	std::unique_lock<std::mutex> lock( mtx );
+
+	while( !stop ) {
+
+		// Wait until there is a file within reach
+		if( next >= files.size() || next > current + depth ) {
+
+			cv.wait( lock );
+			continue;
+
+		}
+
+		unsigned int i = next++;
+		lock.unlock();
+		bool done = Warm( i );
+		lock.lock();
+		if( done ) {
+
+			warmed[i] = true;
+			n_warmed++;
+
+		}
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Three quarters of the bytes go to the start of the file and the rest to the
+/// end, or all of it is read if it is small enough
+/// \param[in] i Index of the file
+/// \return false if the file couldn't be read or we were stopped
+bool ISSFilePrefetcher::Warm( unsigned int i ){
+
+	int fd = open( files[i].data(), O_RDONLY );
+	if( fd < 0 ) return false;
+
+	struct stat st;
+	if( fstat( fd, &st ) != 0 ) {
+
+		close( fd );
+		return false;
+
+	}
+
+	// Regions to read: [0,head) and [tail,size)
+	off_t size = st.st_size;
+	off_t head = size, tail = size;
+	if( size > file_bytes ) {
+
+		head = 0.75 * file_bytes;
+		tail = size - (off_t)( 0.25 * file_bytes );
+
+	}
+
+#ifdef LINUX
+	// Let the kernel start on it while we read
+	posix_fadvise( fd, 0, head, POSIX_FADV_WILLNEED );
+	if( tail < size ) posix_fadvise( fd, tail, size - tail, POSIX_FADV_WILLNEED );
+#endif
+
+	const size_t kChunk = 1 << 20;
+	std::vector<char> buffer( kChunk );
+	std::vector<std::pair<off_t,off_t>> regions = { { 0, head }, { tail, size } };
+	auto t0 = std::chrono::steady_clock::now();
+	double nbytes = 0;
+	bool ok = true;
+
+	for( unsigned int r = 0; r < regions.size() && ok; ++r ) {
+
+		for( off_t pos = regions[r].first; pos < regions[r].second; pos += kChunk ) {
+
+			// Give up if the job is finishing or the chain has already got here
+			{
+				std::lock_guard<std::mutex> lock( mtx );
+				if( stop || current >= i ) ok = false;
+			}
+			if( !ok ) break;
+
+			size_t len = std::min( (off_t)kChunk, regions[r].second - pos );
+			ssize_t n = pread( fd, buffer.data(), len, pos );
+			if( n <= 0 ) break;
+			nbytes += n;
+
+		}
+
+	}
+
+	close( fd );
+
+	std::lock_guard<std::mutex> lock( mtx );
+	bytes_read += nbytes;
+	read_time += std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+
+	return ok;
+
+}
+
+std::string ISSFilePrefetcher::GetReport(){
+
+	std::lock_guard<std::mutex> lock( mtx );
+
+	std::stringstream ss;
+	ss << "  Prefetch: " << n_warmed << " files read ahead, " << std::setprecision(4);
+	ss << bytes_read / 1e6 << " MB in " << read_time << " s, ";
+	ss << n_ready << " of " << n_switches << " ready in time" << std::endl;
+
+	return ss.str();
+
+}
@@ -0,0 +1,522 @@
+#include "Generator.hh"
+
+ISSGenerator::ISSGenerator( ISSSettings *myset ){
+
+	set = myset;
+
+	// Defaults are a busy run with a bit of everything
+	seed = 1;
+	start_time = 0;
+	array_rate = 2e4;
+	singles_rate = 5e4;
+	recoil_rate = 5e3;
+	trace_length = 0;
+	pulser_rate = 10;
+	ebis_rate = 2.5;
+	t1_period = 1.2;
+
+	// Nothing broken by default
+	ooo_fraction = 0;
+	ooo_delay = 0;
+	corrupt_words = 0;
+	corrupt_blocks = 0;
+
+}
+
+double ISSGenerator::Uniform(){
+
+	// 53 random bits, so it's exactly the same on every platform,
+	// unlike the distributions in the standard library
+	return ( rng() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+
+}
+
+double ISSGenerator::Exponential( double rate ){
+
+	return -std::log( 1.0 - Uniform() ) * 1e9 / rate;
+
+}
+
+double ISSGenerator::Gauss( double mean, double sigma ){
+
+	// Box-Muller, throwing away the second number to keep it simple
+	double u1 = 1.0 - Uniform();
+	double u2 = Uniform();
+	return mean + sigma * std::sqrt( -2.0 * std::log( u1 ) ) * std::cos( 2.0 * M_PI * u2 );
+
+}
+
+unsigned int ISSGenerator::Integer( unsigned int n ){
+
+	if( n == 0 ) return 0;
+	return (unsigned int)( Uniform() * n ) % n;
+
+}
+
+void ISSGenerator::AddHit( hit_t &h ){
+
+	h.order = nmade++;
+	h.emit = h.time;
+	h.corrupt = kGood;
+
+	// Written some time after the hits that came after it
+	if( ooo_fraction > 0 && Uniform() < ooo_fraction ) {
+
+		h.emit += (unsigned long long)( Uniform() * ooo_delay );
+		ctr_late++;
+
+	}
+
+	// Broken in one of the ways the converter has to cope with
+	if( h.type != kExtTrigger && corrupt_words > 0 && Uniform() < corrupt_words ) {
+
+		h.corrupt = 1 + Integer( kNumberOfCorruptions - 1 );
+		ctr_corrupt++;
+
+	}
+
+	pending.push( h );
+
+	return;
+
+}
+
+void ISSGenerator::MakeArrayEvent( unsigned long long t ){
+
+	// p-side ASICs 0, 2, 3 and 5 are each a row, n-side ASICs 1 and 4 have two rows
+	const unsigned char pasic[4] = { 0, 2, 3, 5 };
+	if( set->IsCAENOnly() || set->GetNumberOfArrayASICs() < 6 ||
+	    set->GetNumberOfArrayChannels() < 117 ) {
+
+		MakeSingle( t );
+		return;
+
+	}
+
+	unsigned char row = Integer( 4 );
+	unsigned char mod = Integer( set->GetNumberOfArrayModules() );
+
+	// Channels of the n-side strips, as in the event builder
+	unsigned char nch;
+	if( row % 2 == 0 ) nch = Integer(2) ? 11 + Integer(11) : 28 + Integer(11);
+	else nch = Integer(2) ? 89 + Integer(11) : 106 + Integer(11);
+
+	// The same energy on both sides, give or take
+	unsigned int adc = 200 + Integer( 3500 );
+	double nadc = Gauss( adc, 0.02 * adc );
+	if( nadc < 0 ) nadc = 0;
+	if( nadc > 0xFFF ) nadc = 0xFFF;
+
+	hit_t p;
+	p.type = kAsic;
+	p.time = t;
+	p.mod = mod;
+	p.asic = pasic[row];
+	p.ch = Integer( set->GetNumberOfArrayChannels() );
+	p.adc = adc;
+	p.qshort = p.fine = 0;
+	AddHit( p );
+
+	hit_t n = p;
+	n.time = t + Integer( 100 );
+	n.asic = row < 2 ? 1 : 4;
+	n.ch = nch;
+	n.adc = (unsigned int)nadc;
+	AddHit( n );
+
+	return;
+
+}
+
+void ISSGenerator::MakeSingle( unsigned long long t ){
+
+	if( set->IsCAENOnly() ) return;
+
+	hit_t h;
+	h.type = kAsic;
+	h.time = t;
+	h.mod = Integer( set->GetNumberOfArrayModules() );
+	h.asic = Integer( set->GetNumberOfArrayASICs() );
+	h.ch = Integer( set->GetNumberOfArrayChannels() );
+	h.adc = Integer( 0x1000 );
+	h.qshort = h.fine = 0;
+
+	// Keep clear of the pulser
+	if( h.asic == set->GetArrayPulserAsic() &&
+	    h.ch == set->GetArrayPulserChannel() ) h.ch = 0;
+
+	AddHit( h );
+
+	return;
+
+}
+
+void ISSGenerator::MakeCaenHit( unsigned long long t, unsigned char mod, unsigned char ch, unsigned int q ){
+
+	if( set->IsASICOnly() ) return;
+	if( mod >= set->GetNumberOfCAENModules() || ch >= set->GetNumberOfCAENChannels() ) return;
+
+	// Timestamps are in ticks of 2 ns or 4 ns, depending on the digitiser
+	unsigned long long tick = set->GetCAENModel( mod ) == 1730 ? 2 : 4;
+
+	hit_t h;
+	h.type = kCaen;
+	h.time = ( t / tick ) * tick;
+	h.mod = mod;
+	h.asic = 0;
+	h.ch = ch;
+	h.adc = q & 0xFFFF;
+	h.qshort = (unsigned int)( 0.8 * q ) & 0x7FFF;
+	h.fine = Integer( 0x400 );
+	AddHit( h );
+
+	return;
+
+}
+
+void ISSGenerator::MakeRecoilEvent( unsigned long long t ){
+
+	unsigned char sec = Integer( set->GetNumberOfRecoilSectors() );
+
+	// Energy loss in the first layer
+	MakeCaenHit( t, set->GetRecoilModule( sec, 0 ), set->GetRecoilChannel( sec, 0 ),
+				500 + Integer( 3000 ) );
+
+	// Rest of the energy in the next one
+	if( set->GetNumberOfRecoilLayers() > 1 )
+		MakeCaenHit( t + Integer( 50 ), set->GetRecoilModule( sec, 1 ), set->GetRecoilChannel( sec, 1 ),
+					1000 + Integer( 6000 ) );
+
+	return;
+
+}
+
+void ISSGenerator::MakePulser( unsigned long long t ){
+
+	MakeCaenHit( t, set->GetCAENPulserModule(), set->GetCAENPulserChannel(), 2000 );
+
+	// External trigger in every ASIC module at the same time
+	if( set->IsCAENOnly() ) return;
+	for( unsigned int i = 0; i < set->GetNumberOfArrayModules(); ++i ) {
+
+		hit_t h;
+		h.type = kExtTrigger;
+		h.time = t;
+		h.mod = i;
+		h.asic = h.ch = 0;
+		h.adc = h.qshort = h.fine = 0;
+		AddHit( h );
+
+	}
+
+	return;
+
+}
+
+ULong64_t ISSGenerator::InfoWord( unsigned char mod, unsigned char code, unsigned int field, unsigned long long lsb ){
+
+	// Type 2 in bits 31:30, module 29:24, code 23:20, field 19:0
+	ULong64_t word_0 = ( 0x2ULL << 30 ) | ( ( mod & 0x3FULL ) << 24 ) |
+		( ( code & 0xFULL ) << 20 ) | ( field & 0xFFFFFULL );
+	ULong64_t word_1 = lsb & 0x0FFFFFFFULL;
+
+	return ( word_0 << 32 ) | word_1;
+
+}
+
+void ISSGenerator::EncodeTrace( unsigned int amplitude, std::vector<ULong64_t> &words ){
+
+	// Header with the number of words, each of which has four samples
+	unsigned int nwords = trace_length / 4;
+	if( nwords > (unsigned int)WORD_SIZE - 64 ) nwords = WORD_SIZE - 64;
+	words.push_back( ( 0x1ULL << 62 ) | ( (ULong64_t)( nwords & 0xFFFF ) << 32 ) );
+
+	// Baseline and a pulse with an exponential tail
+	unsigned int nsamples = 4 * nwords;
+	double tau = nsamples / 4. + 1.;
+	ULong64_t packet = 0;
+	for( unsigned int k = 0; k < nsamples; ++k ) {
+
+		double s = Gauss( 1000., 2. );
+		if( k >= nsamples / 4 ) s += amplitude / 8. * std::exp( -( k - nsamples / 4. ) / tau );
+		if( s < 0 ) s = 0;
+		if( s > 0x3FFF ) s = 0x3FFF;
+
+		packet = ( packet << 16 ) | ( (ULong64_t)s & 0x3FFF );
+		if( k % 4 == 3 ) {
+
+			words.push_back( packet );
+			packet = 0;
+
+		}
+
+	}
+
+	return;
+
+}
+
+unsigned int ISSGenerator::EncodeHit( const hit_t &h, sync_t &state, std::vector<ULong64_t> &words ){
+
+	unsigned int ninfo = 0;
+	ULong64_t word_0, word_1;
+
+	// CAEN timestamps are in ticks and only use the middle bits
+	if( h.type == kCaen ) {
+
+		unsigned long long tick = set->GetCAENModel( h.mod ) == 1730 ? 2 : 4;
+		unsigned long long raw = h.time / tick;
+		long long msb = ( raw >> 28 ) & 0xFFFFF;
+		unsigned long long lsb = raw & 0x0FFFFFFF;
+
+		if( state.msb != msb ) {
+
+			words.push_back( InfoWord( 0, set->GetSyncCode(), msb, lsb ) );
+			state.msb = msb;
+			ninfo++;
+
+		}
+
+		unsigned char mod = h.mod;
+		if( h.corrupt == kBadModule ) mod = set->GetNumberOfCAENModules();
+
+		// Qlong, Qshort and the fine time or baseline, each in their own word
+		ULong64_t ident = ( ( mod & 0x1FULL ) << 8 ) | ( h.ch & 0x3FULL );
+		word_1 = lsb;
+		word_0 = ( 0x3ULL << 30 ) | ( ( ident | ( 0ULL << 6 ) ) << 16 ) | ( h.adc & 0xFFFF );
+		if( h.corrupt == kBadType ) word_0 &= 0x3FFFFFFF;
+		words.push_back( ( word_0 << 32 ) | word_1 );
+
+		word_0 = ( 0x3ULL << 30 ) | ( ( ident | ( 1ULL << 6 ) ) << 16 ) | ( h.qshort & 0x7FFF );
+		if( h.corrupt != kMissingWord ) words.push_back( ( word_0 << 32 ) | word_1 );
+
+		word_0 = ( 0x3ULL << 30 ) | ( ( ident | ( 3ULL << 6 ) ) << 16 ) | ( h.fine & 0x3FF );
+		words.push_back( ( word_0 << 32 ) | word_1 );
+
+		// Always a trace, even an empty one, so the hit is finished in this block
+		EncodeTrace( h.adc, words );
+
+		return ninfo;
+
+	}
+
+	// ASIC timestamps have the high bits too
+	long long hsb = ( h.time >> 48 ) & 0xFFFFF;
+	long long msb = ( h.time >> 28 ) & 0xFFFFF;
+	unsigned long long lsb = h.time & 0x0FFFFFFF;
+
+	if( state.hsb != hsb ) {
+
+		words.push_back( InfoWord( 0, set->GetTimestampCode(), hsb, lsb ) );
+		state.hsb = hsb;
+		ninfo++;
+
+	}
+
+	// External triggers carry their own middle bits, which the
+	// converter also uses for the CAEN data that follows
+	if( h.type == kExtTrigger ) {
+
+		words.push_back( InfoWord( h.mod, set->GetExternalTriggerCode(), msb, lsb ) );
+		state.msb = msb;
+		return ninfo;
+
+	}
+
+	if( state.msb_asic != msb ) {
+
+		words.push_back( InfoWord( h.mod, set->GetExtItemCode(), msb, lsb ) );
+		state.msb_asic = msb;
+		ninfo++;
+
+	}
+
+	unsigned char mod = h.mod;
+	if( h.corrupt == kBadModule ) mod = set->GetNumberOfArrayModules();
+
+	// Hit bit 29, module 28:23, ASIC 22:19, channel 18:12, ADC 11:0, and bit 28 of the time word
+	ULong64_t ident = ( ( mod & 0x3FULL ) << 11 ) | ( ( h.asic & 0xFULL ) << 7 ) | ( h.ch & 0x7FULL );
+	word_0 = ( 0x3ULL << 30 ) | ( 0x1ULL << 29 ) | ( ident << 12 ) | ( h.adc & 0xFFF );
+	word_1 = ( 0x1ULL << 28 ) | lsb;
+	if( h.corrupt == kBadType ) word_0 &= 0x3FFFFFFF;
+	words.push_back( ( word_0 << 32 ) | word_1 );
+	if( h.corrupt == kMissingWord ) words.push_back( ( word_0 << 32 ) | word_1 );
+
+	return ninfo;
+
+}
+
+bool ISSGenerator::WriteBlock( std::ofstream &output_file ){
+
+	// "EBYEDATA", sequence, stream, tape, my endian, data endian and data length
+	char header[HEADER_SIZE] = { 'E', 'B', 'Y', 'E', 'D', 'A', 'T', 'A' };
+	header[8] = ( nblock >> 24 ) & 0xFF;
+	header[9] = ( nblock >> 16 ) & 0xFF;
+	header[10] = ( nblock >> 8 ) & 0xFF;
+	header[11] = nblock & 0xFF;
+	header[13] = 1;		// stream
+	header[17] = 1;		// my endian
+	header[18] = 1;		// data endian = 256, so no swapping
+
+	unsigned int data_len = block.size() * sizeof(ULong64_t);
+	header[20] = data_len & 0xFF;
+	header[21] = ( data_len >> 8 ) & 0xFF;
+	header[22] = ( data_len >> 16 ) & 0xFF;
+	header[23] = ( data_len >> 24 ) & 0xFF;
+
+	// A header the converter won't recognise
+	if( corrupt_blocks > 0 && Uniform() < corrupt_blocks ) {
+
+		header[7] = 'X';
+		ctr_bad_blocks++;
+
+	}
+
+	output_file.write( header, HEADER_SIZE );
+
+	// Words are written in little endian order whatever machine this is,
+	// padded out to the end of the block with the trailer
+	char data[MAIN_SIZE];
+	for( unsigned int i = 0; i < (unsigned int)WORD_SIZE; ++i ) {
+
+		ULong64_t word = i < block.size() ? block.at(i) : 0x5E5E5E5E5E5E5E5EULL;
+		for( unsigned int j = 0; j < sizeof(ULong64_t); ++j )
+			data[ i * sizeof(ULong64_t) + j ] = ( word >> ( 8 * j ) ) & 0xFF;
+
+	}
+
+	output_file.write( data, MAIN_SIZE );
+
+	nblock++;
+	block.clear();
+
+	return output_file.good();
+
+}
+
+unsigned long ISSGenerator::Generate( std::string filename, unsigned long nblocks ){
+
+	std::ofstream output_file( filename, std::ios::out|std::ios::binary );
+	if( !output_file.is_open() ) {
+
+		std::cerr << "Cannot open " << filename << std::endl;
+		return 0;
+
+	}
+
+	// Start again from the seed
+	rng.seed( seed );
+	pending = std::priority_queue<hit_t,std::vector<hit_t>,later_t>();
+	nmade = 0;
+	block.clear();
+	nblock = 0;
+	ctr_asic = ctr_caen = ctr_info = 0;
+	ctr_late = ctr_corrupt = ctr_bad_blocks = 0;
+
+	// Time of the next hit from each source, infinity if it's turned off
+	const unsigned int nsources = 6;
+	double rates[nsources] = { array_rate, singles_rate, recoil_rate, pulser_rate, ebis_rate,
+		t1_period > 0 ? 1. / t1_period : 0 };
+	double next[nsources];
+	for( unsigned int i = 0; i < nsources; ++i ) {
+
+		if( rates[i] <= 0 ) next[i] = INFINITY;
+		else if( i < 3 ) next[i] = start_time + Exponential( rates[i] );
+		else next[i] = start_time + 1e9 / rates[i] * Uniform();	// steady, but out of step with each other
+
+	}
+
+	// Each block can be read on its own, i.e. after a shard boundary or a missed block
+	sync_t state = { -1, -1, -1 };
+	unsigned long long last_time = start_time;
+	std::vector<ULong64_t> words;
+
+	while( nblock < nblocks ) {
+
+		// Next hit to be made
+		unsigned int src = 0;
+		for( unsigned int i = 1; i < nsources; ++i )
+			if( next[i] < next[src] ) src = i;
+
+		// Nothing more to make or write
+		if( std::isinf( next[src] ) && pending.empty() ) break;
+
+		// Write everything that's due before then
+		while( pending.size() && pending.top().emit < next[src] && nblock < nblocks ) {
+
+			hit_t h = pending.top();
+			pending.pop();
+
+			// Doesn't fit, so start a new block, leaving room for the trailer
+			words.clear();
+			sync_t trial = state;
+			unsigned int ninfo = EncodeHit( h, trial, words );
+			if( block.size() + words.size() >= (unsigned int)WORD_SIZE ) {
+
+				if( !WriteBlock( output_file ) ) {
+
+					std::cerr << "Failed writing to " << filename << std::endl;
+					return ctr_asic + ctr_caen;
+
+				}
+
+				state = { -1, -1, -1 };
+				if( nblock >= nblocks ) break;
+
+				words.clear();
+				trial = state;
+				ninfo = EncodeHit( h, trial, words );
+
+			}
+
+			block.insert( block.end(), words.begin(), words.end() );
+			state = trial;
+			ctr_info += ninfo;
+			if( h.type == kAsic ) ctr_asic++;
+			else if( h.type == kCaen ) ctr_caen++;
+			else ctr_info++;
+			if( h.time > last_time ) last_time = h.time;
+
+		}
+
+		if( std::isinf( next[src] ) || nblock >= nblocks ) continue;
+
+		// Make the hits from this source
+		unsigned long long t = (unsigned long long)next[src];
+		switch( src ) {
+
+			case 0: MakeArrayEvent( t ); break;
+			case 1: MakeSingle( t ); break;
+			case 2: MakeRecoilEvent( t ); break;
+			case 3: MakePulser( t ); break;
+			case 4: MakeCaenHit( t, set->GetEBISModule(), set->GetEBISChannel(), 1000 ); break;
+			case 5: MakeCaenHit( t, set->GetT1Module(), set->GetT1Channel(), 1000 ); break;
+
+		}
+
+		// Random arrivals for the physics, steady ones for the timing signals
+		if( src < 3 ) next[src] += Exponential( rates[src] );
+		else next[src] += 1e9 / rates[src];
+
+	}
+
+	// Whatever is left in the last block
+	if( block.size() && nblock < nblocks ) WriteBlock( output_file );
+	output_file.close();
+
+	// Summary
+	std::cout << "Generated " << filename << " with seed " << seed << std::endl;
+	std::cout << "\t    blocks = " << nblock;
+	if( ctr_bad_blocks ) std::cout << " (" << ctr_bad_blocks << " with bad headers)";
+	std::cout << std::endl;
+	std::cout << "\t ASIC hits = " << ctr_asic << std::endl;
+	std::cout << "\t CAEN hits = " << ctr_caen << std::endl;
+	std::cout << "\tinfo words = " << ctr_info << std::endl;
+	if( ctr_late ) std::cout << "\t late hits = " << ctr_late << std::endl;
+	if( ctr_corrupt ) std::cout << "\t  corrupt  = " << ctr_corrupt << std::endl;
+	std::cout << "\t time span = " << std::fixed << std::setprecision(3);
+	std::cout << ( last_time - start_time ) / 1e9 << " s" << std::defaultfloat << std::endl;
+
+	return ctr_asic + ctr_caen;
+
+}
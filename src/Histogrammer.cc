@@ -8,6 +8,17 @@ ISSHistogrammer::ISSHistogrammer( ISSReaction *myreact, ISSSettings *myset ){
 	// No progress bar by default
 	_prog_ = false;
 	
+	// No metrics by default
+	_metrics_ = false;
+	met_events = nullptr;
+	
+	// Print progress to the terminal by default
+	flag_quiet = false;
+	flag_print_memory = false;
+	
+	// No input tree until one is set, events can be pushed instead
+	input_tree = nullptr;
+	
 }
 
 void ISSHistogrammer::MakeHists() {
@@ -749,6 +760,10 @@ void ISSHistogrammer::MakeHists() {
 		
 	} // ELUM
 	
+	// Memory taken by the histograms, and where to keep track of it
+	memusage.MakeHists( output_file );
+	memusage.ScanHists( output_file );
+	
 }
 
 
@@ -1026,231 +1041,322 @@ unsigned long ISSHistogrammer::FillHists() {
 	/// Main function to fill the histograms
 	n_entries = input_tree->GetEntries();
 	
-	std::cout << " ISSHistogrammer: number of entries in event tree = ";
-	std::cout << n_entries << std::endl;
+	if( !flag_quiet ) {
+		std::cout << " ISSHistogrammer: number of entries in event tree = ";
+		std::cout << n_entries << std::endl;
+	}
 	
 	if( !n_entries ){
 		
-		std::cout << " ISSHistogrammer: Nothing to do..." << std::endl;
+		if( !flag_quiet ) std::cout << " ISSHistogrammer: Nothing to do..." << std::endl;
 		return n_entries;
 		
 	}
 	else {
 		
-		std::cout << " ISSHistogrammer: Start filling histograms" << std::endl;
+		if( !flag_quiet ) std::cout << " ISSHistogrammer: Start filling histograms" << std::endl;
 		
 	}
 	
 	// ------------------------------------------------------------------------ //
 	// Main loop over TTree to find events
 	// ------------------------------------------------------------------------ //
+	int tree_number = 0;
 	for( unsigned int i = 0; i < n_entries; ++i ){
 		
+		// Stop if the job was cancelled from the GUI
+		if( _prog_ && prog->IsCancelled() ) break;
+		
 		// Current event data
 		input_tree->GetEntry(i);
+		if( unpacked_evts ) unpacker->Unpack( read_compact, read_evts );
+		
+		// Start reading ahead of the next file of the chain
+		if( prefetch && input_tree->GetTreeNumber() != tree_number ) {
+			tree_number = input_tree->GetTreeNumber();
+			prefetch->SetCurrent( tree_number );
+		}
+		
+		// Fill the histograms for this event
+		FillEvent();
+		
+		// Progress bar
+		bool update_progress = false;
+		if( n_entries < 200 )
+			update_progress = true;
+		else if( i % (n_entries/100) == 0 || i+1 == n_entries )
+			update_progress = true;
+		
+		if( update_progress ) {
+			
+			// Percent complete
+			float percent = (float)(i+1)*100.0/(float)n_entries;
+			ISS_PROBE2( fill_batch, i+1, n_entries );
+			
+			// Progress bar in GUI
+			if( _prog_ ) prog->SetPosition( percent );
+			
+			// Keep track of the memory as we go
+			memusage.Set( ISSMemoryUsage::kEvents, read_evts ? read_evts->GetMemory() : 0 );
+			memusage.Set( ISSMemoryUsage::kTrees, ISSMemoryUsage::TreeBytes( input_tree ) );
+			
+			// Progress bar in terminal
+			if( !flag_quiet ) {
+				std::cout << " " << std::setw(6) << std::setprecision(4);
+				std::cout << percent << "%    \r";
+				std::cout.flush();
+			}
+			
+		}
 		
-		// tdiff variable
-		double tdiff;
 		
-		// Loop over array events
-		// if you want the p-side only events, use GetArrayPMultiplicity
-		// if you want the "normal" mode using p/n-coincidences, use GetArrayMultiplicity
-		for( unsigned int j = 0; j < read_evts->GetArrayMultiplicity(); ++j ){
-			//for( unsigned int j = 0; j < read_evts->GetArrayPMultiplicity(); ++j ){
+	} // all events
+	
+	if( prefetch && !flag_quiet ) std::cout << prefetch->GetReport();
+	
+	output_file->Write();
+	
+	return n_entries;
+	
+}
+
+void ISSHistogrammer::FillEvent() {
+
+	ISSTimingScope scope( timing, ISSTiming::kFillEvent );
+	if( _metrics_ ) ISSMetrics::Add( met_events );
+	
+	// tdiff variable
+	double tdiff;
+	
+	// Loop over array events
+	ISSTimingScope scope_array( timing, ISSTiming::kFillArray );
+	// if you want the p-side only events, use GetArrayPMultiplicity
+	// if you want the "normal" mode using p/n-coincidences, use GetArrayMultiplicity
+	for( unsigned int j = 0; j < read_evts->GetArrayMultiplicity(); ++j ){
+		//for( unsigned int j = 0; j < read_evts->GetArrayPMultiplicity(); ++j ){
+		
+		// Get array event (uncomment the option you want)
+		// GetArrayEvt is "normal" mode
+		// GetArrayPEvt is p-side only events
+		array_evt = read_evts->GetArrayEvt(j);
+		//array_evt = read_evts->GetArrayPEvt(j);
+		
+		// Do the reaction
+		ISSTimingScope scope_react( timing, ISSTiming::kReaction );
+		react->MakeReaction( array_evt->GetPosition(), array_evt->GetEnergy() );
+		scope_react.Stop();
+		
+		// Singles
+		E_vs_z->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+		E_vs_z_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+		Ex->Fill( react->GetEx() );
+		Ex_mod[array_evt->GetModule()]->Fill( react->GetEx() );
+		Ex_vs_theta->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+		Ex_vs_theta_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+		Ex_vs_z->Fill( react->GetZmeasured(), react->GetEx() );
+		Ex_vs_z_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
+		
+		// Check the E vs z cuts from the user
+		for( unsigned int k = 0; k < react->GetNumberOfEvsZCuts(); ++k ){
 			
-			// Get array event (uncomment the option you want)
-			// GetArrayEvt is "normal" mode
-			// GetArrayPEvt is p-side only events
-			array_evt = read_evts->GetArrayEvt(j);
-			//array_evt = read_evts->GetArrayPEvt(j);
+			// Is inside the cut
+			if( react->GetEvsZCut(k)->IsInside( react->GetZmeasured(), array_evt->GetEnergy() ) ){
+				
+				E_vs_z_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+				Ex_cut[k]->Fill( react->GetEx() );
+				Ex_vs_theta_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+				Ex_vs_z_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
+				
+			} // inside cut
 			
-			// Do the reaction
-			react->MakeReaction( array_evt->GetPosition(), array_evt->GetEnergy() );
+		} // loop over cuts
+		
+		
+		// EBIS time
+		ebis_td_array->Fill( (double)array_evt->GetTime() - (double)read_evts->GetEBIS() );
+		
+		// Check for events in the EBIS on-beam window
+		if( OnBeam( array_evt ) ){
 			
-			// Singles
-			E_vs_z->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-			E_vs_z_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-			Ex->Fill( react->GetEx() );
-			Ex_mod[array_evt->GetModule()]->Fill( react->GetEx() );
-			Ex_vs_theta->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-			Ex_vs_theta_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-			Ex_vs_z->Fill( react->GetZmeasured(), react->GetEx() );
-			Ex_vs_z_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
+			E_vs_z_ebis->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+			E_vs_z_ebis_on->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+			E_vs_z_ebis_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+			E_vs_z_ebis_on_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+			Ex_ebis->Fill( react->GetEx() );
+			Ex_ebis_on->Fill( react->GetEx() );
+			Ex_ebis_mod[array_evt->GetModule()]->Fill( react->GetEx() );
+			Ex_ebis_on_mod[array_evt->GetModule()]->Fill( react->GetEx() );
+			Ex_vs_theta_ebis->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+			Ex_vs_theta_ebis_on->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+			Ex_vs_theta_ebis_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+			Ex_vs_theta_ebis_on_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+			Ex_vs_z_ebis->Fill( react->GetZmeasured(), react->GetEx() );
+			Ex_vs_z_ebis_on->Fill( react->GetZmeasured(), react->GetEx() );
+			Ex_vs_z_ebis_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
+			Ex_vs_z_ebis_on_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
+			
+			// Check for events in the user-defined T1 window
+			Ex_vs_T1->Fill( (double)array_evt->GetTime() - read_evts->GetT1(), react->GetEx() );
+			if( T1Cut( array_evt ) ) {
+				
+				E_vs_z_T1->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+				Ex_T1->Fill( react->GetEx() );
+				Ex_vs_theta_T1->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+				Ex_vs_z_T1->Fill( react->GetZmeasured(), react->GetEx() );
 			
+			} // T1
+
 			// Check the E vs z cuts from the user
 			for( unsigned int k = 0; k < react->GetNumberOfEvsZCuts(); ++k ){
 				
 				// Is inside the cut
 				if( react->GetEvsZCut(k)->IsInside( react->GetZmeasured(), array_evt->GetEnergy() ) ){
 					
-					E_vs_z_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-					Ex_cut[k]->Fill( react->GetEx() );
-					Ex_vs_theta_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-					Ex_vs_z_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
+					E_vs_z_ebis_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+					E_vs_z_ebis_on_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+					Ex_ebis_cut[k]->Fill( react->GetEx() );
+					Ex_ebis_on_cut[k]->Fill( react->GetEx() );
+					Ex_vs_theta_ebis_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+					Ex_vs_theta_ebis_on_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+					Ex_vs_z_ebis_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
+					Ex_vs_z_ebis_on_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
+					
+					// Check for events in the user-defined T1 window
+					Ex_vs_T1_cut[k]->Fill( (double)array_evt->GetTime() - read_evts->GetT1(), react->GetEx() );
+					if( T1Cut( array_evt ) ) {
+						
+						E_vs_z_T1_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+						Ex_T1_cut[k]->Fill( react->GetEx() );
+						Ex_vs_theta_T1_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+						Ex_vs_z_T1_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
 					
+					} // T1
+
 				} // inside cut
 				
 			} // loop over cuts
 			
+		} // ebis
+		
+		else if( OffBeam( array_evt ) ){
 			
-			// EBIS time
-			ebis_td_array->Fill( (double)array_evt->GetTime() - (double)read_evts->GetEBIS() );
+			E_vs_z_ebis->Fill( react->GetZmeasured(), array_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
+			E_vs_z_ebis_off->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+			E_vs_z_ebis_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
+			E_vs_z_ebis_off_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+			Ex_ebis->Fill( react->GetEx(), -1.0 * react->GetEBISFillRatio() );
+			Ex_ebis_off->Fill( react->GetEx() );
+			Ex_ebis_mod[array_evt->GetModule()]->Fill( react->GetEx(), -1.0 * react->GetEBISFillRatio() );
+			Ex_ebis_off_mod[array_evt->GetModule()]->Fill( react->GetEx() );
+			Ex_vs_theta_ebis->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
+			Ex_vs_theta_ebis_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+			Ex_vs_theta_ebis_off->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+			Ex_vs_theta_ebis_off_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+			Ex_vs_z_ebis->Fill( react->GetZmeasured(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
+			Ex_vs_z_ebis_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
+			Ex_vs_z_ebis_off->Fill( react->GetZmeasured(), react->GetEx() );
+			Ex_vs_z_ebis_off_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
 			
-			// Check for events in the EBIS on-beam window
-			if( OnBeam( array_evt ) ){
-				
-				E_vs_z_ebis->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-				E_vs_z_ebis_on->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-				E_vs_z_ebis_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-				E_vs_z_ebis_on_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-				Ex_ebis->Fill( react->GetEx() );
-				Ex_ebis_on->Fill( react->GetEx() );
-				Ex_ebis_mod[array_evt->GetModule()]->Fill( react->GetEx() );
-				Ex_ebis_on_mod[array_evt->GetModule()]->Fill( react->GetEx() );
-				Ex_vs_theta_ebis->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-				Ex_vs_theta_ebis_on->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-				Ex_vs_theta_ebis_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-				Ex_vs_theta_ebis_on_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-				Ex_vs_z_ebis->Fill( react->GetZmeasured(), react->GetEx() );
-				Ex_vs_z_ebis_on->Fill( react->GetZmeasured(), react->GetEx() );
-				Ex_vs_z_ebis_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
-				Ex_vs_z_ebis_on_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
-				
-				// Check for events in the user-defined T1 window
-				Ex_vs_T1->Fill( (double)array_evt->GetTime() - read_evts->GetT1(), react->GetEx() );
-				if( T1Cut( array_evt ) ) {
-					
-					E_vs_z_T1->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-					Ex_T1->Fill( react->GetEx() );
-					Ex_vs_theta_T1->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-					Ex_vs_z_T1->Fill( react->GetZmeasured(), react->GetEx() );
+			// Check the E vs z cuts from the user
+			for( unsigned int k = 0; k < react->GetNumberOfEvsZCuts(); ++k ){
 				
-				} // T1
-
-				// Check the E vs z cuts from the user
-				for( unsigned int k = 0; k < react->GetNumberOfEvsZCuts(); ++k ){
+				// Is inside the cut
+				if( react->GetEvsZCut(k)->IsInside( react->GetZmeasured(), array_evt->GetEnergy() ) ){
 					
-					// Is inside the cut
-					if( react->GetEvsZCut(k)->IsInside( react->GetZmeasured(), array_evt->GetEnergy() ) ){
-						
-						E_vs_z_ebis_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-						E_vs_z_ebis_on_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-						Ex_ebis_cut[k]->Fill( react->GetEx() );
-						Ex_ebis_on_cut[k]->Fill( react->GetEx() );
-						Ex_vs_theta_ebis_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-						Ex_vs_theta_ebis_on_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-						Ex_vs_z_ebis_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
-						Ex_vs_z_ebis_on_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
-						
-						// Check for events in the user-defined T1 window
-						Ex_vs_T1_cut[k]->Fill( (double)array_evt->GetTime() - read_evts->GetT1(), react->GetEx() );
-						if( T1Cut( array_evt ) ) {
-							
-							E_vs_z_T1_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-							Ex_T1_cut[k]->Fill( react->GetEx() );
-							Ex_vs_theta_T1_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-							Ex_vs_z_T1_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
-						
-						} // T1
-
-					} // inside cut
+					E_vs_z_ebis_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
+					E_vs_z_ebis_off_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+					Ex_ebis_cut[k]->Fill( react->GetEx(), -1.0 * react->GetEBISFillRatio() );
+					Ex_ebis_off_cut[k]->Fill( react->GetEx() );
+					Ex_vs_theta_ebis_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
+					Ex_vs_theta_ebis_off_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+					Ex_vs_z_ebis_cut[k]->Fill( react->GetZmeasured(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
+					Ex_vs_z_ebis_off_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
 					
-				} // loop over cuts
+				} // inside cut
 				
-			} // ebis
+			} // loop over cuts
+			
+		} // off ebis
+		
+		// Loop over recoil events
+		double tdiff_min = 99999.;
+		int recoil_idx = -1;
+		for( unsigned int k = 0; k < read_evts->GetRecoilMultiplicity(); ++k ){
+			
+			// Get recoil event
+			recoil_evt = read_evts->GetRecoilEvt(k);
+			
+			// Time differences
+			tdiff = (double)recoil_evt->GetTime() - (double)array_evt->GetTime();
+			recoil_array_td[recoil_evt->GetSector()][array_evt->GetModule()]->Fill( tdiff );
+			recoil_array_tw->Fill( tdiff, array_evt->GetEnergy() );
+			recoil_array_tw_prof->Fill( array_evt->GetEnergy(), tdiff );
+			
+			for( unsigned int i = 0; i < set->GetNumberOfArrayModules(); ++i )
+				for( unsigned int j = 0; j < set->GetNumberOfArrayRows(); ++j )
+					if ( array_evt->GetModule() == i && array_evt->GetRow() == j )
+						recoil_array_tw_row[i][j]->Fill( tdiff, array_evt->GetEnergy() );
+			
+			
+			// Check which is recoil closest in time
+			if( tdiff < tdiff_min ) {
+				
+				recoil_idx = k;
+				tdiff_min = tdiff;
+				
+			}
+			
+		} // k
+		
+		// Only use the recoil closest in time
+		// TODO: Improve this selection criteria
+		if( recoil_idx >= 0 ) {
 			
-			else if( OffBeam( array_evt ) ){
+			// Get recoil event
+			recoil_evt = read_evts->GetRecoilEvt( recoil_idx );
+
+			// Check for prompt events with recoils
+			if( PromptCoincidence( recoil_evt, array_evt ) ){
 				
-				E_vs_z_ebis->Fill( react->GetZmeasured(), array_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
-				E_vs_z_ebis_off->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-				E_vs_z_ebis_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
-				E_vs_z_ebis_off_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-				Ex_ebis->Fill( react->GetEx(), -1.0 * react->GetEBISFillRatio() );
-				Ex_ebis_off->Fill( react->GetEx() );
-				Ex_ebis_mod[array_evt->GetModule()]->Fill( react->GetEx(), -1.0 * react->GetEBISFillRatio() );
-				Ex_ebis_off_mod[array_evt->GetModule()]->Fill( react->GetEx() );
-				Ex_vs_theta_ebis->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
-				Ex_vs_theta_ebis_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-				Ex_vs_theta_ebis_off->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-				Ex_vs_theta_ebis_off_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-				Ex_vs_z_ebis->Fill( react->GetZmeasured(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
-				Ex_vs_z_ebis_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
-				Ex_vs_z_ebis_off->Fill( react->GetZmeasured(), react->GetEx() );
-				Ex_vs_z_ebis_off_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
+				// Recoils in coincidence with an array event
+				recoil_EdE_array[recoil_evt->GetSector()]->Fill( recoil_evt->GetEnergyRest( set->GetRecoilEnergyRestStart(), set->GetRecoilEnergyRestStop() ), recoil_evt->GetEnergyLoss( set->GetRecoilEnergyLossStart(), set->GetRecoilEnergyLossStop() ) );
+				
+				// Array histograms
+				E_vs_z_recoilT->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+				E_vs_z_recoilT_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+				Ex_recoilT->Fill( react->GetEx() );
+				Ex_recoilT_mod[array_evt->GetModule()]->Fill( react->GetEx() );
+				Ex_vs_theta_recoilT->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+				Ex_vs_theta_recoilT_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+				Ex_vs_z_recoilT->Fill( react->GetZmeasured(), react->GetEx() );
+				Ex_vs_z_recoilT_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
 				
 				// Check the E vs z cuts from the user
-				for( unsigned int k = 0; k < react->GetNumberOfEvsZCuts(); ++k ){
+				for( unsigned int l = 0; l < react->GetNumberOfEvsZCuts(); ++l ){
 					
 					// Is inside the cut
-					if( react->GetEvsZCut(k)->IsInside( react->GetZmeasured(), array_evt->GetEnergy() ) ){
+					if( react->GetEvsZCut(l)->IsInside( react->GetZmeasured(), array_evt->GetEnergy() ) ){
 						
-						E_vs_z_ebis_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
-						E_vs_z_ebis_off_cut[k]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-						Ex_ebis_cut[k]->Fill( react->GetEx(), -1.0 * react->GetEBISFillRatio() );
-						Ex_ebis_off_cut[k]->Fill( react->GetEx() );
-						Ex_vs_theta_ebis_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
-						Ex_vs_theta_ebis_off_cut[k]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-						Ex_vs_z_ebis_cut[k]->Fill( react->GetZmeasured(), react->GetEx(), -1.0 * react->GetEBISFillRatio() );
-						Ex_vs_z_ebis_off_cut[k]->Fill( react->GetZmeasured(), react->GetEx() );
+						E_vs_z_recoilT_cut[l]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+						Ex_recoilT_cut[l]->Fill( react->GetEx() );
+						Ex_vs_theta_recoilT_cut[l]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+						Ex_vs_z_recoilT_cut[l]->Fill( react->GetZmeasured(), react->GetEx() );
 						
 					} // inside cut
 					
 				} // loop over cuts
 				
-			} // off ebis
-			
-			// Loop over recoil events
-			double tdiff_min = 99999.;
-			int recoil_idx = -1;
-			for( unsigned int k = 0; k < read_evts->GetRecoilMultiplicity(); ++k ){
-				
-				// Get recoil event
-				recoil_evt = read_evts->GetRecoilEvt(k);
-				
-				// Time differences
-				tdiff = (double)recoil_evt->GetTime() - (double)array_evt->GetTime();
-				recoil_array_td[recoil_evt->GetSector()][array_evt->GetModule()]->Fill( tdiff );
-				recoil_array_tw->Fill( tdiff, array_evt->GetEnergy() );
-				recoil_array_tw_prof->Fill( array_evt->GetEnergy(), tdiff );
-				
-				for( unsigned int i = 0; i < set->GetNumberOfArrayModules(); ++i )
-					for( unsigned int j = 0; j < set->GetNumberOfArrayRows(); ++j )
-						if ( array_evt->GetModule() == i && array_evt->GetRow() == j )
-							recoil_array_tw_row[i][j]->Fill( tdiff, array_evt->GetEnergy() );
-				
-				
-				// Check which is recoil closest in time
-				if( tdiff < tdiff_min ) {
-					
-					recoil_idx = k;
-					tdiff_min = tdiff;
-					
-				}
-				
-			} // k
-			
-			// Only use the recoil closest in time
-			// TODO: Improve this selection criteria
-			if( recoil_idx >= 0 ) {
-				
-				// Get recoil event
-				recoil_evt = read_evts->GetRecoilEvt( recoil_idx );
-
-				// Check for prompt events with recoils
-				if( PromptCoincidence( recoil_evt, array_evt ) ){
-					
-					// Recoils in coincidence with an array event
-					recoil_EdE_array[recoil_evt->GetSector()]->Fill( recoil_evt->GetEnergyRest( set->GetRecoilEnergyRestStart(), set->GetRecoilEnergyRestStop() ), recoil_evt->GetEnergyLoss( set->GetRecoilEnergyLossStart(), set->GetRecoilEnergyLossStop() ) );
+				// Add an energy gate
+				if( RecoilCut( recoil_evt ) ) {
 					
-					// Array histograms
-					E_vs_z_recoilT->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-					E_vs_z_recoilT_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-					Ex_recoilT->Fill( react->GetEx() );
-					Ex_recoilT_mod[array_evt->GetModule()]->Fill( react->GetEx() );
-					Ex_vs_theta_recoilT->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-					Ex_vs_theta_recoilT_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-					Ex_vs_z_recoilT->Fill( react->GetZmeasured(), react->GetEx() );
-					Ex_vs_z_recoilT_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
+					E_vs_z_recoil->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+					E_vs_z_recoil_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+					Ex_recoil->Fill( react->GetEx() );
+					Ex_recoil_mod[array_evt->GetModule()]->Fill( react->GetEx() );
+					Ex_vs_theta_recoil->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+					Ex_vs_theta_recoil_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+					Ex_vs_z_recoil->Fill( react->GetZmeasured(), react->GetEx() );
+					Ex_vs_z_recoil_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
 					
 					// Check the E vs z cuts from the user
 					for( unsigned int l = 0; l < react->GetNumberOfEvsZCuts(); ++l ){
@@ -1258,179 +1364,165 @@ unsigned long ISSHistogrammer::FillHists() {
 						// Is inside the cut
 						if( react->GetEvsZCut(l)->IsInside( react->GetZmeasured(), array_evt->GetEnergy() ) ){
 							
-							E_vs_z_recoilT_cut[l]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-							Ex_recoilT_cut[l]->Fill( react->GetEx() );
-							Ex_vs_theta_recoilT_cut[l]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-							Ex_vs_z_recoilT_cut[l]->Fill( react->GetZmeasured(), react->GetEx() );
+							E_vs_z_recoil_cut[l]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
+							Ex_recoil_cut[l]->Fill( react->GetEx() );
+							Ex_vs_theta_recoil_cut[l]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
+							Ex_vs_z_recoil_cut[l]->Fill( react->GetZmeasured(), react->GetEx() );
 							
 						} // inside cut
 						
 					} // loop over cuts
 					
-					// Add an energy gate
-					if( RecoilCut( recoil_evt ) ) {
-						
-						E_vs_z_recoil->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-						E_vs_z_recoil_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-						Ex_recoil->Fill( react->GetEx() );
-						Ex_recoil_mod[array_evt->GetModule()]->Fill( react->GetEx() );
-						Ex_vs_theta_recoil->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-						Ex_vs_theta_recoil_mod[array_evt->GetModule()]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-						Ex_vs_z_recoil->Fill( react->GetZmeasured(), react->GetEx() );
-						Ex_vs_z_recoil_mod[array_evt->GetModule()]->Fill( react->GetZmeasured(), react->GetEx() );
-						
-						// Check the E vs z cuts from the user
-						for( unsigned int l = 0; l < react->GetNumberOfEvsZCuts(); ++l ){
-							
-							// Is inside the cut
-							if( react->GetEvsZCut(l)->IsInside( react->GetZmeasured(), array_evt->GetEnergy() ) ){
-								
-								E_vs_z_recoil_cut[l]->Fill( react->GetZmeasured(), array_evt->GetEnergy() );
-								Ex_recoil_cut[l]->Fill( react->GetEx() );
-								Ex_vs_theta_recoil_cut[l]->Fill( react->GetThetaCM() * TMath::RadToDeg(), react->GetEx() );
-								Ex_vs_z_recoil_cut[l]->Fill( react->GetZmeasured(), react->GetEx() );
-								
-							} // inside cut
-							
-						} // loop over cuts
-						
-					} // energy cuts
-					
-				} // prompt
+				} // energy cuts
 				
-			} // just one recoil of interest
+			} // prompt
 			
-		} // array
+		} // just one recoil of interest
 		
+	} // array
+	
+	
+	scope_array.Stop();
+	
+	// Loop over ELUM events
+	ISSTimingScope scope_elum( timing, ISSTiming::kFillElum );
+	for( unsigned int j = 0; j < read_evts->GetElumMultiplicity(); ++j ){
+		
+		// Get ELUM event
+		elum_evt = read_evts->GetElumEvt(j);
+		
+		// EBIS time
+		ebis_td_elum->Fill( (double)elum_evt->GetTime() - (double)read_evts->GetEBIS() );
+		
+		// Singles
+		elum->Fill( elum_evt->GetEnergy() );
+		elum_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
+		
+		// Check for events in the EBIS on-beam window
+		if( OnBeam( elum_evt ) ){
+			
+			elum_ebis->Fill( elum_evt->GetEnergy() );
+			elum_ebis_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
+			elum_ebis_on->Fill( elum_evt->GetEnergy() );
+			elum_ebis_on_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
+			elum_vs_T1->Fill( (double)elum_evt->GetTime() - (double)read_evts->GetT1(), elum_evt->GetEnergy() );
+
+		} // ebis
 		
-		// Loop over ELUM events
-		for( unsigned int j = 0; j < read_evts->GetElumMultiplicity(); ++j ){
+		else {
 			
-			// Get ELUM event
-			elum_evt = read_evts->GetElumEvt(j);
+			elum_ebis->Fill( elum_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
+			elum_ebis_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
+			elum_ebis_off->Fill( elum_evt->GetEnergy() );
+			elum_ebis_off_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
 			
-			// EBIS time
-			ebis_td_elum->Fill( (double)elum_evt->GetTime() - (double)read_evts->GetEBIS() );
 			
-			// Singles
-			elum->Fill( elum_evt->GetEnergy() );
-			elum_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
+		}
+		
+		// Loop over recoil events
+		for( unsigned int k = 0; k < read_evts->GetRecoilMultiplicity(); ++k ){
 			
-			// Check for events in the EBIS on-beam window
-			if( OnBeam( elum_evt ) ){
-				
-				elum_ebis->Fill( elum_evt->GetEnergy() );
-				elum_ebis_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
-				elum_ebis_on->Fill( elum_evt->GetEnergy() );
-				elum_ebis_on_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
-				elum_vs_T1->Fill( (double)elum_evt->GetTime() - (double)read_evts->GetT1(), elum_evt->GetEnergy() );
-
-			} // ebis
+			// Get recoil event
+			recoil_evt = read_evts->GetRecoilEvt(k);
 			
-			else {
-				
-				elum_ebis->Fill( elum_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
-				elum_ebis_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy(), -1.0 * react->GetEBISFillRatio() );
-				elum_ebis_off->Fill( elum_evt->GetEnergy() );
-				elum_ebis_off_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
-				
-				
-			}
+			// Time differences
+			tdiff = (double)recoil_evt->GetTime() - (double)elum_evt->GetTime();
+			recoil_elum_td[recoil_evt->GetSector()][elum_evt->GetSector()]->Fill( tdiff );
 			
-			// Loop over recoil events
-			for( unsigned int k = 0; k < read_evts->GetRecoilMultiplicity(); ++k ){
-				
-				// Get recoil event
-				recoil_evt = read_evts->GetRecoilEvt(k);
+			// Check for prompt events with recoils
+			if( PromptCoincidence( recoil_evt, elum_evt ) ){
 				
-				// Time differences
-				tdiff = (double)recoil_evt->GetTime() - (double)elum_evt->GetTime();
-				recoil_elum_td[recoil_evt->GetSector()][elum_evt->GetSector()]->Fill( tdiff );
+				elum_recoilT->Fill( elum_evt->GetEnergy() );
+				elum_recoilT_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
 				
-				// Check for prompt events with recoils
-				if( PromptCoincidence( recoil_evt, elum_evt ) ){
+				// Add an energy gate
+				if( RecoilCut( recoil_evt ) ) {
 					
-					elum_recoilT->Fill( elum_evt->GetEnergy() );
-					elum_recoilT_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
+					elum_recoil->Fill( elum_evt->GetEnergy() );
+					elum_recoil_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
 					
-					// Add an energy gate
-					if( RecoilCut( recoil_evt ) ) {
-						
-						elum_recoil->Fill( elum_evt->GetEnergy() );
-						elum_recoil_sec[elum_evt->GetSector()]->Fill( elum_evt->GetEnergy() );
-						
-					} // energy cuts
-					
-				} // prompt
+				} // energy cuts
 				
-			} // recoils
+			} // prompt
 			
-		} // ELUM
+		} // recoils
 		
+	} // ELUM
+	scope_elum.Stop();
+	
+	
+	// Loop over recoil events
+	ISSTimingScope scope_recoil( timing, ISSTiming::kFillRecoil );
+	for( unsigned int j = 0; j < read_evts->GetRecoilMultiplicity(); ++j ){
 		
-		// Loop over recoil events
-		for( unsigned int j = 0; j < read_evts->GetRecoilMultiplicity(); ++j ){
-			
-			// Get recoil event
-			recoil_evt = read_evts->GetRecoilEvt(j);
-			
-			// EBIS, T1, SC time
-			ebis_td_recoil->Fill( (double)recoil_evt->GetTime() - (double)read_evts->GetEBIS() );
-			t1_td_recoil->Fill( (double)recoil_evt->GetTime() - (double)read_evts->GetT1() );
-			sc_td_recoil->Fill( (double)recoil_evt->GetTime() - (double)read_evts->GetSC() );
+		// Get recoil event
+		recoil_evt = read_evts->GetRecoilEvt(j);
+		
+		// EBIS, T1, SC time
+		ebis_td_recoil->Fill( (double)recoil_evt->GetTime() - (double)read_evts->GetEBIS() );
+		t1_td_recoil->Fill( (double)recoil_evt->GetTime() - (double)read_evts->GetT1() );
+		sc_td_recoil->Fill( (double)recoil_evt->GetTime() - (double)read_evts->GetSC() );
 
-			// Energy EdE plot, unconditioned
-			recoil_EdE[recoil_evt->GetSector()]->Fill( recoil_evt->GetEnergyRest( set->GetRecoilEnergyRestStart(), set->GetRecoilEnergyRestStop() ),
-													  recoil_evt->GetEnergyLoss( set->GetRecoilEnergyLossStart(), set->GetRecoilEnergyLossStop() ) );
+		// Energy EdE plot, unconditioned
+		recoil_EdE[recoil_evt->GetSector()]->Fill( recoil_evt->GetEnergyRest( set->GetRecoilEnergyRestStart(), set->GetRecoilEnergyRestStop() ),
+												  recoil_evt->GetEnergyLoss( set->GetRecoilEnergyLossStart(), set->GetRecoilEnergyLossStop() ) );
 
-			// Energy dE versus T1 time
-			recoil_dE_vs_T1[recoil_evt->GetSector()]->Fill( (double)recoil_evt->GetTime() - (double)read_evts->GetT1(),
-														   recoil_evt->GetEnergyLoss( set->GetRecoilEnergyLossStart(), set->GetRecoilEnergyLossStop() ) );
+		// Energy dE versus T1 time
+		recoil_dE_vs_T1[recoil_evt->GetSector()]->Fill( (double)recoil_evt->GetTime() - (double)read_evts->GetT1(),
+													   recoil_evt->GetEnergyLoss( set->GetRecoilEnergyLossStart(), set->GetRecoilEnergyLossStop() ) );
 
-			// Bragg curve
-			for( unsigned int k = 0; k < recoil_evt->GetEnergies().size(); ++k )
-				recoil_bragg[recoil_evt->GetSector()]->Fill( recoil_evt->GetID(k), recoil_evt->GetEnergy(k) );
-			
-			// Energy EdE plot, after cut
-			if( RecoilCut( recoil_evt ) )
-				recoil_EdE_cut[recoil_evt->GetSector()]->Fill( recoil_evt->GetEnergyRest( set->GetRecoilEnergyRestStart(), set->GetRecoilEnergyRestStop() ),
-															  recoil_evt->GetEnergyLoss( set->GetRecoilEnergyLossStart(), set->GetRecoilEnergyLossStop() ) );
-			
-		} // recoils
+		// Bragg curve
+		for( unsigned int k = 0; k < recoil_evt->GetEnergies().size(); ++k )
+			recoil_bragg[recoil_evt->GetSector()]->Fill( recoil_evt->GetID(k), recoil_evt->GetEnergy(k) );
 		
-		// Progress bar
-		bool update_progress = false;
-		if( n_entries < 200 )
-			update_progress = true;
-		else if( i % (n_entries/100) == 0 || i+1 == n_entries )
-			update_progress = true;
+		// Energy EdE plot, after cut
+		if( RecoilCut( recoil_evt ) )
+			recoil_EdE_cut[recoil_evt->GetSector()]->Fill( recoil_evt->GetEnergyRest( set->GetRecoilEnergyRestStart(), set->GetRecoilEnergyRestStop() ),
+														  recoil_evt->GetEnergyLoss( set->GetRecoilEnergyLossStart(), set->GetRecoilEnergyLossStop() ) );
 		
-		if( update_progress ) {
-			
-			// Percent complete
-			float percent = (float)(i+1)*100.0/(float)n_entries;
-			
-			// Progress bar in GUI
-			if( _prog_ ) {
-				
-				prog->SetPosition( percent );
-				gSystem->ProcessEvents();
-				
-			}
-			
-			// Progress bar in terminal
-			std::cout << " " << std::setw(6) << std::setprecision(4);
-			std::cout << percent << "%    \r";
-			std::cout.flush();
-			
-		}
+	} // recoils
+	
+	return;
+	
+}
+
+void ISSHistogrammer::SetBranches(){
+	
+	// Events written with CompactEvents are unpacked after reading each entry
+	if( input_tree->GetBranch( "ISSCompactEvts" ) ) {
 		
+		unpacker = std::make_unique<ISSEventPacker>( set );
+		unpacked_evts = std::make_unique<ISSEvts>();
+		read_evts = unpacked_evts.get();
+		input_tree->SetBranchAddress( "ISSCompactEvts", &read_compact );
 		
-	} // all events
+	}
 	
-	output_file->Write();
+	else {
+		
+		if( unpacked_evts ) read_evts = nullptr;
+		unpacked_evts.reset();
+		input_tree->SetBranchAddress( "ISSEvts", &read_evts );
+		
+	}
 	
-	return n_entries;
+	return;
+	
+}
+
+void ISSHistogrammer::SetPrefetch(){
+	
+	// Only worth it if there is a next file, wildcards are already expanded
+	std::vector<std::string> names;
+	TIter next( input_tree->GetListOfFiles() );
+	while( TChainElement *e = (TChainElement*)next() )
+		names.push_back( e->GetTitle() );
+	
+	prefetch.reset();
+	if( names.size() > 1 && set->GetPrefetchFiles() )
+		prefetch = std::make_unique<ISSFilePrefetcher>( names, set->GetPrefetchFiles(), set->GetPrefetchMemory() * 1e6 );
+	
+	return;
 	
 }
 
@@ -1443,7 +1535,8 @@ void ISSHistogrammer::SetInputFile( std::vector<std::string> input_file_names )
 		input_tree->Add( input_file_names[i].data() );
 		
 	}
-	input_tree->SetBranchAddress( "ISSEvts", &read_evts );
+	SetBranches();
+	SetPrefetch();
 	
 	return;
 	
@@ -1454,7 +1547,8 @@ void ISSHistogrammer::SetInputFile( std::string input_file_name ) {
 	/// Overloaded function for a single file or multiple files
 	input_tree = new TChain( "evt_tree" );
 	input_tree->Add( input_file_name.data() );
-	input_tree->SetBranchAddress( "ISSEvts", &read_evts );
+	SetBranches();
+	SetPrefetch();
 	
 	return;
 	
@@ -1464,7 +1558,8 @@ void ISSHistogrammer::SetInputTree( TTree *user_tree ){
 	
 	// Find the tree and set branch addresses
 	input_tree = (TChain*)user_tree;
-	input_tree->SetBranchAddress( "ISSEvts", &read_evts );
+	SetBranches();
+	prefetch.reset();
 	
 	return;
 	
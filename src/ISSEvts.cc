@@ -8,6 +8,7 @@ ClassImp(ISSElumEvt)
 ClassImp(ISSZeroDegreeEvt)
 ClassImp(ISSGammaRayEvt)
 ClassImp(ISSEvts)
+ClassImp(ISSCompactEvts)
 
 
 // ---------- //
@@ -377,3 +378,52 @@ void ISSGammaRayEvt::SetEvent( float myenergy, unsigned char myid,
 	
 }
 
+// ------------------ //
+// ISS compact events //
+// ------------------ //
+ISSCompactEvts::ISSCompactEvts(){}
+ISSCompactEvts::~ISSCompactEvts(){}
+
+void ISSCompactEvts::ClearEvt() {
+	
+	n_array = 0;
+	array_mod.clear();
+	array_row.clear();
+	array_pid.clear();
+	array_nid.clear();
+	array_pen.clear();
+	array_nen.clear();
+	array_ptd.clear();
+	array_ntd.clear();
+	
+	recoil_sec.clear();
+	recoil_depth.clear();
+	recoil_id.clear();
+	recoil_en.clear();
+	recoil_detd.clear();
+	recoil_etd.clear();
+	
+	mwpc_tacdiff.clear();
+	mwpc_axis.clear();
+	mwpc_td.clear();
+	
+	elum_id.clear();
+	elum_sec.clear();
+	elum_en.clear();
+	elum_td.clear();
+	
+	zd_sec.clear();
+	zd_depth.clear();
+	zd_id.clear();
+	zd_en.clear();
+	zd_detd.clear();
+	zd_etd.clear();
+	
+	gamma_id.clear();
+	gamma_type.clear();
+	gamma_en.clear();
+	gamma_td.clear();
+	
+	return;
+
+}
@@ -14,7 +14,8 @@ ISSGUI::ISSGUI() {
 	//-------------------//
 	main_frame = new TGMainFrame( gClient->GetRoot(), 1000, 300, kMainFrame | kHorizontalFrame );
 
-	// terminate ROOT session when window is closed
+	// stop any running job and terminate ROOT session when window is closed
+	main_frame->Connect( "CloseWindow()", "ISSGUI", this, "on_close()" );
 	main_frame->Connect( "CloseWindow()", "TApplication", gApplication, "Terminate()" );
 	main_frame->DontCallClose();
 
@@ -296,6 +297,16 @@ ISSGUI::ISSGUI() {
 	but_sort->SetBackgroundColor( TColor::Number2Pixel( kGreen+1 ) );
 	centre_go->AddFrame( but_sort, new TGLayoutHints( kLHintsRight | kLHintsExpandX ) );
 
+	// Cancel sorting
+	but_cancel = new TGTextButton( centre_go, "Cancel", -1, TGTextButton::GetDefaultGC()(),
+							   TGTextButton::GetDefaultFontStruct(), kDoubleBorder );
+	but_cancel->SetTextJustify( 36 );
+	but_cancel->SetMargins( 0, 0, 0, 0 );
+	but_cancel->SetWrapLength( -1 );
+	but_cancel->Resize( 65, 46 );
+	but_cancel->SetState( kButtonDisabled );
+	centre_go->AddFrame( but_cancel, new TGLayoutHints( kLHintsRight | kLHintsExpandX ) );
+
 	
 	//---------------//
 	// Progress bars //
@@ -316,6 +327,17 @@ ISSGUI::ISSGUI() {
 															kLHintsExpandX,5,5,5,10) );
 	centre_progress->AddFrame( prog_hist.get(), new TGLayoutHints(kLHintsTop|kLHintsLeft|
 															kLHintsExpandX,5,5,5,10) );
+	
+	// Progress of the jobs, shared with the worker thread
+	stat_conv = std::make_shared<ISSProgress>();
+	stat_sort = std::make_shared<ISSProgress>();
+	stat_evnt = std::make_shared<ISSProgress>();
+	stat_hist = std::make_shared<ISSProgress>();
+	flag_running = false;
+	
+	// Timer to update the progress bars, only on while a job is running
+	timer = new TTimer( 200 );
+	timer->Connect( "Timeout()", "ISSGUI", this, "on_timer()" );
 
 
 	//-----------------//
@@ -352,6 +374,7 @@ ISSGUI::ISSGUI() {
 	text_add_file->Connect( "ReturnPressed()", "ISSGUI", this, "on_add_clicked()" );
 	but_del->Connect( "Clicked()", "ISSGUI", this, "on_del_clicked()" );
 	but_sort->Connect( "Clicked()", "ISSGUI", this, "on_sort_clicked()" );
+	but_cancel->Connect( "Clicked()", "ISSGUI", this, "on_cancel_clicked()" );
 	but_set->Connect( "Clicked()", "ISSGUI", this, "on_set_clicked()" );
 	but_cal->Connect( "Clicked()", "ISSGUI", this, "on_cal_clicked()" );
 	but_rea->Connect( "Clicked()", "ISSGUI", this, "on_rea_clicked()" );
@@ -366,6 +389,11 @@ ISSGUI::ISSGUI() {
 
 ISSGUI::~ISSGUI() {
 	
+	// Make sure the worker is finished first
+	on_close();
+	timer->TurnOff();
+	delete timer;
+	
 	// Clean up main frame...
 	main_frame->Cleanup();
 	delete main_frame;
@@ -524,7 +552,7 @@ void ISSGUI::gui_convert(){
 	//------------------------//
 	ISSConverter conv( myset.get() );
 	conv.AddCalibration( mycal.get() );
-	conv.AddProgressBar( prog_conv );
+	conv.AddProgress( stat_conv );
 	std::cout << "\n +++ ISS Analysis:: processing Converter +++" << std::endl;
 
 	// Progress bar and filename
@@ -543,6 +571,9 @@ void ISSGUI::gui_convert(){
 
 		force_convert.push_back( false );
 		
+		// Stop here if the job was cancelled
+		if( stat_conv->IsCancelled() ) break;
+		
 		// Skip the file if it's deleted
 		if( !filestatus.at(i) ) continue;
 
@@ -580,7 +611,7 @@ void ISSGUI::gui_convert(){
 			prog_format += name_input_file( name_input_file.Last('/') + 1,
 					name_input_file.Length() - name_input_file.Last('/') ).Data();
 			prog_format += ": %.0f%%";
-			prog_conv->ShowPosition( true, false, prog_format.data() );
+			stat_conv->SetLabel( prog_format );
 
 			conv.SetOutput( name_output_file.Data() );
 			if( flag_source ) conv.SourceOnly();
@@ -589,7 +620,7 @@ void ISSGUI::gui_convert(){
 			conv.ConvertFile( name_input_file.Data() );
 
 			prog_format  = "Converter complete";
-			prog_conv->ShowPosition( true, false, prog_format.data() );
+			stat_conv->SetLabel( prog_format );
 
 			// Time sorting
 			if( !flag_source ) {
@@ -598,21 +629,31 @@ void ISSGUI::gui_convert(){
 				prog_format += name_input_file( name_input_file.Last('/') + 1,
 											   name_input_file.Length() - name_input_file.Last('/') ).Data();
 				prog_format += ": %.0f%%";
-				prog_sort->ShowPosition( true, false, prog_format.data() );
-				conv.AddProgressBar( prog_sort );
+				stat_sort->SetLabel( prog_format );
+				conv.AddProgress( stat_sort );
 				conv.SortTree();
 				
 			}
 			
 			conv.CloseOutput();
+			
+			// Don't leave half a file that looks converted
+			if( stat_conv->IsCancelled() ) {
+				
+				gSystem->Unlink( name_output_file.Data() );
+				stat_conv->SetLabel( "Converter cancelled" );
+				stat_sort->SetLabel( "TimeSorter cancelled" );
+				break;
+				
+			}
 
 			prog_format  = "Time ordering complete";
-			prog_sort->ShowPosition( true, false, prog_format.data() );
+			stat_sort->SetLabel( prog_format );
+			
+			// Back to the converter progress for the next file
+			conv.AddProgress( stat_conv );
 
 		}
-
-		// Update everything
-		gSystem->ProcessEvents();
 		
 	}
 	
@@ -626,11 +667,9 @@ void ISSGUI::gui_build(){
 	// Physics event builder //
 	//-----------------------//
 	ISSEventBuilder eb( myset.get() );
-	eb.AddProgressBar( prog_evnt );
+	eb.AddProgress( stat_evnt );
 	std::cout << "\n +++ ISS Analysis:: processing EventBuilder +++" << std::endl;
 
-	// Update everything
-	gSystem->ProcessEvents();
 
 	// Progress bar and filename
 	std::string prog_format;
@@ -642,6 +681,7 @@ void ISSGUI::gui_build(){
 	// Update calibration file if given
 	if( mycal->InputFile() != "dummy" )
 		eb.AddCalibration( mycal.get() );
+	else eb.AddTimeOffsets( mycal.get() );
 
 	// Do event builder for each file individually
 	for( unsigned int i = 0; i < filelist.size(); i++ ){
@@ -651,6 +691,9 @@ void ISSGUI::gui_build(){
 
 		// Skip the file if it's deleted
 		if( !filestatus.at(i) ) continue;
+		
+		// Stop here if the job was cancelled
+		if( stat_evnt->IsCancelled() ) break;
 
 		// We need to do event builder if we just converted it
 		// specific request to do new event build with -e
@@ -685,7 +728,7 @@ void ISSGUI::gui_build(){
 			prog_format += name_input_file( name_input_file.Last('/') + 1,
 						name_input_file.Length() - name_input_file.Last('/') ).Data();
 			prog_format += ": %.0f%%";
-			prog_evnt->ShowPosition( true, false, prog_format.data() );
+			stat_evnt->SetLabel( prog_format );
 
 			eb.SetInputFile( name_input_file.Data() );
 			eb.SetOutput( name_output_file.Data() );
@@ -693,16 +736,23 @@ void ISSGUI::gui_build(){
 			eb.CloseOutput();
 
 			force_events = false;
+			
+			// Don't leave half a file that looks built
+			if( stat_evnt->IsCancelled() ) {
+				
+				gSystem->Unlink( name_output_file.Data() );
+				stat_evnt->SetLabel( "EventBuilder cancelled" );
+				break;
+				
+			}
 
 		}
 
 		prog_format  = "EventBuilder complete";
-		prog_evnt->ShowPosition( true, false, prog_format.data() );
-
-		// Update everything
-		gSystem->ProcessEvents();
+		stat_evnt->SetLabel( prog_format );
 
 	}
+	
 	return;
 	
 }
@@ -712,12 +762,11 @@ void ISSGUI::gui_hist(){
 	//------------------------------//
 	// Finally make some histograms //
 	//------------------------------//
+	if( stat_hist->IsCancelled() ) return;
 	ISSHistogrammer hist( myrea.get(), myset.get() );
-	hist.AddProgressBar( prog_hist );
+	hist.AddProgress( stat_hist );
 	std::cout << "\n +++ ISS Analysis:: processing Histogrammer +++" << std::endl;
 
-	// Update everything
-	gSystem->ProcessEvents();
 
 	// Progress bar and filename
 	std::string prog_format;
@@ -725,10 +774,9 @@ void ISSGUI::gui_hist(){
 	TString name_output_file;
 	
 	prog_format = "Histogramming: %.0f%%";
-	prog_hist->ShowPosition( true, false, prog_format.data() );
+	stat_hist->SetLabel( prog_format );
 	
-	name_output_file = text_out_file->GetText();
-	if( name_output_file == "" ) name_output_file = "output.root";
+	name_output_file = name_hist_output;
 	hist.SetOutput( name_output_file.Data() );
 	std::vector<std::string> name_hist_files;
 
@@ -747,12 +795,17 @@ void ISSGUI::gui_hist(){
 	hist.FillHists();
 	hist.CloseOutput();
 	
+	if( stat_hist->IsCancelled() ) {
+		
+		gSystem->Unlink( name_output_file.Data() );
+		stat_hist->SetLabel( "Histogrammer cancelled" );
+		return;
+		
+	}
+	
 	prog_format  = "Histogramming complete";
-	prog_hist->ShowPosition( true, false, prog_format.data() );
-
+	stat_hist->SetLabel( prog_format );
 	
-	// Update everything
-	gSystem->ProcessEvents();
 	return;
 	
 }
@@ -762,13 +815,12 @@ void ISSGUI::gui_autocal(){
 	//-----------------------------------//
 	// Run automatic calibration routine //
 	//-----------------------------------//
+	if( stat_sort->IsCancelled() ) return;
 	ISSAutoCalibrator autocal( myset.get(), myrea.get(), "" ); // TODO implement autocal file here!
-	autocal.AddProgressBar( prog_hist );
+	autocal.AddProgress( stat_sort );
 	autocal.AddCalibration( mycal.get() );
 	std::cout << "\n +++ ISS Analysis:: processing AutoCalibration +++" << std::endl;
 
-	// Update everything
-	gSystem->ProcessEvents();
 
 	// Progress bar and filenames
 	std::string prog_format;
@@ -780,13 +832,13 @@ void ISSGUI::gui_autocal(){
 	std::string name_results_file = "autocal_results.cal";
 
 	prog_format = "AutoCalibrating: %.0f%%";
-	prog_sort->ShowPosition( true, false, prog_format.data() );
+	stat_sort->SetLabel( prog_format );
 
 	prog_format = "EventBuilder not running";
-	prog_evnt->ShowPosition( true, false, prog_format.data() );
+	stat_evnt->SetLabel( prog_format );
 
 	prog_format = "Histogrammer not running";
-	prog_hist->ShowPosition( true, false, prog_format.data() );
+	stat_hist->SetLabel( prog_format );
 
 	// Check each file
 	for( unsigned int i = 0; i < filelist.size(); i++ ){
@@ -826,19 +878,29 @@ void ISSGUI::gui_autocal(){
 	// Give this file to the autocalibrator
 	if( autocal.SetOutputFile( name_output_file ) ) return;
 	autocal.DoFits();
+	
+	// Don't save a calibration with only some of the channels done
+	if( stat_sort->IsCancelled() ) {
+		
+		stat_sort->SetLabel( "AutoCalibrator cancelled" );
+		return;
+		
+	}
+	
 	autocal.SaveCalFile( name_results_file );
 	
 	prog_format  = "AutoCalibrator complete";
-	prog_sort->ShowPosition( true, false, prog_format.data() );
+	stat_sort->SetLabel( prog_format );
 
-	// Update everything
-	gSystem->ProcessEvents();
 	return;
 }
 
 
 void ISSGUI::on_sort_clicked() {
 
+	// Only one job at a time
+	if( flag_running ) return;
+
 	// Settings files, etc
 	std::string name_set_file = text_set_file->GetText();
 	std::string name_cal_file = text_cal_file->GetText();
@@ -857,13 +919,43 @@ void ISSGUI::on_sort_clicked() {
 	flag_autocal = check_autocal->IsOn();
 	if( flag_autocal ) flag_source = true;
 
+	// Widgets can only be read here, not from the worker
+	name_hist_output = text_out_file->GetText();
+	if( name_hist_output == "" ) name_hist_output = "output.root";
+
 	myset = std::make_shared<ISSSettings>( name_set_file );
 	mycal = std::make_shared<ISSCalibration>( name_cal_file, myset.get() );
 	myrea = std::make_shared<ISSReaction>( name_rea_file, myset.get(), flag_source );
 	
-	//------------------//
-	// Run the analysis //
-	//------------------//
+	// Clean progress for the new job
+	stat_conv->Reset();
+	stat_sort->Reset();
+	stat_evnt->Reset();
+	stat_hist->Reset();
+	
+	// The file list can't change while the worker is using it
+	but_sort->SetState( kButtonDisabled );
+	but_add->SetState( kButtonDisabled );
+	but_del->SetState( kButtonDisabled );
+	but_open->SetState( kButtonDisabled );
+	but_cancel->SetState( kButtonUp );
+
+	//------------------------------------------//
+	// Run the analysis in the background while //
+	// the timer keeps the progress bars going  //
+	//------------------------------------------//
+	ROOT::EnableThreadSafety();
+	flag_running = true;
+	worker = std::thread( [this](){
+		run_sort();
+		flag_running = false;
+	} );
+	timer->TurnOn();
+	
+}
+
+void ISSGUI::run_sort() {
+
 	gui_convert();
 	if( !flag_source ) {
 		//gui_sort();
@@ -872,7 +964,77 @@ void ISSGUI::on_sort_clicked() {
 	}
 	else if( flag_autocal )
 		gui_autocal();
-	std::cout << "\n\nFinished!\n";
+	
+	if( stat_conv->IsCancelled() ) std::cout << "\n\nCancelled!\n";
+	else std::cout << "\n\nFinished!\n";
+	
+	return;
+	
+}
+
+void ISSGUI::on_cancel_clicked() {
+	
+	if( !flag_running ) return;
+	
+	// Each stage stops at the next entry, block or channel
+	std::cout << "\n Cancelling..." << std::endl;
+	stat_conv->Cancel();
+	stat_sort->Cancel();
+	stat_evnt->Cancel();
+	stat_hist->Cancel();
+	but_cancel->SetState( kButtonDisabled );
+	
+	return;
+	
+}
+
+void ISSGUI::update_bar( std::shared_ptr<ISSProgress> stat,
+						 std::shared_ptr<TGHProgressBar> bar ) {
+	
+	std::string label;
+	if( stat->GetLabel( label ) ) bar->ShowPosition( true, false, label.data() );
+	bar->SetPosition( stat->GetPosition() );
+	
+	return;
+	
+}
+
+void ISSGUI::on_timer() {
+	
+	// Copy the progress of the worker to the bars
+	update_bar( stat_conv, prog_conv );
+	update_bar( stat_sort, prog_sort );
+	update_bar( stat_evnt, prog_evnt );
+	update_bar( stat_hist, prog_hist );
+
+	// Tidy up when the job has finished
+	if( !flag_running && worker.joinable() ) {
+		
+		worker.join();
+		timer->TurnOff();
+		but_sort->SetState( kButtonUp );
+		but_add->SetState( kButtonUp );
+		but_del->SetState( kButtonUp );
+		but_open->SetState( kButtonUp );
+		but_cancel->SetState( kButtonDisabled );
+		
+	}
+	
+	return;
+	
+}
+
+void ISSGUI::on_close() {
+	
+	// Stop the job before the application goes away
+	if( worker.joinable() ) {
+		
+		on_cancel_clicked();
+		worker.join();
+		
+	}
+	
+	return;
 	
 }
 
@@ -0,0 +1,233 @@
+#include "Manifest.hh"
+
+void ISSManifest::AddFile( std::string key, std::string filename ){
+
+	// No file or the defaults
+	if( !filename.size() || filename == "dummy" ||
+	    gSystem->AccessPathName( filename.data() ) ) {
+
+		entries[key] = "none";
+		return;
+
+	}
+
+	TMD5 *md5 = TMD5::FileChecksum( filename.data() );
+	if( md5 ) {
+		entries[key] = md5->AsString();
+		delete md5;
+	}
+	else entries[key] = "unreadable";
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hashes only some lines of a text file, so that the parameters in the other
+/// lines can change without the output being made again
+/// \param[in] key Name of the entry
+/// \param[in] filename Text file, i.e. the calibration
+/// \param[in] part String to look for in each line, i.e. ".Time:" for the time offsets
+/// \param[in] with Hash the lines that contain part (true) or the ones that don't (false)
+void ISSManifest::AddFile( std::string key, std::string filename, std::string part, bool with ){
+
+	std::ifstream input_file( filename.data() );
+	if( !filename.size() || filename == "dummy" || !input_file.is_open() ) {
+
+		entries[key] = "none";
+		return;
+
+	}
+
+	TMD5 md5;
+	std::string line;
+	while( std::getline( input_file, line ) ) {
+
+		if( ( line.find( part ) != std::string::npos ) != with ) continue;
+		line += "\n";
+		md5.Update( (const UChar_t*)line.data(), line.size() );
+
+	}
+
+	input_file.close();
+	md5.Final();
+	entries[key] = md5.AsString();
+
+	return;
+
+}
+
+void ISSManifest::AddData( std::string key, std::string filename ){
+
+	std::ifstream input_file( filename.data(), std::ios::in|std::ios::binary|std::ios::ate );
+	if( !input_file.is_open() ) {
+
+		entries[key] = "none";
+		return;
+
+	}
+
+	// Hashing all of a run file would take as long as converting it,
+	// so use the size plus the first and last MB of data
+	const long long chunk = 1048576;
+	long long size = input_file.tellg();
+	std::vector<char> buffer( chunk );
+	TMD5 md5;
+
+	std::string size_str = std::to_string( size );
+	md5.Update( (const UChar_t*)size_str.data(), size_str.size() );
+
+	input_file.seekg( 0, std::ios::beg );
+	input_file.read( buffer.data(), std::min( chunk, size ) );
+	md5.Update( (const UChar_t*)buffer.data(), input_file.gcount() );
+
+	if( size > chunk ) {
+
+		input_file.clear();
+		input_file.seekg( std::max( chunk, size - chunk ), std::ios::beg );
+		input_file.read( buffer.data(), chunk );
+		md5.Update( (const UChar_t*)buffer.data(), input_file.gcount() );
+
+	}
+
+	input_file.close();
+	md5.Final();
+	entries[key] = md5.AsString();
+
+	return;
+
+}
+
+void ISSManifest::AddManifest( std::string key, const ISSManifest &other ){
+
+	entries[key] = other.GetDigest();
+
+	return;
+
+}
+
+std::string ISSManifest::GetText() const {
+
+	std::stringstream ss;
+	for( auto it = entries.begin(); it != entries.end(); ++it )
+		ss << it->first << " = " << it->second << std::endl;
+
+	return ss.str();
+
+}
+
+std::string ISSManifest::GetDigest() const {
+
+	std::string text = GetText();
+	TMD5 md5;
+	md5.Update( (const UChar_t*)text.data(), text.size() );
+	md5.Final();
+
+	return md5.AsString();
+
+}
+
+bool ISSManifest::Write( std::string filename ) const {
+
+	TFile *output_file = new TFile( filename.data(), "update" );
+	if( output_file->IsZombie() ) {
+
+		std::cerr << "Cannot write the manifest to " << filename << std::endl;
+		delete output_file;
+		return false;
+
+	}
+
+	TNamed manifest( "manifest", GetText().data() );
+	manifest.Write( "manifest", TObject::kOverwrite );
+	output_file->Close();
+	delete output_file;
+
+	return true;
+
+}
+
+bool ISSManifest::Read( std::string filename ){
+
+	entries.clear();
+
+	// Doesn't exist, so don't let ROOT complain about it
+	if( gSystem->AccessPathName( filename.data() ) ) return false;
+
+	TFile *input_file = new TFile( filename.data(), "read" );
+	if( input_file->IsZombie() ) {
+
+		delete input_file;
+		return false;
+
+	}
+
+	// Files from older versions of the code won't have a manifest
+	TNamed *manifest = (TNamed*)input_file->Get( "manifest" );
+	if( manifest ) {
+
+		std::stringstream ss( manifest->GetTitle() );
+		std::string line;
+		while( std::getline( ss, line ) ) {
+
+			size_t pos = line.find( " = " );
+			if( pos == std::string::npos ) continue;
+			entries[ line.substr( 0, pos ) ] = line.substr( pos + 3 );
+
+		}
+
+	}
+
+	input_file->Close();
+	delete input_file;
+
+	return manifest != nullptr;
+
+}
+
+std::vector<std::string> ISSManifest::Compare( const ISSManifest &other ) const {
+
+	std::vector<std::string> changed;
+
+	// Things that are missing or different in the other one
+	for( auto it = entries.begin(); it != entries.end(); ++it ) {
+
+		auto jt = other.entries.find( it->first );
+		if( jt == other.entries.end() || jt->second != it->second )
+			changed.push_back( it->first );
+
+	}
+
+	// Things that are only in the other one
+	for( auto jt = other.entries.begin(); jt != other.entries.end(); ++jt )
+		if( entries.find( jt->first ) == entries.end() )
+			changed.push_back( jt->first );
+
+	return changed;
+
+}
+
+bool ISSManifest::UpToDate( std::string filename ) const {
+
+	// Nothing there yet, so it's definitely not up to date
+	if( gSystem->AccessPathName( filename.data() ) ) return false;
+
+	ISSManifest previous;
+	if( !previous.Read( filename ) ) {
+
+		std::cout << filename << " has no manifest, it will be remade" << std::endl;
+		return false;
+
+	}
+
+	std::vector<std::string> changed = Compare( previous );
+	if( !changed.size() ) return true;
+
+	std::cout << filename << " is out of date, changed:";
+	for( unsigned int i = 0; i < changed.size(); ++i )
+		std::cout << " " << changed.at(i);
+	std::cout << std::endl;
+
+	return false;
+
+}
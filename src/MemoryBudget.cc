@@ -0,0 +1,46 @@
+#include "MemoryBudget.hh"
+
+double ISSMemoryBudget::ReadStatus( std::string key ){
+
+	// Only on Linux, elsewhere we just don't know
+	std::ifstream status_file( "/proc/self/status" );
+	if( !status_file.is_open() ) return 0;
+
+	// Lines like "VmRSS:    123456 kB"
+	std::string line;
+	while( std::getline( status_file, line ) ) {
+
+		if( line.compare( 0, key.size(), key ) != 0 ) continue;
+
+		std::stringstream ss( line.substr( key.size() + 1 ) );
+		double value = 0;
+		ss >> value;
+		return value * 1024.;
+
+	}
+
+	return 0;
+
+}
+
+double ISSMemoryBudget::GetCurrentRSS(){
+
+	return ReadStatus( "VmRSS" );
+
+}
+
+double ISSMemoryBudget::GetPeakRSS(){
+
+	return ReadStatus( "VmHWM" );
+
+}
+
+void ISSMemoryBudget::ResetPeakRSS(){
+
+	// Writing 5 resets the high water mark, since Linux 4.0
+	std::ofstream clear_file( "/proc/self/clear_refs" );
+	if( clear_file.is_open() ) clear_file << "5" << std::endl;
+
+	return;
+
+}
@@ -0,0 +1,233 @@
+#include "MemoryUsage.hh"
+
+ISSMemoryUsage::ISSMemoryUsage(){
+
+	for( unsigned int i = 0; i < kNumberOfCategories; ++i ) {
+
+		current[i] = 0;
+		peak[i] = 0;
+
+	}
+
+	hcurrent = nullptr;
+	hpeak = nullptr;
+	hfamilies = nullptr;
+
+}
+
+std::string ISSMemoryUsage::GetName( category_t c ){
+
+	switch( c ) {
+
+		case kHits:		return "hits";
+		case kEvents:	return "events";
+		case kTraces:	return "traces";
+		case kHists:	return "histograms";
+		case kTrees:	return "trees";
+		default:		return "unknown";
+
+	}
+
+}
+
+void ISSMemoryUsage::MakeHists( TDirectory *file ){
+
+	if( !file ) return;
+
+	TDirectory *saved = gDirectory;
+	if( !file->GetDirectory( "memory" ) ) file->mkdir( "memory" );
+	file->cd( "memory" );
+
+	// Use the ones that are already there if this is called again
+	hcurrent = (TH1D*)gDirectory->GetList()->FindObject( "memory_current" );
+	hpeak = (TH1D*)gDirectory->GetList()->FindObject( "memory_peak" );
+	hfamilies = (TH1D*)gDirectory->GetList()->FindObject( "memory_hists" );
+
+	if( !hcurrent )
+		hcurrent = new TH1D( "memory_current", "Memory in use now;;memory [MB]",
+							kNumberOfCategories, -0.5, kNumberOfCategories - 0.5 );
+	if( !hpeak )
+		hpeak = new TH1D( "memory_peak", "Peak memory in use;;memory [MB]",
+						 kNumberOfCategories, -0.5, kNumberOfCategories - 0.5 );
+	if( !hfamilies )
+		hfamilies = new TH1D( "memory_hists", "Largest families of histograms;;memory [MB]",
+							 nfamilies, -0.5, nfamilies - 0.5 );
+
+	for( unsigned int i = 0; i < kNumberOfCategories; ++i ) {
+
+		hcurrent->GetXaxis()->SetBinLabel( i + 1, GetName( (category_t)i ).data() );
+		hpeak->GetXaxis()->SetBinLabel( i + 1, GetName( (category_t)i ).data() );
+		hcurrent->SetBinContent( i + 1, current[i] / 1e6 );
+		hpeak->SetBinContent( i + 1, peak[i] / 1e6 );
+
+	}
+
+	if( saved ) saved->cd();
+
+	return;
+
+}
+
+void ISSMemoryUsage::Set( category_t c, double bytes ){
+
+	current[c] = bytes;
+	if( bytes > peak[c] ) peak[c] = bytes;
+
+	if( hcurrent ) hcurrent->SetBinContent( c + 1, current[c] / 1e6 );
+	if( hpeak ) hpeak->SetBinContent( c + 1, peak[c] / 1e6 );
+
+	return;
+
+}
+
+std::string ISSMemoryUsage::GetFamily( std::string name ){
+
+	// i.e. asic_hist_3_1 and asic_hist_0_0 are both asic_hist
+	size_t end = name.find_last_not_of( "0123456789_" );
+	if( end == std::string::npos ) return name;
+
+	return name.substr( 0, end + 1 );
+
+}
+
+double ISSMemoryUsage::HistBytes( TH1 *h ){
+
+	if( !h ) return 0;
+
+	// Bins are stored in the array that the histogram inherits from
+	double bytes = h->IsA()->Size();
+	if( TArrayD *a = dynamic_cast<TArrayD*>( h ) ) bytes += 8. * a->GetSize();
+	else if( TArrayF *a = dynamic_cast<TArrayF*>( h ) ) bytes += 4. * a->GetSize();
+	else if( TArrayI *a = dynamic_cast<TArrayI*>( h ) ) bytes += 4. * a->GetSize();
+	else if( TArrayS *a = dynamic_cast<TArrayS*>( h ) ) bytes += 2. * a->GetSize();
+	else if( TArrayC *a = dynamic_cast<TArrayC*>( h ) ) bytes += 1. * a->GetSize();
+
+	// Errors, and the entries and errors of each bin of a profile
+	bytes += 8. * h->GetSumw2N();
+	if( h->InheritsFrom( TProfile::Class() ) )
+		bytes += 16. * h->GetNcells();
+
+	return bytes;
+
+}
+
+double ISSMemoryUsage::BranchBytes( TBranch *b ){
+
+	if( !b ) return 0;
+
+	double bytes = 0;
+	TObjArray *baskets = b->GetListOfBaskets();
+	for( int i = 0; baskets && i <= baskets->GetLast(); ++i ) {
+
+		TBasket *basket = (TBasket*)baskets->At(i);
+		if( basket ) bytes += basket->GetBufferSize();
+
+	}
+
+	TObjArray *branches = b->GetListOfBranches();
+	for( int i = 0; branches && i <= branches->GetLast(); ++i )
+		bytes += BranchBytes( (TBranch*)branches->At(i) );
+
+	return bytes;
+
+}
+
+double ISSMemoryUsage::TreeBytes( TTree *t ){
+
+	if( !t ) return 0;
+
+	double bytes = t->GetCacheSize();
+	TObjArray *branches = t->GetListOfBranches();
+	for( int i = 0; branches && i <= branches->GetLast(); ++i )
+		bytes += BranchBytes( (TBranch*)branches->At(i) );
+
+	return bytes;
+
+}
+
+void ISSMemoryUsage::AddHists( TDirectory *dir, std::map<std::string,double> &sum ){
+
+	TIter next( dir->GetList() );
+	while( TObject *obj = next() ) {
+
+		if( obj->InheritsFrom( TDirectory::Class() ) )
+			AddHists( (TDirectory*)obj, sum );
+
+		else if( obj->InheritsFrom( TH1::Class() ) )
+			sum[ GetFamily( obj->GetName() ) ] += HistBytes( (TH1*)obj );
+
+	}
+
+	return;
+
+}
+
+void ISSMemoryUsage::ScanHists( TDirectory *dir ){
+
+	if( !dir ) return;
+
+	families.clear();
+	AddHists( dir, families );
+
+	double total = 0;
+	for( auto it = families.begin(); it != families.end(); ++it )
+		total += it->second;
+	Set( kHists, total );
+
+	// Largest families first
+	if( hfamilies ) {
+
+		std::vector<std::pair<double,std::string>> sorted;
+		for( auto it = families.begin(); it != families.end(); ++it )
+			sorted.push_back( std::make_pair( it->second, it->first ) );
+		std::sort( sorted.rbegin(), sorted.rend() );
+
+		hfamilies->Reset();
+		for( unsigned int i = 0; i < nfamilies && i < sorted.size(); ++i ) {
+
+			hfamilies->GetXaxis()->SetBinLabel( i + 1, sorted.at(i).second.data() );
+			hfamilies->SetBinContent( i + 1, sorted.at(i).first / 1e6 );
+
+		}
+
+	}
+
+	return;
+
+}
+
+void ISSMemoryUsage::Print( std::string title ) const {
+
+	// All in one go, so that tasks running in parallel don't get mixed up
+	std::stringstream ss;
+	ss << "\n " << title << " memory usage" << std::endl;
+	ss << "  " << std::left << std::setw(20) << "category" << std::right;
+	ss << std::setw(12) << "now/MB" << std::setw(12) << "peak/MB" << std::endl;
+	ss << std::fixed << std::setprecision(2);
+
+	for( unsigned int i = 0; i < kNumberOfCategories; ++i ) {
+
+		ss << "  " << std::left << std::setw(20) << GetName( (category_t)i ) << std::right;
+		ss << std::setw(12) << current[i] / 1e6;
+		ss << std::setw(12) << peak[i] / 1e6 << std::endl;
+
+	}
+
+	// The biggest histogram families
+	std::vector<std::pair<double,std::string>> sorted;
+	for( auto it = families.begin(); it != families.end(); ++it )
+		sorted.push_back( std::make_pair( it->second, it->first ) );
+	std::sort( sorted.rbegin(), sorted.rend() );
+
+	for( unsigned int i = 0; i < 5 && i < sorted.size(); ++i ) {
+
+		ss << "   " << std::left << std::setw(19) << sorted.at(i).second << std::right;
+		ss << std::setw(12) << sorted.at(i).first / 1e6 << std::endl;
+
+	}
+
+	std::cout << ss.str();
+
+	return;
+
+}
@@ -0,0 +1,144 @@
+#include "Metrics.hh"
+
+ISSMetrics::metric_t* ISSMetrics::Find( std::string name, std::string type,
+									   std::string help, std::string labels ){
+
+	std::lock_guard<std::mutex> lock( add_mtx );
+
+	std::string key = name + "{" + labels + "}";
+	auto it = index.find( key );
+	if( it != index.end() ) return it->second;
+
+	metrics.emplace_back();
+	metric_t *m = &metrics.back();
+	m->name = name;
+	m->help = help;
+	m->type = type;
+	m->labels = labels;
+	m->counter.store( 0 );
+	m->gauge.store( 0 );
+	index[key] = m;
+
+	return m;
+
+}
+
+ISSMetrics::counter_t* ISSMetrics::AddCounter( std::string name, std::string help, std::string labels ){
+
+	return &Find( name, "counter", help, labels )->counter;
+
+}
+
+ISSMetrics::gauge_t* ISSMetrics::AddGauge( std::string name, std::string help, std::string labels ){
+
+	return &Find( name, "gauge", help, labels )->gauge;
+
+}
+
+std::string ISSMetrics::GetText(){
+
+	// Memory of the whole process is read when it's asked for
+	Set( AddGauge( "iss_memory_rss_bytes", "Resident memory of the sort" ),
+		ISSMemoryBudget::GetCurrentRSS() );
+	Set( AddGauge( "iss_memory_peak_bytes", "Peak resident memory of the sort" ),
+		ISSMemoryBudget::GetPeakRSS() );
+
+	std::lock_guard<std::mutex> lock( add_mtx );
+
+	// Sorted by name and labels, so each name has one HELP and TYPE line
+	std::stringstream ss;
+	ss << std::setprecision(12);
+	std::string last_name;
+	for( auto it = index.begin(); it != index.end(); ++it ) {
+
+		metric_t *m = it->second;
+		if( m->name != last_name ) {
+
+			ss << "# HELP " << m->name << " " << m->help << "\n";
+			ss << "# TYPE " << m->name << " " << m->type << "\n";
+			last_name = m->name;
+
+		}
+
+		ss << m->name;
+		if( m->labels.size() ) ss << "{" << m->labels << "}";
+		if( m->type == "counter" ) ss << " " << m->counter.load( std::memory_order_relaxed ) << "\n";
+		else ss << " " << m->gauge.load( std::memory_order_relaxed ) << "\n";
+
+	}
+
+	return ss.str();
+
+}
+
+bool ISSMetrics::Save(){
+
+	if( !filename.size() ) return false;
+
+	// Written to a temporary file and then renamed, so that
+	// whatever reads it never sees half a file
+	std::string name_tmp_file = filename + ".tmp";
+	std::ofstream output_file( name_tmp_file.data() );
+	if( !output_file.is_open() ) {
+
+		std::cerr << "Cannot write metrics to " << filename << std::endl;
+		return false;
+
+	}
+
+	output_file << GetText();
+	output_file.close();
+
+	if( gSystem->Rename( name_tmp_file.data(), filename.data() ) != 0 ) {
+
+		std::cerr << "Cannot write metrics to " << filename << std::endl;
+		return false;
+
+	}
+
+	return true;
+
+}
+
+void ISSMetrics::StartWriter( double interval ){
+
+	if( !filename.size() || running ) return;
+
+	running = true;
+	writer = std::thread( [this,interval](){
+
+		std::unique_lock<std::mutex> lock( writer_mtx );
+		while( running ) {
+
+			lock.unlock();
+			Save();
+			lock.lock();
+
+			writer_cv.wait_for( lock, std::chrono::duration<double>( interval ),
+							   [this](){ return !running; } );
+
+		}
+
+	});
+
+	return;
+
+}
+
+void ISSMetrics::StopWriter(){
+
+	{
+		std::lock_guard<std::mutex> lock( writer_mtx );
+		if( !running ) return;
+		running = false;
+	}
+
+	writer_cv.notify_all();
+	if( writer.joinable() ) writer.join();
+
+	// The final values
+	Save();
+
+	return;
+
+}
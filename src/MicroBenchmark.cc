@@ -0,0 +1,659 @@
+#include "MicroBenchmark.hh"
+
+#ifdef LINUX
+# include <cstring>
+# include <unistd.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+#endif
+
+// Results of the kernels go here, so the compiler can't drop the calls
+static volatile double bench_sink = 0;
+
+ISSMicroBenchmark::ISSMicroBenchmark( ISSSettings *myset, std::string mycalfile, std::string myreactfile ){
+
+	set = myset;
+	name_cal_file = mycalfile;
+	name_react_file = myreactfile;
+
+	seed = 1;
+	min_time = 0.2;
+
+}
+
+bool ISSMicroBenchmark::OpenCounters(){
+
+#ifdef LINUX
+	// Counted in one group, so they are all for exactly the same instructions
+	const unsigned long long config[4] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	for( unsigned int i = 0; i < 4; ++i ) {
+
+		struct perf_event_attr attr;
+		std::memset( &attr, 0, sizeof(attr) );
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = config[i];
+		attr.disabled = counter_fd.size() ? 0 : 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		// This thread on any CPU, in the group of the first counter
+		int leader = counter_fd.size() ? counter_fd[0] : -1;
+		int fd = syscall( __NR_perf_event_open, &attr, 0, -1, leader, 0 );
+		if( fd < 0 ) {
+
+			// i.e. in a container or with perf_event_paranoid > 2
+			CloseCounters();
+			return false;
+
+		}
+
+		counter_fd.push_back( fd );
+
+	}
+
+	return true;
+#else
+	return false;
+#endif
+
+}
+
+void ISSMicroBenchmark::StartCounters(){
+
+#ifdef LINUX
+	if( !counter_fd.size() ) return;
+	ioctl( counter_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+	ioctl( counter_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+#endif
+
+	return;
+
+}
+
+ISSMicroBenchmark::counters_t ISSMicroBenchmark::StopCounters(){
+
+	counters_t c = counters_t();
+	c.valid = false;
+
+#ifdef LINUX
+	if( !counter_fd.size() ) return c;
+	ioctl( counter_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+
+	// Number of counters, time enabled and running, then the values
+	unsigned long long buffer[3+4];
+	if( read( counter_fd[0], buffer, sizeof(buffer) ) != (ssize_t)sizeof(buffer) ) return c;
+	if( buffer[0] != 4 || buffer[2] == 0 ) return c;
+
+	// Scaled up if the counters had to share the hardware with something else
+	double scale = (double)buffer[1] / (double)buffer[2];
+	c.valid = true;
+	c.cycles = buffer[3] * scale;
+	c.instructions = buffer[4] * scale;
+	c.cache_misses = buffer[5] * scale;
+	c.branch_misses = buffer[6] * scale;
+#endif
+
+	return c;
+
+}
+
+void ISSMicroBenchmark::CloseCounters(){
+
+#ifdef LINUX
+	for( unsigned int i = 0; i < counter_fd.size(); ++i )
+		close( counter_fd[i] );
+#endif
+	counter_fd.clear();
+
+	return;
+
+}
+
+void ISSMicroBenchmark::Measure( std::string name, kernel_t kernel, double bytes ){
+
+	if( filter.size() && name.find( filter ) == std::string::npos ) return;
+
+	std::cout << " " << name << std::flush;
+
+	// Warm up the caches and find a batch that takes at least a millisecond,
+	// so the clock and the function call don't count
+	unsigned long n = 1;
+	while( true ) {
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		bench_sink = bench_sink + kernel( n );
+		double dt = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+		if( dt > 1e-3 || n >= 1ul<<30 ) break;
+		n *= 2;
+
+	}
+
+	// Then as many batches as fit in the time
+	double calls = 0, elapsed = 0;
+	StartCounters();
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	do {
+
+		bench_sink = bench_sink + kernel( n );
+		calls += n;
+		elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+
+	} while( elapsed < min_time );
+	counters_t hw = StopCounters();
+
+	result_t r;
+	r.name = name;
+	r.calls = calls;
+	r.ns = 1e9 * elapsed / calls;
+	r.bytes = bytes;
+	r.hw = hw;
+	if( hw.valid ) {
+
+		r.hw.cycles /= calls;
+		r.hw.instructions /= calls;
+		r.hw.cache_misses /= calls;
+		r.hw.branch_misses /= calls;
+
+	}
+	results.push_back( r );
+
+	std::cout << ": " << std::setprecision(4) << r.ns << " ns" << std::setprecision(6) << std::endl;
+
+	return;
+
+}
+
+void ISSMicroBenchmark::RunConverter(){
+
+	rng.seed( seed );
+
+	// Blocks from the generator, kept in memory
+	const unsigned int nblocks = 16;
+	const unsigned int block_size = ISSConverter::GetBlockSize();
+	std::string name_dat_file = work_dir + "/iss_microbench_" + std::to_string( gSystem->GetPid() ) + ".dat";
+	std::string name_root_file = work_dir + "/iss_microbench_" + std::to_string( gSystem->GetPid() ) + ".root";
+
+	ISSGenerator gen( set );
+	gen.SetSeed( seed );
+	if( !gen.Generate( name_dat_file, nblocks ) ) return;
+
+	std::vector<char> blocks( nblocks * block_size );
+	std::ifstream input_file( name_dat_file, std::ios::in|std::ios::binary );
+	input_file.read( blocks.data(), blocks.size() );
+	bool complete = input_file.good();
+	input_file.close();
+	gSystem->Unlink( name_dat_file.data() );
+	if( !complete ) {
+
+		std::cerr << "Cannot read the generated blocks from " << name_dat_file << std::endl;
+		return;
+
+	}
+
+	// A converter that doesn't fill the tree, so only the decoding is timed
+	ISSCalibration cal( name_cal_file, set );
+	ISSConverter conv( set );
+	conv.AddCalibration( &cal );
+	conv.SetQuiet();
+	conv.SourceOnly();
+	conv.SetOutput( name_root_file );
+	conv.MakeTree();
+	conv.MakeHists();
+
+	// Words are read straight from the blocks, after the header
+	auto load = [&]( unsigned int b ){
+		char *block = &blocks[ b * block_size ];
+		conv.SetBlockHeader( block );
+		conv.ProcessBlockHeader( b );
+		conv.data = (ULong64_t*)( block + ISSConverter::HEADER_SIZE );
+	};
+
+	// The ADC words are picked out of all the blocks for the ASIC and CAEN decoding
+	std::vector<std::pair<UInt_t,UInt_t>> asic_words, caen_words;
+	for( unsigned int b = 0; b < nblocks; ++b ) {
+
+		load( b );
+
+		for( unsigned int i = 0; i < (unsigned int)ISSConverter::WORD_SIZE; ++i ) {
+
+			ULong64_t word = conv.GetWord( i );
+			UInt_t word_0 = ( word >> 32 ) & 0xFFFFFFFF;
+			UInt_t word_1 = word & 0xFFFFFFFF;
+			if( word_0 == 0xFFFFFFFF || word_0 == 0x5E5E5E5E ) break;
+			if( ( ( word_0 >> 30 ) & 0x3 ) != 0x3 ) continue;
+
+			if( ( word_1 >> 28 ) & 0x1 ) asic_words.push_back( std::make_pair( word_0, word_1 ) );
+			else caen_words.push_back( std::make_pair( word_0, word_1 ) );
+
+		}
+
+	}
+
+	load( 0 );
+	Measure( "ISSConverter::GetWord", [&]( unsigned long n ){
+		ULong64_t sum = 0;
+		for( unsigned long k = 0; k < n; ++k )
+			sum += conv.GetWord( k % ISSConverter::WORD_SIZE );
+		return (double)sum;
+	}, sizeof(ULong64_t) );
+
+	Measure( "ISSConverter::ProcessBlockData", [&]( unsigned long n ){
+		for( unsigned long k = 0; k < n; ++k ) {
+			load( k % nblocks );
+			conv.ProcessBlockData( k );
+		}
+		return (double)conv.my_tm_stp;
+	}, block_size );
+
+	if( asic_words.size() ) {
+
+		Measure( "ISSConverter::ProcessASICData", [&]( unsigned long n ){
+			for( unsigned long k = 0; k < n; ++k ) {
+				const std::pair<UInt_t,UInt_t> &w = asic_words[ k % asic_words.size() ];
+				conv.word_0 = w.first;
+				conv.word_1 = w.second;
+				conv.ProcessASICData();
+			}
+			return (double)conv.my_energy;
+		}, sizeof(ULong64_t) );
+
+	}
+
+	// In the order they were written, so the Qlong, Qshort and fine time
+	// of each hit come together and it is finished as in a block
+	if( caen_words.size() ) {
+
+		Measure( "ISSConverter::ProcessCAENData", [&]( unsigned long n ){
+			for( unsigned long k = 0; k < n; ++k ) {
+				const std::pair<UInt_t,UInt_t> &w = caen_words[ k % caen_words.size() ];
+				conv.word_0 = w.first;
+				conv.word_1 = w.second;
+				conv.ProcessCAENData();
+				conv.FinishCAENData();
+			}
+			return (double)conv.my_adc_data;
+		}, sizeof(ULong64_t) );
+
+	}
+
+	conv.CloseOutput();
+	gSystem->Unlink( name_root_file.data() );
+
+	return;
+
+}
+
+void ISSMicroBenchmark::RunCalibration(){
+
+	rng.seed( seed );
+
+	// Random channels and ADC values, a power of two so they can be cycled through
+	const unsigned int ninputs = 4096;
+	std::vector<unsigned int> asic_mod( ninputs ), asic_asic( ninputs ), asic_ch( ninputs );
+	std::vector<unsigned short> asic_raw( ninputs );
+	std::vector<float> asic_en( ninputs );
+	std::vector<unsigned int> caen_mod( ninputs ), caen_ch( ninputs );
+	std::vector<int> caen_raw( ninputs );
+	for( unsigned int i = 0; i < ninputs; ++i ) {
+
+		asic_mod[i] = Integer( set->GetNumberOfArrayModules() );
+		asic_asic[i] = Integer( set->GetNumberOfArrayASICs() );
+		asic_ch[i] = Integer( set->GetNumberOfArrayChannels() );
+		asic_raw[i] = Integer( 4096 );
+		asic_en[i] = 100. + 9900. * Uniform();
+		caen_mod[i] = Integer( set->GetNumberOfCAENModules() );
+		caen_ch[i] = Integer( set->GetNumberOfCAENChannels() );
+		caen_raw[i] = Integer( 65536 );
+
+	}
+
+	ISSCalibration cal( name_cal_file, set );
+
+	Measure( "ISSCalibration::AsicEnergy", [&]( unsigned long n ){
+		double sum = 0;
+		for( unsigned long k = 0; k < n; ++k ) {
+			unsigned int i = k & ( ninputs - 1 );
+			sum += cal.AsicEnergy( asic_mod[i], asic_asic[i], asic_ch[i], asic_raw[i] );
+		}
+		return sum;
+	} );
+
+	Measure( "ISSCalibration::AsicWalk", [&]( unsigned long n ){
+		double sum = 0;
+		for( unsigned long k = 0; k < n; ++k ) {
+			unsigned int i = k & ( ninputs - 1 );
+			sum += cal.AsicWalk( asic_mod[i], asic_asic[i], asic_en[i] );
+		}
+		return sum;
+	} );
+
+	Measure( "ISSCalibration::CaenEnergy", [&]( unsigned long n ){
+		double sum = 0;
+		for( unsigned long k = 0; k < n; ++k ) {
+			unsigned int i = k & ( ninputs - 1 );
+			sum += cal.CaenEnergy( caen_mod[i], caen_ch[i], caen_raw[i] );
+		}
+		return sum;
+	} );
+
+	return;
+
+}
+
+void ISSMicroBenchmark::RunEventBuilder(){
+
+	rng.seed( seed );
+
+	std::string name_root_file = work_dir + "/iss_microbench_" + std::to_string( gSystem->GetPid() ) + "_events.root";
+	std::string name_log_file = work_dir + "/iss_microbench_" + std::to_string( gSystem->GetPid() ) + "_events.log";
+
+	ISSEventBuilder eb( set );
+	eb.SetQuiet();
+	eb.SetOutput( name_root_file );
+
+	// Array windows, mostly one p-side and one n-side hit in the same module
+	// and row, like the generator, with some extra neighbouring p-sides
+	struct array_window_t {
+		std::vector<float> pen, nen;
+		std::vector<long> ptd, ntd;
+		std::vector<char> pid, nid, pmod, nmod, prow, nrow;
+	};
+
+	// Recoil windows, an energy loss and a rest energy in the same sector
+	struct recoil_window_t {
+		std::vector<float> ren;
+		std::vector<long> rtd;
+		std::vector<char> rid, rsec;
+	};
+
+	const unsigned int nwindows = 1024;
+	std::vector<array_window_t> array_windows( nwindows );
+	std::vector<recoil_window_t> recoil_windows( nwindows );
+	for( unsigned int i = 0; i < nwindows; ++i ) {
+
+		array_window_t &a = array_windows[i];
+		char mod = Integer( set->GetNumberOfArrayModules() );
+		char row = Integer( set->GetNumberOfArrayRows() );
+		char pid = Integer( 127 );
+		unsigned int np = Uniform() < 0.2 ? 2 : 1;
+		unsigned int nn = Uniform() < 0.1 ? 0 : 1;
+		for( unsigned int j = 0; j < np; ++j ) {
+
+			a.pen.push_back( 500. + 9500. * Uniform() );
+			a.ptd.push_back( Integer( 200 ) );
+			a.pid.push_back( pid + j );
+			a.pmod.push_back( mod );
+			a.prow.push_back( row );
+
+		}
+		for( unsigned int j = 0; j < nn; ++j ) {
+
+			a.nen.push_back( 500. + 9500. * Uniform() );
+			a.ntd.push_back( Integer( 200 ) );
+			a.nid.push_back( Integer( 22 ) );
+			a.nmod.push_back( mod );
+			a.nrow.push_back( row );
+
+		}
+
+		recoil_window_t &r = recoil_windows[i];
+		char sec = Integer( set->GetNumberOfRecoilSectors() );
+		r.ren.push_back( 1000. + 9000. * Uniform() );
+		r.rtd.push_back( Integer( 100 ) );
+		r.rid.push_back( set->GetRecoilEnergyLossStart() );
+		r.rsec.push_back( sec );
+		r.ren.push_back( 10000. + 90000. * Uniform() );
+		r.rtd.push_back( Integer( 100 ) );
+		r.rid.push_back( set->GetRecoilEnergyRestStart() );
+		r.rsec.push_back( sec );
+
+	}
+
+	Measure( "ISSEventBuilder::ArrayFinder", [&]( unsigned long n ){
+		for( unsigned long k = 0; k < n; ++k ) {
+			const array_window_t &a = array_windows[ k & ( nwindows - 1 ) ];
+			eb.pen_list = a.pen;
+			eb.nen_list = a.nen;
+			eb.ptd_list = a.ptd;
+			eb.ntd_list = a.ntd;
+			eb.pid_list = a.pid;
+			eb.nid_list = a.nid;
+			eb.pmod_list = a.pmod;
+			eb.nmod_list = a.nmod;
+			eb.prow_list = a.prow;
+			eb.nrow_list = a.nrow;
+			eb.ArrayFinder();
+			eb.write_evts->ClearEvt();
+		}
+		return (double)eb.array_ctr;
+	} );
+
+	Measure( "ISSEventBuilder::RecoilFinder", [&]( unsigned long n ){
+		for( unsigned long k = 0; k < n; ++k ) {
+			const recoil_window_t &r = recoil_windows[ k & ( nwindows - 1 ) ];
+			eb.ren_list = r.ren;
+			eb.rtd_list = r.rtd;
+			eb.rid_list = r.rid;
+			eb.rsec_list = r.rsec;
+			eb.RecoilFinder();
+			eb.write_evts->ClearEvt();
+		}
+		return (double)eb.recoil_ctr;
+	} );
+
+	eb.CloseOutput();
+	gSystem->Unlink( name_root_file.data() );
+	gSystem->Unlink( name_log_file.data() );
+
+	return;
+
+}
+
+void ISSMicroBenchmark::RunEvents(){
+
+	rng.seed( seed );
+
+	const unsigned int nevents = 1024;
+	std::vector<ISSArrayEvt> events( nevents );
+	for( unsigned int i = 0; i < nevents; ++i ) {
+
+		events[i].SetEvent( 500. + 9500. * Uniform(), 500. + 9500. * Uniform(),
+						   Integer( 128 ), Integer( 22 ), 0, 0,
+						   Integer( set->GetNumberOfArrayModules() ),
+						   Integer( set->GetNumberOfArrayRows() ) );
+
+	}
+
+	Measure( "ISSArrayEvt::GetPhiXY", [&]( unsigned long n ){
+		double sum = 0;
+		for( unsigned long k = 0; k < n; ++k )
+			sum += events[ k & ( nevents - 1 ) ].GetPhiXY().X();
+		return sum;
+	} );
+
+	Measure( "ISSArrayEvt::GetZ", [&]( unsigned long n ){
+		double sum = 0;
+		for( unsigned long k = 0; k < n; ++k )
+			sum += events[ k & ( nevents - 1 ) ].GetZ();
+		return sum;
+	} );
+
+	return;
+
+}
+
+void ISSMicroBenchmark::RunReaction(){
+
+	rng.seed( seed );
+
+	// Positions on the array and energies of the ejectiles
+	const unsigned int ninputs = 1024;
+	std::vector<TVector3> pos( ninputs );
+	std::vector<double> en( ninputs );
+	std::vector<double> cut_z( ninputs ), cut_en( ninputs );
+	for( unsigned int i = 0; i < ninputs; ++i ) {
+
+		ISSArrayEvt evt;
+		evt.SetEvent( 0, 0, Integer( 128 ), Integer( 22 ), 0, 0,
+					 Integer( set->GetNumberOfArrayModules() ),
+					 Integer( set->GetNumberOfArrayRows() ) );
+		pos[i] = evt.GetPosition();
+		en[i] = 500. + 9500. * Uniform();
+		cut_z[i] = 100. + 500. * Uniform();
+		cut_en[i] = 10000. * Uniform();
+
+	}
+
+	// Stopping powers of protons in silicon, roughly, in keV/um
+	// on a log scale of energy, like the ones read from SRIM
+	std::unique_ptr<TGraph> g = std::make_unique<TGraph>();
+	for( unsigned int i = 0; i < 200; ++i ) {
+
+		double e = 10. * TMath::Power( 1.05, i );
+		g->SetPoint( i, e, 50. * TMath::Power( e / 100., -0.7 ) );
+
+	}
+
+	// Banana shaped cut in E vs z, like those used in the histogrammer
+	const unsigned int npoints = 24;
+	TCutG cut( "iss_microbench_cut", npoints );
+	for( unsigned int i = 0; i < npoints; ++i ) {
+
+		double phi = TMath::TwoPi() * i / ( npoints - 1 );
+		cut.SetPoint( i, 350. + 200. * TMath::Cos( phi ), 5000. + 2000. * TMath::Sin( phi ) + 0.005 * TMath::Power( 200. * TMath::Cos( phi ), 2 ) );
+
+	}
+
+	ISSReaction react( name_react_file, set, false );
+
+	Measure( "ISSReaction::MakeReaction", [&]( unsigned long n ){
+		double sum = 0;
+		for( unsigned long k = 0; k < n; ++k ) {
+			unsigned int i = k & ( ninputs - 1 );
+			react.MakeReaction( pos[i], en[i] );
+			sum += react.GetEx();
+		}
+		return sum;
+	} );
+
+	Measure( "ISSReaction::GetEnergyLoss", [&]( unsigned long n ){
+		double sum = 0;
+		for( unsigned long k = 0; k < n; ++k )
+			sum += react.GetEnergyLoss( en[ k & ( ninputs - 1 ) ], 0.5, g );
+		return sum;
+	} );
+
+	Measure( "TCutG::IsInside", [&]( unsigned long n ){
+		double sum = 0;
+		for( unsigned long k = 0; k < n; ++k ) {
+			unsigned int i = k & ( ninputs - 1 );
+			sum += cut.IsInside( cut_z[i], cut_en[i] );
+		}
+		return sum;
+	} );
+
+	return;
+
+}
+
+bool ISSMicroBenchmark::Run(){
+
+	results.clear();
+	work_dir = gSystem->TempDirectory();
+
+	if( !OpenCounters() )
+		std::cout << "Hardware counters are not available, only the time is measured" << std::endl;
+
+	RunConverter();
+	RunCalibration();
+	RunEventBuilder();
+	RunEvents();
+	RunReaction();
+
+	CloseCounters();
+
+	return results.size() > 0;
+
+}
+
+void ISSMicroBenchmark::Print(){
+
+	std::cout << std::endl << std::left << std::setw(34) << "kernel" << std::right;
+	std::cout << std::setw(10) << "ns/call" << std::setw(12) << "Mcalls/s";
+	std::cout << std::setw(10) << "MB/s" << std::setw(10) << "cycles";
+	std::cout << std::setw(10) << "instr" << std::setw(8) << "IPC";
+	std::cout << std::setw(12) << "cache miss" << std::setw(12) << "br miss" << std::endl;
+
+	std::cout << std::fixed;
+	for( unsigned int i = 0; i < results.size(); ++i ) {
+
+		const result_t &r = results[i];
+		std::cout << std::left << std::setw(34) << r.name << std::right;
+		std::cout << std::setprecision(1) << std::setw(10) << r.ns;
+		std::cout << std::setprecision(2) << std::setw(12) << 1e3 / r.ns;
+		if( r.bytes > 0 ) std::cout << std::setprecision(0) << std::setw(10) << 1e3 * r.bytes / r.ns;
+		else std::cout << std::setw(10) << "-";
+
+		if( r.hw.valid ) {
+
+			std::cout << std::setprecision(1) << std::setw(10) << r.hw.cycles;
+			std::cout << std::setw(10) << r.hw.instructions;
+			std::cout << std::setprecision(2) << std::setw(8) << ( r.hw.cycles > 0 ? r.hw.instructions / r.hw.cycles : 0 );
+			std::cout << std::setprecision(3) << std::setw(12) << r.hw.cache_misses;
+			std::cout << std::setw(12) << r.hw.branch_misses;
+
+		}
+		else std::cout << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(8) << "-" << std::setw(12) << "-" << std::setw(12) << "-";
+
+		std::cout << std::endl;
+
+	}
+
+	std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+
+	return;
+
+}
+
+bool ISSMicroBenchmark::Save( std::string filename ){
+
+	std::ofstream output_file( filename.data() );
+	if( !output_file.is_open() ) {
+
+		std::cerr << "Cannot write microbenchmark results to " << filename << std::endl;
+		return false;
+
+	}
+
+	// Hardware counters are -1 when they couldn't be read
+	output_file << "# kernel calls ns_per_call MB_per_s cycles instructions cache_misses branch_misses" << std::endl;
+	output_file << std::setprecision(8);
+	for( unsigned int i = 0; i < results.size(); ++i ) {
+
+		const result_t &r = results[i];
+		output_file << r.name << " " << r.calls << " " << r.ns << " ";
+		output_file << 1e3 * r.bytes / r.ns << " ";
+		if( r.hw.valid ) {
+
+			output_file << r.hw.cycles << " " << r.hw.instructions << " ";
+			output_file << r.hw.cache_misses << " " << r.hw.branch_misses << std::endl;
+
+		}
+		else output_file << "-1 -1 -1 -1" << std::endl;
+
+	}
+
+	output_file.close();
+
+	return true;
+
+}
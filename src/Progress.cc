@@ -0,0 +1,39 @@
+#include "Progress.hh"
+
+ISSProgress::ISSProgress(){
+
+	percent = 0;
+	cancel = false;
+	label_changed = false;
+
+}
+
+void ISSProgress::SetLabel( std::string mylabel ){
+
+	std::lock_guard<std::mutex> lock( label_mutex );
+	label = mylabel;
+	label_changed = true;
+
+	return;
+
+}
+
+bool ISSProgress::GetLabel( std::string &mylabel ){
+
+	std::lock_guard<std::mutex> lock( label_mutex );
+	if( !label_changed ) return false;
+	mylabel = label;
+	label_changed = false;
+
+	return true;
+
+}
+
+void ISSProgress::Reset(){
+
+	percent = 0;
+	cancel = false;
+
+	return;
+
+}
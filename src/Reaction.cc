@@ -859,13 +859,122 @@ float ISSReaction::SimulateDecay( TVector3 vec, double en ){
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// Currently empty function...
 /// This function will use the interaction position and excitation energy of an ejectile
 /// event, to solve the reaction kinematics and define parameters such as:
-/// theta_cm, theta_lab,, E_lab, E_det, etc.
-/// \param[in] vec TBD
-/// \param[in] ex TBD
-void ISSReaction::SimulateReaction( TVector3 vec, double ex ){
+/// theta_cm, theta_lab, E_lab, E_det, etc. It is the reverse of MakeReaction,
+/// with the beam at the centre of the target, so calling it along the array
+/// gives the kinematic line of a state in E vs. z.
+/// \param[in] vec The position of the interaction with the detector
+/// \param[in] ex The excitation energy of the recoil in keV
+/// \returns The detected energy of the ejectile, NaN if it can't get there
+float ISSReaction::SimulateReaction( TVector3 vec, double ex ){
+
+	// Apply the X and Y offsets directly to the TVector3 input
+	// We move the array opposite to the target, which replicates the same
+	// geometrical shift that is observed with respect to the beam
+	vec.SetX( vec.X() - x_offset );
+	vec.SetY( vec.Y() - y_offset );
+
+	// Set the input parameters, might use them in another function
+	z_meas = vec.Z();					// measured z in mm
+	r_meas = vec.Perp();				// measured radius
+	if( z0 < 0 ) z_meas = z0 - z_meas;	// upstream
+	else z_meas += z0;					// downstream
+	Recoil.SetEx( ex );
+	Ejectile.SetEx( 0.0 );
+
+	// Total energy of ejectile in centre of mass
+	double m3 = Ejectile.GetMass();
+	double m4 = Recoil.GetMass() + ex;
+	e3_cm  = TMath::Power( GetEnergyTotCM(), 2.0 );
+	e3_cm += m3 * m3 - m4 * m4;
+	e3_cm /= 2.0 * GetEnergyTotCM();
+	if( e3_cm <= m3 ) return TMath::QuietNaN(); // below threshold
+	Ejectile.SetEnergyTotCM( e3_cm );
+	Recoil.SetEnergyTotCM( GetEnergyTotCM() - e3_cm );
+
+	//------------------------//
+	// Kinematics calculation //
+	//------------------------//
+	// Every ejectile from this state has E = e3_cm/gamma + beta * p_z in the lab,
+	// and is detected on its way back to the axis, in the second half of its
+	// first turn, when qb*z/2pi < p_z < qb*z/pi
+	double qb = TMath::Abs( (float)Ejectile.GetZ() * GetField_corr() );	// qb
+	double sz = z_meas < 0 ? -1.0 : 1.0;									// backwards or forwards
+	double a = e3_cm / GetGamma();
+	double b = GetBeta() * sz;
+
+	// Radius after travelling z_meas for a given p_z, zero if the total momentum is too small
+	auto radius = [&]( double pz ){
+		double etot = a + b * pz;
+		double pt2 = etot * etot - m3 * m3 - pz * pz;
+		if( pt2 <= 0 ) return 0.0;
+		return 2.0 * TMath::Sqrt( pt2 ) / qb * TMath::Abs( TMath::Sin( qb * TMath::Abs( z_meas ) / ( 2.0 * pz ) ) );
+	};
+
+	// Highest p_z is when all of the momentum is along the beam
+	double p_max = ( a * b + TMath::Sqrt( a * a - m3 * m3 * ( 1.0 - b * b ) ) ) / ( 1.0 - b * b );
+	double p_lo = qb * TMath::Abs( z_meas ) / TMath::TwoPi();
+	double p_hi = qb * TMath::Abs( z_meas ) / TMath::Pi();
+	if( p_hi > p_max ) p_hi = p_max;
+	if( !( p_hi > p_lo ) ) return TMath::QuietNaN();
+
+	// Step back from a full turn until we pass r_meas, then bisect
+	unsigned int nsteps = 200;
+	double step = ( p_hi - p_lo ) / nsteps;
+	double pz = p_lo, pz_prev = p_lo;
+	bool found = false;
+	for( unsigned int i = 1; i <= nsteps; ++i ) {
+
+		pz_prev = pz;
+		pz = p_lo + i * step;
+		if( radius( pz ) >= r_meas ) {
+			found = true;
+			break;
+		}
+
+	}
+	if( !found ) return TMath::QuietNaN();
+
+	for( unsigned int i = 0; i < 50; ++i ) {
+
+		double mid = 0.5 * ( pz + pz_prev );
+		if( radius( mid ) >= r_meas ) pz = mid;
+		else pz_prev = mid;
+
+	}
+
+	// Ejectile in the lab
+	double etot = a + b * pz;
+	double pt = TMath::Sqrt( etot * etot - m3 * m3 - pz * pz );
+	Ejectile.SetEnergyLab( etot - m3 );
+	Ejectile.SetThetaLab( TMath::ATan2( pt, sz * pz ) );
+	alpha = Ejectile.GetThetaLab() - TMath::PiOver2();
+	z = sz * TMath::TwoPi() * pz / qb;	// where it would cross the beam axis
+
+	// Theta_CM, the same way round as MakeReaction
+	theta_cm  = e3_cm;
+	theta_cm -= Ejectile.GetEnergyTotLab() / GetGamma();
+	theta_cm /= GetBeta() * Ejectile.GetMomentumCM();
+	theta_cm  = TMath::ACos( theta_cm );
+	Recoil.SetThetaCM( theta_cm );
+	Ejectile.SetThetaCM( TMath::Pi() - theta_cm );
+
+	// Energy loss through half of the target and the dead layer, as MakeReaction
+	double en = Ejectile.GetEnergyLab();
+	if( stopping ) {
+
+		double dist = 0.5 * target_thickness / TMath::Abs( TMath::Sin( alpha ) );
+		en -= GetEnergyLoss( en, dist, gStopping[1] );
+		dist = deadlayer / TMath::Abs( TMath::Cos( alpha ) );
+		en -= GetEnergyLoss( en, dist, gStopping[2] );
+
+	}
+
+	// Pulse height deficit of the charge collected
+	en += GetPulseHeightDeficit( en, false );
+
+	return en;
 
 }
 
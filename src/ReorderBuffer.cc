@@ -0,0 +1,254 @@
+#include "ReorderBuffer.hh"
+
+ISSReorderBuffer::ISSReorderBuffer( ISSSettings *myset ){
+
+	set = myset;
+
+	// No offsets until there is a calibration
+	SetCalibration( nullptr );
+	Reset();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Copies the time offsets of every channel, so they can be looked up quickly
+/// and the range of them is known. Only call this between files.
+/// \param[in] mycal The calibration, or nullptr for all offsets to be zero
+void ISSReorderBuffer::SetCalibration( ISSCalibration *mycal ){
+
+	asic_offset.assign( set->GetNumberOfArrayModules(),
+					   std::vector<long>( set->GetNumberOfArrayASICs(), 0 ) );
+	caen_offset.assign( set->GetNumberOfCAENModules(),
+					   std::vector<long>( set->GetNumberOfCAENChannels(), 0 ) );
+	info_offset.assign( set->GetNumberOfCAENModules(), std::vector<long>( 5, 0 ) );
+
+	// The ASIC info data never have an offset
+	min_offset = 0;
+	max_offset = 0;
+	if( !mycal ) return;
+
+	for( unsigned int mod = 0; mod < set->GetNumberOfArrayModules(); ++mod ) {
+
+		for( unsigned int asic = 0; asic < set->GetNumberOfArrayASICs(); ++asic ) {
+
+			asic_offset[mod][asic] = mycal->AsicTime( mod, asic );
+			min_offset = std::min( min_offset, asic_offset[mod][asic] );
+			max_offset = std::max( max_offset, asic_offset[mod][asic] );
+
+		}
+
+	}
+
+	for( unsigned int mod = 0; mod < set->GetNumberOfCAENModules(); ++mod ) {
+
+		for( unsigned int ch = 0; ch < set->GetNumberOfCAENChannels(); ++ch ) {
+
+			caen_offset[mod][ch] = mycal->CaenTime( mod, ch );
+			min_offset = std::min( min_offset, caen_offset[mod][ch] );
+			max_offset = std::max( max_offset, caen_offset[mod][ch] );
+
+		}
+
+		// Timing signals from the CAEN, with the codes given by ISSConverter::FinishCAENData
+		info_offset[mod][0] = mycal->CaenTime( mod, set->GetCAENPulserChannel() );
+		info_offset[mod][1] = mycal->CaenTime( mod, set->GetEBISChannel() );
+		info_offset[mod][2] = mycal->CaenTime( mod, set->GetT1Channel() );
+		info_offset[mod][3] = mycal->CaenTime( mod, set->GetSCChannel() );
+		info_offset[mod][4] = mycal->CaenTime( mod, set->GetLaserChannel() );
+
+	}
+
+	return;
+
+}
+
+void ISSReorderBuffer::Reset(){
+
+	while( heap.size() ) {
+
+		spare.push_back( std::move( heap.back().hit ) );
+		heap.pop_back();
+
+	}
+
+	newest = 0;
+	flag_finish = false;
+	flag_skip = false;
+	max_size = 0;
+
+	return;
+
+}
+
+long long ISSReorderBuffer::GetRawTime( ISSDataPackets *hit ){
+
+	if( hit->asic_packets.size() ) return hit->asic_packets[0].GetTime();
+	if( hit->caen_packets.size() ) return hit->caen_packets[0].GetTime();
+	if( hit->info_packets.size() ) return hit->info_packets[0].GetTime();
+
+	return 0;
+
+}
+
+long ISSReorderBuffer::GetOffset( ISSDataPackets *hit ){
+
+	if( hit->asic_packets.size() ) {
+
+		unsigned int mod = hit->asic_packets[0].GetModule();
+		unsigned int asic = hit->asic_packets[0].GetAsic();
+		if( mod < asic_offset.size() && asic < asic_offset[mod].size() )
+			return asic_offset[mod][asic];
+
+	}
+
+	else if( hit->caen_packets.size() ) {
+
+		unsigned int mod = hit->caen_packets[0].GetModule();
+		unsigned int ch = hit->caen_packets[0].GetChannel();
+		if( mod < caen_offset.size() && ch < caen_offset[mod].size() )
+			return caen_offset[mod][ch];
+
+	}
+
+	// CAEN modules come after the array modules in the info data
+	else if( hit->info_packets.size() ) {
+
+		unsigned int mod = hit->info_packets[0].GetModule();
+		unsigned int code = hit->info_packets[0].GetCode();
+		if( mod >= set->GetNumberOfArrayModules() && code >= 20 && code <= 24 ) {
+
+			mod -= set->GetNumberOfArrayModules();
+			if( mod < info_offset.size() ) return info_offset[mod][code-20];
+
+		}
+
+	}
+
+	return 0;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The hits have to be pushed in the order of their raw timestamps, as they
+/// are in the sorted tree
+/// \param[in] hit The hit, which is copied so the caller can reuse it
+/// \param[in] entry Its entry in the tree, or a counter, to keep the order of equal times
+void ISSReorderBuffer::Push( ISSDataPackets *hit, unsigned long long entry ){
+
+	long long raw = GetRawTime( hit );
+	long offset = GetOffset( hit );
+	if( raw > newest ) newest = raw;
+
+	// Reuse a hit that has already been popped
+	item_t item;
+	if( spare.size() ) {
+
+		item.hit = std::move( spare.back() );
+		spare.pop_back();
+		*item.hit = *hit;
+
+	}
+
+	else item.hit = std::make_unique<ISSDataPackets>( *hit );
+
+	// Add the offset to the copy
+	item.time = raw + offset;
+	item.entry = entry;
+	if( offset != 0 ) {
+
+		if( item.hit->asic_packets.size() ) item.hit->asic_packets[0].SetTime( item.time );
+		else if( item.hit->caen_packets.size() ) item.hit->caen_packets[0].SetTime( item.time );
+		else if( item.hit->info_packets.size() ) item.hit->info_packets[0].SetTime( item.time );
+
+	}
+
+	heap.push_back( std::move( item ) );
+	std::push_heap( heap.begin(), heap.end(), Later );
+	if( heap.size() > max_size ) max_size = heap.size();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[out] time The time of the hit, with its offset
+/// \param[out] entry The entry it was pushed with
+/// \return The earliest hit, if no hit still to be pushed can be earlier than it
+std::unique_ptr<ISSDataPackets> ISSReorderBuffer::Pop( unsigned long long &time, unsigned long long &entry ){
+
+	while( heap.size() ) {
+
+		// Anything pushed from now on has at least this time
+		if( !flag_finish && heap.front().time > newest + min_offset )
+			return nullptr;
+
+		std::pop_heap( heap.begin(), heap.end(), Later );
+		item_t item = std::move( heap.back() );
+		heap.pop_back();
+
+		// Already used before a restart
+		if( flag_skip && ( item.time < skip_time ||
+			( item.time == skip_time && item.entry <= skip_entry ) ) ) {
+
+			spare.push_back( std::move( item.hit ) );
+			continue;
+
+		}
+
+		time = item.time;
+		entry = item.entry;
+		return std::move( item.hit );
+
+	}
+
+	return nullptr;
+
+}
+
+void ISSReorderBuffer::Recycle( std::unique_ptr<ISSDataPackets> hit ){
+
+	if( hit ) spare.push_back( std::move( hit ) );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// After a restart, the entries are read again from ISSReorderBuffer::GetOldestEntry,
+/// which gives some hits that were popped before. They come out in the same
+/// order as before, so everything up to the last one popped is dropped.
+/// \param[in] time The time of the last hit popped before the restart
+/// \param[in] entry The entry of the last hit popped before the restart
+void ISSReorderBuffer::SetSkip( unsigned long long time, unsigned long long entry ){
+
+	flag_skip = true;
+	skip_time = time;
+	skip_entry = entry;
+
+	return;
+
+}
+
+unsigned long long ISSReorderBuffer::GetOldestEntry( unsigned long long entry ){
+
+	for( unsigned int i = 0; i < heap.size(); ++i )
+		entry = std::min( entry, heap[i].entry );
+
+	return entry;
+
+}
+
+void ISSReorderBuffer::MarkRawTimes( TTree *t ){
+
+	if( t && !HasRawTimes( t ) )
+		t->GetUserInfo()->Add( new TNamed( "timestamps", "raw" ) );
+
+	return;
+
+}
+
+bool ISSReorderBuffer::HasRawTimes( TTree *t ){
+
+	return t && t->GetUserInfo()->FindObject( "timestamps" );
+
+}
@@ -0,0 +1,453 @@
+#include "Scheduler.hh"
+
+ISSScheduler::ISSScheduler( unsigned int myncpu, double mymem ){
+
+	// Resources available to the tasks
+	ncpu = myncpu;
+	if( ncpu < 1 ) ncpu = 1;
+	max_mem = mymem;
+	max_io = 1.0;
+
+	// Nothing running yet
+	cpu_used = 0;
+	mem_used = 0;
+	io_used = 0;
+	nrunning = 0;
+	nfinished = 0;
+	nreturned = 0;
+
+	// Defaults are one retry and no journal
+	retries = 1;
+	journal_name = "";
+
+	// No metrics unless they are added
+	met_running = nullptr;
+	met_ready = nullptr;
+	met_waiting = nullptr;
+	met_finished = nullptr;
+
+}
+
+void ISSScheduler::AddMetrics( std::shared_ptr<ISSMetrics> mymetrics ){
+
+	metrics = mymetrics;
+	met_running = metrics->AddGauge( "iss_tasks_running", "Tasks running now" );
+	met_ready = metrics->AddGauge( "iss_tasks_ready", "Tasks ready to start but waiting for resources" );
+	met_waiting = metrics->AddGauge( "iss_tasks_waiting", "Tasks not yet started" );
+	met_finished = metrics->AddGauge( "iss_tasks_finished", "Tasks done, failed or skipped" );
+
+	return;
+
+}
+
+std::string ISSScheduler::GetStage( std::string name ){
+
+	return name.substr( 0, name.find( ' ' ) );
+
+}
+
+void ISSScheduler::UpdateMetrics( unsigned int nready ){
+
+	if( !metrics ) return;
+
+	unsigned int nwaiting = 0;
+	for( unsigned int i = 0; i < tasks.size(); ++i )
+		if( tasks.at(i).state == ISSTask::kWaiting ) nwaiting++;
+
+	ISSMetrics::Set( met_running, nrunning );
+	ISSMetrics::Set( met_ready, nready );
+	ISSMetrics::Set( met_waiting, nwaiting );
+	ISSMetrics::Set( met_finished, nfinished );
+
+	return;
+
+}
+
+unsigned int ISSScheduler::AddTask( std::string name, std::function<bool()> func,
+								    std::vector<unsigned int> deps,
+								    float cpu, double mem, float io,
+								    int priority, bool soft_deps ){
+
+	ISSTask task;
+	task.name = name;
+	task.func = func;
+	task.soft_deps = soft_deps;
+	task.cpu = cpu;
+	task.mem = mem;
+	task.io = io;
+	task.priority = priority;
+	task.state = ISSTask::kWaiting;
+	task.attempts = 0;
+	task.wall_time = 0;
+	task.peak_rss = 0;
+
+	// Dependencies can only be on tasks we already know about
+	for( unsigned int j = 0; j < deps.size(); ++j ) {
+
+		if( deps.at(j) < tasks.size() )
+			task.deps.push_back( deps.at(j) );
+		else
+			std::cerr << "Task " << name << " has an unknown dependency" << std::endl;
+
+	}
+
+	tasks.push_back( task );
+
+	return tasks.size() - 1;
+
+}
+
+bool ISSScheduler::IsReady( unsigned int i ){
+
+	for( unsigned int j = 0; j < tasks.at(i).deps.size(); ++j ) {
+
+		ISSTask::state_t dep_state = tasks.at( tasks.at(i).deps.at(j) ).state;
+
+		// Soft dependencies only need to be finished, one way or another
+		if( tasks.at(i).soft_deps ) {
+			if( dep_state == ISSTask::kWaiting || dep_state == ISSTask::kRunning )
+				return false;
+		}
+
+		// Otherwise they must have worked
+		else if( dep_state != ISSTask::kDone ) return false;
+
+	}
+
+	return true;
+
+}
+
+bool ISSScheduler::DependenciesDone( unsigned int i ){
+
+	for( unsigned int j = 0; j < tasks.at(i).deps.size(); ++j )
+		if( tasks.at( tasks.at(i).deps.at(j) ).state != ISSTask::kDone ) return false;
+
+	return true;
+
+}
+
+bool ISSScheduler::DependencyFailed( unsigned int i ){
+
+	if( tasks.at(i).soft_deps ) return false;
+
+	for( unsigned int j = 0; j < tasks.at(i).deps.size(); ++j ) {
+
+		ISSTask::state_t dep_state = tasks.at( tasks.at(i).deps.at(j) ).state;
+		if( dep_state == ISSTask::kFailed || dep_state == ISSTask::kSkipped )
+			return true;
+
+	}
+
+	return false;
+
+}
+
+bool ISSScheduler::FitsResources( unsigned int i ){
+
+	// Always let a task run if nothing else is, however big it is
+	if( nrunning == 0 ) return true;
+
+	// Small tolerance for adding up fractions
+	if( cpu_used + tasks.at(i).cpu > ncpu + 1e-3 ) return false;
+	if( max_mem > 0 && mem_used + tasks.at(i).mem > max_mem ) return false;
+	if( max_io > 0 && io_used + tasks.at(i).io > max_io + 1e-3 ) return false;
+
+	return true;
+
+}
+
+void ISSScheduler::Execute( unsigned int i ){
+
+	// Do the work outside of the lock, so other tasks can progress
+	auto t_start = std::chrono::steady_clock::now();
+	bool success = false;
+	try {
+		success = tasks.at(i).func();
+	}
+	catch( std::exception &e ) {
+		std::cerr << tasks.at(i).name << ": " << e.what() << std::endl;
+		success = false;
+	}
+	auto t_stop = std::chrono::steady_clock::now();
+
+	// Now update the book keeping
+	std::lock_guard<std::mutex> lock( sched_mtx );
+	ISSTask &task = tasks.at(i);
+	task.wall_time = std::chrono::duration<double>( t_stop - t_start ).count();
+	task.peak_rss = ISSMemoryBudget::GetPeakRSS();
+	cpu_used -= task.cpu;
+	mem_used -= task.mem;
+	io_used -= task.io;
+	nrunning--;
+	nreturned++;
+
+	// Time of each stage, so the rates can be followed as the batch runs
+	if( metrics ) {
+
+		std::string labels = "stage=\"" + GetStage( task.name ) + "\"";
+		ISSMetrics::Set( metrics->AddGauge( "iss_task_last_seconds",
+			"Time taken by the last task of each stage", labels ), task.wall_time );
+		ISSMetrics::Add( metrics->AddCounter( "iss_task_milliseconds_total",
+			"Time spent in the tasks of each stage", labels ), task.wall_time * 1e3 );
+		ISSMetrics::Add( metrics->AddCounter( "iss_tasks_completed_total",
+			"Tasks of each stage that returned", labels + ",result=\"" +
+			( success ? "done" : "failed" ) + "\"" ) );
+
+	}
+
+	if( success ) {
+
+		task.state = ISSTask::kDone;
+		nfinished++;
+		WriteJournal(i);
+
+	}
+
+	else if( task.attempts <= retries ) {
+
+		task.state = ISSTask::kWaiting;
+		std::cout << " " << task.name << " failed, trying again (attempt ";
+		std::cout << task.attempts+1 << " of " << retries+1 << ")" << std::endl;
+
+	}
+
+	else {
+
+		task.state = ISSTask::kFailed;
+		nfinished++;
+
+	}
+
+	// Progress
+	if( task.state != ISSTask::kWaiting ) {
+
+		std::cout << " [" << std::setw(4) << nfinished << "/" << tasks.size() << "] ";
+		std::cout << task.name;
+		if( success ) std::cout << " done in ";
+		else std::cout << " FAILED after ";
+		std::cout << std::fixed << std::setprecision(1);
+		std::cout << task.wall_time << " s" << std::defaultfloat;
+		if( task.peak_rss > 0 )
+			std::cout << ", peak RSS " << std::setprecision(3) << task.peak_rss / 1e9 << " GB";
+		std::cout << " (" << nrunning << " running)" << std::endl;
+
+	}
+
+	sched_cv.notify_all();
+
+	return;
+
+}
+
+bool ISSScheduler::Run(){
+
+	// Nothing to do
+	if( !tasks.size() ) return true;
+
+	// Pick up from where a previous batch stopped
+	ReadJournal();
+	if( journal_name.size() )
+		journal_file.open( journal_name.data(), std::ios::app );
+
+	std::vector<std::thread> workers;
+	std::unique_lock<std::mutex> lock( sched_mtx );
+
+	while( nfinished < tasks.size() ) {
+
+		// Anything depending on a failed task can't run
+		for( unsigned int i = 0; i < tasks.size(); ++i ) {
+
+			if( tasks.at(i).state == ISSTask::kWaiting && DependencyFailed(i) ) {
+
+				tasks.at(i).state = ISSTask::kSkipped;
+				nfinished++;
+				std::cout << " [" << std::setw(4) << nfinished << "/" << tasks.size() << "] ";
+				std::cout << tasks.at(i).name << " skipped, a dependency failed" << std::endl;
+
+			}
+
+		}
+
+		// List what is ready to go, highest priority first
+		std::vector<unsigned int> ready;
+		for( unsigned int i = 0; i < tasks.size(); ++i )
+			if( tasks.at(i).state == ISSTask::kWaiting && IsReady(i) )
+				ready.push_back(i);
+
+		std::stable_sort( ready.begin(), ready.end(),
+						 [&]( unsigned int a, unsigned int b ){
+							 return tasks.at(a).priority > tasks.at(b).priority;
+						 });
+
+		// Start as many as we have resources for
+		bool started = false;
+		for( unsigned int j = 0; j < ready.size(); ++j ) {
+
+			unsigned int i = ready.at(j);
+			if( !FitsResources(i) ) continue;
+
+			// Peak memory is for the whole process, so it can only be
+			// measured for each task from when it starts on its own
+			if( nrunning == 0 ) ISSMemoryBudget::ResetPeakRSS();
+
+			tasks.at(i).state = ISSTask::kRunning;
+			tasks.at(i).attempts++;
+			cpu_used += tasks.at(i).cpu;
+			mem_used += tasks.at(i).mem;
+			io_used += tasks.at(i).io;
+			nrunning++;
+			started = true;
+
+			// Single core, so just do it here and then look again
+			if( ncpu == 1 ) {
+
+				lock.unlock();
+				Execute(i);
+				lock.lock();
+				break;
+
+			}
+
+			else workers.push_back( std::thread( &ISSScheduler::Execute, this, i ) );
+
+		}
+
+		// Ready tasks left over are waiting for resources
+		unsigned int nstarted = 0;
+		for( unsigned int j = 0; j < ready.size(); ++j )
+			if( tasks.at( ready.at(j) ).state != ISSTask::kWaiting ) nstarted++;
+		UpdateMetrics( ready.size() - nstarted );
+
+		if( nfinished == tasks.size() ) break;
+
+		// Nothing running and nothing can start, so give up on the rest
+		if( !started && nrunning == 0 ) {
+
+			for( unsigned int i = 0; i < tasks.size(); ++i ) {
+
+				if( tasks.at(i).state == ISSTask::kWaiting ) {
+
+					tasks.at(i).state = ISSTask::kSkipped;
+					nfinished++;
+					std::cerr << " " << tasks.at(i).name;
+					std::cerr << " skipped, its dependencies can't be met" << std::endl;
+
+				}
+
+			}
+
+			break;
+
+		}
+
+		// Wait for a running task to return
+		if( nrunning > 0 ) {
+
+			unsigned int nbefore = nreturned;
+			sched_cv.wait( lock, [&]{ return nreturned != nbefore; } );
+
+		}
+
+	}
+
+	UpdateMetrics( 0 );
+	lock.unlock();
+	for( unsigned int j = 0; j < workers.size(); ++j )
+		workers.at(j).join();
+
+	// Check if everything worked
+	bool success = true;
+	for( unsigned int i = 0; i < tasks.size(); ++i )
+		if( tasks.at(i).state != ISSTask::kDone ) success = false;
+
+	// No need to keep the journal if the whole batch is complete
+	if( journal_file.is_open() ) journal_file.close();
+	if( success && journal_name.size() )
+		gSystem->Unlink( journal_name.data() );
+
+	return success;
+
+}
+
+void ISSScheduler::ReadJournal(){
+
+	if( !journal_name.size() ) return;
+
+	std::ifstream input_file( journal_name.data() );
+	if( !input_file.is_open() ) return;
+
+	// Names of the tasks already done
+	std::set<std::string> completed;
+	std::string line;
+	while( std::getline( input_file, line ) )
+		if( line.size() ) completed.insert( line );
+	input_file.close();
+
+	// Mark them as done, but only if everything they depend on is done too,
+	// otherwise a dependency that runs again would leave them out of date.
+	// Dependencies always come first, so one pass is enough.
+	unsigned int nresumed = 0;
+	for( unsigned int i = 0; i < tasks.size(); ++i ) {
+
+		if( tasks.at(i).state == ISSTask::kWaiting &&
+		    completed.count( tasks.at(i).name ) && DependenciesDone(i) ) {
+
+			tasks.at(i).state = ISSTask::kDone;
+			nfinished++;
+			nresumed++;
+
+		}
+
+	}
+
+	if( nresumed ) {
+
+		std::cout << " Resuming batch: " << nresumed << " of " << tasks.size();
+		std::cout << " tasks already completed according to " << journal_name;
+		std::cout << " (delete it to start from scratch)" << std::endl;
+
+	}
+
+	return;
+
+}
+
+void ISSScheduler::WriteJournal( unsigned int i ){
+
+	if( !journal_file.is_open() ) return;
+
+	// A task that ran after a soft dependency failed has to run again
+	// once that dependency has been fixed
+	if( !DependenciesDone(i) ) return;
+
+	journal_file << tasks.at(i).name << std::endl;
+
+	return;
+
+}
+
+void ISSScheduler::PrintSummary(){
+
+	std::cout << "\n Task summary:" << std::endl;
+
+	for( unsigned int i = 0; i < tasks.size(); ++i ) {
+
+		std::cout << "  " << std::setw(8) << std::left;
+		if( tasks.at(i).state == ISSTask::kDone ) std::cout << "done";
+		else if( tasks.at(i).state == ISSTask::kFailed ) std::cout << "FAILED";
+		else if( tasks.at(i).state == ISSTask::kSkipped ) std::cout << "skipped";
+		else std::cout << "waiting";
+		std::cout << std::right << std::fixed << std::setprecision(1);
+		std::cout << std::setw(10) << tasks.at(i).wall_time << " s  ";
+		std::cout << std::setprecision(2) << std::setw(7) << tasks.at(i).peak_rss / 1e9 << " GB  ";
+		std::cout << std::defaultfloat << tasks.at(i).name;
+		if( tasks.at(i).attempts > 1 )
+			std::cout << " (" << tasks.at(i).attempts << " attempts)";
+		std::cout << std::endl;
+
+	}
+
+	return;
+
+}
@@ -71,6 +71,41 @@ void ISSSettings::ReadSettings() {
 	array_hit_window = config->GetValue( "ArrayHitWindow", 500 );
 	zd_hit_window = config->GetValue( "ZeroDegreeHitWindow", 500 );
 	gamma_hit_window = config->GetValue( "GammaRayHitWindow", 500 );
+	
+	// Compact events
+	flag_compact = config->GetValue( "CompactEvents", false );
+	compact_array_step = config->GetValue( "CompactArrayStep", 1.0 );
+	compact_recoil_step = config->GetValue( "CompactRecoilStep", 10.0 );
+	compact_elum_step = config->GetValue( "CompactElumStep", 1.0 );
+	compact_zd_step = config->GetValue( "CompactZeroDegreeStep", 10.0 );
+	compact_gamma_step = config->GetValue( "CompactGammaRayStep", 1.0 );
+	compact_time_step = config->GetValue( "CompactTimeStep", 1 );
+	
+	// Compression of the output of each stage
+	for( std::string stage : { "Convert", "Build", "Hist" } ) {
+		
+		compression[stage] = config->GetValue( ( stage + "Compression" ).data(), "default" );
+		compression_level[stage] = config->GetValue( ( stage + "CompressionLevel" ).data(), 0 );
+		basket_size[stage] = config->GetValue( ( stage + "BasketSize" ).data(), 0 );
+		auto_flush[stage] = config->GetValue( ( stage + "AutoFlush" ).data(), 0.0 );
+		
+	}
+	
+	// Reading ahead in chains of files
+	prefetch_files = config->GetValue( "PrefetchFiles", 1 );
+	prefetch_memory = config->GetValue( "PrefetchMemory", 128.0 );
+	
+	// Write conditions
+	unsigned int n_write_cond = config->GetValue( "NumberOfWriteConditions", 0 );
+	write_cond.clear();
+	write_prescale.clear();
+	for( unsigned int i = 0; i < n_write_cond; ++i ) {
+		
+		write_cond.push_back( config->GetValue( Form( "WriteCondition_%d.Expression", i ), "" ) );
+		int prescale = config->GetValue( Form( "WriteCondition_%d.Prescale", i ), 1 );
+		write_prescale.push_back( prescale > 1 ? prescale : 1 );
+		
+	}
 
 	
 	// Data things
@@ -0,0 +1,423 @@
+#include "Simulation.hh"
+
+ISSSimulation::ISSSimulation( ISSReaction *myreact, ISSSettings *myset ){
+
+	react = myreact;
+	set = myset;
+
+	// Defaults
+	nevents = 1000000;
+	nthreads = std::thread::hardware_concurrency();
+	if( nthreads == 0 ) nthreads = 1;
+	seed = 1;
+	sigma = 0;
+
+	// Copy everything the events need, so the threads don't touch the reaction
+	m_beam = react->Beam.GetMass();
+	m_target = react->Target.GetMass();
+	m_ejectile = react->Ejectile.GetMass();
+	m_recoil = react->Recoil.GetMass();
+	e_beam = react->Eb;
+	e_beam_mid = react->Beam.GetEnergyLab();
+	thickness = react->target_thickness;
+	deadlayer = react->deadlayer;
+	qb = TMath::Abs( (double)react->Ejectile.GetZ() * react->GetField_corr() );
+	turn = react->Ejectile.GetZ() * react->GetField() < 0 ? -1.0 : 1.0;
+	x_offset = react->x_offset;
+	y_offset = react->y_offset;
+	z0 = react->z0;
+
+	// Energy losses and pulse height deficit
+	stopping = react->stopping;
+	if( stopping ) {
+
+		MakeTable( dedx_beam, react->gStopping[0].get(), 16384 );
+		MakeTable( dedx_target, react->gStopping[1].get(), 16384 );
+		MakeTable( dedx_si, react->gStopping[2].get(), 16384 );
+
+	}
+	phd = react->phdcurves;
+	if( phd ) MakeTable( phd_curve, react->gPHD_inv.get(), 16384 );
+
+	// z axis covers the four rows of wafers, with some space at each end
+	double length = 4.0 * kWaferPitch;
+	if( z0 < 0 ) {
+		zmin = z0 - length - 10.0;
+		zmax = z0 + 10.0;
+	}
+	else {
+		zmin = z0 - 10.0;
+		zmax = z0 + length + 10.0;
+	}
+
+}
+
+double ISSSimulation::table_t::Eval( double x ) const {
+
+	double f = ( x - xmin ) * inv_step;
+	if( f <= 0 ) return y.front();
+	unsigned int i = (unsigned int)f;
+	if( i + 1 >= y.size() ) return y.back();
+	f -= i;
+
+	return y[i] + f * ( y[i+1] - y[i] );
+
+}
+
+void ISSSimulation::MakeTable( table_t &t, TGraph *g, unsigned int n ){
+
+	// Same as TGraph::Eval at the points, but without the search
+	double xmin = g->GetN() ? TMath::MinElement( g->GetN(), g->GetX() ) : 0;
+	double xmax = g->GetN() ? TMath::MaxElement( g->GetN(), g->GetX() ) : 1;
+	if( xmax <= xmin ) xmax = xmin + 1;
+
+	t.xmin = xmin;
+	t.inv_step = ( n - 1 ) / ( xmax - xmin );
+	t.y.resize( n );
+	for( unsigned int i = 0; i < n; ++i )
+		t.y[i] = g->GetN() ? g->Eval( xmin + i / t.inv_step ) : 0;
+
+	return;
+
+}
+
+double ISSSimulation::EnergyAfter( const table_t &t, double en, double dist ) const {
+
+	// Midpoint steps, small enough that each loses less than 5% of the energy,
+	// with the same 100 keV limit as ISSReaction::GetEnergyLoss
+	unsigned int nsteps = 1;
+	double de = t.Eval( en ) * dist;
+	if( de > 0.05 * en ) nsteps = std::ceil( de / ( 0.05 * en ) );
+	if( nsteps > 50 ) nsteps = 50;
+
+	double dx = dist / nsteps;
+	for( unsigned int i = 0; i < nsteps; ++i ) {
+
+		if( en < 100. ) return 0;
+		double mid = en - 0.5 * t.Eval( en ) * dx;
+		en -= t.Eval( mid ) * dx;
+
+	}
+
+	return en > 0 ? en : 0;
+
+}
+
+bool ISSSimulation::Transport( double px, double py, double pz, double &z_hit, double &cos_inc ){
+
+	// Only ejectiles going towards the array
+	if( z0 < 0 ? pz >= 0 : pz <= 0 ) return false;
+
+	// Transverse motion is a circle of radius rho, starting at the target,
+	// on which phi gets smaller for a positive ejectile in a positive field
+	double pt = std::sqrt( px*px + py*py );
+	if( pt <= 0 ) return false;
+	double rho = pt / qb;
+	double s = turn;
+	double psi0 = std::atan2( py, px ) + s * TMath::PiOver2();
+
+	// Centre of the circle
+	double cx = x_offset - rho * std::cos( psi0 );
+	double cy = y_offset - rho * std::sin( psi0 );
+
+	// Every time in the first turn that the ejectile crosses a side of the
+	// hexagon, going out or coming back in
+	struct crossing_t { double t; int face; bool inward; } cross[12];
+	unsigned int ncross = 0;
+	double half_side = kApothem * std::tan( TMath::Pi() / 6. );
+	for( int k = 0; k < 6; ++k ) {
+
+		double theta = -TMath::Pi() / 6. + k * TMath::Pi() / 3.;
+		double nx = std::cos( theta ), ny = std::sin( theta );
+		double c = ( kApothem - nx*cx - ny*cy ) / rho;
+		if( c >= 1.0 || c <= -1.0 ) continue;
+		double a = std::acos( c );
+
+		for( int j = 0; j < 2; ++j ) {
+
+			// Phase of the crossing, going out first, and the turning angle to get there
+			double psi = theta + ( j ? -s : s ) * a;
+			double t = std::fmod( s * ( psi0 - psi ), TMath::TwoPi() );
+			if( t < 0 ) t += TMath::TwoPi();
+
+			// Must be on this side of the hexagon
+			double x = cx + rho * std::cos( psi );
+			double y = cy + rho * std::sin( psi );
+			if( TMath::Abs( ny*x - nx*y ) > half_side ) continue;
+
+			// In time order
+			unsigned int i = ncross++;
+			for( ; i > 0 && cross[i-1].t > t; --i ) cross[i] = cross[i-1];
+			cross[i] = { t, k, j == 1 };
+
+		}
+
+	}
+
+	// Never leaves the hexagon, so never gets to the silicon
+	if( !ncross ) return false;
+
+	// Follow the crossings, turn by turn, until the ejectile gets to the
+	// array. It can only be detected coming back in, anything else hits the
+	// inside of the array or an inactive part
+	double length = 4.0 * kWaferPitch;
+	for( unsigned int n = 0; n < 100; ++n ) {
+
+		for( unsigned int i = 0; i < ncross; ++i ) {
+
+			double t = cross[i].t + n * TMath::TwoPi();
+			z_hit = pz / qb * t;
+			double d = z0 < 0 ? z0 - z_hit : z_hit - z0;
+			if( d < 0 ) continue;
+			if( d >= length || !cross[i].inward ) return false;
+
+			// Along the p-side strips
+			double local = std::fmod( d, kWaferPitch );
+			if( local < kEdge || local > kEdge + kActiveLength ) return false;
+
+			// Across the n-side strips
+			double theta = -TMath::Pi() / 6. + cross[i].face * TMath::Pi() / 3.;
+			double nx = std::cos( theta ), ny = std::sin( theta );
+			double psi = psi0 - s * cross[i].t;
+			double x = cx + rho * std::cos( psi );
+			double y = cy + rho * std::sin( psi );
+			if( TMath::Abs( ny*x - nx*y ) > kActiveWidth ) return false;
+
+			// Angle to the normal of the face, for the path through the dead layer
+			double phi = psi - s * TMath::PiOver2();
+			cos_inc = -pt * std::cos( phi - theta ) / std::sqrt( pt*pt + pz*pz );
+
+			return cos_inc > 0;
+
+		}
+
+	}
+
+	return false;
+
+}
+
+void ISSSimulation::MakeHists( hists_t &h, unsigned int level ){
+
+	std::string title = " for Ex = " + std::to_string( (int)levels[level] ) + " keV";
+	unsigned int zbins = std::round( zmax - zmin );
+
+	h.thetacm_gen = std::make_unique<TH1D>( "thetacm_gen",
+		( "Centre-of-mass angle of all events" + title + ";#theta_{CM} [deg];Counts per deg" ).data(),
+		180, 0, 180 );
+	h.thetacm_det = std::make_unique<TH1D>( "thetacm_det",
+		( "Centre-of-mass angle of detected events" + title + ";#theta_{CM} [deg];Counts per deg" ).data(),
+		180, 0, 180 );
+	h.E_vs_z = std::make_unique<TH2F>( "E_vs_z",
+		( "Energy vs. z distance" + title + ";z [mm];Energy [keV];Counts per mm per 20 keV" ).data(),
+		zbins, zmin, zmax, 800, 0, 16000 );
+	h.z_vs_thetacm = std::make_unique<TH2F>( "z_vs_thetacm",
+		( "z distance vs. centre-of-mass angle" + title + ";#theta_{CM} [deg];z [mm];Counts" ).data(),
+		180, 0, 180, zbins, zmin, zmax );
+	h.ndet = 0;
+
+	return;
+
+}
+
+void ISSSimulation::Generate( unsigned int level, unsigned long chunk, hists_t &h ){
+
+	// Stream of this chunk, independent of the thread that runs it
+	std::seed_seq seq{ (unsigned int)seed, (unsigned int)( seed >> 32 ), level, (unsigned int)chunk };
+	stream_t r;
+	r.rng.seed( seq );
+
+	unsigned long first = chunk * kChunk;
+	unsigned long n = nevents - first < kChunk ? nevents - first : kChunk;
+	double m_exc = m_recoil + levels[level];
+
+	for( unsigned long i = 0; i < n; ++i ) {
+
+		// Depth of the reaction in the target
+		double depth = r.Uniform();
+		double eb = e_beam_mid;
+		if( stopping && thickness > 0 ) eb = EnergyAfter( dedx_beam, e_beam, depth * thickness );
+
+		// Boost from the lab to the centre of mass
+		double e1 = m_beam + eb;
+		double p1 = std::sqrt( eb * ( eb + 2.0 * m_beam ) );
+		double ecm = std::sqrt( m_beam*m_beam + m_target*m_target + 2.0 * e1 * m_target );
+		double gamma = ( e1 + m_target ) / ecm;
+		double beta = p1 / ( e1 + m_target );
+
+		// Isotropic ejectile, the angle is stored for the recoil as in ISSReaction
+		double cos3 = 2.0 * r.Uniform() - 1.0;
+		double sin3 = std::sqrt( 1.0 - cos3*cos3 );
+		double phi = TMath::TwoPi() * r.Uniform();
+		double thetacm = ( TMath::Pi() - std::acos( cos3 ) ) * TMath::RadToDeg();
+		h.thetacm_gen->Fill( thetacm );
+
+		// Below threshold
+		double e3cm = ( ecm*ecm + m_ejectile*m_ejectile - m_exc*m_exc ) / ( 2.0 * ecm );
+		if( e3cm <= m_ejectile ) continue;
+		double p3cm = std::sqrt( e3cm*e3cm - m_ejectile*m_ejectile );
+
+		// Ejectile in the lab
+		double pz = gamma * ( p3cm * cos3 + beta * e3cm );
+		double pt = p3cm * sin3;
+		double p = std::sqrt( pz*pz + pt*pt );
+		double en = gamma * ( e3cm + beta * p3cm * cos3 ) - m_ejectile;
+
+		// Never leaves the target
+		if( pz == 0 ) continue;
+
+		// Out of the target, forwards or backwards
+		if( stopping && thickness > 0 ) {
+
+			double left = pz > 0 ? 1.0 - depth : depth;
+			en = EnergyAfter( dedx_target, en, left * thickness * p / TMath::Abs( pz ) );
+			if( en <= 0 ) continue;
+			double scale = std::sqrt( en * ( en + 2.0 * m_ejectile ) ) / p;
+			pz *= scale;
+			pt *= scale;
+
+		}
+
+		// To the array
+		double z_hit, cos_inc;
+		if( !Transport( pt * std::cos( phi ), pt * std::sin( phi ), pz, z_hit, cos_inc ) ) continue;
+
+		// Dead layer, pulse height deficit and resolution
+		if( stopping ) en = EnergyAfter( dedx_si, en, deadlayer / cos_inc );
+		if( en <= 0 ) continue;
+		if( phd ) en = phd_curve.Eval( en );
+		if( sigma > 0 ) en += sigma * r.Gauss();
+
+		h.thetacm_det->Fill( thetacm );
+		h.E_vs_z->Fill( z_hit, en );
+		h.z_vs_thetacm->Fill( thetacm, z_hit );
+		h.ndet++;
+
+	}
+
+	return;
+
+}
+
+bool ISSSimulation::Run( std::string filename ){
+
+	TFile *output_file = new TFile( filename.data(), "recreate" );
+	if( output_file->IsZombie() ) {
+
+		std::cerr << "Cannot open " << filename << std::endl;
+		return false;
+
+	}
+
+	if( !levels.size() ) levels.push_back( 0 );
+	if( !stopping ) std::cout << "No stopping powers, so no energy losses" << std::endl;
+
+	// Histograms are only added to the file when they are written
+	bool add_dir = TH1::AddDirectoryStatus();
+	TH1::AddDirectory( kFALSE );
+
+	std::unique_ptr<TGraph> efficiency = std::make_unique<TGraph>();
+	efficiency->SetName( "efficiency" );
+	efficiency->SetTitle( "Fraction of events detected;Excitation energy [keV];Efficiency" );
+	std::unique_ptr<TH2F> E_vs_z_all;
+
+	std::cout << std::endl << " +++  Simulating " << nevents << " events for ";
+	std::cout << levels.size() << " levels with " << nthreads << " threads  +++" << std::endl;
+
+	for( unsigned int l = 0; l < levels.size(); ++l ) {
+
+		auto t_start = std::chrono::steady_clock::now();
+
+		// Each thread fills its own histograms
+		std::vector<hists_t> hists( nthreads );
+		for( unsigned int j = 0; j < nthreads; ++j )
+			MakeHists( hists[j], l );
+
+		// Threads take chunks until there are none left
+		unsigned long nchunks = ( nevents + kChunk - 1 ) / kChunk;
+		std::atomic<unsigned long> next( 0 );
+		std::vector<std::thread> workers;
+		for( unsigned int j = 0; j < nthreads; ++j ) {
+
+			workers.push_back( std::thread( [this,l,j,nchunks,&next,&hists](){
+				unsigned long c;
+				while( ( c = next++ ) < nchunks )
+					Generate( l, c, hists[j] );
+			} ) );
+
+		}
+		for( unsigned int j = 0; j < nthreads; ++j )
+			workers[j].join();
+
+		// Add them all up
+		for( unsigned int j = 1; j < nthreads; ++j ) {
+
+			hists[0].thetacm_gen->Add( hists[j].thetacm_gen.get() );
+			hists[0].thetacm_det->Add( hists[j].thetacm_det.get() );
+			hists[0].E_vs_z->Add( hists[j].E_vs_z.get() );
+			hists[0].z_vs_thetacm->Add( hists[j].z_vs_thetacm.get() );
+			hists[0].ndet += hists[j].ndet;
+
+		}
+		hists_t &h = hists[0];
+
+		double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - t_start ).count();
+		double eff = nevents ? (double)h.ndet / nevents : 0;
+		efficiency->SetPoint( l, levels[l], eff );
+
+		std::cout << "Ex = " << levels[l] << " keV: " << h.ndet << " of " << nevents;
+		std::cout << " detected (" << std::fixed << std::setprecision(1) << 100. * eff << "%), ";
+		std::cout << std::setprecision(2) << ( seconds > 0 ? nevents / seconds * 1e-6 : 0 );
+		std::cout << " million events/s" << std::defaultfloat << std::endl;
+
+		// Acceptance as a function of the angle
+		std::unique_ptr<TH1D> acceptance( (TH1D*)h.thetacm_det->Clone( "acceptance" ) );
+		acceptance->SetTitle( ( std::string( "Acceptance for Ex = " ) + std::to_string( (int)levels[l] ) +
+							   " keV;#theta_{CM} [deg];Fraction detected" ).data() );
+		acceptance->Divide( h.thetacm_det.get(), h.thetacm_gen.get(), 1, 1, "B" );
+
+		// Kinematic line at the radius of the silicon, in the same frame as the data
+		std::unique_ptr<TGraph> line = std::make_unique<TGraph>();
+		line->SetName( "kinematic_line" );
+		line->SetTitle( ( std::string( "Kinematic line for Ex = " ) + std::to_string( (int)levels[l] ) +
+						 " keV;z [mm];Energy [keV]" ).data() );
+		for( double d = kEdge; d < 4.0 * kWaferPitch; d += 2.0 ) {
+
+			TVector3 vec( kApothem + x_offset, y_offset, d );
+			float en = react->SimulateReaction( vec, levels[l] );
+			if( en > 0 ) line->SetPoint( line->GetN(), react->GetZmeasured(), en );
+
+		}
+
+		// Write this level
+		std::string dirname = "level_" + std::to_string( l );
+		output_file->mkdir( dirname.data() );
+		output_file->cd( dirname.data() );
+		h.thetacm_gen->Write();
+		h.thetacm_det->Write();
+		acceptance->Write();
+		h.E_vs_z->Write();
+		h.z_vs_thetacm->Write();
+		line->Write();
+		output_file->cd();
+
+		// All of the levels together
+		if( !E_vs_z_all ) {
+			E_vs_z_all.reset( (TH2F*)h.E_vs_z->Clone( "E_vs_z" ) );
+			E_vs_z_all->SetTitle( "Energy vs. z distance;z [mm];Energy [keV];Counts per mm per 20 keV" );
+		}
+		else E_vs_z_all->Add( h.E_vs_z.get() );
+
+	}
+
+	E_vs_z_all->Write();
+	efficiency->Write();
+
+	TH1::AddDirectory( add_dir );
+
+	output_file->Close();
+	delete output_file;
+
+	return true;
+
+}
@@ -0,0 +1,557 @@
+#include "TimeAligner.hh"
+
+ISSTimeAligner::ISSTimeAligner( ISSSettings *myset, ISSCalibration *mycal ){
+
+	set = myset;
+	cal = mycal;
+	_prog_ = false;
+
+	// Defaults
+	window = 1e4;
+	resolution = 50.0;
+	min_counts = 100.0;
+	SetReference( "pulser" );
+
+	n_asic = set->GetNumberOfArrayModules() * set->GetNumberOfArrayASICs();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Chooses the signal that every channel is aligned to
+/// \param[in] ref "pulser" for the CAEN pulser, "caen_<mod>_<ch>" for a CAEN
+/// channel or "asic_<mod>_<asic>" for an ASIC, the same as in the calibration file
+/// \returns false if the reference isn't recognised or doesn't exist
+bool ISSTimeAligner::SetReference( std::string ref ){
+
+	unsigned int mod, ch;
+	char c;
+
+	if( ref == "pulser" ) {
+
+		ref_pulser = true;
+		ref_caen = true;
+		ref_mod = set->GetCAENPulserModule();
+		ref_ch = set->GetCAENPulserChannel();
+
+	}
+
+	else if( sscanf( ref.data(), "caen_%u_%u%c", &mod, &ch, &c ) == 2 &&
+			 mod < set->GetNumberOfCAENModules() && ch < set->GetNumberOfCAENChannels() ) {
+
+		ref_pulser = false;
+		ref_caen = true;
+		ref_mod = mod;
+		ref_ch = ch;
+
+	}
+
+	else if( sscanf( ref.data(), "asic_%u_%u%c", &mod, &ch, &c ) == 2 &&
+			 mod < set->GetNumberOfArrayModules() && ch < set->GetNumberOfArrayASICs() ) {
+
+		ref_pulser = false;
+		ref_caen = false;
+		ref_mod = mod;
+		ref_ch = ch;
+
+	}
+
+	else {
+
+		std::cerr << "Unknown time reference " << ref;
+		std::cerr << ", it should be pulser, caen_<mod>_<ch> or asic_<mod>_<asic>" << std::endl;
+		return false;
+
+	}
+
+	ref_name = ref;
+
+	return true;
+
+}
+
+void ISSTimeAligner::MakeHists(){
+
+	std::string hname, htitle;
+	tdiff.resize( n_asic + set->GetNumberOfCAENModules() * set->GetNumberOfCAENChannels() );
+	results.resize( tdiff.size() );
+
+	for( unsigned int i = 0; i < tdiff.size(); ++i ) {
+
+		if( i < n_asic ) {
+
+			unsigned int mod = i / set->GetNumberOfArrayASICs();
+			unsigned int asic = i % set->GetNumberOfArrayASICs();
+			hname = "tdiff_asic_" + std::to_string(mod) + "_" + std::to_string(asic);
+			htitle = "Time difference between ASIC " + std::to_string(asic);
+			htitle += " of module " + std::to_string(mod);
+
+		}
+
+		else {
+
+			unsigned int mod = ( i - n_asic ) / set->GetNumberOfCAENChannels();
+			unsigned int ch = ( i - n_asic ) % set->GetNumberOfCAENChannels();
+			hname = "tdiff_caen_" + std::to_string(mod) + "_" + std::to_string(ch);
+			htitle = "Time difference between CAEN channel " + std::to_string(ch);
+			htitle += " of module " + std::to_string(mod);
+
+		}
+
+		htitle += " and " + ref_name + ";#Deltat (ns);Counts";
+		tdiff[i] = new TH1F( hname.data(), htitle.data(), kBins, -window, window );
+		tdiff[i]->SetDirectory( nullptr );
+
+		results[i].aligned = false;
+		results[i].shift = 0;
+		results[i].counts = 0;
+		results[i].spread = 0;
+		results[i].offset = 0;
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Works out which histogram a hit belongs to
+/// \param[in] hit A hit from the time-sorted tree
+/// \returns the histogram, -1 for the reference or -2 if the hit isn't used
+int ISSTimeAligner::GetIndex( ISSDataPackets *hit ){
+
+	// Only real signals, the noise would swamp the peaks
+	if( hit->IsAsic() ) {
+
+		std::shared_ptr<ISSAsicData> asic_data = hit->GetAsicData();
+		if( !asic_data->IsOverThreshold() ) return -2;
+
+		unsigned int mod = asic_data->GetModule();
+		unsigned int asic = asic_data->GetAsic();
+		if( mod >= set->GetNumberOfArrayModules() ||
+		    asic >= set->GetNumberOfArrayASICs() ) return -2;
+
+		if( !ref_caen && mod == ref_mod && asic == ref_ch ) return -1;
+		return mod * set->GetNumberOfArrayASICs() + asic;
+
+	}
+
+	else if( hit->IsCaen() ) {
+
+		std::shared_ptr<ISSCaenData> caen_data = hit->GetCaenData();
+		if( !caen_data->IsOverThreshold() ) return -2;
+
+		unsigned int mod = caen_data->GetModule();
+		unsigned int ch = caen_data->GetChannel();
+		if( mod >= set->GetNumberOfCAENModules() ||
+		    ch >= set->GetNumberOfCAENChannels() ) return -2;
+
+		if( ref_caen && !ref_pulser && mod == ref_mod && ch == ref_ch ) return -1;
+		return n_asic + mod * set->GetNumberOfCAENChannels() + ch;
+
+	}
+
+	// The CAEN pulser is converted to info data, with its time offset
+	else if( hit->IsInfo() && ref_pulser ) {
+
+		if( hit->GetInfoData()->GetCode() == set->GetCAENPulserCode() ) return -1;
+
+	}
+
+	return -2;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Fills the time differences from the converted file of one run. The hits are
+/// already sorted in time, so each new hit only has to be paired with the ones
+/// still in the window, and every pair is counted once, by the later hit.
+/// \param[in] input_file_name The converted ROOT file, with the iss_sort tree
+/// \returns the number of pairs
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] hit The next hit in time order
+/// \return The number of time differences it was paired in
+unsigned long ISSTimeAligner::PairHit( ISSDataPackets *hit ){
+
+	int index = GetIndex( hit );
+	if( index < -1 ) return 0;
+
+	long long t = hit->GetTime();
+	unsigned long n_pairs = 0;
+
+	// Forget the hits that are now too far in the past
+	while( recent.size() && t - recent.front().time > window )
+		recent.pop_front();
+
+	// A reference pairs with the channels in the window and vice versa
+	for( unsigned int j = 0; j < recent.size(); ++j ) {
+
+		if( index == -1 && recent[j].index >= 0 ) {
+
+			tdiff[recent[j].index]->Fill( recent[j].time - t );
+			n_pairs++;
+
+		}
+
+		else if( index >= 0 && recent[j].index == -1 ) {
+
+			tdiff[index]->Fill( t - recent[j].time );
+			n_pairs++;
+
+		}
+
+	}
+
+	recent.push_back( { t, index } );
+
+	return n_pairs;
+
+}
+
+unsigned long ISSTimeAligner::AddFile( std::string input_file_name ){
+
+	TFile *input_file = new TFile( input_file_name.data(), "read" );
+	if( input_file->IsZombie() ) {
+
+		std::cout << "Cannot open " << input_file_name << std::endl;
+		delete input_file;
+		return 0;
+
+	}
+
+	TTree *input_tree = (TTree*)input_file->Get("iss_sort");
+	if( !input_tree ) {
+
+		std::cout << "No time-sorted tree in " << input_file_name << std::endl;
+		input_file->Close();
+		delete input_file;
+		return 0;
+
+	}
+
+	ISSDataPackets *in_data = nullptr;
+	input_tree->SetBranchAddress( "data", &in_data );
+
+	// Newer files have the raw timestamps, so the offsets of the calibration
+	// are added here and the hits put back in order, like the event builder
+	bool raw = ISSReorderBuffer::HasRawTimes( input_tree );
+	ISSReorderBuffer reorder( set );
+	reorder.SetCalibration( raw ? cal : nullptr );
+	std::unique_ptr<ISSDataPackets> hit;
+	unsigned long long time, entry;
+
+	unsigned long n_entries = input_tree->GetEntries();
+	unsigned long n_pairs = 0;
+	recent.clear();
+
+	std::cout << " Time alignment: " << input_file_name << ", ";
+	std::cout << n_entries << " hits against " << ref_name << std::endl;
+
+	for( unsigned long i = 0; i < n_entries; ++i ) {
+
+		// Stop if the job was cancelled from the GUI
+		if( _prog_ && prog->IsCancelled() ) break;
+
+		input_tree->GetEntry(i);
+
+		if( !raw ) n_pairs += PairHit( in_data );
+
+		else {
+
+			reorder.Push( in_data, i );
+			while( ( hit = reorder.Pop( time, entry ) ) ) {
+
+				n_pairs += PairHit( hit.get() );
+				reorder.Recycle( std::move( hit ) );
+
+			}
+
+		}
+
+		// Progress bar
+		if( n_entries >= 100 && ( i % (n_entries/100) == 0 || i+1 == n_entries ) ) {
+
+			float percent = (float)(i+1)*100.0/(float)n_entries;
+			if( _prog_ ) prog->SetPosition( percent );
+			std::cout << " " << std::setw(6) << std::setprecision(4);
+			std::cout << percent << "%    \r";
+			std::cout.flush();
+
+		}
+
+	}
+
+	// The hits still in the buffer
+	reorder.Finish();
+	while( ( hit = reorder.Pop( time, entry ) ) )
+		n_pairs += PairHit( hit.get() );
+
+	std::cout << std::endl;
+
+	input_file->Close();
+	delete input_file;
+
+	return n_pairs;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Iterative radix-2 FFT, with the length a power of 2
+/// \param[in,out] x The data, replaced by its transform
+/// \param[in] inverse Do the inverse transform, including the 1/N
+void ISSTimeAligner::FFT( std::vector<std::complex<double>> &x, bool inverse ){
+
+	unsigned int n = x.size();
+
+	// Bit reversed order
+	for( unsigned int i = 1, j = 0; i < n; ++i ) {
+
+		unsigned int bit = n >> 1;
+		for( ; j & bit; bit >>= 1 ) j ^= bit;
+		j ^= bit;
+		if( i < j ) std::swap( x[i], x[j] );
+
+	}
+
+	// Butterflies
+	for( unsigned int len = 2; len <= n; len <<= 1 ) {
+
+		double ang = TMath::TwoPi() / len * ( inverse ? 1.0 : -1.0 );
+		std::complex<double> wlen( std::cos( ang ), std::sin( ang ) );
+
+		for( unsigned int i = 0; i < n; i += len ) {
+
+			std::complex<double> w( 1.0, 0.0 );
+			for( unsigned int j = 0; j < len / 2; ++j ) {
+
+				std::complex<double> u = x[i+j];
+				std::complex<double> v = x[i+j+len/2] * w;
+				x[i+j] = u + v;
+				x[i+j+len/2] = u - v;
+				w *= wlen;
+
+			}
+
+		}
+
+	}
+
+	if( inverse )
+		for( unsigned int i = 0; i < n; ++i ) x[i] /= (double)n;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Finds the peak of a time-difference histogram by cross-correlating it with
+/// a Gaussian of the expected resolution, then measures it above the background
+/// \param[in] h The time differences of one channel
+/// \param[out] res The position, counts and spread of the peak
+void ISSTimeAligner::FindPeak( TH1F *h, result_t &res ){
+
+	res.aligned = false;
+	if( h->GetEntries() < min_counts ) return;
+
+	// Zero padded to twice the length, so the ends don't wrap around
+	unsigned int n = 2 * kBins;
+	double bw = h->GetBinWidth(1);
+	std::vector<std::complex<double>> hx( n, 0.0 ), kx( n, 0.0 );
+	for( unsigned int i = 0; i < kBins; ++i )
+		hx[i] = h->GetBinContent( i+1 );
+
+	// Gaussian centred on zero, out to 4 sigma either side
+	double sig = resolution > bw ? resolution / bw : 1.0;
+	int m = std::ceil( 4.0 * sig );
+	for( int j = -m; j <= m; ++j )
+		kx[( j + n ) % n] = std::exp( -0.5 * j * j / ( sig * sig ) );
+
+	// Cross-correlation is the inverse of H times the conjugate of K
+	FFT( hx, false );
+	FFT( kx, false );
+	for( unsigned int i = 0; i < n; ++i )
+		hx[i] *= std::conj( kx[i] );
+	FFT( hx, true );
+
+	// Highest point, then a parabola through its neighbours
+	unsigned int imax = 0;
+	for( unsigned int i = 1; i < kBins; ++i )
+		if( hx[i].real() > hx[imax].real() ) imax = i;
+
+	double delta = 0;
+	if( imax > 0 && imax + 1 < kBins ) {
+
+		double c0 = hx[imax-1].real();
+		double c1 = hx[imax].real();
+		double c2 = hx[imax+1].real();
+		double denom = c0 - 2.0 * c1 + c2;
+		if( denom < 0 ) delta = 0.5 * ( c0 - c2 ) / denom;
+		if( TMath::Abs( delta ) > 0.5 ) delta = 0;
+
+	}
+
+	res.shift = h->GetBinLowEdge(1) + ( imax + 0.5 + delta ) * bw;
+
+	// Flat background of randoms from well outside the peak
+	double peak_width = TMath::Max( 5.0 * resolution, 2.0 * bw );
+	double bg = 0, nbg = 0;
+	for( unsigned int i = 1; i <= kBins; ++i ) {
+
+		if( TMath::Abs( h->GetBinCenter(i) - res.shift ) > 2.0 * peak_width ) {
+
+			bg += h->GetBinContent(i);
+			nbg++;
+
+		}
+
+	}
+	if( nbg > 0 ) bg /= nbg;
+
+	// Counts, mean and spread of the peak above the background
+	double sum = 0, sumx = 0, sumx2 = 0;
+	for( unsigned int i = 1; i <= kBins; ++i ) {
+
+		double x = h->GetBinCenter(i) - res.shift;
+		if( TMath::Abs( x ) > peak_width ) continue;
+
+		double y = h->GetBinContent(i) - bg;
+		sum += y;
+		sumx += y * x;
+		sumx2 += y * x * x;
+
+	}
+
+	res.counts = sum;
+	if( sum < min_counts ) return;
+
+	double var = sumx2 / sum - ( sumx / sum ) * ( sumx / sum );
+	res.spread = var > 0 ? std::sqrt( var ) : 0;
+	res.aligned = true;
+
+	return;
+
+}
+
+void ISSTimeAligner::Align(){
+
+	std::cout << "\n +++ ISS Analysis:: aligning time offsets to " << ref_name << " +++" << std::endl;
+	std::cout << std::setw(16) << "channel" << std::setw(10) << "old" << std::setw(10) << "new";
+	std::cout << std::setw(10) << "counts" << std::setw(10) << "spread" << std::endl;
+
+	unsigned int n_aligned = 0;
+	for( unsigned int i = 0; i < tdiff.size(); ++i ) {
+
+		long old_offset;
+		if( i < n_asic )
+			old_offset = cal->AsicTime( i / set->GetNumberOfArrayASICs(), i % set->GetNumberOfArrayASICs() );
+		else
+			old_offset = cal->CaenTime( ( i - n_asic ) / set->GetNumberOfCAENChannels(), ( i - n_asic ) % set->GetNumberOfCAENChannels() );
+
+		results[i].offset = old_offset;
+		if( !tdiff[i]->GetEntries() ) continue;
+
+		// A late channel needs a smaller offset
+		FindPeak( tdiff[i], results[i] );
+		if( results[i].aligned ) {
+
+			results[i].offset = old_offset - std::lround( results[i].shift );
+			n_aligned++;
+
+		}
+
+		std::string name = std::string( tdiff[i]->GetName() ).substr( 6 );
+		std::cout << std::setw(16) << name << std::setw(10) << old_offset;
+		if( results[i].aligned ) std::cout << std::setw(10) << results[i].offset;
+		else std::cout << std::setw(10) << "-";
+		std::cout << std::setw(10) << std::lround( results[i].counts );
+		std::cout << std::setw(10) << std::setprecision(3) << results[i].spread << std::endl;
+
+	}
+
+	std::cout << " " << n_aligned << " of " << tdiff.size() << " channels aligned" << std::endl;
+
+	return;
+
+}
+
+void ISSTimeAligner::SaveCalFile( std::string name_results_file ){
+
+	// New offsets in the calibration that the files were sorted with
+	for( unsigned int i = 0; i < results.size(); ++i ) {
+
+		if( !results[i].aligned ) continue;
+
+		if( i < n_asic )
+			cal->SetAsicTime( i / set->GetNumberOfArrayASICs(), i % set->GetNumberOfArrayASICs(), results[i].offset );
+		else
+			cal->SetCaenTime( ( i - n_asic ) / set->GetNumberOfCAENChannels(), ( i - n_asic ) % set->GetNumberOfCAENChannels(), results[i].offset );
+
+	}
+
+	// Output
+	std::ofstream cal_file;
+	cal_file.open( name_results_file );
+	if( cal_file.is_open() ) {
+
+		cal->PrintCalibration( cal_file, "" );
+		cal_file.close();
+
+	}
+
+	else {
+
+		std::cerr << "Couldn't open " << name_results_file;
+		std::cerr << std::endl;
+
+	}
+
+	return;
+
+}
+
+void ISSTimeAligner::SaveHists( std::string name_output_file ){
+
+	TFile *output_file = new TFile( name_output_file.data(), "recreate" );
+	if( output_file->IsZombie() ) {
+
+		std::cerr << "Couldn't open " << name_output_file << std::endl;
+		delete output_file;
+		return;
+
+	}
+
+	// Summary of every channel
+	TH1F *shift = new TH1F( "shift", "Change of the time offsets;Channel;#Deltat (ns)",
+						   tdiff.size(), -0.5, tdiff.size() - 0.5 );
+	TH1F *spread = new TH1F( "spread", "Residual spread of the time differences;Channel;#sigma (ns)",
+							tdiff.size(), -0.5, tdiff.size() - 0.5 );
+	shift->SetDirectory( nullptr );
+	spread->SetDirectory( nullptr );
+
+	for( unsigned int i = 0; i < tdiff.size(); ++i ) {
+
+		std::string name = std::string( tdiff[i]->GetName() ).substr( 6 );
+		shift->GetXaxis()->SetBinLabel( i+1, name.data() );
+		spread->GetXaxis()->SetBinLabel( i+1, name.data() );
+
+		if( results[i].aligned ) {
+
+			shift->SetBinContent( i+1, results[i].shift );
+			spread->SetBinContent( i+1, results[i].spread );
+
+		}
+
+		if( tdiff[i]->GetEntries() ) tdiff[i]->Write();
+
+	}
+
+	shift->Write();
+	spread->Write();
+	delete shift;
+	delete spread;
+
+	output_file->Close();
+	delete output_file;
+
+	return;
+
+}
@@ -0,0 +1,134 @@
+#include "Timing.hh"
+
+void ISSTiming::Reset(){
+
+	for( unsigned int i = 0; i < kNumberOfRegions; ++i ) {
+
+		ticks_sum[i] = 0;
+		ncalls[i] = 0;
+
+	}
+
+	tick_start = Now();
+	time_start = std::chrono::steady_clock::now();
+
+	return;
+
+}
+
+std::string ISSTiming::GetName( region_t r ){
+
+	switch( r ) {
+
+		case kBlock:			return "ProcessBlockData";
+		case kAsic:				return "ProcessASICData";
+		case kCaen:				return "ProcessCAENData";
+		case kInfo:				return "ProcessInfoData";
+		case kSort:				return "SortTree";
+		case kArrayFinder:		return "ArrayFinder";
+		case kRecoilFinder:		return "RecoilFinder";
+		case kMwpcFinder:		return "MwpcFinder";
+		case kElumFinder:		return "ElumFinder";
+		case kZeroDegreeFinder:	return "ZeroDegreeFinder";
+		case kGammaRayFinder:	return "GammaRayFinder";
+		case kFillEvent:		return "FillEvent";
+		case kReaction:			return "MakeReaction";
+		case kFillArray:		return "FillArray";
+		case kFillElum:			return "FillElum";
+		case kFillRecoil:		return "FillRecoil";
+		default:				return "unknown";
+
+	}
+
+}
+
+double ISSTiming::GetTickRate() const {
+
+	// Calibrate the counter against the system clock over the whole run,
+	// which is long enough that the calls themselves don't matter
+	double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - time_start ).count();
+	unsigned long long ticks = Now() - tick_start;
+	if( seconds <= 0 || !ticks ) return 1e9;
+
+	return ticks / seconds;
+
+}
+
+double ISSTiming::GetSeconds( region_t r ) const {
+
+	return ticks_sum[r] / GetTickRate();
+
+}
+
+void ISSTiming::Print( std::string title ) const {
+
+	if( !enabled ) return;
+
+	double rate = GetTickRate();
+	double total = ( Now() - tick_start ) / rate;
+
+	// Only the regions that were used, with the most time first
+	std::vector<unsigned int> used;
+	for( unsigned int i = 0; i < kNumberOfRegions; ++i )
+		if( ncalls[i] ) used.push_back( i );
+	std::sort( used.begin(), used.end(), [&]( unsigned int a, unsigned int b ){
+		return ticks_sum[a] > ticks_sum[b];
+	});
+
+	// All in one go, so that tasks running in parallel don't get mixed up
+	std::stringstream ss;
+	ss << "\n " << title << " timing, " << std::fixed << std::setprecision(2);
+	ss << total << " s in total" << std::endl;
+	ss << "  " << std::left << std::setw(20) << "region" << std::right;
+	ss << std::setw(12) << "time/s" << std::setw(8) << "%";
+	ss << std::setw(14) << "calls" << std::setw(12) << "ns/call" << std::endl;
+
+	for( unsigned int j = 0; j < used.size(); ++j ) {
+
+		unsigned int i = used.at(j);
+		double seconds = ticks_sum[i] / rate;
+
+		ss << "  " << std::left << std::setw(20) << GetName( (region_t)i ) << std::right;
+		ss << std::setprecision(3) << std::setw(12) << seconds;
+		ss << std::setprecision(1) << std::setw(8) << 100. * seconds / total;
+		ss << std::setw(14) << ncalls[i];
+		ss << std::setw(12) << 1e9 * seconds / ncalls[i] << std::endl;
+
+	}
+
+	std::cout << ss.str();
+
+	return;
+
+}
+
+void ISSTiming::Write( TDirectory *dir ) const {
+
+	if( !enabled || !dir ) return;
+
+	TDirectory *saved = gDirectory;
+	dir->cd();
+
+	TH1D htime( "timing_seconds", "Time spent in each region;;time [s]",
+			   kNumberOfRegions, -0.5, kNumberOfRegions - 0.5 );
+	TH1D hcalls( "timing_calls", "Number of calls of each region;;calls",
+				kNumberOfRegions, -0.5, kNumberOfRegions - 0.5 );
+
+	for( unsigned int i = 0; i < kNumberOfRegions; ++i ) {
+
+		std::string name = GetName( (region_t)i );
+		htime.GetXaxis()->SetBinLabel( i + 1, name.data() );
+		hcalls.GetXaxis()->SetBinLabel( i + 1, name.data() );
+		htime.SetBinContent( i + 1, GetSeconds( (region_t)i ) );
+		hcalls.SetBinContent( i + 1, ncalls[i] );
+
+	}
+
+	htime.Write( "timing_seconds", TObject::kOverwrite );
+	hcalls.Write( "timing_calls", TObject::kOverwrite );
+
+	if( saved ) saved->cd();
+
+	return;
+
+}
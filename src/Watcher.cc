@@ -0,0 +1,218 @@
+#include "Watcher.hh"
+
+ISSWatcher::ISSWatcher( std::string mydir, std::string mypattern, int mysettle ){
+
+	dir = mydir;
+	if( dir.size() && dir.back() != '/' ) dir += "/";
+	pattern = mypattern;
+	settle = mysettle;
+
+	// Not watching yet
+	fd = -1;
+	wd = -1;
+
+}
+
+ISSWatcher::~ISSWatcher(){
+
+	Close();
+
+}
+
+bool ISSWatcher::Open(){
+
+	// Check we can read the directory
+	void *dirp = gSystem->OpenDirectory( dir.data() );
+	if( !dirp ) {
+
+		std::cerr << "Cannot open directory " << dir << std::endl;
+		return false;
+
+	}
+	gSystem->FreeDirectory( dirp );
+
+#ifdef LINUX
+	// Kernel notifications when files are written, closed or moved in
+	fd = inotify_init1( IN_NONBLOCK );
+	if( fd >= 0 ) {
+
+		wd = inotify_add_watch( fd, dir.data(),
+							   IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO );
+		if( wd < 0 ) {
+			close( fd );
+			fd = -1;
+		}
+
+	}
+	if( fd < 0 )
+		std::cout << "inotify not available, scanning " << dir << " instead" << std::endl;
+#endif
+
+	// Everything already in the directory is a candidate
+	Scan();
+
+	return true;
+
+}
+
+void ISSWatcher::Close(){
+
+#ifdef LINUX
+	if( fd >= 0 ) {
+		if( wd >= 0 ) inotify_rm_watch( fd, wd );
+		close( fd );
+	}
+#endif
+
+	fd = -1;
+	wd = -1;
+
+	return;
+
+}
+
+bool ISSWatcher::IsRunFile( std::string name ){
+
+	// Hidden files and our own outputs
+	if( !name.size() || name[0] == '.' ) return false;
+	if( name.find( ".root" ) != std::string::npos ) return false;
+	if( name.find( ".log" ) != std::string::npos ) return false;
+	if( name.find( ".tasks" ) != std::string::npos ) return false;
+	if( name.find( ".closed" ) != std::string::npos ) return false;
+
+	// Must match the pattern
+	TRegexp regexp( pattern.data(), kTRUE );
+	TString tname( name.data() );
+	Ssiz_t len = 0;
+	if( regexp.Index( tname, &len ) != 0 || len != tname.Length() ) return false;
+
+	return true;
+
+}
+
+void ISSWatcher::Touch( std::string name ){
+
+	// Marker to say the run is finished
+	std::string marker = ".closed";
+	if( name.size() > marker.size() &&
+	    name.compare( name.size() - marker.size(), marker.size(), marker ) == 0 ) {
+
+		std::string run = name.substr( 0, name.size() - marker.size() );
+		if( IsRunFile( run ) && !completed.count( run ) ) {
+			if( !candidates.count( run ) ) candidates[run] = { -1, time(0), true };
+			else candidates[run].closed = true;
+		}
+		return;
+
+	}
+
+	if( !IsRunFile( name ) || completed.count( name ) ) return;
+
+	// New file, its size is checked in Poll()
+	if( !candidates.count( name ) ) candidates[name] = { -1, time(0), false };
+
+	return;
+
+}
+
+void ISSWatcher::Scan(){
+
+	void *dirp = gSystem->OpenDirectory( dir.data() );
+	if( !dirp ) return;
+
+	const char *entry;
+	while( ( entry = gSystem->GetDirEntry( dirp ) ) ) {
+
+		std::string name = entry;
+		if( name == "." || name == ".." ) continue;
+		Touch( name );
+
+	}
+
+	gSystem->FreeDirectory( dirp );
+
+	return;
+
+}
+
+std::vector<std::string> ISSWatcher::Poll( int timeout_ms ){
+
+	std::vector<std::string> ready;
+
+#ifdef LINUX
+	if( fd >= 0 ) {
+
+		// Wait for something to happen, or the timeout
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if( poll( &pfd, 1, timeout_ms ) > 0 ) {
+
+			char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+			ssize_t len;
+			while( ( len = read( fd, buffer, sizeof(buffer) ) ) > 0 ) {
+
+				for( char *ptr = buffer; ptr < buffer + len;
+					 ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len ) {
+
+					struct inotify_event *event = (struct inotify_event*)ptr;
+
+					// Lost some events, so look at everything again
+					if( event->mask & IN_Q_OVERFLOW ) Scan();
+					else if( event->len ) Touch( event->name );
+
+				}
+
+			}
+
+		}
+
+	}
+	else {
+		gSystem->Sleep( timeout_ms );
+		Scan();
+	}
+#else
+	gSystem->Sleep( timeout_ms );
+	Scan();
+#endif
+
+	// Check if the candidates have stopped growing
+	time_t now = time(0);
+	for( auto it = candidates.begin(); it != candidates.end(); ) {
+
+		std::string path = dir + it->first;
+		FileStat_t fstat;
+		if( gSystem->GetPathInfo( path.data(), fstat ) || R_ISDIR( fstat.fMode ) ) {
+
+			// It's been removed, or it's not a file
+			it = candidates.erase( it );
+			continue;
+
+		}
+
+		// It has grown, so the clock starts again from the last write
+		if( fstat.fSize != it->second.size ) {
+
+			it->second.size = fstat.fSize;
+			if( fstat.fMtime < now ) it->second.last_change = fstat.fMtime;
+			else it->second.last_change = now;
+
+		}
+
+		bool settled = now - it->second.last_change >= settle;
+		if( it->second.size > 0 && ( it->second.closed || settled ) ) {
+
+			ready.push_back( path );
+			completed.insert( it->first );
+			it = candidates.erase( it );
+
+		}
+
+		else ++it;
+
+	}
+
+	return ready;
+
+}